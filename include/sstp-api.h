@@ -31,6 +31,9 @@
 /*! The message signature */
 #define SSTP_API_MSG_MAGIC          0x73737470
 
+/*! The longest either end waits on the other, in milliseconds */
+#define SSTP_API_MSG_TIMEOUT        5000
+
 /*! Align to every 4 byte boundary */
 #define ALIGN32(n)                  (((n) + 3) & ~3)
 
@@ -42,6 +45,9 @@ typedef enum
     SSTP_API_MSG_AUTH    = 1,
     SSTP_API_MSG_ADDR    = 2,
     SSTP_API_MSG_ACK     = 3,
+    SSTP_API_MSG_IPUP    = 4,
+    SSTP_API_MSG_LCPUP   = 5,
+    SSTP_API_MSG_DOWN    = 6,
 
     /*
      * Add more event message types here
@@ -61,6 +67,9 @@ typedef enum
     SSTP_API_ATTR_MPPE_RECV = 2,
     SSTP_API_ATTR_GATEWAY   = 3,
     SSTP_API_ATTR_ADDR      = 4,
+    SSTP_API_ATTR_IFNAME    = 5,
+    SSTP_API_ATTR_LOCAL     = 6,
+    SSTP_API_ATTR_REMOTE    = 7,
 
     /*
      * Add more attribute type here
@@ -130,6 +139,16 @@ SSTP_API
 int sstp_api_msg_type(sstp_api_msg_st *msg, sstp_api_msg_t *type);
 
 
+/*!
+ * @brief Check if a whole message is at the start of a buffer
+ *
+ * @return The length of the message, 0 if more is needed to tell, or
+ *  -1 if the buffer doesn't start with a message.
+ */
+SSTP_API
+int sstp_api_msg_frame(unsigned char *buf, int length);
+
+
 /*!
  * @brief Append an attribute to the message
  */
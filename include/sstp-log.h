@@ -56,6 +56,41 @@ typedef enum
 } sstp_level_t;
 
 
+/*!
+ * @brief The trace filter decision for a place messages are logged from
+ */
+typedef struct
+{
+    /*< The file of the call site, matched against the filter tokens */
+    const char *file;
+
+    /*< The generation of the level and filter the decision was made with */
+    unsigned int gen;
+
+    /*< Log the messages of this call site */
+    int pass;
+
+} sstp_log_site_st;
+
+
+/*< Bumped each time the log-level or the trace filter changes */
+extern unsigned int sstp_log_gen;
+
+
+/*! 
+ * @brief Check if the trace messages of a call site are logged
+ *
+ * @par Note:
+ *  The decision is made once per call site and generation, after that
+ *  it's the compare of the generation and a branch on the cached 
+ *  decision, both of which are the same from call to call.
+ */
+#define sstp_log_site_pass(site)        \
+    (((site)->gen == sstp_log_gen)      \
+        ? (site)->pass                  \
+        : sstp_log_site(site))
+
+
 /*! Expand to appropriate function */
 #define logmsg(level,fmt,args...)       \
     sstp_log_msg(level, __FILE__, __LINE__, fmt, ##args)
@@ -93,11 +128,14 @@ typedef enum
     }
 
 
-/*! Write trace logs */
+/*! Write trace logs, see sstp_log_site_pass() */
 #define log_trace(fmt, args...)         \
-    if (SSTP_LOG_TRACE <= sstp_log_level()) \
     {                                   \
-        logmsg(SSTP_LOG_TRACE, fmt, ##args);\
+        static sstp_log_site_st __site = { .file = __FILE__ }; \
+        if (sstp_log_site_pass(&__site))    \
+        {                               \
+            logmsg(SSTP_LOG_TRACE, fmt, ##args);\
+        }                               \
     }
 
 /*! Log all levels up to x */
@@ -110,8 +148,30 @@ typedef enum
 sstp_level_t sstp_log_level();
 
 
+/*!
+ * @brief Set the log-level, -1 restores the level given on the command line
+ */
+void sstp_log_setlevel(int level);
+
+
+/*!
+ * @brief Set the tokens to filter trace messages on, separated by ','; NULL
+ *  or "" restores the filter given on the command line
+ */
+void sstp_log_setfilter(const char *filter);
+
+
+/*!
+ * @brief Decide on the trace messages of a call site, and cache it
+ */
+int sstp_log_site(sstp_log_site_st *site);
+
+
 /*!
  * @brief Log a message
+ *
+ * @par Note:
+ *  Trace messages are filtered at the call site, see log_trace()
  */
 void sstp_log_msg(int level, const char *file, int line,
         const char *fmt, ...);
@@ -70,6 +70,33 @@ done:
 }
 
 
+SSTP_API
+int sstp_api_msg_frame(unsigned char *buf, int length)
+{
+    sstp_api_msg_st *msg = (sstp_api_msg_st*) buf;
+
+    /* Wait for the header */
+    if (length < (int) sizeof(*msg))
+    {
+        return 0;
+    }
+
+    /* Check the signature */
+    if (msg->msg_magic != SSTP_API_MSG_MAGIC)
+    {
+        return -1;
+    }
+
+    /* Wait for the payload */
+    if (length < sstp_api_msg_len(msg))
+    {
+        return 0;
+    }
+
+    return sstp_api_msg_len(msg);
+}
+
+
 SSTP_API 
 void sstp_api_attr_add(sstp_api_msg_st *msg, sstp_api_attr_t type, 
     unsigned int len, void *data)
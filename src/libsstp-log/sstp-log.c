@@ -54,6 +54,9 @@ typedef struct
     
     /*! The current log level */
     int level;
+
+    /*! The log level given on the command line */
+    int level_argv;
     
     /*! Handle to the file output */
     log_ctx_st file;
@@ -73,9 +76,18 @@ typedef struct
     /*! The application name passed in per command line */
     char appname[32];
     
-    /*! The filter string, tokens separated by ',' */
+    /*! The filter string given on the command line, tokens separated by ',' */
     char filter[256];
     
+    /*! The second the time stamp string is of */
+    time_t stamp;
+
+    /*! The time stamp string, with the terminating zero */
+    char stamp_str[32];
+
+    /*! The length of the time stamp string */
+    int stamp_len;
+
     /*! The log-message */
     uint8_t buf[2048];
 
@@ -85,6 +97,9 @@ typedef struct
 /*< The global log-context */
 static sstp_log_st m_ctx = {};
 
+/*< The call sites decided with any other generation decide again */
+unsigned int sstp_log_gen = 1;
+
 
 /*!
  * @brief Parses the log message and returns a table of attribute pointers
@@ -183,50 +198,25 @@ void sstp_log_msg(int level, const char *file, int line, const char *fmt, ...)
     int index = 0;
     va_list list;
     
-    /* Check if we are filtering */
-    if (SSTP_LOG_TRACE == level &&
-        m_ctx.token[0])
-    {
-        const char *ptr;
-        int index;
-        
-        ptr = strrchr(file, '/');
-        ptr = (ptr != NULL)
-            ? (ptr + 1)
-            : file ;
-     
-        /* Lookup the appropriate token */
-        for (index = 0; index < (sizeof(m_ctx.token)/sizeof(char*)); index++)
-        {
-            if (!m_ctx.token[index])
-            {
-                break;
-            }
-            
-            if (0 == fnmatch(m_ctx.token[index], ptr, 0))
-            {
-                break;
-            }
-        }
-        
-        /* Don't log this message */
-        if (!m_ctx.token[index])
-        {
-            return;
-        }
-    }
-    
     /* Get the message structure and fill in the details */
     msg = (log_msg_st*) &m_ctx.buf[index];
     msg->msg_level = level;
     msg->msg_stamp = time(NULL);
     index = sizeof(*msg);
-    
+
+    /* Format the time stamp once a second */
+    if (m_ctx.stamp != msg->msg_stamp || !m_ctx.stamp_len)
+    {
+        m_ctx.stamp_len = strftime(m_ctx.stamp_str, sizeof(m_ctx.stamp_str),
+            "%b %e %H:%M:%S", localtime_r(&msg->msg_stamp, &tm)) + 1;
+        m_ctx.stamp = msg->msg_stamp;
+    }
+
     /* Add the TIME STAMP string */
     attr = (log_attr_st*) &m_ctx.buf[index];
     attr->attr_type = LOG_ATTR_TIME;
-    attr->attr_len = strftime((char*) attr->attr_data, 255, "%b %e %H:%M:%S",
-        localtime_r(&msg->msg_stamp, &tm)) + 1;
+    attr->attr_len  = m_ctx.stamp_len;
+    memcpy(attr->attr_data, m_ctx.stamp_str, m_ctx.stamp_len);
     index += (sizeof(*attr) + LOG_ALIGN32(attr->attr_len));
     
     /* Add the LINEINFO attribute */
@@ -264,17 +254,124 @@ void sstp_log_msg(int level, const char *file, int line, const char *fmt, ...)
 }
 
 
+int sstp_log_site(sstp_log_site_st *site)
+{
+    const char *ptr;
+    int index;
+
+    site->gen  = sstp_log_gen;
+    site->pass = (SSTP_LOG_TRACE <= m_ctx.level);
+
+    /* Check if we are filtering */
+    if (!site->pass || !m_ctx.token[0])
+    {
+        return site->pass;
+    }
+
+    ptr = strrchr(site->file, '/');
+    ptr = (ptr != NULL)
+        ? (ptr + 1)
+        : site->file;
+
+    /* Lookup the appropriate token */
+    for (index = 0; index < (sizeof(m_ctx.token)/sizeof(char*)); index++)
+    {
+        if (!m_ctx.token[index])
+        {
+            break;
+        }
+
+        if (0 == fnmatch(m_ctx.token[index], ptr, 0))
+        {
+            break;
+        }
+    }
+
+    /* Log the messages if a token matched */
+    site->pass = (m_ctx.token[index] != NULL);
+    return site->pass;
+}
+
+
 sstp_level_t sstp_log_level(void)
 {
     return m_ctx.level;
 }
 
 
+/*!
+ * @brief Replace the tokens to filter the trace messages on
+ */
+static void sstp_log_tokens(const char *filter)
+{
+    char buff[256];
+    char *ptr1 = NULL;
+    char *ptr2 = NULL;
+    int index  = 0;
+
+    /* Have the call sites decide again */
+    sstp_log_gen++;
+
+    for (index = 0; index < (sizeof(m_ctx.token)/sizeof(char*)); index++)
+    {
+        if (m_ctx.token[index])
+        {
+            free(m_ctx.token[index]);
+            m_ctx.token[index] = NULL;
+        }
+    }
+
+    if (!filter[0])
+    {
+        return;
+    }
+
+    strncpy(buff, filter, sizeof(buff) - 1);
+    buff[sizeof(buff) - 1] = '\0';
+
+    /* Keep the last token NULL */
+    for (ptr1 = buff, index = 0; ptr1 != NULL && 
+            index < (sizeof(m_ctx.token)/sizeof(char*)) - 1; ptr1 = ptr2)
+    {
+        /* Seek to the separator */
+        ptr2 = strchr(ptr1, ',');
+        if (ptr2)
+        {
+            *ptr2++ = '\0';
+        }
+
+        /* Copy the filter token */
+        m_ctx.token[index++] = strdup(ptr1);
+    }
+}
+
+
+void sstp_log_setlevel(int level)
+{
+    m_ctx.level = (level < 0)
+        ? m_ctx.level_argv
+        : level;
+
+    /* Have the call sites decide again */
+    sstp_log_gen++;
+}
+
+
+void sstp_log_setfilter(const char *filter)
+{
+    sstp_log_tokens((filter && filter[0])
+        ? filter
+        : m_ctx.filter);
+}
+
+
 status_t sstp_init_log(const char *name, int opts, int level)
 {
     /* Configure the structure */
     m_ctx.level = level;
+    m_ctx.level_argv = level;
     m_ctx.opt   = opts;
+    sstp_log_gen++;
     
     /* Initialize syslog if enabled */
     if (SSTP_OPT_SYSLOG & opts)
@@ -352,7 +449,6 @@ status_t sstp_log_init_argv(int *argc, char *argv[])
     status_t retval = SSTP_FAIL;
     status_t status = SSTP_FAIL;
     char *ptr1 = NULL;
-    char *ptr2 = NULL;
     int level = SSTP_LOG_ERR;
     int opt   = SSTP_OPT_SYSLOG;
     int index = 0;
@@ -514,21 +610,8 @@ status_t sstp_log_init_argv(int *argc, char *argv[])
     }
  
     /* Process the tokens */
-    if (buff[0])
-    {
-        for (ptr1 = buff, index = 0; ptr1 != NULL; ptr1 = ptr2)
-        {
-            /* Seek to the separator */
-            ptr2 = strchr(ptr1, ',');
-            if (ptr2)
-            {
-                *ptr2++ = '\0';
-            }
-            
-            /* Copy the filter token */
-            m_ctx.token[index++] = strdup(ptr1);
-        }
-    }
+    strncpy(m_ctx.filter, buff, sizeof(m_ctx.filter) - 1);
+    sstp_log_tokens(m_ctx.filter);
     
     /* Success */
     retval = SSTP_OKAY;
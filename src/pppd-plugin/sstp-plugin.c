@@ -24,14 +24,18 @@
 
 #include <config.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
 #include <sys/socket.h>
+#include <sys/time.h>
 #include <sys/un.h>
 #include <unistd.h>
 
 #include <pppd/pppd.h>
+#include <pppd/fsm.h>
+#include <pppd/ipcp.h>
 #include <sstp-api.h>
 
 #ifndef MPPE
@@ -44,6 +48,12 @@ extern int mppe_keys_set;
 
 static int sstp_notify_sent = 0;
 
+/*! Have we told sstp-client that LCP is up */
+static int sstp_lcp_up = 0;
+
+/*! The connection to sstp-client, held for as long as pppd runs */
+static int sstp_fd = -1;
+
 /*!
  * @brief PPP daemon requires this symbol to be exported
  */
@@ -63,37 +73,163 @@ static option_t sstp_option [] =
 
 
 /*!
- * @brief Exchange the MPPE keys with sstp-client
+ * @brief Close the connection to sstp-client
  */
-static void sstp_send_notify(unsigned char *skey, int slen, 
-    unsigned char *rkey, int rlen)
+static void sstp_disconnect(void)
+{
+    if (sstp_fd >= 0)
+    {
+        close(sstp_fd);
+        sstp_fd = -1;
+    }
+}
+
+
+/*!
+ * @brief Connect to sstp-client, unless we already are
+ *
+ * @par Note:
+ *  The send timeout bounds both the connect, should sstp-client not 
+ *  accept it, and each send thereafter.
+ */
+static int sstp_connect(void)
 {
     struct sockaddr_un addr;
+    struct timeval tv;
     int ret  = (-1);
-    int sock = (-1);
     int alen = (sizeof(addr));
-    uint8_t buf[SSTP_MAX_BUFLEN+1];
-    sstp_api_msg_st  *msg  = NULL;
+
+    if (sstp_fd >= 0)
+    {
+        return 0;
+    }
 
     /* Open the socket */
-    sock = socket(AF_UNIX, SOCK_STREAM, 0);
-    if (sock < 0)
+    sstp_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sstp_fd < 0)
     {
-        fatal("Could not open socket to communicate with sstp-client");
+        error("Could not open socket to communicate with sstp-client");
+        return -1;
     }
 
+    /* Never wait on sstp-client for long */
+    tv.tv_sec  = SSTP_API_MSG_TIMEOUT / 1000;
+    tv.tv_usec = SSTP_API_MSG_TIMEOUT % 1000 * 1000;
+    setsockopt(sstp_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    fcntl(sstp_fd, F_SETFD, FD_CLOEXEC);
+
     /* Setup the address */
+    memset(&addr, 0, sizeof(addr));
     addr.sun_family = AF_UNIX;
-    strncpy(addr.sun_path, sstp_sock, sizeof(addr.sun_path));
+    strncpy(addr.sun_path, sstp_sock, sizeof(addr.sun_path) - 1);
 
     /* Connect the socket */
-    ret = connect(sock, (struct sockaddr*) &addr, alen);
+    ret = connect(sstp_fd, (struct sockaddr*) &addr, alen);
     if (ret < 0)
     {
-        fatal("Could not connect to sstp-client (%s), %s (%d)", sstp_sock,
+        error("Could not connect to sstp-client (%s), %s (%d)", sstp_sock,
             strerror(errno), errno);
+        sstp_disconnect();
+        return -1;
     }
 
+    return 0;
+}
+
+
+/*!
+ * @brief Discard the ACKs sstp-client sent us, without waiting for any
+ */
+static void sstp_drain(void)
+{
+    uint8_t buf[SSTP_MAX_BUFLEN+1];
+    int ret = 0;
+
+    do
+    {
+        ret = recv(sstp_fd, buf, sizeof(buf), MSG_DONTWAIT);
+    }
+    while (ret > 0);
+
+    /* sstp-client closed the connection */
+    if (ret == 0)
+    {
+        sstp_disconnect();
+    }
+}
+
+
+/*!
+ * @brief Send a message to sstp-client
+ *
+ * @par Note:
+ *  The messages are ordered on the connection, so there is no need to 
+ *  wait for the ACK. Should sstp-client have gone away, e.g. handed the
+ *  session over to a new sstpc, we connect once more and try again.
+ */
+static int sstp_send_msg(sstp_api_msg_st *msg)
+{
+    uint8_t *data = (uint8_t*) msg;
+    int retry = 0;
+    int off = 0;
+    int ret = 0;
+
+    for (retry = 0; retry < 2; retry++)
+    {
+        if (sstp_connect())
+        {
+            return -1;
+        }
+
+        sstp_drain();
+        if (sstp_fd < 0)
+        {
+            continue;
+        }
+
+        /* Send the structure */
+        for (off = 0; off < sstp_api_msg_len(msg); off += ret)
+        {
+            ret = send(sstp_fd, data + off, sstp_api_msg_len(msg) - off, 
+                    MSG_NOSIGNAL);
+            if (ret < 0 && errno == EINTR)
+            {
+                ret = 0;
+                continue;
+            }
+
+            if (ret < 0)
+            {
+                break;
+            }
+        }
+
+        if (off == sstp_api_msg_len(msg))
+        {
+            return 0;
+        }
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            error("Timed out sending to sstp-client");
+        }
+
+        sstp_disconnect();
+    }
+
+    return -1;
+}
+
+
+/*!
+ * @brief Exchange the MPPE keys with sstp-client
+ */
+static void sstp_send_notify(unsigned char *skey, int slen, 
+    unsigned char *rkey, int rlen)
+{
+    uint8_t buf[SSTP_MAX_BUFLEN+1];
+    sstp_api_msg_st  *msg  = NULL;
+
     /* Create a new message */
     msg = sstp_api_msg_new(buf, SSTP_API_MSG_AUTH);
 
@@ -105,25 +241,88 @@ static void sstp_send_notify(unsigned char *skey, int slen,
     sstp_api_attr_add(msg, SSTP_API_ATTR_MPPE_RECV, 
             MPPE_MAX_KEY_LEN, rkey);
 
-    /* Send the structure */
-    ret = send(sock, msg, sstp_api_msg_len(msg), 0);
-    if (ret < 0)
-    {
-        fatal("Could not send data to sstp-client");
-    }
-    
-    /* Wait for the ACK to be received */
-    ret = recv(sock, msg, (sizeof(*msg)), 0);
-    if (ret < 0 || ret != (sizeof(*msg)))
+    if (sstp_send_msg(msg))
     {
-        fatal("Could not wait for ack from sstp-client");
+        fatal("Could not send the MPPE keys to sstp-client");
     }
 
     /* We have communicated the keys */
     sstp_notify_sent = 1;
+}
+
+
+/*!
+ * @brief Tell sstp-client the interface is up, e.g. to install routes
+ */
+static void sstp_send_ipup(void)
+{
+    uint8_t buf[SSTP_MAX_BUFLEN+1];
+    sstp_api_msg_st  *msg  = NULL;
+
+    /* Create a new message */
+    msg = sstp_api_msg_new(buf, SSTP_API_MSG_IPUP);
+
+    /* Add the interface name */
+    sstp_api_attr_add(msg, SSTP_API_ATTR_IFNAME, strlen(ifname) + 1,
+            ifname);
+
+    /* Add the addresses IPCP settled on */
+    sstp_api_attr_add(msg, SSTP_API_ATTR_LOCAL, sizeof(uint32_t),
+            &ipcp_gotoptions[0].ouraddr);
+    sstp_api_attr_add(msg, SSTP_API_ATTR_REMOTE, sizeof(uint32_t),
+            &ipcp_hisoptions[0].hisaddr);
+
+    if (sstp_send_msg(msg))
+    {
+        fatal("Could not tell sstp-client the interface is up");
+    }
+}
+
+
+/*!
+ * @brief Tell sstp-client of a change to the link
+ */
+static void sstp_send_link(sstp_api_msg_t type)
+{
+    uint8_t buf[SSTP_MAX_BUFLEN+1];
+    sstp_api_msg_st  *msg  = NULL;
+
+    /* Create a new message */
+    msg = sstp_api_msg_new(buf, type);
+
+    if (sstp_send_msg(msg))
+    {
+        warn("Could not tell sstp-client of the link");
+    }
+}
+
+
+/*!
+ * @brief Tell sstp-client once LCP is up, the authentication and the 
+ *  network phase follow
+ */
+static void sstp_phase_change(void *arg, int phase)
+{
+    if (sstp_lcp_up)
+    {
+        return;
+    }
+
+    if (phase == PHASE_AUTHENTICATE || phase == PHASE_NETWORK)
+    {
+        sstp_send_link(SSTP_API_MSG_LCPUP);
+        sstp_lcp_up = 1;
+    }
+}
+
 
-    /* Close socket */
-    close(sock);
+/*!
+ * @brief Tell sstp-client the link went down
+ */
+static void sstp_link_down(void *arg, int dummy)
+{
+    sstp_send_link(SSTP_API_MSG_DOWN);
+    sstp_lcp_up = 0;
 }
 
 
@@ -139,19 +338,22 @@ static void sstp_send_notify(unsigned char *skey, int slen,
  */
 static void sstp_ip_up(void *arg, int dummy)
 {
-    if (sstp_notify_sent)
-        return;
-
-    /* Auth-Type is not MSCHAPv2, reset the keys and send blank keys */
-    if (!mppe_keys_set)
+    if (!sstp_notify_sent)
     {
-        memset(&mppe_send_key, 0, sizeof(mppe_send_key));
-        memset(&mppe_recv_key, 0, sizeof(mppe_recv_key));
+        /* Auth-Type is not MSCHAPv2, reset the keys and send blank keys */
+        if (!mppe_keys_set)
+        {
+            memset(&mppe_send_key, 0, sizeof(mppe_send_key));
+            memset(&mppe_recv_key, 0, sizeof(mppe_recv_key));
+        }
+
+        /* Send the MPPE keys to the sstpc client */
+        sstp_send_notify(mppe_send_key, sizeof(mppe_send_key),
+                mppe_recv_key, sizeof(mppe_recv_key));
     }
 
-    /* Send the MPPE keys to the sstpc client */
-    sstp_send_notify(mppe_send_key, sizeof(mppe_send_key),
-            mppe_recv_key, sizeof(mppe_recv_key));
+    /* The interface is up */
+    sstp_send_ipup();
 }
 
 
@@ -239,6 +441,10 @@ void plugin_init(void)
 
     /* Add ip-up notifier */
     add_notifier(&ip_up_notifier, sstp_ip_up, NULL);
+
+    /* Tell sstp-client as the link comes up and goes down */
+    add_notifier(&phasechange, sstp_phase_change, NULL);
+    add_notifier(&link_down_notifier, sstp_link_down, NULL);
 }
 
 
@@ -29,6 +29,7 @@
 #include <string.h>
 #include <openssl/sha.h>
 #include <openssl/md4.h>
+#include <openssl/des.h>
 #include "sstp-private.h"
 #include "sstp-chap.h"
 
@@ -46,15 +47,14 @@
 
 
 /*!
- * @brief Create the a double MD4 hash from a password made into unicode
+ * @brief Create the MD4 hash from a password made into unicode
  * @param pass  The password as specified by command line
  * @param len   The length of the password
  * @param hash  The resulting hash from this operation.
  * 
  * @retval 0: success, -1: failure
  */
-static int sstp_chap_hash_pass(const char *pass, int len, 
-    uint8_t hash[16])
+static int sstp_chap_hash_nt(const char *pass, int len, uint8_t hash[16])
 {
     uint8_t buf[512] = {};
     uint8_t inx;
@@ -76,6 +76,28 @@ static int sstp_chap_hash_pass(const char *pass, int len,
     MD4_Update  (&ctx, buf, (len << 1));
     MD4_Final   (hash, &ctx);
 
+    return 0;
+}
+
+
+/*!
+ * @brief Create the a double MD4 hash from a password made into unicode
+ * @param pass  The password as specified by command line
+ * @param len   The length of the password
+ * @param hash  The resulting hash from this operation.
+ * 
+ * @retval 0: success, -1: failure
+ */
+static int sstp_chap_hash_pass(const char *pass, int len, 
+    uint8_t hash[16])
+{
+    MD4_CTX ctx;
+
+    if (sstp_chap_hash_nt(pass, len, hash) < 0)
+    {
+        return -1;
+    }
+
     /* Generate the hash hash */
     MD4_Init    (&ctx);
     MD4_Update  (&ctx, hash, 16);
@@ -212,6 +234,66 @@ static int sstp_chap_hash_session(uint8_t key[16], uint8_t master[16],
 }
 
 
+/*!
+ * @brief Encrypt 8 bytes with DES, using 7 bytes of the password hash
+ *  as the key
+ */
+static void sstp_chap_des(const uint8_t key[7], const uint8_t clear[8],
+    uint8_t cipher[8])
+{
+    DES_key_schedule sched;
+    DES_cblock k;
+
+    /* Spread the 56 bits over 8 bytes, leaving room for the parity */
+    k[0] =  key[0];
+    k[1] = (key[0] << 7) | (key[1] >> 1);
+    k[2] = (key[1] << 6) | (key[2] >> 2);
+    k[3] = (key[2] << 5) | (key[3] >> 3);
+    k[4] = (key[3] << 4) | (key[4] >> 4);
+    k[5] = (key[4] << 3) | (key[5] >> 5);
+    k[6] = (key[5] << 2) | (key[6] >> 6);
+    k[7] = (key[6] << 1);
+
+    DES_set_odd_parity(&k);
+    DES_set_key_unchecked(&k, &sched);
+    DES_ecb_encrypt((const_DES_cblock*) clear, (DES_cblock*) cipher, 
+            &sched, DES_ENCRYPT);
+}
+
+
+int sstp_chap_response(sstp_chap_st *ctx, const uint8_t challenge[16],
+        const char *user, const char *password)
+{
+    uint8_t digest[SHA_DIGEST_LENGTH];
+    uint8_t phash[21] = {};
+    SHA_CTX sha;
+    int ret = -1;
+
+    /* The challenge hash, from both challenges and the user name */
+    SHA1_Init   (&sha);
+    SHA1_Update (&sha, ctx->challenge, 16);
+    SHA1_Update (&sha, challenge, 16);
+    SHA1_Update (&sha, user, strlen(user));
+    SHA1_Final  (digest, &sha);
+
+    /* The password hash, zero padded to three DES keys */
+    ret = sstp_chap_hash_nt(password, strlen(password), phash);
+    if (ret < 0)
+    {
+        log_err("Could not create password hash");
+        return -1;
+    }
+
+    sstp_chap_des(phash +  0, digest, ctx->nt_response +  0);
+    sstp_chap_des(phash +  7, digest, ctx->nt_response +  8);
+    sstp_chap_des(phash + 14, digest, ctx->nt_response + 16);
+
+    memset(ctx->response, 0, sizeof(ctx->response));
+    ctx->flags[0] = 0;
+    return 0;
+}
+
+
 int sstp_chap_mppe_get(sstp_chap_st *ctx, const char *password, 
         uint8_t skey[16], uint8_t rkey[16], char server)
 {
@@ -306,9 +388,42 @@ int main(int argc, char *argv[])
         0x50, 0xf8, 0xcd, 0x94, 0x69, 0x57, 0x3c, 0xdb
     };
 
+    /* RFC 2759, section 9.2 */
+    sstp_chap_st resp =
+    {
+        .challenge =
+        {
+            0x21, 0x40, 0x23, 0x24, 0x25, 0x5e, 0x26, 0x2a,
+            0x28, 0x29, 0x5f, 0x2b, 0x3a, 0x33, 0x7c, 0x7e
+        },
+    };
+
+    uint8_t auth[16] =
+    {
+        0x5b, 0x5d, 0x7c, 0x7d, 0x7b, 0x3f, 0x2f, 0x3e,
+        0x3c, 0x2c, 0x60, 0x21, 0x32, 0x26, 0x26, 0x28
+    };
+
+    uint8_t cmp3[24] =
+    {
+        0x82, 0x30, 0x9e, 0xcd, 0x8d, 0x70, 0x8b, 0x5e,
+        0xa0, 0x8f, 0xaa, 0x39, 0x81, 0xcd, 0x83, 0x54,
+        0x42, 0x33, 0x11, 0x4a, 0x3d, 0x85, 0xd6, 0xdf
+    };
+
     uint8_t skey[16];
     uint8_t rkey[16];
 
+    /* Compute the NT-Response */
+    sstp_chap_response(&resp, auth, "User", "clientPass");
+    if (memcmp(resp.nt_response, cmp3, 24))
+    {
+        printf("NT-Response Failed!\n");
+        goto done;
+    }
+
+    printf("The NT-Response is correct\n");
+
     /* Get the MPPE keys */
     sstp_chap_mppe_get(&ctx, "DukeNuke3D", skey, rkey, false);
 
@@ -50,6 +50,20 @@ typedef struct sstp_chap
 } __attribute__((packed)) sstp_chap_st;
     
 
+/*!
+ * @brief Compute the MS-CHAPv2 response to a challenge (RFC 2759)
+ *
+ * @param ctx       The response, with the peer challenge chosen by the caller
+ * @param challenge The challenge of the authenticator
+ * @param user      The user's name
+ * @param password  The user's password
+ *
+ * @retval 0: success, -1: failure
+ */
+int sstp_chap_response(sstp_chap_st *ctx, const uint8_t challenge[16],
+        const char *user, const char *password);
+
+
 /*! 
  * @brief Takes the CHAP context and generate the MPPE key
  *
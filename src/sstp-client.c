@@ -27,8 +27,10 @@
 #include <stdio.h>
 #include <errno.h>
 #include <netdb.h>
+#include <poll.h>
 #include <unistd.h>
 #include <signal.h>
+#include <sys/time.h>
 
 
 #include "sstp-private.h"
@@ -78,6 +80,76 @@ static void sstp_client_event_cb(sstp_client_st *client, int ret)
 }
 
 
+/*!
+ * @brief Called as pppd brings the link up and down, per sstp-plugin
+ */
+static void sstp_client_link(sstp_client_st *client, sstp_event_link_t ev)
+{
+    switch (ev)
+    {
+    case SSTP_EVENT_LCPUP:
+
+        /* The plugin tells us of the authentication and ip-up */
+        if (client->pppd)
+        {
+            sstp_pppd_plugin(client->pppd);
+        }
+        break;
+
+    case SSTP_EVENT_DOWN:
+        log_info("pppd brought the link down");
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/*!
+ * @brief Called when the split-tunnel routes are installed
+ */
+static void sstp_client_rset_done(sstp_client_st *client, int done, 
+        int failed)
+{
+    if (failed)
+    {
+        log_warn("Installed %d split-tunnel routes, %d failed", done, failed);
+        return;
+    }
+
+    log_info("Installed %d split-tunnel routes", done);
+}
+
+
+/*!
+ * @brief Install the split-tunnel routes each time pppd brings the 
+ *  interface up
+ */
+static void sstp_client_ipup(sstp_client_st *client, const char *ifname)
+{
+    int ret = 0;
+
+    /* A route to the server through the tunnel is not a move */
+    if (client->monitor)
+    {
+        sstp_monitor_exclude(client->monitor, ifname);
+    }
+
+    if (!client->rset)
+    {
+        return;
+    }
+
+    ret = sstp_rset_install(client->rset, ifname, (sstp_rset_done_fn)
+            sstp_client_rset_done, client);
+    if (SSTP_OKAY != ret)
+    {
+        log_warn("Could not install the split-tunnel routes via %s", ifname);
+    }
+}
+
+
 static void sstp_client_pppd_cb(sstp_client_st *client, sstp_pppd_event_t ev)
 {
     int ret = (-1);
@@ -87,49 +159,578 @@ static void sstp_client_pppd_cb(sstp_client_st *client, sstp_pppd_event_t ev)
     case SSTP_PPP_DOWN:
         log_err("PPPd terminated");
         //sstp_state_disconnect(client->state);
+        client->stop = 1;
         event_base_loopbreak(client->ev_base);
         break;
 
     case SSTP_PPP_UP:
 
-        /* Tell the state machine to connect */
-        ret = sstp_state_accept(client->state);
-        if (SSTP_FAIL == ret)
-        {
-            sstp_die("Negotiation with server failed", -1);
-        }
-        break;
+        /* Tell the state machine to connect */
+        ret = sstp_state_accept(client->state);
+        if (SSTP_FAIL == ret)
+        {
+            sstp_die("Negotiation with server failed", -1);
+        }
+        break;
+
+    case SSTP_PPP_AUTH:
+    {
+        uint8_t skey[16];
+        uint8_t rkey[16];
+
+        /* Get the MPPE keys */
+        ret = sstp_chap_mppe_get(sstp_pppd_getchap(client->pppd), 
+                client->option.password, skey, rkey, 0); 
+        if (SSTP_FAIL == ret)
+        {
+            return;
+        }
+
+        /* Set the keys */
+        sstp_state_mppe_keys(client->state, skey, 16, rkey, 16);
+        break;
+    }
+
+    default:
+        
+        break;
+    }
+
+    return;
+}
+
+
+/*!
+ * @brief Create the PPP context and start the pppd daemon
+ *
+ * @par Note:
+ *  With a NULL @a stream, the frames from pppd are held until the call 
+ *  is connected.
+ */
+static void sstp_client_pppd_start(sstp_client_st *client, 
+        sstp_stream_st *stream)
+{
+    int ret = 0;
+
+    /* Create the PPP context */
+    ret = sstp_pppd_create(&client->pppd, client->ev_base, stream, 
+            (sstp_pppd_fn) sstp_client_pppd_cb, client);
+    if (SSTP_OKAY != ret)
+    {
+        sstp_die("Could not initialize PPP daemon", -1);
+    }
+
+    /* Share the event loop fairly with the stream */
+    sstp_pppd_setsched(client->pppd, client->sched);
+
+    /* Account the traffic inside the tunnel */
+    if (client->flow)
+    {
+        sstp_pppd_setflow(client->pppd, client->flow);
+    }
+
+    /* Size the frames to the path to the server */
+    if (client->mtu)
+    {
+        sstp_pppd_setmtu(client->pppd, client->mtu);
+    }
+
+    /* Start the pppd daemon */
+    ret = sstp_pppd_start(client->pppd, &client->option, 
+            sstp_event_sockname(client->event));
+    if (SSTP_OKAY != ret)
+    {
+        sstp_die("Could not start PPP daemon", -1);
+    }
+}
+
+
+/*!
+ * @brief Log the round-trip time statistics
+ */
+static void sstp_client_rtt_stats(sstp_client_st *client, sstp_rtt_st *rtt)
+{
+    sstp_state_rtt(client->state, rtt);
+
+    log_info("RTT min/p50/p90/p99/max = %d.%03d/%d.%03d/%d.%03d/%d.%03d/%d.%03d ms, "
+            "srtt %d.%03d ms, rttvar %d.%03d ms, %d samples, %d sent, %d lost",
+            rtt->min  / 1000, rtt->min  % 1000, rtt->p50 / 1000, rtt->p50 % 1000,
+            rtt->p90  / 1000, rtt->p90  % 1000, rtt->p99 / 1000, rtt->p99 % 1000,
+            rtt->max  / 1000, rtt->max  % 1000, rtt->srtt / 1000, rtt->srtt % 1000,
+            rtt->rttvar / 1000, rtt->rttvar % 1000, rtt->count, rtt->sent, 
+            rtt->lost);
+}
+
+
+/*!
+ * @brief Report the traffic per PPP protocol and the busiest flows
+ */
+static void sstp_client_flow_stats(sstp_client_st *client)
+{
+    sstp_flow_st top[SSTP_FLOW_REPORT];
+    uint64_t tx = 0;
+    uint64_t rx = 0;
+    char buf1[32];
+    char buf2[32];
+    char name[128];
+    int count = 0;
+    int i = 0;
+
+    for (i = 0; i < SSTP_FLOW_PROTO_MAX; i++)
+    {
+        tx = sstp_flow_bytes(client->flow, SSTP_FLOW_SEND, i);
+        rx = sstp_flow_bytes(client->flow, SSTP_FLOW_RECV, i);
+        if (tx || rx)
+        {
+            log_info("%-8s received %s, sent %s", sstp_flow_proto_name(i),
+                    sstp_norm_data(rx, buf1, sizeof(buf1)),
+                    sstp_norm_data(tx, buf2, sizeof(buf2)));
+        }
+    }
+
+    count = sstp_flow_top(client->flow, top, SSTP_FLOW_REPORT);
+    for (i = 0; i < count; i++)
+    {
+        log_info("Flow %s, received %s, sent %s%s", sstp_flow_name(&top[i],
+                    name, sizeof(name)),
+                sstp_norm_data(top[i].rx_bytes, buf1, sizeof(buf1)),
+                sstp_norm_data(top[i].tx_bytes, buf2, sizeof(buf2)),
+                top[i].error ? " (or more)" : "");
+    }
+}
+
+
+/*!
+ * @brief Size the PPP frames so each fills a TCP segment in one TLS record
+ */
+static void sstp_client_mtu(sstp_client_st *client)
+{
+    int mss = sstp_stream_mss(client->stream);
+    int tls = sstp_stream_overhead(client->stream);
+    int hdr = (client->host.addr.sa_family == AF_INET6) ? 60 : 40;
+    int mtu = 0;
+
+    if (mss <= 0 || tls < 0)
+    {
+        log_warn("Could not size the MTU to the path");
+        return;
+    }
+
+    mtu = MIN(mss - tls - SSTP_PPP_FRAMING, SSTP_PPP_MTU_MAX);
+    if (mtu < SSTP_PPP_MTU_MIN)
+    {
+        mtu = SSTP_PPP_MTU_MIN;
+    }
+
+    client->mtu      = mtu;
+    client->mtu_wire = hdr + tls + SSTP_PPP_FRAMING + mtu;
+
+    log_info("Segment size is %d, TLS overhead %d, MTU/MRU %d at %.1f%% "
+            "efficiency", mss, tls, mtu, 100.0 * mtu / client->mtu_wire);
+}
+
+
+/*!
+ * @brief Dump the statistics of the connection on SIGUSR1
+ */
+static void sstp_client_stats(int sig, short event, sstp_client_st *client)
+{
+    sstp_session_st detail;
+    sstp_rtt_st rtt;
+    char buf1[32];
+    char buf2[32];
+    char buf3[32];
+
+    if (client->state)
+    {
+        sstp_client_rtt_stats(client, &rtt);
+    }
+
+    if (client->pppd)
+    {
+        sstp_pppd_session_details(client->pppd, &detail);
+        log_info("Session up for %s, received %s, sent %s",
+                sstp_norm_time(detail.established, buf1, sizeof(buf1)),
+                sstp_norm_data(detail.rx_bytes, buf2, sizeof(buf2)),
+                sstp_norm_data(detail.tx_bytes, buf3, sizeof(buf3)));
+    }
+
+    if (client->mtu)
+    {
+        log_info("Frames of %d bytes take %d bytes on the wire, %.1f%% "
+                "efficiency", client->mtu, client->mtu_wire, 
+                100.0 * client->mtu / client->mtu_wire);
+    }
+
+    if (client->flow)
+    {
+        sstp_client_flow_stats(client);
+    }
+
+    /* Report the time spent in the event loop callbacks */
+    sstp_probe_dump();
+
+    if (sstp_cycle_enabled())
+    {
+        sstp_cycle_dump();
+    }
+}
+
+
+/*!
+ * @brief Set the bounds of the keep-alive, the configuration file takes
+ *  precedence over the command line
+ */
+static void sstp_client_keepalive(sstp_client_st *client)
+{
+    const sstp_tune_st *tune = sstp_tune();
+
+    sstp_state_keepalive(client->state, 
+            (tune->keepalive) ? tune->keepalive : client->option.keepalive,
+            (tune->keepalive_max) ? tune->keepalive_max 
+                                  : client->option.keepalive_max);
+}
+
+
+/*!
+ * @brief Apply the settings that can change while connected
+ */
+static void sstp_client_apply(sstp_client_st *client)
+{
+    const sstp_tune_st *tune = sstp_tune();
+    int budget = 0;
+
+    sstp_log_setlevel(tune->log_level);
+    sstp_log_setfilter(tune->log_filter);
+
+    /* Report callbacks holding up the event loop */
+    budget = (tune->stall_budget) 
+            ? tune->stall_budget * 1000
+            : client->option.stall_budget * 1000;
+    sstp_probe_budget((budget) ? budget : SSTP_PROBE_BUDGET);
+
+    sstp_sched_setbudget(client->sched, tune->sched_budget);
+
+    if (client->state)
+    {
+        sstp_client_keepalive(client);
+    }
+
+    if (client->stream && SSTP_OKAY != sstp_set_sndbuf(
+            sstp_stream_sock(client->stream), tune->send_buf))
+    {
+        log_warn("Could not set the send buffer size");
+    }
+}
+
+
+/*!
+ * @brief Report a setting changed by the configuration file
+ */
+static void sstp_client_retune(sstp_client_st *client, const char *name,
+        const char *value, sstp_tune_apply_t apply)
+{
+    switch (apply)
+    {
+    case SSTP_TUNE_LIVE:
+        log_info("Applied %s = %s", name, value);
+        break;
+
+    case SSTP_TUNE_RECONNECT:
+        log_info("Changed %s = %s, takes effect on the next connection", 
+                name, value);
+        break;
+
+    case SSTP_TUNE_RESTART:
+    default:
+        log_warn("Can't change %s = %s while running, restart to apply", 
+                name, value);
+        break;
+    }
+}
+
+
+/*!
+ * @brief Read the configuration file again on SIGHUP, keeping the tunnel
+ */
+static void sstp_client_reload(int sig, short event, sstp_client_st *client)
+{
+    sstp_tune_st prev;
+    int line = 0;
+    int ret  = 0;
+
+    if (!client->option.config)
+    {
+        log_warn("No configuration file to reload, see --config");
+        return;
+    }
+
+    memcpy(&prev, sstp_tune(), sizeof(prev));
+
+    ret = sstp_tune_load(client->option.config, &line);
+    if (SSTP_OKAY != ret)
+    {
+        log_err("Could not reload %s, line %d, keeping the configuration",
+                client->option.config, line);
+        return;
+    }
+
+    log_info("Reloaded %s", client->option.config);
+    sstp_tune_diff(&prev, (sstp_tune_fn) sstp_client_retune, client);
+    sstp_client_apply(client);
+}
+
+
+/*!
+ * @brief Start the cycle accounting, or stop and report it on SIGUSR2
+ */
+static void sstp_client_cycle(int sig, short event, sstp_client_st *client)
+{
+    if (sstp_cycle_enabled())
+    {
+        sstp_cycle_dump();
+        sstp_cycle_enable(0);
+        return;
+    }
+
+    log_info("Cycle accounting started, signal again to report");
+    sstp_cycle_enable(1);
+}
+
+
+/*!
+ * @brief Send an Echo-Request once a second in ping mode, then report
+ */
+static void sstp_client_ping(int fd, short event, sstp_client_st *client)
+{
+    timeval_st tv = { 1, 0 };
+    sstp_rtt_st rtt;
+
+    if (client->ping_sent < client->option.ping)
+    {
+        sstp_state_echo(client->state);
+        client->ping_sent++;
+        event_add(client->ev_ping, &tv);
+        return;
+    }
+
+    /* Give the replies still on their way a few more seconds */
+    sstp_state_rtt(client->state, &rtt);
+    if (rtt.lost > 0 && 
+        client->ping_sent < client->option.ping + SSTP_ECHO_TIMEOUT)
+    {
+        client->ping_sent++;
+        event_add(client->ev_ping, &tv);
+        return;
+    }
+
+    sstp_client_rtt_stats(client, &rtt);
+
+    printf("--- %s sstp ping statistics ---\n", client->host.name);
+    printf("%d requests sent, %d replies, %d%% lost\n", rtt.sent, rtt.recv,
+            rtt.lost * 100 / rtt.sent);
+    if (rtt.count > 0)
+    {
+        printf("rtt min/p50/p90/p99/max = %.3f/%.3f/%.3f/%.3f/%.3f ms\n",
+                rtt.min / 1000.0, rtt.p50 / 1000.0, rtt.p90 / 1000.0, 
+                rtt.p99 / 1000.0, rtt.max / 1000.0);
+    }
+
+    client->stop = 1;
+    event_base_loopbreak(client->ev_base);
+}
+
+
+/*!
+ * @brief Called when the state machine transitions
+ */
+static void sstp_client_state_cb(sstp_client_st *client, sstp_state_t event);
+
+
+/*!
+ * @brief Connect to the best ranked server not yet tried
+ */
+static void sstp_client_connect_next(sstp_client_st *client);
+
+
+/*!
+ * @brief Setup the standby connection
+ */
+static status_t sstp_client_standby_init(sstp_client_st *client);
+
+
+/*!
+ * @brief Prepare the stream to carry the data
+ */
+static void sstp_client_stream_tune(sstp_client_st *client)
+{
+    /* Share the event loop fairly with pppd */
+    sstp_stream_setsched(client->stream, client->sched);
+
+    /* Have the kernel busy poll the device queue for us */
+    if (client->option.busy_poll && SSTP_OKAY != sstp_set_busypoll(
+            sstp_stream_sock(client->stream), client->option.busy_poll))
+    {
+        log_warn("Could not enable busy polling on the socket");
+    }
+}
+
+
+/*!
+ * @brief Release the resources of a failed connection
+ */
+static void sstp_client_dispose(sstp_client_st *client)
+{
+    if (client->http)
+    {
+        sstp_http_free(client->http);
+        client->http = NULL;
+    }
+
+    if (client->state)
+    {
+        sstp_state_free(client->state);
+        client->state = NULL;
+    }
+
+    if (client->stream)
+    {
+        sstp_stream_abort(client->stream);
+        sstp_stream_destroy(client->stream);
+        client->stream = NULL;
+    }
+}
+
+
+/*!
+ * @brief Connect to the next server once we are back in the event loop
+ */
+static void sstp_client_reconnect(sstp_client_st *client, int budget)
+{
+    client->failover = 0;
+
+    /* Dispose of the failed connection */
+    sstp_client_dispose(client);
+
+    /* The standby connection was kept to the previous server */
+    if (client->standby && !client->option.standby)
+    {
+        sstp_standby_free(client->standby);
+        client->standby = NULL;
+    }
+
+    sstp_client_connect_next(client);
+}
+
+
+/*!
+ * @brief The connection failed, try the next server or give up
+ */
+static void sstp_client_fail(sstp_client_st *client, int code, 
+        const char *message)
+{
+    /* Only a single server to connect to */
+    if (!client->select)
+    {
+        sstp_die("%s", code, message);
+    }
+
+    /* Already moving on to the next server */
+    if (client->failover)
+    {
+        return;
+    }
+
+    log_warn("%s", message);
+    sstp_select_result(client->select, SSTP_FAIL);
+
+    /* Hold on to the frames from pppd until the new stream is connected */
+    if (client->pppd)
+    {
+        sstp_pppd_rebind(client->pppd, NULL);
+    }
+
+    client->failover = 1;
+    sstp_sched_defer(client->sched, SSTP_SCHED_CONTROL, (sstp_sched_fn)
+            sstp_client_reconnect, client);
+}
+
+
+/*!
+ * @brief Replace the failed stream with the standby connection
+ */
+static void sstp_client_failover(sstp_client_st *client, int budget)
+{
+    sstp_stream_st *stream = NULL;
+    status_t status = SSTP_FAIL;
+
+    client->failover = 0;
+
+    /* Take over the standby connection */
+    stream = sstp_standby_promote(client->standby);
+    if (!stream)
+    {
+        sstp_die("Connection was aborted, no standby connection available", -1);
+    }
+
+    /* Dispose of the failed connection */
+    sstp_client_dispose(client);
+    client->stream = stream;
+    sstp_client_stream_tune(client);
+
+    log_info("Failing over to standby connection at %s", 
+            sstp_standby_server(client->standby));
+
+    /* Now we need to start the state-machine */
+    status = sstp_state_create(&client->state, client->stream, (sstp_state_change_fn)
+            sstp_client_state_cb, client, SSTP_MODE_CLIENT);
+    if (SSTP_OKAY != status)
+    {
+        sstp_die("Could not create state machine", -1);
+    }
+
+    /* Set the bounds of the keep-alive */
+    sstp_client_keepalive(client);
 
-    case SSTP_PPP_AUTH:
+    /* Send the Call Connect request right away */
+    status = sstp_state_start(client->state);
+    if (SSTP_FAIL == status)
     {
-        uint8_t skey[16];
-        uint8_t rkey[16];
+        sstp_die("Could not start the state machine", -1);
+    }
+}
 
-        /* Get the MPPE keys */
-        ret = sstp_chap_mppe_get(sstp_pppd_getchap(client->pppd), 
-                client->option.password, skey, rkey, 0); 
-        if (SSTP_FAIL == ret)
-        {
-            return;
-        }
 
-        /* Set the keys */
-        sstp_state_mppe_keys(client->state, skey, 16, rkey, 16);
-        break;
+/*!
+ * @brief Fail over once we are back in the event loop
+ *
+ * @retval 1 if the fail-over was scheduled, 0 if there is no standby.
+ */
+static int sstp_client_failover_schedule(sstp_client_st *client)
+{
+    if (client->failover)
+    {
+        return 1;
     }
 
-    default:
-        
-        break;
+    if (!client->standby || !sstp_standby_ready(client->standby))
+    {
+        return 0;
     }
 
-    return;
+    /* Hold on to the frames from pppd until the new stream is connected */
+    if (client->pppd)
+    {
+        sstp_pppd_rebind(client->pppd, NULL);
+    }
+
+    client->failover = 1;
+    sstp_sched_defer(client->sched, SSTP_SCHED_CONTROL, (sstp_sched_fn)
+            sstp_client_failover, client);
+    return 1;
 }
 
 
-/*!
- * @brief Called when the state machine transitions
- */
 static void sstp_client_state_cb(sstp_client_st *client, sstp_state_t event)
 {
     int ret = 0;
@@ -138,22 +739,43 @@ static void sstp_client_state_cb(sstp_client_st *client, sstp_state_t event)
     {
     case SSTP_CALL_CONNECT:
 
-        /* Create the PPP context */
-        ret = sstp_pppd_create(&client->pppd, client->ev_base, client->stream, 
-                (sstp_pppd_fn) sstp_client_pppd_cb, client);
-        if (SSTP_OKAY != ret)
+        /* Measure the round-trip time, no need for pppd */
+        if (client->option.ping > 0)
+        {
+            timeval_st tv = { 1, 0 };
+
+            log_info("Sending %d Echo-Requests to %s", client->option.ping,
+                    client->host.name);
+            event_add(client->ev_ping, &tv);
+            break;
+        }
+
+        /* Size the frames to the path, once pppd gets started */
+        if ((client->option.enable & SSTP_OPT_AUTOMTU) && !client->mtu)
         {
-            sstp_die("Could not initialize PPP daemon", -1);
+            sstp_client_mtu(client);
+            if (client->pppd)
+            {
+                log_warn("The MTU/MRU does not apply to pppd started early");
+            }
         }
 
-        /* Start the pppd daemon */
-        ret = sstp_pppd_start(client->pppd, &client->option, 
-                sstp_event_sockname(client->event));
-        if (SSTP_OKAY != ret)
+        /* Keep the running pppd across a fail-over, or started early */
+        if (client->pppd)
         {
-            sstp_die("Could not start PPP daemon", -1);
+            sstp_pppd_rebind(client->pppd, client->stream);
+            sstp_state_set_forward(client->state, (sstp_state_forward_fn) 
+                    sstp_pppd_send, client->pppd);
+
+            log_info((client->sandbox)
+                    ? "Renegotiating PPP Link"
+                    : "Started PPP Link Negotiation");
+            break;
         }
 
+        /* Create the PPP context and start pppd */
+        sstp_client_pppd_start(client, client->stream);
+
         /* Set the forwarder function */
         sstp_state_set_forward(client->state, (sstp_state_forward_fn) 
                 sstp_pppd_send, client->pppd);
@@ -165,23 +787,65 @@ static void sstp_client_state_cb(sstp_client_st *client, sstp_state_t event)
 
         log_info("Connection Established");
         
-        /* Enter the privilege separation directory */
-        if (getuid() == 0)
+        /* Enter the privilege separation directory, still able to install
+         * and remove the split-tunnel and server routes later on */
+        if (!client->sandbox && getuid() == 0)
         {
             ret = sstp_sandbox(client->option.priv_dir, 
                     client->option.priv_user, 
-                    client->option.priv_group);
+                    client->option.priv_group,
+                    client->rset || client->route_ctx);
             if (ret != 0) 
             {
                 log_warn("Could not enter privilege directory");
             }
         }
+        client->sandbox = 1;
+
+        /* Remember the server that worked for us */
+        if (client->select)
+        {
+            sstp_select_result(client->select, SSTP_OKAY);
+        }
+
+        /* Keep the standby connection to this server, unless specified */
+        if ((client->option.enable & SSTP_OPT_STANDBY) && !client->standby)
+        {
+            ret = sstp_client_standby_init(client);
+            if (SSTP_OKAY != ret)
+            {
+                log_warn("Could not setup the standby connection");
+            }
+        }
+
+        /* Warm up the standby connection */
+        if (client->standby && !sstp_standby_ready(client->standby))
+        {
+            sstp_standby_start(client->standby);
+        }
 
         break;
 
     case SSTP_CALL_ABORT:
     default:
 
+        /* Fail over to the standby connection if we have one */
+        if (sstp_client_failover_schedule(client))
+        {
+            log_warn("Connection was aborted, %s", 
+                    sstp_state_reason(client->state));
+            break;
+        }
+
+        /* Fail over to the next server in the list */
+        if (client->select)
+        {
+            log_warn("Connection was aborted, %s", 
+                    sstp_state_reason(client->state));
+            sstp_client_fail(client, -1, "Could not connect to the server");
+            break;
+        }
+
 	if (client->pppd) 
         {
 	    sstp_pppd_stop(client->pppd);
@@ -202,7 +866,8 @@ static void sstp_client_http_done(sstp_client_st *client, int status)
 
     if (SSTP_OKAY != status)
     {
-        sstp_die("HTTP handshake with server failed", -1);
+        sstp_client_fail(client, -1, "HTTP handshake with server failed");
+        return;
     }
 
     /* Free the handshake data */
@@ -222,11 +887,17 @@ static void sstp_client_http_done(sstp_client_st *client, int status)
     if (SSTP_OKAY != status)
     {
         if (!(SSTP_OPT_CERTWARN & client->option.enable))
-            sstp_die("Verification of server certificate failed", -2);
+        {
+            sstp_client_fail(client, -2, "Verification of server certificate failed");
+            return;
+        }
         
         log_warn("Server certificated failed verification, ignoring");
     }
 
+    /* Setup the stream for data */
+    sstp_client_stream_tune(client);
+
     /* Now we need to start the state-machine */
     status = sstp_state_create(&client->state, client->stream, (sstp_state_change_fn)
             sstp_client_state_cb, client, SSTP_MODE_CLIENT);
@@ -235,6 +906,9 @@ static void sstp_client_http_done(sstp_client_st *client, int status)
         sstp_die("Could not create state machine", -1);
     }
 
+    /* Set the bounds of the keep-alive */
+    sstp_client_keepalive(client);
+
     /* Kick off the state machine */
     status = sstp_state_start(client->state);
     if (SSTP_FAIL == status)
@@ -254,7 +928,8 @@ static void sstp_client_connected(sstp_stream_st *stream, sstp_buff_st *buf,
 
     if (SSTP_CONNECTED != status)
     {
-        sstp_die("Could not complete connect to the client", -1);
+        sstp_client_fail(client, -1, "Could not complete connect to the client");
+        return;
     }
 
     /* Success! */
@@ -320,7 +995,8 @@ static void sstp_client_proxy_done(sstp_client_st *client, int status)
 
         /* Reconnect to the proxy (now with credentials set) */
         ret = sstp_stream_connect(client->stream, &client->host.addr, client->host.alen,
-                (sstp_complete_fn) sstp_client_proxy_connected, client, 10);
+                (sstp_complete_fn) sstp_client_proxy_connected, client, 
+                sstp_tune()->connect_timeout);
         break;
 
     case SSTP_OKAY:
@@ -412,8 +1088,15 @@ static status_t sstp_client_connect(sstp_client_st *client,
         goto done;
     }
 
+    /* Take the path to the server as reference */
+    if (client->monitor && SSTP_OKAY != sstp_monitor_watch(client->monitor, addr))
+    {
+        log_warn("Could not look up the route to the server");
+    }
+
     /* Have the stream connect */
-    ret = sstp_stream_connect(client->stream, addr, alen, (sstp_complete_fn) complete_cb, client, 10);
+    ret = sstp_stream_connect(client->stream, addr, alen, (sstp_complete_fn) complete_cb, client, 
+            sstp_tune()->connect_timeout);
     if (SSTP_INPROG != ret && 
         SSTP_OKAY   != ret)
     {
@@ -545,6 +1228,253 @@ done:
 }
 
 
+/*!
+ * @brief Add a route to the server we are connecting to
+ */
+static status_t sstp_client_route(sstp_client_st *client)
+{
+    status_t status = SSTP_FAIL;
+    int ret = 0;
+
+    if (!client->route_ctx)
+    {
+        ret = sstp_route_init(&client->route_ctx);
+        if (SSTP_OKAY != ret)
+        {
+            log_err("Could not initialize route module");
+            goto done;
+        }
+    }
+
+    /* Remove the route to the previous server */
+    if (client->route_saved)
+    {
+        sstp_route_delete(client->route_ctx, &client->route);
+        client->route_saved = 0;
+    }
+
+    ret = sstp_route_get(client->route_ctx, &client->host.addr,
+            &client->route);
+    if (ret != 0)
+    {
+        log_err("Could not get server route");
+        goto done;
+    }
+
+    ret = sstp_route_replace(client->route_ctx, &client->route);
+    if (ret != 0)
+    {
+        log_err("Could not replace server route");
+        goto done;
+    }
+
+    /* Success! */
+    client->route_saved = 1;
+    status = SSTP_OKAY;
+
+done:
+
+    return status;
+}
+
+
+/*!
+ * @brief Connect to the same server again over the new path
+ */
+static void sstp_client_rejoin(sstp_client_st *client, int budget)
+{
+    status_t ret = SSTP_FAIL;
+
+    client->failover = 0;
+
+    /* Dispose of the connection over the previous path */
+    sstp_client_dispose(client);
+
+    ret = sstp_client_connect(client, &client->host.addr, client->host.alen);
+    if (SSTP_OKAY != ret)
+    {
+        sstp_client_fail(client, -1, "Could not reconnect to the server");
+    }
+}
+
+
+/*!
+ * @brief The route to the server moved, refresh the server route and 
+ *  reconnect before the old path times out
+ */
+static void sstp_client_moved(sstp_client_st *client, const char *ifname)
+{
+    status_t ret = SSTP_FAIL;
+
+    /* Already moving on to another connection */
+    if (client->failover)
+    {
+        return;
+    }
+
+    log_info("The route to %s moved to %s, reconnecting", 
+            client->host.name, ifname);
+
+    if (client->route_saved)
+    {
+        ret = sstp_client_route(client);
+        if (SSTP_OKAY != ret)
+        {
+            log_warn("Could not refresh the server route");
+        }
+    }
+
+    /* Hold on to the frames from pppd until the new stream is connected */
+    if (client->pppd)
+    {
+        sstp_pppd_rebind(client->pppd, NULL);
+    }
+
+    client->failover = 1;
+    sstp_sched_defer(client->sched, SSTP_SCHED_CONTROL, (sstp_sched_fn)
+            sstp_client_rejoin, client);
+}
+
+
+static void sstp_client_connect_next(sstp_client_st *client)
+{
+    struct sockaddr *addr = NULL;
+    const char *server = NULL;
+    const char *host   = NULL;
+    int alen = 0;
+    int ret  = 0;
+
+    while (SSTP_OKAY == sstp_select_next(client->select, &server, &host,
+            &addr, &alen))
+    {
+        client->option.server = (char*) server;
+
+        /* Via proxy, client->host is the proxy server */
+        if (!client->option.proxy)
+        {
+            memset(&client->host, 0, sizeof(client->host));
+            strncpy(client->host.name, host, sizeof(client->host.name) - 1);
+            memcpy(&client->host.addr, addr, MIN(alen, sizeof(client->host.addr)));
+            client->host.alen = alen;
+
+            /* Add a server route if we are asked to */
+            if (client->option.enable & SSTP_OPT_SAVEROUTE)
+            {
+                ret = sstp_client_route(client);
+                if (SSTP_OKAY != ret)
+                {
+                    log_warn("Could not add route to %s", host);
+                }
+            }
+        }
+
+        /* Connect to the server */
+        ret = sstp_client_connect(client, &client->host.addr, 
+                client->host.alen);
+        if (SSTP_OKAY == ret)
+        {
+            return;
+        }
+
+        sstp_client_dispose(client);
+        sstp_select_result(client->select, SSTP_FAIL);
+    }
+
+    sstp_die("Could not connect to any of the servers", -1);
+}
+
+
+/*!
+ * @brief Called when all the servers are probed
+ */
+static void sstp_client_select_done(sstp_client_st *client)
+{
+    sstp_client_connect_next(client);
+}
+
+
+static status_t sstp_client_standby_init(sstp_client_st *client)
+{
+    sstp_url_st *url = NULL;
+    status_t status  = SSTP_FAIL;
+    int ret = 0;
+
+    /* We can't keep the proxy connection warm */
+    if (client->option.proxy)
+    {
+        log_warn("Standby connection is not supported via proxy server");
+        return SSTP_OKAY;
+    }
+
+    /* Parse the standby server, default to the same server */
+    ret = sstp_url_parse(&url, (client->option.standby)
+            ? client->option.standby
+            : client->option.server);
+    if (SSTP_OKAY != ret)
+    {
+        log_err("Could not parse the standby server URL");
+        goto done;
+    }
+
+    /* Lookup the standby server, or use the server we connected to */
+    if (client->option.standby)
+    {
+        ret = sstp_client_lookup(url, &client->standby_host);
+        if (SSTP_OKAY != ret)
+        {
+            goto done;
+        }
+    }
+    else
+    {
+        memcpy(&client->standby_host, &client->host, sizeof(client->host));
+    }
+
+    /* Add a route to the standby server as well */
+    if (client->route_ctx && memcmp(&client->host.addr, 
+            &client->standby_host.addr, sizeof(client->host.addr)))
+    {
+        ret = sstp_route_get(client->route_ctx, &client->standby_host.addr,
+                &client->standby_route);
+        if (ret != 0)
+        {
+            log_err("Could not get standby server route");
+            goto done;
+        }
+
+        ret = sstp_route_replace(client->route_ctx, &client->standby_route);
+        if (ret != 0)
+        {
+            log_err("Could not replace standby server route");
+            goto done;
+        }
+
+        client->standby_saved = 1;
+    }
+
+    /* Create the standby context, it's started once we are established */
+    ret = sstp_standby_create(&client->standby, client->ev_base, 
+            client->ssl_ctx, &client->option, url->host, 
+            &client->standby_host.addr, client->standby_host.alen);
+    if (SSTP_OKAY != ret)
+    {
+        goto done;
+    }
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+    
+    if (url)
+    {
+        sstp_url_free(url);
+    }
+
+    return status;
+}
+
+
 /*!
  * @brief Initialize the sstp-client 
  */
@@ -553,24 +1483,84 @@ static status_t sstp_client_init(sstp_client_st *client, sstp_option_st *opts)
     int retval = SSTP_FAIL;
     int status = 0;
 
-    /* Initialize the event library */
-    client->ev_base = event_base_new();
-    if (!client->ev_base)
+    /* Initialize the event library */
+    client->ev_base = event_base_new();
+    if (!client->ev_base)
+    {
+        log_err("Could not initialize event base");
+        goto done;
+    }
+
+    /* Initialize the SSL context, cert store, etc */
+    status = sstp_init_ssl(client, opts);
+    if (SSTP_OKAY != status)
+    {
+        log_err("Could not initialize secure socket layer");
+        goto done;
+    }
+    
+    /* Keep a copy of the options */
+    memcpy(&client->option, opts, sizeof(client->option));
+
+    /* Create the scheduler */
+    status = sstp_sched_create(&client->sched, client->ev_base);
+    if (SSTP_OKAY != status)
+    {
+        log_err("Could not initialize the scheduler");
+        goto done;
+    }
+
+    /* Create the flow accounting */
+    if (SSTP_OPT_FLOWS & opts->enable)
+    {
+        status = sstp_flow_create(&client->flow);
+        if (SSTP_OKAY != status)
+        {
+            log_err("Could not initialize the flow accounting");
+            goto done;
+        }
+    }
+
+    /* Dump the statistics on SIGUSR1 */
+    client->ev_stats = event_new(client->ev_base, SIGUSR1, EV_SIGNAL | 
+            EV_PERSIST, (event_fn) sstp_client_stats, client);
+    if (!client->ev_stats)
     {
-        log_err("Could not initialize event base");
+        log_err("Could not setup statistics signal");
         goto done;
     }
+    event_add(client->ev_stats, NULL);
 
-    /* Initialize the SSL context, cert store, etc */
-    status = sstp_init_ssl(client, opts);
-    if (SSTP_OKAY != status)
+    /* Reload the configuration on SIGHUP, unless pppd hangs up on us */
+    if (!(SSTP_OPT_NOLAUNCH & opts->enable))
+    {
+        client->ev_reload = event_new(client->ev_base, SIGHUP, EV_SIGNAL | 
+                EV_PERSIST, (event_fn) sstp_client_reload, client);
+        if (!client->ev_reload)
+        {
+            log_err("Could not setup reload signal");
+            goto done;
+        }
+        event_add(client->ev_reload, NULL);
+    }
+
+    /* Toggle the cycle accounting on SIGUSR2 */
+    client->ev_cycle = event_new(client->ev_base, SIGUSR2, EV_SIGNAL | 
+            EV_PERSIST, (event_fn) sstp_client_cycle, client);
+    if (!client->ev_cycle)
+    {
+        log_err("Could not setup cycle accounting signal");
+        goto done;
+    }
+    event_add(client->ev_cycle, NULL);
+
+    /* The ping timer */
+    client->ev_ping = event_new(client->ev_base, -1, 0, (event_fn) 
+            sstp_client_ping, client);
+    if (!client->ev_ping)
     {
-        log_err("Could not initialize secure socket layer");
         goto done;
     }
-    
-    /* Keep a copy of the options */
-    memcpy(&client->option, opts, sizeof(client->option));
 
     /* Success! */
     retval = SSTP_OKAY;
@@ -593,6 +1583,49 @@ static void sstp_client_free(sstp_client_st *client)
         client->stream = NULL;
     }
 
+    /* Release the server selection */
+    if (client->select)
+    {
+        sstp_select_free(client->select);
+        client->select = NULL;
+    }
+
+    /* Remove the signal and ping events */
+    if (client->ev_stats)
+    {
+        event_del(client->ev_stats);
+        event_free(client->ev_stats);
+        client->ev_stats = NULL;
+    }
+
+    if (client->ev_cycle)
+    {
+        event_del(client->ev_cycle);
+        event_free(client->ev_cycle);
+        client->ev_cycle = NULL;
+    }
+
+    if (client->ev_reload)
+    {
+        event_del(client->ev_reload);
+        event_free(client->ev_reload);
+        client->ev_reload = NULL;
+    }
+
+    if (client->ev_ping)
+    {
+        event_del(client->ev_ping);
+        event_free(client->ev_ping);
+        client->ev_ping = NULL;
+    }
+
+    /* Close the standby connection */
+    if (client->standby)
+    {
+        sstp_standby_free(client->standby);
+        client->standby = NULL;
+    }
+
     /* Shutdown the SSL context */
     if (client->ssl_ctx)
     {
@@ -600,6 +1633,13 @@ static void sstp_client_free(sstp_client_st *client)
         client->ssl_ctx = NULL;
     }
 
+    /* Remove the split-tunnel routes while the interface is up */
+    if (client->rset)
+    {
+        sstp_rset_free(client->rset);
+        client->rset = NULL;
+    }
+
     /* Close the PPPD layer */
     if (client->pppd)
     {
@@ -614,6 +1654,13 @@ static void sstp_client_free(sstp_client_st *client)
         client->event = NULL;
     }
 
+    /* Stop watching the routes, before the route context */
+    if (client->monitor)
+    {
+        sstp_monitor_free(client->monitor);
+        client->monitor = NULL;
+    }
+
     /* Free the route context */
     if (client->route_ctx)
     {
@@ -621,6 +1668,20 @@ static void sstp_client_free(sstp_client_st *client)
         client->route_ctx = NULL;
     }
 
+    /* Free the flow accounting, after pppd */
+    if (client->flow)
+    {
+        sstp_flow_free(client->flow);
+        client->flow = NULL;
+    }
+
+    /* Free the scheduler, after the stream and pppd */
+    if (client->sched)
+    {
+        sstp_sched_free(client->sched);
+        client->sched = NULL;
+    }
+
     /* Free the options */
     sstp_option_free(&client->option);
 
@@ -629,11 +1690,90 @@ static void sstp_client_free(sstp_client_st *client)
 }
 
 
+/*!
+ * @brief Spin on the descriptors of pppd and the server until either is
+ *  ready, or the busy poll time has passed
+ */
+static void sstp_client_spin(sstp_client_st *client)
+{
+    struct pollfd fds[2];
+    timeval_st end;
+    timeval_st now;
+    int count = 0;
+
+    /* Work is queued for this turn of the event loop, don't hold it up */
+    if ((client->sched && sstp_sched_pending(client->sched)) ||
+        (client->stream && sstp_stream_queued(client->stream)) ||
+        (client->pppd && sstp_pppd_unsent(client->pppd) > 0))
+    {
+        return;
+    }
+
+    if (client->stream)
+    {
+        fds[count].fd       = sstp_stream_sock(client->stream);
+        fds[count++].events = POLLIN;
+    }
+
+    if (client->pppd)
+    {
+        fds[count].fd       = sstp_pppd_sock(client->pppd);
+        fds[count++].events = POLLIN;
+    }
+
+    gettimeofday(&end, NULL);
+    end.tv_usec += client->option.busy_poll;
+    end.tv_sec  += end.tv_usec / 1000000;
+    end.tv_usec %= 1000000;
+
+    do
+    {
+        if (poll(fds, count, 0) != 0)
+        {
+            break;
+        }
+
+        gettimeofday(&now, NULL);
+
+    } while (timercmp(&now, &end, <));
+}
+
+
+/*!
+ * @brief Run the event loop, busy polling before we sleep if enabled
+ */
+static int sstp_client_dispatch(sstp_client_st *client)
+{
+    int ret = 0;
+
+    if (!client->option.busy_poll)
+    {
+        return event_base_dispatch(client->ev_base);
+    }
+
+    while (!client->stop)
+    {
+        /* Avoid the wake-up latency of sleeping in the kernel */
+        sstp_client_spin(client);
+
+        ret = event_base_loop(client->ev_base, EVLOOP_ONCE);
+        if (ret != 0)
+        {
+            /* No more events is a normal exit */
+            return (ret < 0) ? ret : 0;
+        }
+    }
+
+    return 0;
+}
+
+
 void sstp_signal_cb(int signal)
 {
     log_err("Terminating on %s (%d)", 
             strsignal(signal), signal);
 
+    client.stop = 1;
     event_base_loopbreak(client.ev_base);
 }
 
@@ -668,6 +1808,14 @@ status_t sstp_signal_init(void)
         goto done;
     }
 
+    /* Broken connections are handled where they are written */
+    act.sa_handler = SIG_IGN;
+    ret = sigaction(SIGPIPE, &act, NULL);
+    if (ret)
+    {
+        goto done;
+    }
+
     /* Success */
     status = SSTP_OKAY;
 
@@ -677,12 +1825,97 @@ done:
 }
 
 
+/*!
+ * @brief Load test the server with many sessions, without pppd
+ */
+static int sstp_client_load(sstp_client_st *client)
+{
+    sstp_option_st *opts = &client->option;
+    sstp_load_st *load = NULL;
+    int ret = 0;
+
+    if (opts->proxy || opts->nservers > 1)
+    {
+        sstp_die("The load test connects to a single server, without proxy", -1);
+    }
+
+    /* The sessions authenticate themselves */
+    if (!opts->user || !opts->password)
+    {
+        sstp_die("The username and password must be specified", -1);
+    }
+
+    ret = sstp_url_parse(&client->url, opts->server);
+    if (SSTP_OKAY != ret)
+    {
+        sstp_die("Could not parse the server URL", -1);
+    }
+
+    ret = sstp_client_lookup(client->url, &client->host);
+    if (SSTP_OKAY != ret)
+    {
+        sstp_die("Could not lookup host: `%s'", -1, client->url->host);
+    }
+
+    ret = sstp_load_create(&load, client->ev_base, client->ssl_ctx, opts,
+            client->host.name, &client->host.addr, client->host.alen);
+    if (SSTP_OKAY != ret)
+    {
+        sstp_die("Could not start the load test", -1);
+    }
+
+    /* Runs until the time is up, or we are interrupted */
+    ret = event_base_dispatch(client->ev_base);
+    if (ret < 0)
+    {
+        sstp_die("The event loop terminated unsuccessfully", -1);
+    }
+
+    sstp_load_report(load);
+    sstp_load_free(load);
+    sstp_client_free(client);
+    return EXIT_SUCCESS;
+}
+
+
+/*!
+ * @brief Replay a recorded session, without server or pppd
+ */
+static int sstp_client_replay(sstp_client_st *client)
+{
+    sstp_replay_st *replay = NULL;
+    int ret = 0;
+
+    ret = sstp_replay_create(&replay, client->ev_base, client->sched,
+            &client->option);
+    if (SSTP_OKAY != ret)
+    {
+        sstp_die("Could not replay %s", -1, client->option.replay);
+    }
+
+    /* Runs until the recording is replayed, or we are interrupted */
+    ret = event_base_dispatch(client->ev_base);
+    if (ret < 0)
+    {
+        sstp_die("The event loop terminated unsuccessfully", -1);
+    }
+
+    ret = sstp_replay_report(replay);
+    sstp_replay_free(replay);
+    sstp_client_free(client);
+    return (SSTP_OKAY == ret)
+        ? EXIT_SUCCESS
+        : EXIT_FAILURE;
+}
+
+
 /*!
  * @brief The main application entry-point
  */
 int main(int argc, char *argv[])
 {
     sstp_option_st option;
+    char tunables[512];
     int ret = 0;
 
     /* Reset the memory */
@@ -709,6 +1942,29 @@ int main(int argc, char *argv[])
         sstp_die("Could not parse input arguments", -1);
     }
 
+    /* Record the tunables in effect */
+    log_debug("Tunables: %s", sstp_tune_print(tunables, sizeof(tunables)));
+
+    /* Pin ourselves to the given cores */
+    if (option.cpus)
+    {
+        ret = sstp_set_affinity(0, option.cpus);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_die("Could not set the CPU affinity", -1);
+        }
+    }
+
+    /* Run with real-time priority, inherited by pppd */
+    if (option.realtime)
+    {
+        ret = sstp_set_realtime(option.realtime);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_die("Could not set the real-time priority", -1);
+        }
+    }
+
     /* Check if we can access the runtime directory */
     if (access(SSTP_RUNTIME_DIR, F_OK))
     {
@@ -734,12 +1990,22 @@ int main(int argc, char *argv[])
 
 #ifndef HAVE_PPP_PLUGIN
     /* In non-plugin mode, username and password must be specified */
-    if (!option.password || !option.user)
+    if (!option.ping && !option.replay && (!option.password || !option.user))
     {
         sstp_die("The username and password must be specified", -1);
     }
 #endif /* #ifndef HAVE_PPP_PLUGIN */
 
+    /* Fork the other links of the bundle, each connects on its own */
+    if (option.links > 1)
+    {
+        ret = sstp_link_spawn(&option);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_die("Could not start the links of the bundle", -1);
+        }
+    }
+
     /* Initialize the client */
     ret = sstp_client_init(&client, &option);
     if (SSTP_OKAY != ret)
@@ -747,6 +2013,38 @@ int main(int argc, char *argv[])
         sstp_die("Could not initialize the client", -1);
     }
 
+    /* Apply the log, keep-alive and scheduler settings */
+    sstp_client_apply(&client);
+
+    /* Load test the server, no pppd */
+    if (option.load > 0)
+    {
+        return sstp_client_load(&client);
+    }
+
+    /* Replay a recorded session, no server or pppd */
+    if (option.replay)
+    {
+        return sstp_client_replay(&client);
+    }
+
+    /* Record the session, to replay it later */
+    if (option.record)
+    {
+        ret = sstp_record_open(option.record, option.server);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_die("Could not record the session to %s", -1, option.record);
+        }
+    }
+
+    /* Carry on with the links left, should one of them exit */
+    ret = sstp_link_watch(client.ev_base);
+    if (SSTP_OKAY != ret)
+    {
+        sstp_die("Could not watch the links of the bundle", -1);
+    }
+
     /* Create the event notification callback */
     if (!(option.enable & SSTP_OPT_NOPLUGIN))
     {
@@ -756,6 +2054,71 @@ int main(int argc, char *argv[])
         {
             sstp_die("Could not setup notification", -1);
         }
+
+        sstp_event_setlink(client.event, (sstp_event_link_fn) 
+                sstp_client_link, &client);
+    }
+
+    /* Load the split-tunnel routes, while we can read the file */
+    if (option.route_file)
+    {
+        int line = 0;
+
+        ret = sstp_rset_create(&client.rset, client.ev_base);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_die("Could not create the route set", -1);
+        }
+
+        ret = sstp_rset_load(client.rset, option.route_file, &line);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_die("Could not load the routes from %s, line %d", -1,
+                    option.route_file, line);
+        }
+
+        log_info("Loaded %d split-tunnel routes from %s", 
+                sstp_rset_count(client.rset), option.route_file);
+
+        if (!client.event)
+        {
+            log_warn("The split-tunnel routes need the sstp-plugin");
+        }
+        else
+        {
+            sstp_event_setipup(client.event, (sstp_event_ipup_fn) 
+                    sstp_client_ipup, &client);
+        }
+    }
+
+    /* Reconnect as soon as the path to the server changes */
+    if (option.enable & SSTP_OPT_MONITOR)
+    {
+        if (!client.route_ctx && sstp_route_init(&client.route_ctx))
+        {
+            sstp_die("Could not initialize route module", -1);
+        }
+
+        ret = sstp_monitor_create(&client.monitor, client.ev_base, 
+                client.route_ctx, (sstp_monitor_fn) sstp_client_moved, &client);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_die("Could not monitor the route to the server", -1);
+        }
+
+        /* Learn the interface of the tunnel */
+        if (client.event)
+        {
+            sstp_event_setipup(client.event, (sstp_event_ipup_fn) 
+                    sstp_client_ipup, &client);
+        }
+    }
+
+    /* Start pppd while we connect, it's off the critical path */
+    if (option.enable & SSTP_OPT_EARLYPPPD)
+    {
+        sstp_client_pppd_start(&client, NULL);
+        log_info("Started pppd ahead of the connection");
     }
 
     /* Connect to the proxy first */
@@ -768,7 +2131,7 @@ int main(int argc, char *argv[])
             sstp_die("Could not parse the proxy URL", -1);
         }
     }
-    else
+    else if (option.nservers == 1)
     {
         ret = sstp_url_parse(&client.url, option.server);
         if (SSTP_OKAY != ret)
@@ -778,45 +2141,73 @@ int main(int argc, char *argv[])
     }
 
     /* Lookup the URL of the proxy server */
-    ret = sstp_client_lookup(client.url, &client.host);
-    if (SSTP_OKAY != ret)
-    {
-        sstp_die("Could not lookup host: `%s'", -1, client.url->host);
-    }
-
-    /* Connect to the server */
-    ret = sstp_client_connect(&client, &client.host.addr, 
-            client.host.alen);
-    if (SSTP_FAIL == ret)
+    if (client.url)
     {
-        sstp_die("Could not connect to `%s'", -1, client.host.name);
+        ret = sstp_client_lookup(client.url, &client.host);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_die("Could not lookup host: `%s'", -1, client.url->host);
+        }
     }
 
-    /* Add a server route if we are asked to */
-    if (option.enable & SSTP_OPT_SAVEROUTE)
+    /* Select among the servers */
+    if (option.nservers > 1)
     {
-        ret = sstp_route_init(&client.route_ctx);
+        ret = sstp_select_create(&client.select, client.ev_base, 
+                client.ssl_ctx, &client.option);
         if (SSTP_OKAY != ret)
         {
-            sstp_die("Could not initialize route module", -1);
+            sstp_die("Could not setup server selection", -1);
         }
 
-        ret = sstp_route_get(client.route_ctx, &client.host.addr,
-                &client.route);
-        if (ret != 0)
+        /* Servers can't be probed through the proxy, use the ranking */
+        if (option.proxy)
+        {
+            sstp_client_connect_next(&client);
+        }
+        else
+        {
+            ret = sstp_select_probe(client.select, (sstp_select_done_fn)
+                    sstp_client_select_done, &client, SSTP_SELECT_TIMEOUT);
+            if (SSTP_OKAY != ret)
+            {
+                sstp_client_connect_next(&client);
+            }
+        }
+    }
+    else
+    {
+        /* Connect to the server */
+        ret = sstp_client_connect(&client, &client.host.addr, 
+                client.host.alen);
+        if (SSTP_FAIL == ret)
         {
-            sstp_die("Could not get server route", -1);
+            sstp_die("Could not connect to `%s'", -1, client.host.name);
         }
 
-        ret = sstp_route_replace(client.route_ctx, &client.route);
-        if (ret != 0)
+        /* Add a server route if we are asked to */
+        if (option.enable & SSTP_OPT_SAVEROUTE)
         {
-          sstp_die("Could not replace server route", -1);
+            ret = sstp_client_route(&client);
+            if (SSTP_OKAY != ret)
+            {
+                sstp_die("Could not add the server route", -1);
+            }
         }
     }
     
+    /* Prepare the standby connection, otherwise setup once connected */
+    if (option.standby)
+    {
+        ret = sstp_client_standby_init(&client);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_die("Could not setup the standby connection", -1);
+        }
+    }
+
     /* Wait for the connect to finish and then continue */
-    ret = event_base_dispatch(client.ev_base);
+    ret = sstp_client_dispatch(&client);
     if (ret != 0)
     {
         sstp_die("The event loop terminated unsuccessfully", -1);
@@ -841,15 +2232,33 @@ int main(int argc, char *argv[])
     }
 
     /* Remove the server route */
-    if (option.enable & SSTP_OPT_SAVEROUTE)
+    if (client.route_ctx)
     {
-        ret = sstp_route_delete(client.route_ctx, &client.route);
-        if (SSTP_OKAY != ret)
+        if (client.route_saved)
+        {
+            ret = sstp_route_delete(client.route_ctx, &client.route);
+            if (SSTP_OKAY != ret)
+            {
+                log_warn("Could not remove the server route");
+            }
+        }
+
+        if (client.standby_saved)
         {
-            log_warn("Could not remove the server route");
+            ret = sstp_route_delete(client.route_ctx, &client.standby_route);
+            if (SSTP_OKAY != ret)
+            {
+                log_warn("Could not remove the standby server route");
+            }
         }
     }
 
+    /* Flush the recording */
+    sstp_record_close();
+
+    /* Take the bundle down with us */
+    sstp_link_stop();
+
     /* Release allocated resources */
     sstp_client_free(&client);
     return EXIT_SUCCESS;
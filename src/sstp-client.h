@@ -82,6 +82,66 @@ typedef struct
     /*! The route context */
     sstp_route_ctx_st *route_ctx;
 
+    /*! Did we add a route to the server */
+    int route_saved;
+
+    /*! The split-tunnel routes, if any */
+    sstp_rset_st *rset;
+
+    /*! The link and route monitor, if enabled */
+    sstp_monitor_st *monitor;
+
+    /*! The server selection, if more than one server */
+    sstp_select_st *select;
+
+    /*! The standby server peer */
+    sstp_peer_st standby_host;
+
+    /*! The standby connection, if enabled */
+    sstp_standby_st *standby;
+
+    /*! The route to the standby server (if other than server) */
+    sstp_route_st standby_route;
+
+    /*! Did we add a route to the standby server */
+    int standby_saved;
+
+    /*! A fail-over to the standby connection is pending */
+    int failover;
+
+    /*! Have we entered the privilege separation directory */
+    int sandbox;
+
+    /*! The MTU/MRU sized to the path to the server, if enabled */
+    int mtu;
+
+    /*! The bytes on the wire of a frame of mtu bytes */
+    int mtu_wire;
+
+    /*! The scheduler of uplink, downlink and control work */
+    sstp_sched_st *sched;
+
+    /*! The flow accounting, if enabled */
+    sstp_flow_ctx_st *flow;
+
+    /*! The statistics dump on SIGUSR1 */
+    event_st *ev_stats;
+
+    /*! Toggle the cycle accounting on SIGUSR2 */
+    event_st *ev_cycle;
+
+    /*! Reload the configuration on SIGHUP */
+    event_st *ev_reload;
+
+    /*! The ping timer */
+    event_st *ev_ping;
+
+    /*! The number of Echo-Requests sent in ping mode */
+    int ping_sent;
+
+    /*! The event loop should terminate */
+    int stop;
+
     /*! The SSL context */
     SSL_CTX *ssl_ctx;
 
@@ -0,0 +1,164 @@
+/*!
+ * @brief Account the CPU cycles spent per stage of the data path
+ *
+ * @file sstp-cycle.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define SSTP_CYCLE_UNIT     "cycles"
+#else
+#define SSTP_CYCLE_UNIT     "ns"
+#endif
+
+#include "sstp-private.h"
+
+
+/*!
+ * @brief The counters of a stage
+ */
+typedef struct
+{
+    /*< The cycles spent */
+    uint64_t cycles;
+
+    /*< The bytes moved */
+    uint64_t bytes;
+
+    /*< The number of calls that moved data */
+    uint64_t calls;
+
+} sstp_cycle_st;
+
+
+/*!
+ * @brief The cycle accounting
+ */
+static struct
+{
+    /*< The counters per stage */
+    sstp_cycle_st stage[SSTP_CYCLE_MAX];
+
+    /*< The accounting is running */
+    int enabled;
+
+    /*< The time the accounting started */
+    time_t started;
+
+} sstp_cycle;
+
+
+/*!
+ * @brief Read the time stamp counter, or the monotonic clock (ns)
+ */
+static uint64_t sstp_cycle_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+
+uint64_t sstp_cycle_start(void)
+{
+    return (sstp_cycle.enabled)
+        ? sstp_cycle_now()
+        : 0;
+}
+
+
+void sstp_cycle_stop(sstp_cycle_stage_t stage, uint64_t start, int bytes)
+{
+    sstp_cycle_st *ctx = &sstp_cycle.stage[stage];
+
+    /* Started before the accounting was enabled */
+    if (!start || !sstp_cycle.enabled)
+    {
+        return;
+    }
+
+    ctx->cycles += sstp_cycle_now() - start;
+    if (bytes > 0)
+    {
+        ctx->bytes += bytes;
+        ctx->calls++;
+    }
+}
+
+
+void sstp_cycle_enable(int enable)
+{
+    if (enable)
+    {
+        memset(sstp_cycle.stage, 0, sizeof(sstp_cycle.stage));
+        sstp_cycle.started = time(NULL);
+    }
+
+    sstp_cycle.enabled = enable;
+}
+
+
+int sstp_cycle_enabled(void)
+{
+    return sstp_cycle.enabled;
+}
+
+
+void sstp_cycle_dump(void)
+{
+    static const char *names[SSTP_CYCLE_MAX] =
+    {
+        "pty read", "HDLC decode", "trace", "SSL_write", "sock send",
+        "sock recv", "SSL_read", "trace", "HDLC encode", "pty write"
+    };
+    sstp_cycle_st *ctx = NULL;
+    int i = 0;
+
+    log_info("Cycle accounting over the last %ld seconds, in %s",
+            (long) (time(NULL) - sstp_cycle.started), SSTP_CYCLE_UNIT);
+
+    for (i = 0; i < SSTP_CYCLE_MAX; i++)
+    {
+        ctx = &sstp_cycle.stage[i];
+        if (!ctx->cycles)
+        {
+            continue;
+        }
+
+        log_info("  %-8s %-12s %llu calls, %llu bytes, %.1f/byte, "
+                "%.0f/call", (i < SSTP_CYCLE_SOCK_RECV) ? "uplink" : 
+                "downlink", names[i], 
+                (unsigned long long) ctx->calls,
+                (unsigned long long) ctx->bytes,
+                ctx->bytes ? (double) ctx->cycles / ctx->bytes : 0.0,
+                ctx->calls ? (double) ctx->cycles / ctx->calls : 0.0);
+    }
+}
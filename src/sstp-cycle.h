@@ -0,0 +1,87 @@
+/*!
+ * @brief Account the CPU cycles spent per stage of the data path
+ *
+ * @file sstp-cycle.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_CYCLE_H__
+#define __SSTP_CYCLE_H__
+
+#include <stdint.h>
+
+
+/*!
+ * @brief The stages of the data path, uplink then downlink
+ */
+typedef enum
+{
+    SSTP_CYCLE_PTY_READ     = 0,
+    SSTP_CYCLE_DECODE       = 1,
+    SSTP_CYCLE_TRACE_SEND   = 2,
+    SSTP_CYCLE_SSL_WRITE    = 3,
+    SSTP_CYCLE_SOCK_SEND    = 4,
+    SSTP_CYCLE_SOCK_RECV    = 5,
+    SSTP_CYCLE_SSL_READ     = 6,
+    SSTP_CYCLE_TRACE_RECV   = 7,
+    SSTP_CYCLE_ENCODE       = 8,
+    SSTP_CYCLE_PTY_WRITE    = 9,
+    SSTP_CYCLE_MAX          = 10,
+
+} sstp_cycle_stage_t;
+
+
+/*!
+ * @brief Start timing a stage
+ *
+ * @retval The cycle counter, or 0 if the accounting is disabled
+ */
+uint64_t sstp_cycle_start(void);
+
+
+/*!
+ * @brief Account the cycles since sstp_cycle_start() to @a stage
+ *
+ * @par Note:
+ *  A call that moved no @a bytes, e.g. a read that would block, adds its
+ *  cycles but is not counted as a call.
+ */
+void sstp_cycle_stop(sstp_cycle_stage_t stage, uint64_t start, int bytes);
+
+
+/*!
+ * @brief Start the accounting from scratch, or stop it
+ */
+void sstp_cycle_enable(int enable);
+
+
+/*!
+ * @brief Check if the accounting is running
+ */
+int sstp_cycle_enabled(void);
+
+
+/*!
+ * @brief Log the cycles per byte and per call of each stage
+ */
+void sstp_cycle_dump(void);
+
+
+#endif /* #ifndef __SSTP_CYCLE_H__ */
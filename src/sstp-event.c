@@ -24,6 +24,7 @@
 
 #include <config.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -34,12 +35,24 @@
 #include <sys/un.h>
 #include <unistd.h>
 #include <netdb.h>
+#include <arpa/inet.h>
 #include <sstp-api.h>
 
 #include "sstp-private.h"
 #include "sstp-client.h"
 
 
+/*< The longest message we take from the plugin, and the replies we hold */
+#define SSTP_EVENT_BUFSZ        1024
+
+/*< The longest MPPE key we take */
+#define SSTP_EVENT_KEYLEN       32
+
+
+struct sstp_event_conn;
+typedef struct sstp_event_conn sstp_event_conn_st;
+
+
 /*!
  * @brief The event notification context structure
  */
@@ -58,43 +71,217 @@ struct sstp_event
     void *arg;
 
     /*! The receive key */
-    sstp_api_attr_st *rkey;
+    uint8_t rkey[SSTP_EVENT_KEYLEN];
+
+    /*! The length of the receive key */
+    size_t rlen;
 
     /*! The send key */
-    sstp_api_attr_st *skey;
+    uint8_t skey[SSTP_EVENT_KEYLEN];
+
+    /*! The length of the send key */
+    size_t slen;
+
+    /*! Called when the interface is up */
+    sstp_event_ipup_fn ipup_cb;
+
+    /*! The argument to pass ipup_cb */
+    void *ipup_arg;
+
+    /*! Called as pppd brings the link up and down */
+    sstp_event_link_fn link_cb;
+
+    /*! The argument to pass link_cb */
+    void *link_arg;
+
+    /*! The event base */
+    event_base_st *base;
 
     /*! Event listener */
     event_st *ev_event;
+
+    /*! The timing probe of the listener */
+    sstp_probe_st probe;
+
+    /*! The longest we wait for the rest of a message, or a reply to go */
+    struct timeval timeout;
+
+    /*! The connections accepted */
+    sstp_event_conn_st *conns;
+};
+
+
+/*!
+ * @brief A connection from sstp-plugin, or any other user of the API
+ *
+ * @par Note:
+ *  The plugin keeps its connection for as long as pppd runs, others
+ *  may connect for a single message.
+ */
+struct sstp_event_conn
+{
+    /*! The event context */
+    sstp_event_st *ctx;
+
+    /*! The socket */
+    int sock;
+
+    /*! Reads the messages */
+    event_st *ev_read;
+
+    /*! Sends the replies the socket didn't take at once */
+    event_st *ev_write;
+
+    /*! The timing probe of the reader */
+    sstp_probe_st probe;
+
+    /*! The timing probe of the writer */
+    sstp_probe_st wr_probe;
+
+    /*! The messages received */
+    unsigned char ibuf[SSTP_EVENT_BUFSZ];
+
+    /*! The number of bytes received */
+    int ilen;
+
+    /*! The replies not yet sent */
+    unsigned char obuf[SSTP_EVENT_BUFSZ];
+
+    /*! The number of bytes not yet sent */
+    int olen;
+
+    /*! The next connection */
+    sstp_event_conn_st *next;
 };
 
 
-static int sstp_event_auth(sstp_event_st *ctx, int sock, 
+/*!
+ * @brief Close a connection, and forget about it
+ */
+static void sstp_event_close(sstp_event_conn_st *conn)
+{
+    sstp_event_conn_st **iter = &conn->ctx->conns;
+
+    while (*iter && *iter != conn)
+    {
+        iter = &(*iter)->next;
+    }
+
+    if (*iter)
+    {
+        *iter = conn->next;
+    }
+
+    event_free(conn->ev_read);
+    event_free(conn->ev_write);
+    close(conn->sock);
+    free(conn);
+}
+
+
+/*!
+ * @brief Send what we can of the replies, without blocking
+ */
+static status_t sstp_event_flush(sstp_event_conn_st *conn)
+{
+    int ret = 0;
+
+    while (conn->olen > 0)
+    {
+        ret = send(conn->sock, conn->obuf, conn->olen, MSG_NOSIGNAL);
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                event_add(conn->ev_write, &conn->ctx->timeout);
+                return SSTP_INPROG;
+            }
+
+            log_warn("Could not reply message back to pppd, %s (%d)", 
+                strerror(errno), errno);
+            return SSTP_FAIL;
+        }
+
+        conn->olen -= ret;
+        memmove(conn->obuf, conn->obuf + ret, conn->olen);
+    }
+
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief The socket takes more of the replies
+ */
+static void sstp_event_send(int fd, short event, sstp_event_conn_st *conn)
+{
+    if (event & EV_TIMEOUT)
+    {
+        log_warn("Timed out replying message back to pppd");
+        sstp_event_close(conn);
+        return;
+    }
+
+    if (SSTP_FAIL == sstp_event_flush(conn))
+    {
+        sstp_event_close(conn);
+    }
+}
+
+
+/*!
+ * @brief Queue a reply, and send it if nothing is ahead of it
+ */
+static status_t sstp_event_reply(sstp_event_conn_st *conn, 
         sstp_api_msg_st *msg)
 {
-    char *buff = NULL;
-    int cnt    = (SSTP_API_ATTR_MAX+1);
-    int ret    = SSTP_OKAY;
-    int retval = SSTP_FAIL;
-    sstp_api_attr_st *list[SSTP_API_ATTR_MAX+1];
-    
-    /* Allocate buffer on stack */
-    buff = alloca(msg->msg_len);
-    if (!buff)
+    int len = sstp_api_msg_len(msg);
+
+    if (conn->olen + len > (int) sizeof(conn->obuf))
     {
-        log_err("Could not read the length");
-        goto done;
+        log_warn("Could not reply message back to pppd, it's not reading");
+        return SSTP_FAIL;
     }
 
-    /* Read the remainder of the payload */
-    ret = read(sock, buff, msg->msg_len);
-    if (ret < 0 || ret != msg->msg_len)
+    memcpy(conn->obuf + conn->olen, msg, len);
+    conn->olen += len;
+
+    /* The rest goes when the socket takes it */
+    if (conn->olen > len)
     {
-        log_err("Could not read the payload");
-        goto done;
+        return SSTP_OKAY;
     }
 
+    return (SSTP_FAIL == sstp_event_flush(conn))
+        ? SSTP_FAIL
+        : SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Acknowledge a message
+ */
+static status_t sstp_event_ack(sstp_event_conn_st *conn)
+{
+    unsigned char buff[sizeof(sstp_api_msg_st)];
+
+    return sstp_event_reply(conn, sstp_api_msg_new(buff, 
+            SSTP_API_MSG_ACK));
+}
+
+
+static int sstp_event_auth(sstp_event_st *ctx, sstp_event_conn_st *conn,
+        sstp_api_msg_st *msg)
+{
+    int cnt    = (SSTP_API_ATTR_MAX+1);
+    int ret    = SSTP_OKAY;
+    int retval = SSTP_FAIL;
+    sstp_api_attr_st *list[SSTP_API_ATTR_MAX+1];
+    sstp_api_attr_st *skey = NULL;
+    sstp_api_attr_st *rkey = NULL;
+
     /* Parse the Attribute */
-    ret = sstp_api_attr_parse(buff, msg->msg_len, list, cnt);
+    ret = sstp_api_attr_parse((char*) msg->msg_data, msg->msg_len, list, cnt);
     if (ret != 0)
     {
         log_err("Could not parse attributes");
@@ -102,36 +289,32 @@ static int sstp_event_auth(sstp_event_st *ctx, int sock,
     }
 
     /* Check for SEND KEY */
-    ctx->skey = list[SSTP_API_ATTR_MPPE_SEND];
-    if (!ctx->skey)
+    skey = list[SSTP_API_ATTR_MPPE_SEND];
+    if (!skey || skey->attr_len > sizeof(ctx->skey))
     {
         log_err("Missing attribute MPPE SEND");
         goto done;
     }
 
     /* Check for RECV KEY */
-    ctx->rkey = list[SSTP_API_ATTR_MPPE_RECV];
-    if (!ctx->rkey)
+    rkey = list[SSTP_API_ATTR_MPPE_RECV];
+    if (!rkey || rkey->attr_len > sizeof(ctx->rkey))
     {
         log_err("Missing attribute MPPE RECV");
         goto done;
     }
 
+    /* Keep the keys, the message goes with the buffer */
+    memcpy(ctx->skey, skey->attr_data, skey->attr_len);
+    ctx->slen = skey->attr_len;
+    memcpy(ctx->rkey, rkey->attr_data, rkey->attr_len);
+    ctx->rlen = rkey->attr_len;
+
     /* Success */
     ctx->event_cb(ctx->arg, SSTP_OKAY);
 
-    /* Prepare the ACK */
-    sstp_api_msg_new((unsigned char*)msg, SSTP_API_MSG_ACK);
-
     /* ACK the message */
-    ret = send(sock, msg, sizeof(*msg), 0);
-    if (ret < 0 || ret != sizeof(*msg))
-    {
-        log_warn("Could not reply message back to pppd");
-    }
-
-    /* Success */
-    retval = SSTP_OKAY;
+    retval = sstp_event_ack(conn);
 
 done:
 
@@ -139,12 +322,10 @@ done:
 }
 
 
-static int sstp_event_addr(sstp_event_st *ctx, int sock, 
+static int sstp_event_addr(sstp_event_st *ctx, sstp_event_conn_st *conn,
         sstp_api_msg_st *msg)
 {
     unsigned char buff[255];
-    int ret    = SSTP_OKAY;
-    int retval = SSTP_FAIL;
     sstp_client_st *client = (sstp_client_st*) ctx->arg;
     
     /* Prepare the ACK */
@@ -161,99 +342,330 @@ static int sstp_event_addr(sstp_event_st *ctx, int sock,
             &client->host.addr);
 
     /* ACK the message */
-    ret = send(sock, msg, msg->msg_len + sizeof(*msg), 0);
-    if (ret <= 0 || ret != (msg->msg_len + sizeof(*msg)))
+    return sstp_event_reply(conn, msg);
+}
+
+
+/*!
+ * @brief Format the IPCP address of an attribute, if any
+ */
+static const char *sstp_event_addrstr(sstp_api_attr_st *attr, char *buf,
+        int len)
+{
+    if (!attr || attr->attr_len != sizeof(struct in_addr))
     {
-        log_warn("Could not reply message back to pppd");
+        return "unknown";
     }
 
-    /* Success */
-    retval = SSTP_OKAY;
-    return retval;
+    return inet_ntop(AF_INET, attr->attr_data, buf, len);
 }
 
 
-static void sstp_event_accept(int fd, short event, sstp_event_st *ctx)
+static int sstp_event_ipup(sstp_event_st *ctx, sstp_event_conn_st *conn,
+        sstp_api_msg_st *msg)
 {
-    int sock = (-1);
-    int len  = ( 0);
+    int cnt    = (SSTP_API_ATTR_MAX+1);
+    int ret    = SSTP_OKAY;
+    int retval = SSTP_FAIL;
+    sstp_api_attr_st *list[SSTP_API_ATTR_MAX+1];
+    sstp_api_attr_st *attr = NULL;
+    char local[INET_ADDRSTRLEN];
+    char remote[INET_ADDRSTRLEN];
+    char ifname[32];
 
-    sstp_api_msg_st msg;
-    sstp_api_msg_t  type;
+    /* Parse the Attribute */
+    ret = sstp_api_attr_parse((char*) msg->msg_data, msg->msg_len, list, cnt);
+    if (ret != 0)
+    {
+        log_err("Could not parse attributes");
+        goto done;
+    }
 
-    /* Accept the incoming socket */
-    sock = accept(fd, NULL, NULL);
-    if (sock < 0)
+    /* Check for the interface name */
+    attr = list[SSTP_API_ATTR_IFNAME];
+    if (!attr || attr->attr_len >= sizeof(ifname))
     {
-        log_err("Unable to accept connection on socket, %s (%d)", 
-            strerror(errno), errno);
+        log_err("Missing attribute interface name");
         goto done;
     }
 
-    log_info("Received callback from sstp-plugin");
+    memcpy(ifname, attr->attr_data, attr->attr_len);
+    ifname[attr->attr_len] = '\0';
+
+    /* The addresses IPCP settled on, older plugins don't send them */
+    log_info("Interface %s is up, local address %s, remote address %s", 
+            ifname, 
+            sstp_event_addrstr(list[SSTP_API_ATTR_LOCAL], local, 
+                sizeof(local)),
+            sstp_event_addrstr(list[SSTP_API_ATTR_REMOTE], remote, 
+                sizeof(remote)));
+
+    /* Success */
+    retval = SSTP_OKAY;
 
-    /* Read the header from the plugin */
-    len = read(sock, &msg, sizeof(msg));
-    if (len < 0 || len != sizeof(msg))
+done:
+
+    /* Always ACK the message, older plugins give up without it */
+    if (SSTP_OKAY != sstp_event_ack(conn))
     {
-        log_err("Could not read the header of the message: %d, %s (%d)", 
-            len, strerror(errno), errno);
-        goto done;
+        return SSTP_FAIL;
+    }
+
+    if (SSTP_OKAY == retval && ctx->ipup_cb)
+    {
+        ctx->ipup_cb(ctx->ipup_arg, ifname);
+    }
+
+    return SSTP_OKAY;
+}
+
+
+static int sstp_event_link(sstp_event_st *ctx, sstp_event_conn_st *conn,
+        sstp_event_link_t ev)
+{
+    if (SSTP_OKAY != sstp_event_ack(conn))
+    {
+        return SSTP_FAIL;
+    }
+
+    if (ctx->link_cb)
+    {
+        ctx->link_cb(ctx->link_arg, ev);
     }
 
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Handle a whole message from the connection
+ */
+static int sstp_event_dispatch(sstp_event_st *ctx, sstp_event_conn_st *conn,
+        sstp_api_msg_st *msg)
+{
+    sstp_api_msg_t type;
+
     /* Validate message header */
-    if (sstp_api_msg_type(&msg, &type))
+    if (sstp_api_msg_type(msg, &type))
     {
         log_err("Invalid Message");
-        goto done;
+        return SSTP_FAIL;
     }
 
     switch (type)
     {
     /* Receive the MPPE keys */
     case SSTP_API_MSG_AUTH:
-        sstp_event_auth(ctx, sock, &msg);
-        break;
+        return sstp_event_auth(ctx, conn, msg);
 
     /* Return the IP Address and Gateway */
     case SSTP_API_MSG_ADDR:
-        sstp_event_addr(ctx, sock, &msg);
-        break;
+        return sstp_event_addr(ctx, conn, msg);
+
+    /* The interface is up */
+    case SSTP_API_MSG_IPUP:
+        return sstp_event_ipup(ctx, conn, msg);
+
+    /* LCP is up, the plugin reports on the link from here on */
+    case SSTP_API_MSG_LCPUP:
+        return sstp_event_link(ctx, conn, SSTP_EVENT_LCPUP);
+
+    /* The link went down */
+    case SSTP_API_MSG_DOWN:
+        return sstp_event_link(ctx, conn, SSTP_EVENT_DOWN);
 
     default:
+        log_debug("Ignoring message %d from sstp-plugin", type);
         break;
     }
 
-    
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Receive what the connection has for us, and handle each whole
+ *  message as it completes
+ */
+static void sstp_event_recv(int fd, short event, sstp_event_conn_st *conn)
+{
+    sstp_event_st *ctx = conn->ctx;
+    int off = 0;
+    int len = 0;
+
+    if (event & EV_TIMEOUT)
+    {
+        log_warn("Timed out waiting for the rest of the message from pppd");
+        goto close;
+    }
+
+    len = read(fd, conn->ibuf + conn->ilen, sizeof(conn->ibuf) - conn->ilen);
+    if (len < 0)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        {
+            return;
+        }
+
+        log_err("Could not read the message: %s (%d)", strerror(errno), 
+            errno);
+        goto close;
+    }
+
+    if (len == 0)
+    {
+        log_debug("sstp-plugin closed the connection");
+        goto close;
+    }
+
+    conn->ilen += len;
+
+    /* Handle each of the whole messages */
+    while ((len = sstp_api_msg_frame(conn->ibuf + off, conn->ilen - off)) > 0)
+    {
+        if (SSTP_OKAY != sstp_event_dispatch(ctx, conn, 
+                (sstp_api_msg_st*) (conn->ibuf + off)))
+        {
+            goto close;
+        }
+
+        off += len;
+    }
+
+    if (len < 0)
+    {
+        log_err("Invalid Message");
+        goto close;
+    }
+
+    /* Keep the start of the next */
+    conn->ilen -= off;
+    memmove(conn->ibuf, conn->ibuf + off, conn->ilen);
+
+    if (conn->ilen == sizeof(conn->ibuf))
+    {
+        log_err("The message from sstp-plugin is too long");
+        goto close;
+    }
+
+    /* Wait for the rest of a message only so long */
+    event_add(conn->ev_read, (conn->ilen > 0)
+            ? &ctx->timeout
+            : NULL);
+    return;
+
+close:
+
+    sstp_event_close(conn);
+}
+
+
+static void sstp_event_accept(int fd, short event, sstp_event_st *ctx)
+{
+    sstp_event_conn_st *conn = NULL;
+    int sock = (-1);
+
+    /* Accept the incoming socket */
+    sock = accept(fd, NULL, NULL);
+    if (sock < 0)
+    {
+        log_err("Unable to accept connection on socket, %s (%d)", 
+            strerror(errno), errno);
+        goto done;
+    }
+
+    /* Never wait on pppd */
+    if (fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK))
+    {
+        log_err("Could not set the connection non-blocking");
+        goto done;
+    }
+
+    conn = calloc(1, sizeof(sstp_event_conn_st));
+    if (!conn)
+    {
+        log_err("Could not allocate memory for the connection");
+        goto done;
+    }
+
+    conn->ctx  = ctx;
+    conn->sock = sock;
+    conn->ev_read = event_new(ctx->base, sock, EV_READ | EV_PERSIST, 
+            (event_fn) sstp_probe_call, SSTP_PROBE(&conn->probe, 
+                sstp_event_recv, conn));
+    conn->ev_write = event_new(ctx->base, sock, EV_WRITE, 
+            (event_fn) sstp_probe_call, SSTP_PROBE(&conn->wr_probe, 
+                sstp_event_send, conn));
+    if (!conn->ev_read || !conn->ev_write)
+    {
+        log_err("Could not create the events of the connection");
+        goto done;
+    }
+
+    log_info("Received callback from sstp-plugin");
+
+    event_add(conn->ev_read, NULL);
+    conn->next = ctx->conns;
+    ctx->conns = conn;
+
+    /* Success! */
+    conn = NULL;
+    sock = -1;
+
 done:
  
+    if (conn)
+    {
+        if (conn->ev_read)
+        {
+            event_free(conn->ev_read);
+        }
+
+        if (conn->ev_write)
+        {
+            event_free(conn->ev_write);
+        }
+
+        free(conn);
+    }
+
     /* Close the client socket */
-    if (sock > 0)
+    if (sock >= 0)
     {
         close(sock);
     }
-
-    event_add(ctx->ev_event, NULL);
 }
 
 
 status_t sstp_event_mppe_result(sstp_event_st *ctx, uint8_t **skey, 
         size_t *slen, uint8_t **rkey, size_t *rlen)
 {
-    sstp_api_attr_st *key = NULL;
-    
-    key = ctx->skey;
-    *skey = key->attr_data;
-    *slen = key->attr_len;
+    *skey = ctx->skey;
+    *slen = ctx->slen;
 
-    key = ctx->rkey;
-    *rkey = key->attr_data;
-    *rlen = key->attr_len;
+    *rkey = ctx->rkey;
+    *rlen = ctx->rlen;
 
     return SSTP_OKAY;
 }
 
 
+void sstp_event_setipup(sstp_event_st *ctx, sstp_event_ipup_fn ipup_cb,
+        void *arg)
+{
+    ctx->ipup_cb  = ipup_cb;
+    ctx->ipup_arg = arg;
+}
+
+
+void sstp_event_setlink(sstp_event_st *ctx, sstp_event_link_fn link_cb,
+        void *arg)
+{
+    ctx->link_cb  = link_cb;
+    ctx->link_arg = arg;
+}
+
+
 const char *sstp_event_sockname(sstp_event_st *ctx)
 {
     return ctx->sockname;
@@ -332,11 +744,15 @@ status_t sstp_event_create(sstp_event_st **ctx, sstp_option_st *opts,
     obj->sock     = sock;
     obj->arg      = arg;
     obj->event_cb = event_cb;
+    obj->base     = base;
+    obj->timeout.tv_sec  = SSTP_API_MSG_TIMEOUT / 1000;
+    obj->timeout.tv_usec = SSTP_API_MSG_TIMEOUT % 1000 * 1000;
     strncpy(obj->sockname, addr.sun_path, sizeof(obj->sockname));
 
     /* Configure a event object for accept socket */
-    obj->ev_event = event_new(base, sock, EV_READ, (event_fn) 
-            sstp_event_accept, obj);
+    obj->ev_event = event_new(base, sock, EV_READ | EV_PERSIST, 
+            (event_fn) sstp_probe_call,
+            SSTP_PROBE(&obj->probe, sstp_event_accept, obj));
 
     /* Add a read event for accept */
     event_add(obj->ev_event, NULL);
@@ -379,6 +795,12 @@ void sstp_event_free(sstp_event_st *ctx)
         ctx->sock = -1;
     }
 
+    /* Close the connections */
+    while (ctx->conns)
+    {
+        sstp_event_close(ctx->conns);
+    }
+
     /* Remove event listener */
     event_del(ctx->ev_event);
     event_free(ctx->ev_event);
@@ -35,13 +35,56 @@ typedef struct sstp_event sstp_event_st;
 typedef void (*sstp_event_fn)(void *ctx, int status);
 
 
+/*!
+ * @brief A callback function for when pppd brought the interface up
+ */
+typedef void (*sstp_event_ipup_fn)(void *ctx, const char *ifname);
+
+
+/*!
+ * @brief The events of the link reported by sstp-plugin
+ */
+typedef enum
+{
+    SSTP_EVENT_LCPUP = 1,
+    SSTP_EVENT_DOWN  = 2,
+
+} sstp_event_link_t;
+
+
+/*!
+ * @brief A callback function for when pppd brings the link up or down
+ */
+typedef void (*sstp_event_link_fn)(void *ctx, sstp_event_link_t ev);
+
+
 /*!
  * @brief Create an event to listen for callback
+ *
+ * @par Note:
+ *  The plugin holds its connection for the life of pppd, and neither
+ *  side blocks on the other: the messages are read and replied to as
+ *  the socket allows, and a connection stalling mid-message for more
+ *  than SSTP_API_MSG_TIMEOUT is closed.
  */
 status_t sstp_event_create(sstp_event_st **ctx, sstp_option_st *opts,
         event_base_st *base, sstp_event_fn event_cb, void *arg);
 
 
+/*!
+ * @brief Have @a ipup_cb called each time pppd brings the interface up
+ */
+void sstp_event_setipup(sstp_event_st *ctx, sstp_event_ipup_fn ipup_cb,
+        void *arg);
+
+
+/*!
+ * @brief Have @a link_cb called as pppd brings the link up and down
+ */
+void sstp_event_setlink(sstp_event_st *ctx, sstp_event_link_fn link_cb,
+        void *arg);
+
+
 /*! 
  * @brief Get the socket name for the callback
  */
@@ -0,0 +1,600 @@
+/*!
+ * @brief Account the traffic inside the tunnel per flow and protocol
+ *
+ * @file sstp-flow.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "sstp-private.h"
+
+
+/*!
+ * @brief The flow accounting context
+ */
+struct sstp_flow
+{
+    /*< The flows tracked */
+    sstp_flow_st flow[SSTP_FLOW_MAX];
+
+    /*< The hash of each flow, to skip the flows that can't match */
+    uint32_t hash[SSTP_FLOW_MAX];
+
+    /*< The number of flows tracked */
+    int count;
+
+    /*< The bytes per direction and PPP protocol */
+    uint64_t bytes[2][SSTP_FLOW_PROTO_MAX];
+};
+
+
+/*!
+ * @brief Map a PPP protocol number to the class we account it to
+ */
+static sstp_flow_proto_t sstp_flow_classify(uint16_t proto)
+{
+    switch (proto)
+    {
+    case 0x0021:
+        return SSTP_FLOW_IP;
+
+    case 0x0057:
+        return SSTP_FLOW_IPV6;
+
+    case 0xc021:
+        return SSTP_FLOW_LCP;
+
+    case 0x8021:
+        return SSTP_FLOW_IPCP;
+
+    case 0x8057:
+        return SSTP_FLOW_IPV6CP;
+
+    case 0x80fd:
+    case 0x80fb:
+        return SSTP_FLOW_CCP;
+
+    case 0xc023:
+    case 0xc223:
+    case 0xc227:
+        return SSTP_FLOW_AUTH;
+
+    default:
+        break;
+    }
+
+    return SSTP_FLOW_OTHER;
+}
+
+
+/*!
+ * @brief FNV-1a hash of the flow key
+ */
+static uint32_t sstp_flow_hash(const sstp_flow_key_st *key)
+{
+    const uint8_t *byte = (const uint8_t*) key;
+    uint32_t hash = 2166136261u;
+    int i = 0;
+
+    for (i = 0; i < sizeof(*key); i++)
+    {
+        hash ^= byte[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+
+/*!
+ * @brief Get the ports of the transport protocols that have them
+ */
+static void sstp_flow_ports(sstp_flow_key_st *key, sstp_flow_dir_t dir,
+        const unsigned char *data, int len)
+{
+    uint16_t sport = 0;
+    uint16_t dport = 0;
+
+    switch (key->proto)
+    {
+    case IPPROTO_TCP:
+    case IPPROTO_UDP:
+    case 132:   /* SCTP */
+    case 136:   /* UDP-Lite */
+        break;
+
+    default:
+        return;
+    }
+
+    if (len < 4)
+    {
+        return;
+    }
+
+    sport = (data[0] << 8) | data[1];
+    dport = (data[2] << 8) | data[3];
+
+    key->lport = (SSTP_FLOW_SEND == dir) ? sport : dport;
+    key->rport = (SSTP_FLOW_SEND == dir) ? dport : sport;
+}
+
+
+/*!
+ * @brief Get the flow key of an IPv4 datagram
+ */
+static status_t sstp_flow_key4(sstp_flow_key_st *key, sstp_flow_dir_t dir,
+        const unsigned char *data, int len)
+{
+    int hlen = 0;
+    int frag = 0;
+
+    if (len < 20 || (data[0] >> 4) != 4)
+    {
+        return SSTP_FAIL;
+    }
+
+    hlen = (data[0] & 0x0f) << 2;
+    if (hlen < 20 || hlen > len)
+    {
+        return SSTP_FAIL;
+    }
+
+    key->family = AF_INET;
+    key->proto  = data[9];
+    memcpy(key->laddr, data + ((SSTP_FLOW_SEND == dir) ? 12 : 16), 4);
+    memcpy(key->raddr, data + ((SSTP_FLOW_SEND == dir) ? 16 : 12), 4);
+
+    /* Only the first fragment has the ports */
+    frag = ((data[6] & 0x1f) << 8) | data[7];
+    if (frag == 0)
+    {
+        sstp_flow_ports(key, dir, data + hlen, len - hlen);
+    }
+
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Get the flow key of an IPv6 datagram
+ */
+static status_t sstp_flow_key6(sstp_flow_key_st *key, sstp_flow_dir_t dir,
+        const unsigned char *data, int len)
+{
+    int next = 0;
+    int off  = 40;
+    int frag = 0;
+
+    if (len < 40 || (data[0] >> 4) != 6)
+    {
+        return SSTP_FAIL;
+    }
+
+    key->family = AF_INET6;
+    memcpy(key->laddr, data + ((SSTP_FLOW_SEND == dir) ?  8 : 24), 16);
+    memcpy(key->raddr, data + ((SSTP_FLOW_SEND == dir) ? 24 :  8), 16);
+
+    /* Skip the extension headers to find the transport protocol */
+    next = data[6];
+    while (off + 8 <= len)
+    {
+        if (next == IPPROTO_HOPOPTS ||
+            next == IPPROTO_ROUTING ||
+            next == IPPROTO_DSTOPTS)
+        {
+            next = data[off];
+            off += (data[off + 1] + 1) << 3;
+            continue;
+        }
+
+        if (next == IPPROTO_FRAGMENT)
+        {
+            frag |= ((data[off + 2] << 8) | data[off + 3]) & 0xfff8;
+            next  = data[off];
+            off  += 8;
+            continue;
+        }
+
+        break;
+    }
+
+    key->proto = next;
+    if (frag == 0 && off < len)
+    {
+        sstp_flow_ports(key, dir, data + off, len - off);
+    }
+
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Add the bytes to the flow, replacing the least busy flow if new
+ */
+static void sstp_flow_update(sstp_flow_ctx_st *ctx, sstp_flow_dir_t dir,
+        sstp_flow_key_st *key, int len)
+{
+    sstp_flow_st *flow = NULL;
+    uint64_t least = 0;
+    uint64_t total = 0;
+    uint32_t hash  = 0;
+    int i = 0;
+
+    hash = sstp_flow_hash(key);
+
+    for (i = 0; i < ctx->count; i++)
+    {
+        if (ctx->hash[i] == hash &&
+            !memcmp(&ctx->flow[i].key, key, sizeof(*key)))
+        {
+            flow = &ctx->flow[i];
+            break;
+        }
+    }
+
+    if (!flow && ctx->count < SSTP_FLOW_MAX)
+    {
+        i = ctx->count++;
+        flow = &ctx->flow[i];
+        memset(flow, 0, sizeof(*flow));
+        flow->key = *key;
+        ctx->hash[i] = hash;
+    }
+
+    /* Take over the least busy flow, and its count as the error */
+    if (!flow)
+    {
+        int victim = 0;
+
+        least = ~0ULL;
+        for (i = 0; i < ctx->count; i++)
+        {
+            flow  = &ctx->flow[i];
+            total = flow->tx_bytes + flow->rx_bytes + flow->error;
+            if (total < least)
+            {
+                least  = total;
+                victim = i;
+            }
+        }
+
+        flow = &ctx->flow[victim];
+        memset(flow, 0, sizeof(*flow));
+        flow->key   = *key;
+        flow->error = least;
+        ctx->hash[victim] = hash;
+    }
+
+    if (SSTP_FLOW_SEND == dir)
+    {
+        flow->tx_bytes += len;
+    }
+    else
+    {
+        flow->rx_bytes += len;
+    }
+}
+
+
+void sstp_flow_account(sstp_flow_ctx_st *ctx, sstp_flow_dir_t dir,
+        const unsigned char *frame, int len)
+{
+    sstp_flow_key_st key;
+    sstp_flow_proto_t type;
+    uint16_t proto = 0;
+    int total = len;
+    int ret   = 0;
+
+    /* Skip the address and control field */
+    if (len >= 2 && frame[0] == 0xff && frame[1] == 0x03)
+    {
+        frame += 2;
+        len   -= 2;
+    }
+
+    if (len < 1)
+    {
+        return;
+    }
+
+    /* The protocol field may be compressed to a single byte */
+    if (frame[0] & 0x01)
+    {
+        proto  = frame[0];
+        frame += 1;
+        len   -= 1;
+    }
+    else
+    {
+        if (len < 2)
+        {
+            return;
+        }
+
+        proto  = (frame[0] << 8) | frame[1];
+        frame += 2;
+        len   -= 2;
+    }
+
+    type = sstp_flow_classify(proto);
+    ctx->bytes[dir][type] += total;
+
+    memset(&key, 0, sizeof(key));
+    switch (type)
+    {
+    case SSTP_FLOW_IP:
+        ret = sstp_flow_key4(&key, dir, frame, len);
+        break;
+
+    case SSTP_FLOW_IPV6:
+        ret = sstp_flow_key6(&key, dir, frame, len);
+        break;
+
+    default:
+        return;
+    }
+
+    if (SSTP_OKAY == ret)
+    {
+        sstp_flow_update(ctx, dir, &key, len);
+    }
+}
+
+
+uint64_t sstp_flow_bytes(sstp_flow_ctx_st *ctx, sstp_flow_dir_t dir,
+        sstp_flow_proto_t proto)
+{
+    return ctx->bytes[dir][proto];
+}
+
+
+const char *sstp_flow_proto_name(sstp_flow_proto_t proto)
+{
+    static const char *names[SSTP_FLOW_PROTO_MAX] =
+    {
+        "IP", "IPv6", "LCP", "IPCP", "IPv6CP", "CCP", "Auth", "Other"
+    };
+
+    return names[proto];
+}
+
+
+/*!
+ * @brief Order the flows by their estimated size, largest first
+ */
+static int sstp_flow_compare(const void *a, const void *b)
+{
+    const sstp_flow_st *fa = a;
+    const sstp_flow_st *fb = b;
+    uint64_t ta = fa->tx_bytes + fa->rx_bytes + fa->error;
+    uint64_t tb = fb->tx_bytes + fb->rx_bytes + fb->error;
+
+    return (ta < tb) ? 1 : (ta > tb) ? -1 : 0;
+}
+
+
+int sstp_flow_top(sstp_flow_ctx_st *ctx, sstp_flow_st *flows, int max)
+{
+    sstp_flow_st sorted[SSTP_FLOW_MAX];
+
+    memcpy(sorted, ctx->flow, ctx->count * sizeof(sstp_flow_st));
+    qsort(sorted, ctx->count, sizeof(sstp_flow_st), sstp_flow_compare);
+
+    if (max > ctx->count)
+    {
+        max = ctx->count;
+    }
+
+    memcpy(flows, sorted, max * sizeof(sstp_flow_st));
+    return max;
+}
+
+
+const char *sstp_flow_name(const sstp_flow_st *flow, char *buf, int len)
+{
+    const sstp_flow_key_st *key = &flow->key;
+    char laddr[INET6_ADDRSTRLEN];
+    char raddr[INET6_ADDRSTRLEN];
+    char proto[16];
+    const char *fmt = (AF_INET6 == key->family)
+            ? "%s [%s]:%u <-> [%s]:%u"
+            : "%s %s:%u <-> %s:%u";
+
+    inet_ntop(key->family, key->laddr, laddr, sizeof(laddr));
+    inet_ntop(key->family, key->raddr, raddr, sizeof(raddr));
+
+    switch (key->proto)
+    {
+    case IPPROTO_TCP:
+        strcpy(proto, "tcp");
+        break;
+
+    case IPPROTO_UDP:
+        strcpy(proto, "udp");
+        break;
+
+    case IPPROTO_ICMP:
+        strcpy(proto, "icmp");
+        break;
+
+    case IPPROTO_ICMPV6:
+        strcpy(proto, "icmpv6");
+        break;
+
+    default:
+        snprintf(proto, sizeof(proto), "ip-%u", key->proto);
+        break;
+    }
+
+    snprintf(buf, len, fmt, proto, laddr, key->lport, raddr, key->rport);
+    return buf;
+}
+
+
+void sstp_flow_free(sstp_flow_ctx_st *ctx)
+{
+    if (ctx)
+    {
+        free(ctx);
+    }
+}
+
+
+status_t sstp_flow_create(sstp_flow_ctx_st **ctx)
+{
+    *ctx = calloc(1, sizeof(sstp_flow_ctx_st));
+    if (!*ctx)
+    {
+        return SSTP_FAIL;
+    }
+
+    return SSTP_OKAY;
+}
+
+
+#ifdef __SSTP_UNIT_TEST_FLOW
+
+/*!
+ * @brief Build a PPP frame with an IPv4 TCP datagram of @a len bytes
+ */
+static int sstp_test_frame4(unsigned char *frame, int len,
+        const char *src, int sport, const char *dst, int dport)
+{
+    unsigned char *ip = frame + 4;
+
+    memset(frame, 0, len + 4);
+    frame[0] = 0xff;
+    frame[1] = 0x03;
+    frame[2] = 0x00;
+    frame[3] = 0x21;
+
+    ip[0] = 0x45;
+    ip[2] = len >> 8;
+    ip[3] = len & 0xff;
+    ip[9] = IPPROTO_TCP;
+    inet_pton(AF_INET, src, ip + 12);
+    inet_pton(AF_INET, dst, ip + 16);
+    ip[20] = sport >> 8;
+    ip[21] = sport & 0xff;
+    ip[22] = dport >> 8;
+    ip[23] = dport & 0xff;
+
+    return len + 4;
+}
+
+
+int main(void)
+{
+    sstp_flow_ctx_st *ctx = NULL;
+    sstp_flow_st top[SSTP_FLOW_REPORT];
+    unsigned char frame[1504];
+    unsigned char v6[64];
+    char addr[32];
+    char name[128];
+    int count = 0;
+    int flen  = 0;
+    int i = 0;
+
+    if (SSTP_OKAY != sstp_flow_create(&ctx))
+    {
+        printf("Could not create the flow context\n");
+        return EXIT_FAILURE;
+    }
+
+    /* One heavy flow hidden among many more flows than we can track */
+    for (i = 0; i < 200; i++)
+    {
+        flen = sstp_test_frame4(frame, 1000, "10.0.0.2", 4711,
+                "10.0.0.1", 80);
+        sstp_flow_account(ctx, SSTP_FLOW_SEND, frame, flen);
+
+        if (i % 2)
+        {
+            flen = sstp_test_frame4(frame, 500, "10.0.0.1", 80,
+                    "10.0.0.2", 4711);
+            sstp_flow_account(ctx, SSTP_FLOW_RECV, frame, flen);
+        }
+
+        snprintf(addr, sizeof(addr), "10.1.%d.%d", i / 250, i % 250);
+        flen = sstp_test_frame4(frame, 100, "10.0.0.2", 5000 + i,
+                addr, 443);
+        sstp_flow_account(ctx, SSTP_FLOW_SEND, frame, flen);
+    }
+
+    /* An LCP Echo-Request, and an IPv6 UDP datagram w/compressed protocol */
+    flen = sstp_test_frame4(frame, 0, "0.0.0.0", 0, "0.0.0.0", 0);
+    frame[2] = 0xc0;
+    sstp_flow_account(ctx, SSTP_FLOW_SEND, frame, 12);
+
+    memset(v6, 0, sizeof(v6));
+    v6[0] = 0x57;
+    v6[1] = 0x60;
+    v6[7] = IPPROTO_UDP;
+    inet_pton(AF_INET6, "fe80::1", v6 +  9);
+    inet_pton(AF_INET6, "ff02::1", v6 + 25);
+    v6[41] = 0x02;
+    v6[42] = 0x22;
+    v6[43] = 0x02;
+    v6[44] = 0x23;
+    sstp_flow_account(ctx, SSTP_FLOW_RECV, v6, 49);
+
+    if (sstp_flow_bytes(ctx, SSTP_FLOW_SEND, SSTP_FLOW_IP) !=
+            200 * (1004 + 104) ||
+        sstp_flow_bytes(ctx, SSTP_FLOW_RECV, SSTP_FLOW_IP) != 100 * 504 ||
+        sstp_flow_bytes(ctx, SSTP_FLOW_SEND, SSTP_FLOW_LCP) != 12 ||
+        sstp_flow_bytes(ctx, SSTP_FLOW_RECV, SSTP_FLOW_IPV6) != 49)
+    {
+        printf("Unexpected protocol counters\n");
+        return EXIT_FAILURE;
+    }
+
+    count = sstp_flow_top(ctx, top, SSTP_FLOW_REPORT);
+    if (count != SSTP_FLOW_REPORT)
+    {
+        printf("Expected %d flows, got %d\n", SSTP_FLOW_REPORT, count);
+        return EXIT_FAILURE;
+    }
+
+    /* Both directions are accounted to the same flow, without error */
+    sstp_flow_name(&top[0], name, sizeof(name));
+    if (strcmp(name, "tcp 10.0.0.2:4711 <-> 10.0.0.1:80") ||
+        top[0].tx_bytes != 200 * 1000 ||
+        top[0].rx_bytes != 100 * 500  ||
+        top[0].error    != 0)
+    {
+        printf("Unexpected top flow: %s\n", name);
+        return EXIT_FAILURE;
+    }
+
+    printf("Successfully found the top flow: %s\n", name);
+
+    sstp_flow_free(ctx);
+    return EXIT_SUCCESS;
+}
+
+#endif /* #ifdef __SSTP_UNIT_TEST_FLOW */
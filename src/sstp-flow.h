@@ -0,0 +1,169 @@
+/*!
+ * @brief Account the traffic inside the tunnel per flow and protocol
+ *
+ * @file sstp-flow.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_FLOW_H__
+#define __SSTP_FLOW_H__
+
+#include <stdint.h>
+
+
+/*< The number of flows tracked, the heaviest flows are kept */
+#define SSTP_FLOW_MAX           32
+
+/*< The number of flows reported with the statistics */
+#define SSTP_FLOW_REPORT        10
+
+
+/*!
+ * @brief The PPP protocols accounted for
+ */
+typedef enum
+{
+    SSTP_FLOW_IP        = 0,
+    SSTP_FLOW_IPV6      = 1,
+    SSTP_FLOW_LCP       = 2,
+    SSTP_FLOW_IPCP      = 3,
+    SSTP_FLOW_IPV6CP    = 4,
+    SSTP_FLOW_CCP       = 5,
+    SSTP_FLOW_AUTH      = 6,
+    SSTP_FLOW_OTHER     = 7,
+    SSTP_FLOW_PROTO_MAX = 8,
+
+} sstp_flow_proto_t;
+
+
+/*!
+ * @brief The direction of the traffic
+ */
+typedef enum
+{
+    SSTP_FLOW_SEND = 0,
+    SSTP_FLOW_RECV = 1,
+
+} sstp_flow_dir_t;
+
+
+/*!
+ * @brief The inner 5-tuple, seen from our side of the tunnel
+ */
+typedef struct
+{
+    /*< AF_INET or AF_INET6 */
+    uint8_t family;
+
+    /*< The IP protocol */
+    uint8_t proto;
+
+    /*< Our port, or zero */
+    uint16_t lport;
+
+    /*< The remote port, or zero */
+    uint16_t rport;
+
+    /*< Our address */
+    uint8_t laddr[16];
+
+    /*< The remote address */
+    uint8_t raddr[16];
+
+} sstp_flow_key_st;
+
+
+/*!
+ * @brief A flow and its counters
+ */
+typedef struct
+{
+    /*< The flow */
+    sstp_flow_key_st key;
+
+    /*< The bytes sent */
+    uint64_t tx_bytes;
+
+    /*< The bytes received */
+    uint64_t rx_bytes;
+
+    /*< The bytes over-counted at most, inherited from an evicted flow */
+    uint64_t error;
+
+} sstp_flow_st;
+
+
+struct sstp_flow;
+typedef struct sstp_flow sstp_flow_ctx_st;
+
+
+/*!
+ * @brief Create the flow accounting context
+ */
+status_t sstp_flow_create(sstp_flow_ctx_st **ctx);
+
+
+/*!
+ * @brief Account a decoded PPP frame
+ *
+ * @par Note:
+ *  The frame may start with the address and control field. IPv4 and IPv6
+ *  datagrams are accounted to their flow, where the least busy flow is
+ *  replaced by a new flow once the table is full (space-saving); any flow
+ *  larger than 1/SSTP_FLOW_MAX of the traffic is guaranteed to be kept.
+ */
+void sstp_flow_account(sstp_flow_ctx_st *ctx, sstp_flow_dir_t dir,
+        const unsigned char *frame, int len);
+
+
+/*!
+ * @brief Get the bytes accounted to a PPP protocol in one direction
+ */
+uint64_t sstp_flow_bytes(sstp_flow_ctx_st *ctx, sstp_flow_dir_t dir,
+        sstp_flow_proto_t proto);
+
+
+/*!
+ * @brief Get the name of a PPP protocol, e.g. "IPv6"
+ */
+const char *sstp_flow_proto_name(sstp_flow_proto_t proto);
+
+
+/*!
+ * @brief Get the busiest flows, busiest first
+ *
+ * @retval The number of flows copied to @a flows
+ */
+int sstp_flow_top(sstp_flow_ctx_st *ctx, sstp_flow_st *flows, int max);
+
+
+/*!
+ * @brief Format a flow as "tcp 10.0.0.2:4711 <-> 10.0.0.1:80"
+ */
+const char *sstp_flow_name(const sstp_flow_st *flow, char *buf, int len);
+
+
+/*!
+ * @brief Release resources associated with the flow accounting
+ */
+void sstp_flow_free(sstp_flow_ctx_st *ctx);
+
+
+#endif /* #ifndef __SSTP_FLOW_H__ */
@@ -134,7 +134,7 @@ status_t sstp_http_create(sstp_http_st **http, const char *server,
     (*http)->mode    = mode;
 
     /* Create the buffer */
-    ret = sstp_buff_create(&(*http)->buf, 8192);
+    ret = sstp_buff_create(&(*http)->buf, sstp_tune()->http_buf);
     if (SSTP_OKAY != ret)
     {
         free(*http);
@@ -248,7 +248,8 @@ static void sstp_http_send_complete(sstp_stream_st *stream, sstp_buff_st *buf,
 
     /* Setup a receiver for HTTP messages */
     sstp_stream_setrecv(stream, sstp_stream_recv, http->buf,
-            (sstp_complete_fn) sstp_recv_hello_complete, http, 60);
+            (sstp_complete_fn) sstp_recv_hello_complete, http,
+            sstp_tune()->recv_timeout);
 }
 
 
@@ -263,7 +264,8 @@ static void sstp_http_send_proxy_complete(sstp_stream_st *stream, sstp_buff_st *
 
     /* Setup a receiver for HTTP messages */
     sstp_stream_setrecv(stream, sstp_stream_recv_plain, http->buf,
-            (sstp_complete_fn) sstp_recv_proxy_complete, http, 60);
+            (sstp_complete_fn) sstp_recv_proxy_complete, http,
+            sstp_tune()->recv_timeout);
 }
 
 /*! 
@@ -311,7 +313,7 @@ static status_t sstp_http_send_hello(sstp_http_st *http,
 
     /* Send the buffer */
     return sstp_stream_send(stream, http->buf, (sstp_complete_fn)
-            sstp_http_send_complete, http, 10);
+            sstp_http_send_complete, http, sstp_tune()->send_timeout);
 }
 
 
@@ -326,7 +328,8 @@ status_t sstp_http_handshake(sstp_http_st *http, sstp_stream_st *stream)
 
         /* Setup a receiver for HTTP messages */
         sstp_stream_setrecv(stream, sstp_stream_recv, http->buf,
-                (sstp_complete_fn) sstp_recv_hello_complete, http, 60);
+                (sstp_complete_fn) sstp_recv_hello_complete, http,
+                sstp_tune()->recv_timeout);
 
         /* Send the sstp hello to the server */
         ret = sstp_http_send_hello(http, stream);
@@ -334,6 +337,9 @@ status_t sstp_http_handshake(sstp_http_st *http, sstp_stream_st *stream)
         {
             break;
         }
+
+        /* Sent in one go, receive the reply into an empty buffer */
+        sstp_http_send_complete(stream, http->buf, http, SSTP_OKAY);
         break;
 
     case SSTP_MODE_SERVER:
@@ -499,7 +505,7 @@ status_t sstp_http_proxy(sstp_http_st *http, sstp_stream_st *stream)
 
     /* Send the HTTP header */
     ret = sstp_stream_send_plain(stream, http->buf, (sstp_complete_fn)
-                sstp_http_send_proxy_complete, http, 10);
+                sstp_http_send_proxy_complete, http, sstp_tune()->send_timeout);
     if (SSTP_OKAY != ret)
     {
         goto done;
@@ -507,7 +513,8 @@ status_t sstp_http_proxy(sstp_http_st *http, sstp_stream_st *stream)
 
     /* Configure the receiver */
     sstp_stream_setrecv(stream, sstp_stream_recv_plain, http->buf,
-            (sstp_complete_fn) sstp_recv_proxy_complete, http, 60);
+            (sstp_complete_fn) sstp_recv_proxy_complete, http,
+            sstp_tune()->recv_timeout);
 done:
     
     return ret;
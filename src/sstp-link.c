@@ -0,0 +1,183 @@
+/*!
+ * @brief Run several connections as the links of a multilink PPP bundle
+ *
+ * @file sstp-link.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "sstp-private.h"
+
+
+/*!
+ * @brief The links forked by the first
+ */
+static struct
+{
+    /*< The process of each link, zero once exited */
+    pid_t pid[SSTP_LINK_MAX];
+
+    /*< The number of links */
+    int count;
+
+    /*< The number of links still running, the first included */
+    int alive;
+
+    /*< Reaps the links that exited */
+    event_st *ev_child;
+
+} sstp_links;
+
+
+status_t sstp_link_spawn(sstp_option_st *opts)
+{
+    char name[64];
+    pid_t pid = 0;
+    int i = 0;
+
+    sstp_links.count = opts->links;
+    sstp_links.alive = 1;
+
+    for (i = 1; i < opts->links; i++)
+    {
+        pid = fork();
+        if (pid < 0)
+        {
+            log_err("Could not fork link %d, %s (%d)", i, strerror(errno),
+                    errno);
+            sstp_link_stop();
+            return SSTP_FAIL;
+        }
+
+        if (pid > 0)
+        {
+            sstp_links.pid[i] = pid;
+            sstp_links.alive++;
+            continue;
+        }
+
+        /* The link keeps the notifications of its pppd to itself */
+        snprintf(name, sizeof(name), "%s.%d", (opts->ipparam)
+                ? opts->ipparam
+                : SSTP_SOCK_NAME, i);
+        if (opts->ipparam)
+        {
+            free(opts->ipparam);
+        }
+        opts->ipparam = strdup(name);
+
+        /* The first link adds the server route for all of them */
+        opts->enable &= ~SSTP_OPT_SAVEROUTE;
+        opts->link = i;
+
+        memset(&sstp_links, 0, sizeof(sstp_links));
+        return SSTP_OKAY;
+    }
+
+    log_info("Started %d links of the bundle", opts->links);
+
+    /* Don't leave the links behind, however we exit */
+    atexit(sstp_link_stop);
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Reap the links that exited
+ */
+static void sstp_link_reap(int sig, short event, void *arg)
+{
+    int status = 0;
+    int i = 0;
+
+    for (i = 1; i < sstp_links.count; i++)
+    {
+        if (sstp_links.pid[i] <= 0 ||
+            waitpid(sstp_links.pid[i], &status, WNOHANG) != sstp_links.pid[i])
+        {
+            continue;
+        }
+
+        sstp_links.pid[i] = 0;
+        sstp_links.alive--;
+
+        log_warn("Link %d exited with status %d, %d links left", i,
+                WIFEXITED(status) ? WEXITSTATUS(status) : -1,
+                sstp_links.alive);
+    }
+}
+
+
+status_t sstp_link_watch(event_base_st *base)
+{
+    if (sstp_links.count <= 1)
+    {
+        return SSTP_OKAY;
+    }
+
+    sstp_links.ev_child = event_new(base, SIGCHLD, EV_SIGNAL | EV_PERSIST,
+            (event_fn) sstp_link_reap, NULL);
+    if (!sstp_links.ev_child)
+    {
+        return SSTP_FAIL;
+    }
+
+    event_add(sstp_links.ev_child, NULL);
+    return SSTP_OKAY;
+}
+
+
+void sstp_link_stop(void)
+{
+    int i = 0;
+
+    if (sstp_links.ev_child)
+    {
+        event_del(sstp_links.ev_child);
+        event_free(sstp_links.ev_child);
+        sstp_links.ev_child = NULL;
+    }
+
+    for (i = 1; i < sstp_links.count; i++)
+    {
+        if (sstp_links.pid[i] > 0)
+        {
+            kill(sstp_links.pid[i], SIGTERM);
+        }
+    }
+
+    for (i = 1; i < sstp_links.count; i++)
+    {
+        if (sstp_links.pid[i] > 0)
+        {
+            waitpid(sstp_links.pid[i], NULL, 0);
+            sstp_links.pid[i] = 0;
+        }
+    }
+}
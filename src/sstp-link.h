@@ -0,0 +1,61 @@
+/*!
+ * @brief Run several connections as the links of a multilink PPP bundle
+ *
+ * @file sstp-link.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_LINK_H__
+#define __SSTP_LINK_H__
+
+
+/*< The largest number of links of a bundle */
+#define SSTP_LINK_MAX           8
+
+
+/*!
+ * @brief Fork an sstpc for each of the opts->links links but the first
+ *
+ * @par Note:
+ *  Each link is an sstpc of its own, with its connection to the server
+ *  and a pppd started with "multilink" that joins the bundle of the
+ *  first. The kernel sends the fragments of a packet on the links that
+ *  are ready to take them; as a link stops reading from its pty while
+ *  its stream is backed up, the links get fragments in proportion to
+ *  the rate they deliver at. Returns in each process, with opts->link
+ *  set to the number of the link; the first terminates the others as
+ *  it exits.
+ */
+status_t sstp_link_spawn(sstp_option_st *opts);
+
+
+/*!
+ * @brief Log the links that exited, as the bundle carries on without them
+ */
+status_t sstp_link_watch(event_base_st *base);
+
+
+/*!
+ * @brief Terminate the links, and wait for them to exit
+ */
+void sstp_link_stop(void);
+
+
+#endif /* #ifndef __SSTP_LINK_H__ */
@@ -0,0 +1,1764 @@
+/*!
+ * @brief Load test a server with many sessions, answering PPP ourselves
+ *
+ * @file sstp-load.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include <openssl/rand.h>
+
+#include "sstp-private.h"
+#include "sstp-ppp.h"
+
+
+/*< The PPP protocols we speak */
+#define SSTP_LOAD_PROTO_IP      0x0021
+#define SSTP_LOAD_PROTO_IPCP    0x8021
+#define SSTP_LOAD_PROTO_LCP     0xc021
+#define SSTP_LOAD_PROTO_PAP     0xc023
+#define SSTP_LOAD_PROTO_CHAP    0xc223
+
+/*< The PAP codes */
+#define SSTP_LOAD_PAP_REQ       1
+#define SSTP_LOAD_PAP_ACK       2
+#define SSTP_LOAD_PAP_NAK       3
+
+/*< The MS-CHAPv2 algorithm of the CHAP authentication option */
+#define SSTP_LOAD_CHAP_MSV2     0x81
+
+/*< We acknowledged the request of the server */
+#define SSTP_LOAD_ACKSENT       0x01
+
+/*< The server acknowledged our request */
+#define SSTP_LOAD_ACKRCVD       0x02
+
+/*< Both ends acknowledged the request of the other */
+#define SSTP_LOAD_OPENED        (SSTP_LOAD_ACKSENT | SSTP_LOAD_ACKRCVD)
+
+/*< The tick of the ramp and the fast traffic patterns (msec) */
+#define SSTP_LOAD_TICK          10
+
+/*< The UDP discard port */
+#define SSTP_LOAD_DISCARD       9
+
+
+/*!
+ * @brief The phase of a session
+ */
+typedef enum
+{
+    SSTP_PHASE_CONNECT  = 0,
+    SSTP_PHASE_CALL     = 1,
+    SSTP_PHASE_LCP      = 2,
+    SSTP_PHASE_AUTH     = 3,
+    SSTP_PHASE_IPCP     = 4,
+    SSTP_PHASE_UP       = 5,
+    SSTP_PHASE_DOWN     = 6,
+
+} sstp_phase_t;
+
+
+/*!
+ * @brief A session of the load test
+ */
+typedef struct
+{
+    /*< The load test */
+    sstp_load_st *load;
+
+    /*< The number of the session */
+    int id;
+
+    /*< The phase of the session */
+    sstp_phase_t phase;
+
+    /*< The connection to the server */
+    sstp_stream_st *stream;
+
+    /*< The HTTP handshake, while in progress */
+    sstp_http_st *http;
+
+    /*< The SSTP state machine */
+    sstp_state_st *state;
+
+    /*< The frames sent, each held by the stream until sent */
+    sstp_buff_st *tx[SSTP_LOAD_TXBUF];
+
+    /*< The frames held by the stream, one bit per frame */
+    int busy;
+
+    /*< The time the session was started */
+    struct timeval start;
+
+    /*< The time the session went down, until up again */
+    struct timeval down;
+
+    /*< The identifier of our last PPP packet */
+    uint8_t ident;
+
+    /*< The identifier of our outstanding Configure-Request */
+    uint8_t reqid;
+
+    /*< Our LCP magic number */
+    uint32_t magic;
+
+    /*< Request no LCP options, the server refused ours */
+    int lcp_plain;
+
+    /*< The LCP negotiation, SSTP_LOAD_ACKSENT | SSTP_LOAD_ACKRCVD */
+    int lcp;
+
+    /*< The IPCP negotiation, SSTP_LOAD_ACKSENT | SSTP_LOAD_ACKRCVD */
+    int ipcp;
+
+    /*< The authentication protocol the server asked for, or zero */
+    uint16_t auth;
+
+    /*< Our address, as assigned by the server */
+    uint8_t addr[4];
+
+    /*< The address of the server's end of the link */
+    uint8_t peer[4];
+
+    /*< The MS-CHAPv2 response, to derive the MPPE keys */
+    sstp_chap_st chap;
+
+    /*< The identification of the next IP datagram */
+    uint16_t ip_id;
+
+    /*< Resend the current PPP request */
+    event_st *ev_restart;
+
+    /*< Send the next traffic */
+    event_st *ev_traffic;
+
+    /*< The number of traffic intervals sent */
+    int ticks;
+
+    /*< The number of times the current request was sent */
+    int retry;
+
+} sstp_load_sess_st;
+
+
+/*!
+ * @brief The load test context
+ */
+struct sstp_load
+{
+    /*< The sessions */
+    sstp_load_sess_st *sess;
+
+    /*< The number of sessions */
+    int count;
+
+    /*< The number of sessions started */
+    int started;
+
+    /*< The number of sessions up */
+    int up;
+
+    /*< The number of sessions that went up at some point */
+    int established;
+
+    /*< The number of sessions failed */
+    int failed;
+
+    /*< The setup time of each session that went up (msec) */
+    int *setup;
+
+    /*< The number of sessions that went up again after going down */
+    int recovered;
+
+    /*< The shortest, the longest and the sum of the recoveries (msec) */
+    int rec_min;
+    int rec_max;
+    int rec_sum;
+
+    /*< The bytes of IP traffic sent */
+    uint64_t tx_bytes;
+
+    /*< The bytes of IP traffic received */
+    uint64_t rx_bytes;
+
+    /*< The datagrams dropped since the stream was backed up */
+    uint64_t drops;
+
+    /*< The time the test started */
+    struct timeval start;
+
+    /*< The traffic of each session */
+    sstp_load_traffic_st traffic;
+
+    /*< The sessions started per second */
+    int rate;
+
+    /*< Start the next sessions */
+    event_st *ev_ramp;
+
+    /*< Log the progress */
+    event_st *ev_report;
+
+    /*< End the test */
+    event_st *ev_stop;
+
+    /*< The SSL context of the sessions */
+    SSL_CTX *ssl_ctx;
+
+    /*< The options */
+    sstp_option_st *opts;
+
+    /*< The name of the server */
+    char server[256];
+
+    /*< The address of the server */
+    struct sockaddr_storage addr;
+
+    /*< The length of the address */
+    int alen;
+
+    /*< The event base */
+    event_base_st *ev_base;
+};
+
+
+static void sstp_load_fail(sstp_load_sess_st *sess, const char *reason);
+static void sstp_load_traffic_start(sstp_load_sess_st *sess);
+static void sstp_load_start(sstp_load_st *ctx, sstp_load_sess_st *sess);
+
+
+status_t sstp_load_traffic(const char *spec, sstp_load_traffic_st *traffic)
+{
+    int pps = 0;
+    int ret = 0;
+
+    memset(traffic, 0, sizeof(*traffic));
+
+    if (!strcmp(spec, "idle"))
+    {
+        traffic->pattern = SSTP_LOAD_IDLE;
+        return SSTP_OKAY;
+    }
+
+    if (!strncmp(spec, "cbr:", 4))
+    {
+        ret = sscanf(spec + 4, "%d:%d", &pps, &traffic->size);
+        if (ret != 2 || pps <= 0 || pps > 100000)
+        {
+            return SSTP_FAIL;
+        }
+
+        /* Send the faster rates in batches, each tick */
+        traffic->pattern  = SSTP_LOAD_CBR;
+        traffic->count    = 1;
+        traffic->interval = 1000 / pps;
+        if (traffic->interval < SSTP_LOAD_TICK)
+        {
+            traffic->interval = SSTP_LOAD_TICK;
+            traffic->count    = (pps * SSTP_LOAD_TICK + 999) / 1000;
+        }
+    }
+    else if (!strncmp(spec, "burst:", 6))
+    {
+        ret = sscanf(spec + 6, "%d:%d:%d", &traffic->count, &traffic->size,
+                &traffic->interval);
+        if (ret != 3 || traffic->count <= 0 || traffic->interval <= 0)
+        {
+            return SSTP_FAIL;
+        }
+
+        traffic->pattern = SSTP_LOAD_BURST;
+    }
+    else
+    {
+        return SSTP_FAIL;
+    }
+
+    /* An IP and UDP header, up to a full frame */
+    if (traffic->size < 28 || traffic->size > SSTP_LOAD_PKTMAX)
+    {
+        return SSTP_FAIL;
+    }
+
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Get the milliseconds elapsed since @a start
+ */
+static int sstp_load_elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return ((now.tv_sec  - start->tv_sec) * 1000) +
+           ((now.tv_usec - start->tv_usec) / 1000);
+}
+
+
+/*!
+ * @brief The stream is done with a frame, it may be reused
+ */
+static void sstp_load_sent(sstp_stream_st *stream, sstp_buff_st *buf,
+        sstp_load_sess_st *sess, status_t status)
+{
+    int i = 0;
+
+    for (i = 0; i < SSTP_LOAD_TXBUF; i++)
+    {
+        if (sess->tx[i] == buf)
+        {
+            sess->busy &= ~(1 << i);
+            break;
+        }
+    }
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_load_fail(sess, "Could not send to the server");
+    }
+}
+
+
+/*!
+ * @brief Get a free frame, SSTP data header and PPP header in place
+ *
+ * @retval The frame, or NULL if they are all held by the stream
+ */
+static sstp_buff_st *sstp_load_frame(sstp_load_sess_st *sess, uint16_t proto)
+{
+    sstp_buff_st *buf = NULL;
+    int i = 0;
+
+    for (i = 0; i < SSTP_LOAD_TXBUF; i++)
+    {
+        if (!(sess->busy & (1 << i)))
+        {
+            break;
+        }
+    }
+
+    if (i == SSTP_LOAD_TXBUF)
+    {
+        return NULL;
+    }
+
+    buf = sess->tx[i];
+    if (SSTP_OKAY != sstp_pkt_init(buf, SSTP_MSG_DATA))
+    {
+        return NULL;
+    }
+
+    buf->data[buf->len++] = 0xff;
+    buf->data[buf->len++] = 0x03;
+    buf->data[buf->len++] = proto >> 8;
+    buf->data[buf->len++] = proto & 0xff;
+    return buf;
+}
+
+
+/*!
+ * @brief Send a frame got by sstp_load_frame()
+ */
+static status_t sstp_load_send(sstp_load_sess_st *sess, sstp_buff_st *buf)
+{
+    status_t ret = SSTP_FAIL;
+    int i = 0;
+
+    sstp_pkt_update(buf);
+
+    ret = sstp_stream_send(sess->stream, buf, (sstp_complete_fn)
+            sstp_load_sent, sess, sstp_tune()->send_timeout);
+    switch (ret)
+    {
+    case SSTP_INPROG:
+
+        /* Held by the stream until sstp_load_sent() */
+        for (i = 0; i < SSTP_LOAD_TXBUF; i++)
+        {
+            if (sess->tx[i] == buf)
+            {
+                sess->busy |= (1 << i);
+                break;
+            }
+        }
+        ret = SSTP_OKAY;
+        break;
+
+    case SSTP_OKAY:
+        break;
+
+    default:
+        sstp_load_fail(sess, "Could not send to the server");
+        break;
+    }
+
+    return ret;
+}
+
+
+/*!
+ * @brief Send a PPP control packet, @a data holds the packet after the
+ *  code, identifier and length
+ */
+static status_t sstp_load_send_ctrl(sstp_load_sess_st *sess, uint16_t proto,
+        uint8_t code, uint8_t id, const uint8_t *data, int len)
+{
+    sstp_buff_st *buf = NULL;
+
+    buf = sstp_load_frame(sess, proto);
+    if (!buf || sstp_buff_space(buf, len + 4))
+    {
+        return SSTP_OVERFLOW;
+    }
+
+    buf->data[buf->len++] = code;
+    buf->data[buf->len++] = id;
+    buf->data[buf->len++] = (len + 4) >> 8;
+    buf->data[buf->len++] = (len + 4) & 0xff;
+    memcpy(buf->data + buf->len, data, len);
+    buf->len += len;
+
+    return sstp_load_send(sess, buf);
+}
+
+
+/*!
+ * @brief Send our LCP or IPCP Configure-Request, and await the answer
+ */
+static void sstp_load_confreq(sstp_load_sess_st *sess, uint16_t proto)
+{
+    timeval_st tv = { SSTP_LOAD_RESTART, 0 };
+    uint8_t opts[8];
+    int len = 0;
+
+    if (SSTP_LOAD_PROTO_LCP == proto && !sess->lcp_plain)
+    {
+        opts[len++] = CI_MAGIC;
+        opts[len++] = 6;
+        memcpy(opts + len, &sess->magic, 4);
+        len += 4;
+    }
+    else if (SSTP_LOAD_PROTO_IPCP == proto)
+    {
+        opts[len++] = CI_ADDR;
+        opts[len++] = 6;
+        memcpy(opts + len, sess->addr, 4);
+        len += 4;
+    }
+
+    sess->reqid = ++sess->ident;
+    sstp_load_send_ctrl(sess, proto, FSM_CONFREQ, sess->reqid, opts, len);
+    event_add(sess->ev_restart, &tv);
+}
+
+
+/*!
+ * @brief The server didn't answer our request in time, send it again
+ */
+static void sstp_load_restart(int fd, short event, sstp_load_sess_st *sess)
+{
+    if (++sess->retry >= SSTP_LOAD_RETRY)
+    {
+        sstp_load_fail(sess, "The server did not answer");
+        return;
+    }
+
+    switch (sess->phase)
+    {
+    case SSTP_PHASE_LCP:
+        sstp_load_confreq(sess, SSTP_LOAD_PROTO_LCP);
+        break;
+
+    case SSTP_PHASE_IPCP:
+        sstp_load_confreq(sess, SSTP_LOAD_PROTO_IPCP);
+        break;
+
+    default:
+        sstp_load_fail(sess, "The server did not authenticate us");
+        break;
+    }
+}
+
+
+/*!
+ * @brief Move on to the next phase
+ */
+static void sstp_load_phase(sstp_load_sess_st *sess, sstp_phase_t phase)
+{
+    sstp_load_st *ctx = sess->load;
+    timeval_st tv = { SSTP_LOAD_RESTART * SSTP_LOAD_RETRY, 0 };
+
+    sess->phase = phase;
+    sess->retry = 0;
+    event_del(sess->ev_restart);
+
+    switch (phase)
+    {
+    case SSTP_PHASE_AUTH:
+
+        /* The server speaks first, don't wait forever */
+        event_add(sess->ev_restart, &tv);
+        break;
+
+    case SSTP_PHASE_IPCP:
+
+        /* Tell the server we are authenticated, with the MPPE keys */
+        if (SSTP_FAIL == sstp_state_accept(sess->state))
+        {
+            sstp_load_fail(sess, "Could not send Call Connected");
+            return;
+        }
+
+        sstp_load_confreq(sess, SSTP_LOAD_PROTO_IPCP);
+        break;
+
+    case SSTP_PHASE_UP:
+
+        ctx->up++;
+
+        /* Time the recovery of a session that reconnected */
+        if (timerisset(&sess->down))
+        {
+            int msec = sstp_load_elapsed(&sess->down);
+
+            log_info("Session %d recovered after %d ms", sess->id, msec);
+            if (!ctx->recovered || msec < ctx->rec_min)
+            {
+                ctx->rec_min = msec;
+            }
+            if (msec > ctx->rec_max)
+            {
+                ctx->rec_max = msec;
+            }
+            ctx->rec_sum += msec;
+            ctx->recovered++;
+            timerclear(&sess->down);
+        }
+        else
+        {
+            ctx->setup[ctx->established++] = sstp_load_elapsed(&sess->start);
+        }
+
+        log_debug("Session %d is up", sess->id);
+        sstp_load_traffic_start(sess);
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/*!
+ * @brief Both ends of LCP are opened, authenticate if asked to
+ */
+static void sstp_load_lcp_up(sstp_load_sess_st *sess)
+{
+    sstp_load_st *ctx = sess->load;
+    uint8_t data[512];
+    int ulen = 0;
+    int plen = 0;
+
+    switch (sess->auth)
+    {
+    case SSTP_LOAD_PROTO_PAP:
+
+        ulen = strlen(ctx->opts->user);
+        plen = strlen(ctx->opts->password);
+        if (ulen + plen + 2 > sizeof(data))
+        {
+            sstp_load_fail(sess, "The credentials are too long");
+            return;
+        }
+
+        /* The Authenticate-Request */
+        data[0] = ulen;
+        memcpy(data + 1, ctx->opts->user, ulen);
+        data[ulen + 1] = plen;
+        memcpy(data + ulen + 2, ctx->opts->password, plen);
+
+        sstp_load_phase(sess, SSTP_PHASE_AUTH);
+        sstp_load_send_ctrl(sess, SSTP_LOAD_PROTO_PAP, SSTP_LOAD_PAP_REQ,
+                ++sess->ident, data, ulen + plen + 2);
+        break;
+
+    case SSTP_LOAD_PROTO_CHAP:
+
+        /* Wait for the Challenge */
+        sstp_load_phase(sess, SSTP_PHASE_AUTH);
+        break;
+
+    default:
+        sstp_load_phase(sess, SSTP_PHASE_IPCP);
+        break;
+    }
+}
+
+
+/*!
+ * @brief Handle the Configure-Request of the server
+ *
+ * @par Note:
+ *  Options we don't know are rejected, an authentication protocol other
+ *  than PAP or MS-CHAPv2 is nak'ed with MS-CHAPv2.
+ */
+static void sstp_load_conf_peer(sstp_load_sess_st *sess, uint16_t proto,
+        uint8_t id, uint8_t *data, int len)
+{
+    uint8_t rej[SSTP_LOAD_PKTMAX];
+    uint8_t nak[SSTP_LOAD_PKTMAX];
+    uint16_t auth = 0;
+    int nrej = 0;
+    int nnak = 0;
+    int off  = 0;
+    int *flag = (SSTP_LOAD_PROTO_LCP == proto)
+            ? &sess->lcp
+            : &sess->ipcp;
+
+    while (off + 2 <= len)
+    {
+        uint8_t type = data[off];
+        uint8_t olen = data[off + 1];
+        int accept = 0;
+
+        if (olen < 2 || off + olen > len)
+        {
+            sstp_load_fail(sess, "Received a malformed Configure-Request");
+            return;
+        }
+
+        if (SSTP_LOAD_PROTO_LCP == proto)
+        {
+            switch (type)
+            {
+            case CI_MRU:
+            case CI_ASYNCMAP:
+            case CI_MAGIC:
+                accept = 1;
+                break;
+
+            case CI_AUTH:
+                auth = (olen >= 4)
+                        ? (data[off + 2] << 8) | data[off + 3]
+                        : 0;
+                if ((SSTP_LOAD_PROTO_PAP == auth && olen == 4) ||
+                    (SSTP_LOAD_PROTO_CHAP == auth && olen == 5 &&
+                     SSTP_LOAD_CHAP_MSV2 == data[off + 4]))
+                {
+                    accept = 1;
+                    break;
+                }
+
+                /* Ask for MS-CHAPv2 instead */
+                nak[nnak++] = CI_AUTH;
+                nak[nnak++] = 5;
+                nak[nnak++] = SSTP_LOAD_PROTO_CHAP >> 8;
+                nak[nnak++] = SSTP_LOAD_PROTO_CHAP & 0xff;
+                nak[nnak++] = SSTP_LOAD_CHAP_MSV2;
+                accept = -1;
+                break;
+
+            default:
+                break;
+            }
+        }
+        else if (CI_ADDR == type && olen == 6)
+        {
+            memcpy(sess->peer, data + off + 2, 4);
+            accept = 1;
+        }
+
+        if (!accept)
+        {
+            memcpy(rej + nrej, data + off, olen);
+            nrej += olen;
+        }
+
+        off += olen;
+    }
+
+    if (nrej)
+    {
+        sstp_load_send_ctrl(sess, proto, FSM_CONFREJ, id, rej, nrej);
+        return;
+    }
+
+    if (nnak)
+    {
+        sstp_load_send_ctrl(sess, proto, FSM_CONFNAK, id, nak, nnak);
+        return;
+    }
+
+    if (SSTP_LOAD_PROTO_LCP == proto)
+    {
+        sess->auth = auth;
+    }
+
+    sstp_load_send_ctrl(sess, proto, FSM_CONFACK, id, data, len);
+    *flag |= SSTP_LOAD_ACKSENT;
+}
+
+
+/*!
+ * @brief Handle the answer of the server to our IPCP request
+ */
+static void sstp_load_conf_ipcp(sstp_load_sess_st *sess, uint8_t code,
+        uint8_t *data, int len)
+{
+    int off = 0;
+
+    switch (code)
+    {
+    case FSM_CONFACK:
+        sess->ipcp |= SSTP_LOAD_ACKRCVD;
+        event_del(sess->ev_restart);
+        break;
+
+    case FSM_CONFNAK:
+
+        /* Take the address the server assigned us */
+        while (off + 2 <= len && data[off + 1] >= 2)
+        {
+            if (CI_ADDR == data[off] && data[off + 1] == 6 && off + 6 <= len)
+            {
+                memcpy(sess->addr, data + off + 2, 4);
+            }
+            off += data[off + 1];
+        }
+        sstp_load_confreq(sess, SSTP_LOAD_PROTO_IPCP);
+        break;
+
+    default:
+        sstp_load_fail(sess, "The server refused to assign an address");
+        break;
+    }
+}
+
+
+/*!
+ * @brief Handle a LCP or IPCP packet
+ */
+static void sstp_load_recv_cp(sstp_load_sess_st *sess, uint16_t proto,
+        uint8_t *data, int len)
+{
+    uint8_t code = data[0];
+    uint8_t id   = data[1];
+
+    switch (code)
+    {
+    case FSM_CONFREQ:
+        sstp_load_conf_peer(sess, proto, id, data + 4, len - 4);
+        break;
+
+    case FSM_CONFACK:
+    case FSM_CONFNAK:
+    case FSM_CONFREJ:
+
+        /* A stale answer to a request we sent again */
+        if (id != sess->reqid)
+        {
+            break;
+        }
+
+        if (SSTP_LOAD_PROTO_IPCP == proto)
+        {
+            sstp_load_conf_ipcp(sess, code, data + 4, len - 4);
+            break;
+        }
+
+        if (FSM_CONFACK == code)
+        {
+            sess->lcp |= SSTP_LOAD_ACKRCVD;
+            event_del(sess->ev_restart);
+            break;
+        }
+
+        /* The magic number is the only option we ask for */
+        sess->lcp_plain = 1;
+        sstp_load_confreq(sess, proto);
+        break;
+
+    case FSM_TERMREQ:
+        sstp_load_send_ctrl(sess, proto, FSM_TERMACK, id, NULL, 0);
+        sstp_load_fail(sess, "The server terminated the link");
+        return;
+
+    case FSM_ECHOREQ:
+        if (SSTP_LOAD_PROTO_LCP == proto && len >= 8)
+        {
+            memcpy(data + 4, &sess->magic, 4);
+            sstp_load_send_ctrl(sess, proto, FSM_ECHOREP, id, data + 4,
+                    len - 4);
+        }
+        break;
+
+    case FSM_CODEREJ:
+    case FSM_PROTOREJ:
+        log_debug("Session %d got a %s reject from the server", sess->id,
+                (FSM_CODEREJ == code) ? "code" : "protocol");
+        break;
+
+    default:
+        break;
+    }
+
+    /* LCP opened, move on to authentication */
+    if (SSTP_PHASE_LCP == sess->phase && SSTP_LOAD_OPENED == sess->lcp)
+    {
+        sstp_load_lcp_up(sess);
+    }
+
+    /* IPCP opened, the session is up */
+    if (SSTP_PHASE_IPCP == sess->phase && SSTP_LOAD_OPENED == sess->ipcp)
+    {
+        sstp_load_phase(sess, SSTP_PHASE_UP);
+    }
+}
+
+
+/*!
+ * @brief Answer the MS-CHAPv2 challenge of the server, or take the result
+ */
+static void sstp_load_recv_chap(sstp_load_sess_st *sess, uint8_t *data,
+        int len)
+{
+    sstp_load_st *ctx = sess->load;
+    const char *user = ctx->opts->user;
+    const char *name = strrchr(user, '\\');
+    uint8_t resp[1 + 49 + 256];
+    uint8_t skey[16];
+    uint8_t rkey[16];
+    int ulen = strlen(user);
+
+    if (SSTP_PHASE_AUTH != sess->phase)
+    {
+        return;
+    }
+
+    switch (data[0])
+    {
+    case CHAP_CHALLENGE:
+
+        if (len < 5 + 16 || data[4] != 16 || ulen > 256)
+        {
+            sstp_load_fail(sess, "Received a malformed CHAP Challenge");
+            return;
+        }
+
+        /* The hash is over the name without the domain */
+        name = (name) ? name + 1 : user;
+
+        memset(&sess->chap, 0, sizeof(sess->chap));
+        RAND_bytes(sess->chap.challenge, sizeof(sess->chap.challenge));
+        if (sstp_chap_response(&sess->chap, data + 5, name,
+                ctx->opts->password))
+        {
+            sstp_load_fail(sess, "Could not compute the CHAP Response");
+            return;
+        }
+
+        resp[0] = 49;
+        memcpy(resp + 1, &sess->chap, 49);
+        memcpy(resp + 50, user, ulen);
+        sstp_load_send_ctrl(sess, SSTP_LOAD_PROTO_CHAP, CHAP_RESPONSE,
+                data[1], resp, 50 + ulen);
+        break;
+
+    case CHAP_SUCCESS:
+
+        /* Bind the SSTP layer to the authentication */
+        if (sstp_chap_mppe_get(&sess->chap, ctx->opts->password, skey,
+                rkey, 0))
+        {
+            sstp_load_fail(sess, "Could not get the MPPE keys");
+            return;
+        }
+
+        sstp_state_mppe_keys(sess->state, skey, 16, rkey, 16);
+        sstp_load_phase(sess, SSTP_PHASE_IPCP);
+        break;
+
+    case CHAP_FAILURE:
+        sstp_load_fail(sess, "Authentication failed");
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/*!
+ * @brief Take the result of the PAP authentication
+ */
+static void sstp_load_recv_pap(sstp_load_sess_st *sess, uint8_t *data,
+        int len)
+{
+    if (SSTP_PHASE_AUTH != sess->phase)
+    {
+        return;
+    }
+
+    switch (data[0])
+    {
+    case SSTP_LOAD_PAP_ACK:
+        sstp_load_phase(sess, SSTP_PHASE_IPCP);
+        break;
+
+    case SSTP_LOAD_PAP_NAK:
+        sstp_load_fail(sess, "Authentication failed");
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+/*!
+ * @brief Reject a protocol we don't speak, e.g. CCP or IPv6CP
+ */
+static void sstp_load_protorej(sstp_load_sess_st *sess, uint16_t proto,
+        uint8_t *data, int len)
+{
+    uint8_t rej[64];
+
+    /* The rejected information may be truncated */
+    if (len > sizeof(rej) - 2)
+    {
+        len = sizeof(rej) - 2;
+    }
+
+    rej[0] = proto >> 8;
+    rej[1] = proto & 0xff;
+    memcpy(rej + 2, data, len);
+
+    sstp_load_send_ctrl(sess, SSTP_LOAD_PROTO_LCP, FSM_PROTOREJ,
+            ++sess->ident, rej, len + 2);
+}
+
+
+/*!
+ * @brief A PPP frame was received from the server
+ */
+static status_t sstp_load_recv(sstp_load_sess_st *sess, uint8_t *data,
+        int len)
+{
+    sstp_load_st *ctx = sess->load;
+    uint16_t proto = 0;
+    int plen = 0;
+
+    /* Skip the address and control field */
+    if (len >= 2 && data[0] == 0xff && data[1] == 0x03)
+    {
+        data += 2;
+        len  -= 2;
+    }
+
+    /* The protocol field may be compressed to a single byte */
+    if (len >= 1 && (data[0] & 0x01))
+    {
+        proto = data[0];
+        data += 1;
+        len  -= 1;
+    }
+    else if (len >= 2)
+    {
+        proto = (data[0] << 8) | data[1];
+        data += 2;
+        len  -= 2;
+    }
+    else
+    {
+        return SSTP_OKAY;
+    }
+
+    if (SSTP_LOAD_PROTO_IP == proto)
+    {
+        ctx->rx_bytes += len;
+        return SSTP_OKAY;
+    }
+
+    /* The control packets carry their own length, ignore any padding */
+    if (len < 4)
+    {
+        return SSTP_OKAY;
+    }
+
+    plen = (data[2] << 8) | data[3];
+    if (plen < 4 || plen > len)
+    {
+        return SSTP_OKAY;
+    }
+
+    switch (proto)
+    {
+    case SSTP_LOAD_PROTO_LCP:
+        sstp_load_recv_cp(sess, proto, data, plen);
+        break;
+
+    case SSTP_LOAD_PROTO_IPCP:
+
+        /* The server may start IPCP before it sees our Call Connected */
+        if (SSTP_PHASE_LCP == sess->phase)
+        {
+            break;
+        }
+        sstp_load_recv_cp(sess, proto, data, plen);
+        break;
+
+    case SSTP_LOAD_PROTO_CHAP:
+        sstp_load_recv_chap(sess, data, plen);
+        break;
+
+    case SSTP_LOAD_PROTO_PAP:
+        sstp_load_recv_pap(sess, data, plen);
+        break;
+
+    default:
+        if (SSTP_PHASE_LCP != sess->phase)
+        {
+            sstp_load_protorej(sess, proto, data, plen);
+        }
+        break;
+    }
+
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief The ones' complement checksum of the IP header
+ */
+static uint16_t sstp_load_cksum(const uint8_t *data, int len)
+{
+    uint32_t sum = 0;
+    int i = 0;
+
+    for (i = 0; i + 1 < len; i += 2)
+    {
+        sum += (data[i] << 8) | data[i + 1];
+    }
+
+    while (sum >> 16)
+    {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+
+    return ~sum & 0xffff;
+}
+
+
+/*!
+ * @brief Send a UDP datagram to the discard port of the server's end
+ */
+static status_t sstp_load_datagram(sstp_load_sess_st *sess, int size)
+{
+    sstp_load_st *ctx = sess->load;
+    sstp_buff_st *buf = NULL;
+    uint8_t *ip  = NULL;
+    uint8_t *udp = NULL;
+    uint16_t sum = 0;
+
+    buf = sstp_load_frame(sess, SSTP_LOAD_PROTO_IP);
+    if (!buf || sstp_buff_space(buf, size))
+    {
+        ctx->drops++;
+        return SSTP_OVERFLOW;
+    }
+
+    ip = (uint8_t*) buf->data + buf->len;
+    memset(ip, 0, size);
+
+    ip[0]  = 0x45;
+    ip[2]  = size >> 8;
+    ip[3]  = size & 0xff;
+    ip[4]  = sess->ip_id >> 8;
+    ip[5]  = sess->ip_id & 0xff;
+    ip[8]  = 64;
+    ip[9]  = IPPROTO_UDP;
+    memcpy(ip + 12, sess->addr, 4);
+    memcpy(ip + 16, sess->peer, 4);
+    sum    = sstp_load_cksum(ip, 20);
+    ip[10] = sum >> 8;
+    ip[11] = sum & 0xff;
+    sess->ip_id++;
+
+    /* Any source port, no checksum */
+    udp    = ip + 20;
+    udp[0] = (1024 + sess->id % 60000) >> 8;
+    udp[1] = (1024 + sess->id % 60000) & 0xff;
+    udp[3] = SSTP_LOAD_DISCARD;
+    udp[4] = (size - 20) >> 8;
+    udp[5] = (size - 20) & 0xff;
+
+    buf->len += size;
+    ctx->tx_bytes += size;
+
+    return sstp_load_send(sess, buf);
+}
+
+
+/*!
+ * @brief Send the traffic of this interval
+ */
+static void sstp_load_tick(int fd, short event, sstp_load_sess_st *sess)
+{
+    sstp_load_traffic_st *traffic = &sess->load->traffic;
+    timeval_st tv;
+    int i = 0;
+
+    /* The first tick was offset, run at the full interval from now on */
+    if (0 == sess->ticks++)
+    {
+        tv.tv_sec  = traffic->interval / 1000;
+        tv.tv_usec = (traffic->interval % 1000) * 1000;
+        event_add(sess->ev_traffic, &tv);
+    }
+
+    for (i = 0; i < traffic->count && SSTP_PHASE_UP == sess->phase; i++)
+    {
+        if (SSTP_OKAY != sstp_load_datagram(sess, traffic->size))
+        {
+            break;
+        }
+    }
+}
+
+
+/*!
+ * @brief Start the traffic of a session that went up
+ */
+static void sstp_load_traffic_start(sstp_load_sess_st *sess)
+{
+    sstp_load_traffic_st *traffic = &sess->load->traffic;
+    timeval_st tv;
+    int offset = 0;
+
+    if (SSTP_LOAD_IDLE == traffic->pattern)
+    {
+        return;
+    }
+
+    /* Spread the sessions over the interval by offsetting the first tick */
+    offset = sess->id % traffic->interval;
+    tv.tv_sec  = offset / 1000;
+    tv.tv_usec = (offset % 1000) * 1000;
+    sess->ticks = 0;
+
+    sess->ev_traffic = event_new(sess->load->ev_base, -1, EV_PERSIST,
+            (event_fn) sstp_load_tick, sess);
+    if (!sess->ev_traffic)
+    {
+        sstp_load_fail(sess, "Could not schedule the traffic");
+        return;
+    }
+    event_add(sess->ev_traffic, &tv);
+}
+
+
+/*!
+ * @brief Release the resources of a session
+ */
+static void sstp_load_release(sstp_load_sess_st *sess)
+{
+    int i = 0;
+
+    if (sess->ev_traffic)
+    {
+        event_del(sess->ev_traffic);
+        event_free(sess->ev_traffic);
+        sess->ev_traffic = NULL;
+    }
+
+    if (sess->ev_restart)
+    {
+        event_del(sess->ev_restart);
+        event_free(sess->ev_restart);
+        sess->ev_restart = NULL;
+    }
+
+    if (sess->state)
+    {
+        sstp_state_free(sess->state);
+        sess->state = NULL;
+    }
+
+    if (sess->http)
+    {
+        sstp_http_free(sess->http);
+        sess->http = NULL;
+    }
+
+    if (sess->stream)
+    {
+        sstp_stream_destroy(sess->stream);
+        sess->stream = NULL;
+    }
+
+    for (i = 0; i < SSTP_LOAD_TXBUF; i++)
+    {
+        if (sess->tx[i])
+        {
+            sstp_buff_destroy(sess->tx[i]);
+            sess->tx[i] = NULL;
+        }
+    }
+}
+
+
+/*!
+ * @brief Start a failed session over, keeping the time it went down
+ */
+static void sstp_load_reconnect(int fd, short event, sstp_load_sess_st *sess)
+{
+    sstp_load_st *ctx = sess->load;
+    struct timeval down = sess->down;
+    int id = sess->id;
+
+    memset(sess, 0, sizeof(*sess));
+    sess->load = ctx;
+    sess->id   = id;
+    sess->down = down;
+
+    ctx->failed--;
+
+    log_debug("Session %d is reconnecting", sess->id);
+    sstp_load_start(ctx, sess);
+}
+
+
+/*!
+ * @brief Release a failed session, from the event loop
+ */
+static void sstp_load_reap(int fd, short event, sstp_load_sess_st *sess)
+{
+    sstp_load_st *ctx = sess->load;
+    timeval_st tv = { ctx->opts->load_reconnect, 0 };
+
+    sstp_load_release(sess);
+
+    if (ctx->opts->load_reconnect > 0)
+    {
+        event_base_once(ctx->ev_base, -1, EV_TIMEOUT, (event_fn)
+                sstp_load_reconnect, sess, &tv);
+    }
+}
+
+
+/*!
+ * @brief The session failed, release it once the callers unwound
+ */
+static void sstp_load_fail(sstp_load_sess_st *sess, const char *reason)
+{
+    sstp_load_st *ctx = sess->load;
+    timeval_st tv = { 0, 0 };
+
+    if (SSTP_PHASE_DOWN == sess->phase)
+    {
+        return;
+    }
+
+    if (SSTP_PHASE_UP == sess->phase)
+    {
+        ctx->up--;
+    }
+
+    log_info("Session %d went down, %s", sess->id, reason);
+
+    sess->phase = SSTP_PHASE_DOWN;
+    ctx->failed++;
+
+    /* The recovery counts from the first failure, across the attempts */
+    if (!timerisset(&sess->down))
+    {
+        gettimeofday(&sess->down, NULL);
+    }
+
+    if (sess->ev_restart)
+    {
+        event_del(sess->ev_restart);
+    }
+
+    if (sess->ev_traffic)
+    {
+        event_del(sess->ev_traffic);
+    }
+
+    event_base_once(ctx->ev_base, -1, EV_TIMEOUT, (event_fn)
+            sstp_load_reap, sess, &tv);
+}
+
+
+/*!
+ * @brief The SSTP state machine of a session changed
+ */
+static void sstp_load_state_cb(sstp_load_sess_st *sess, sstp_state_t event)
+{
+    switch (event)
+    {
+    case SSTP_CALL_CONNECT:
+
+        RAND_bytes((unsigned char*) &sess->magic, sizeof(sess->magic));
+        sess->phase = SSTP_PHASE_LCP;
+        sstp_load_confreq(sess, SSTP_LOAD_PROTO_LCP);
+        break;
+
+    case SSTP_CALL_ESTABLISHED:
+        break;
+
+    case SSTP_CALL_ABORT:
+    default:
+        sstp_load_fail(sess, (sess->state)
+                ? sstp_state_reason(sess->state)
+                : "Connection was aborted");
+        break;
+    }
+}
+
+
+/*!
+ * @brief The HTTP handshake of a session completed
+ */
+static void sstp_load_http_done(sstp_load_sess_st *sess, int status)
+{
+    sstp_load_st *ctx = sess->load;
+    int opts = SSTP_VERIFY_NAME;
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_load_fail(sess, "HTTP handshake with server failed");
+        return;
+    }
+
+    if (ctx->opts->ca_cert || ctx->opts->ca_path)
+    {
+        opts = SSTP_VERIFY_CERT;
+    }
+
+    /* Too many sessions to warn of each, when asked to ignore it */
+    status = sstp_verify_cert(sess->stream, ctx->server, opts);
+    if (SSTP_OKAY != status && !(SSTP_OPT_CERTWARN & ctx->opts->enable))
+    {
+        sstp_load_fail(sess, "Verification of server certificate failed");
+        return;
+    }
+
+    status = sstp_state_create(&sess->state, sess->stream,
+            (sstp_state_change_fn) sstp_load_state_cb, sess,
+            SSTP_MODE_CLIENT);
+    if (SSTP_OKAY != status)
+    {
+        sstp_load_fail(sess, "Could not create state machine");
+        return;
+    }
+
+    sstp_state_set_forward(sess->state, (sstp_state_forward_fn)
+            sstp_load_recv, sess);
+
+    sess->phase = SSTP_PHASE_CALL;
+    status = sstp_state_start(sess->state);
+    if (SSTP_FAIL == status)
+    {
+        sstp_load_fail(sess, "Could not start the state machine");
+    }
+}
+
+
+/*!
+ * @brief The connect of a session completed
+ */
+static void sstp_load_connected(sstp_stream_st *stream, sstp_buff_st *buf,
+        sstp_load_sess_st *sess, status_t status)
+{
+    sstp_load_st *ctx = sess->load;
+
+    if (SSTP_CONNECTED != status)
+    {
+        sstp_load_fail(sess, "Could not connect to the server");
+        return;
+    }
+
+    status = sstp_http_create(&sess->http, ctx->server, (sstp_http_done_fn)
+            sstp_load_http_done, sess, SSTP_MODE_CLIENT);
+    if (SSTP_OKAY != status)
+    {
+        sstp_load_fail(sess, "Could not configure HTTP handshake");
+        return;
+    }
+
+    status = sstp_http_handshake(sess->http, sess->stream);
+    if (SSTP_FAIL == status)
+    {
+        sstp_load_fail(sess, "Could not perform HTTP handshake");
+    }
+}
+
+
+/*!
+ * @brief Start a session
+ */
+static void sstp_load_start(sstp_load_st *ctx, sstp_load_sess_st *sess)
+{
+    status_t ret = SSTP_FAIL;
+    int i = 0;
+
+    gettimeofday(&sess->start, NULL);
+
+    for (i = 0; i < SSTP_LOAD_TXBUF; i++)
+    {
+        ret = sstp_buff_create(&sess->tx[i], SSTP_LOAD_PKTMAX + 64);
+        if (SSTP_OKAY != ret)
+        {
+            goto fail;
+        }
+    }
+
+    sess->ev_restart = event_new(ctx->ev_base, -1, 0, (event_fn)
+            sstp_load_restart, sess);
+    if (!sess->ev_restart)
+    {
+        goto fail;
+    }
+
+    ret = sstp_stream_create(&sess->stream, ctx->ev_base, ctx->ssl_ctx);
+    if (SSTP_OKAY != ret)
+    {
+        goto fail;
+    }
+
+    ret = sstp_stream_connect(sess->stream, (struct sockaddr*) &ctx->addr,
+            ctx->alen, (sstp_complete_fn) sstp_load_connected, sess,
+            sstp_tune()->connect_timeout);
+    if (SSTP_FAIL == ret)
+    {
+        goto fail;
+    }
+
+    return;
+
+fail:
+
+    sstp_load_fail(sess, "Could not start the session");
+}
+
+
+/*!
+ * @brief Start the sessions due by now, at the rate given
+ */
+static void sstp_load_ramp(int fd, short event, sstp_load_st *ctx)
+{
+    int due = 0;
+
+    due = (int64_t) ctx->rate * sstp_load_elapsed(&ctx->start) / 1000 + 1;
+    if (due > ctx->count)
+    {
+        due = ctx->count;
+    }
+
+    while (ctx->started < due)
+    {
+        sstp_load_sess_st *sess = &ctx->sess[ctx->started++];
+        sstp_load_start(ctx, sess);
+    }
+
+    if (ctx->started == ctx->count)
+    {
+        log_info("Started all of the %d sessions", ctx->count);
+        event_del(ctx->ev_ramp);
+    }
+}
+
+
+/*!
+ * @brief Log the progress
+ */
+static void sstp_load_progress(int fd, short event, sstp_load_st *ctx)
+{
+    sstp_load_report(ctx);
+}
+
+
+/*!
+ * @brief The load test ran its time
+ */
+static void sstp_load_stop(int fd, short event, sstp_load_st *ctx)
+{
+    log_info("The load test ran for %d seconds", ctx->opts->load_time);
+    event_base_loopexit(ctx->ev_base, NULL);
+}
+
+
+/*!
+ * @brief Order the setup times, shortest first
+ */
+static int sstp_load_compare(const void *a, const void *b)
+{
+    int ta = *(const int*) a;
+    int tb = *(const int*) b;
+
+    return (ta > tb) - (ta < tb);
+}
+
+
+void sstp_load_report(sstp_load_st *ctx)
+{
+    int *sorted = NULL;
+    int elapsed = 0;
+    int n = ctx->established;
+
+    elapsed = sstp_load_elapsed(&ctx->start);
+    if (elapsed <= 0)
+    {
+        elapsed = 1;
+    }
+
+    log_info("Load: %d up, %d connecting, %d failed, %.1f handshakes/sec",
+            ctx->up, ctx->started - ctx->up - ctx->failed, ctx->failed,
+            ctx->established * 1000.0 / elapsed);
+
+    log_info("Load: sent %.2f Mbit/s, received %.2f Mbit/s, %llu dropped",
+            ctx->tx_bytes * 8.0 / elapsed / 1000.0,
+            ctx->rx_bytes * 8.0 / elapsed / 1000.0,
+            (unsigned long long) ctx->drops);
+
+    if (ctx->recovered)
+    {
+        log_info("Load: recovered %d times, min %d ms, avg %d ms, max %d ms",
+                ctx->recovered, ctx->rec_min, ctx->rec_sum / ctx->recovered,
+                ctx->rec_max);
+    }
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    sorted = malloc(n * sizeof(int));
+    if (!sorted)
+    {
+        return;
+    }
+
+    memcpy(sorted, ctx->setup, n * sizeof(int));
+    qsort(sorted, n, sizeof(int), sstp_load_compare);
+
+    log_info("Load: setup time p50 %d ms, p90 %d ms, p99 %d ms, max %d ms",
+            sorted[n * 50 / 100], sorted[n * 90 / 100], sorted[n * 99 / 100],
+            sorted[n - 1]);
+
+    free(sorted);
+}
+
+
+/*!
+ * @brief Allow a socket per session, as far as we may
+ */
+static void sstp_load_nofile(int count)
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit))
+    {
+        return;
+    }
+
+    if (limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    if (limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur < count + 64)
+    {
+        log_warn("The open file limit of %llu is too low for %d sessions",
+                (unsigned long long) limit.rlim_cur, count);
+    }
+}
+
+
+status_t sstp_load_create(sstp_load_st **ctx, event_base_st *base,
+        SSL_CTX *ssl, sstp_option_st *opts, const char *server,
+        struct sockaddr *addr, int alen)
+{
+    status_t status = SSTP_FAIL;
+    timeval_st tv = { 0, SSTP_LOAD_TICK * 1000 };
+    int i = 0;
+
+    *ctx = calloc(1, sizeof(sstp_load_st));
+    if (!*ctx)
+    {
+        goto done;
+    }
+
+    (*ctx)->count   = opts->load;
+    (*ctx)->rate    = (opts->load_rate > 0) ? opts->load_rate : SSTP_LOAD_RATE;
+    (*ctx)->ssl_ctx = ssl;
+    (*ctx)->opts    = opts;
+    (*ctx)->alen    = alen;
+    (*ctx)->ev_base = base;
+    memcpy(&(*ctx)->addr, addr, alen);
+    strncpy((*ctx)->server, server, sizeof((*ctx)->server) - 1);
+
+    if (opts->load_traffic &&
+        SSTP_OKAY != sstp_load_traffic(opts->load_traffic, &(*ctx)->traffic))
+    {
+        log_err("Invalid traffic pattern: %s", opts->load_traffic);
+        goto done;
+    }
+
+    (*ctx)->sess  = calloc((*ctx)->count, sizeof(sstp_load_sess_st));
+    (*ctx)->setup = calloc((*ctx)->count, sizeof(int));
+    if (!(*ctx)->sess || !(*ctx)->setup)
+    {
+        goto done;
+    }
+
+    for (i = 0; i < (*ctx)->count; i++)
+    {
+        (*ctx)->sess[i].load = *ctx;
+        (*ctx)->sess[i].id   = i;
+    }
+
+    sstp_load_nofile((*ctx)->count);
+
+    /* Tick slower when the sessions start less often */
+    if ((*ctx)->rate < 1000 / SSTP_LOAD_TICK)
+    {
+        tv.tv_sec  = 0;
+        tv.tv_usec = (1000000 / (*ctx)->rate);
+        if (tv.tv_usec >= 1000000)
+        {
+            tv.tv_sec  = tv.tv_usec / 1000000;
+            tv.tv_usec = tv.tv_usec % 1000000;
+        }
+    }
+
+    (*ctx)->ev_ramp = event_new(base, -1, EV_PERSIST, (event_fn)
+            sstp_load_ramp, *ctx);
+    if (!(*ctx)->ev_ramp)
+    {
+        goto done;
+    }
+    event_add((*ctx)->ev_ramp, &tv);
+
+    tv.tv_sec  = SSTP_LOAD_REPORT;
+    tv.tv_usec = 0;
+    (*ctx)->ev_report = event_new(base, -1, EV_PERSIST, (event_fn)
+            sstp_load_progress, *ctx);
+    if (!(*ctx)->ev_report)
+    {
+        goto done;
+    }
+    event_add((*ctx)->ev_report, &tv);
+
+    if (opts->load_time > 0)
+    {
+        tv.tv_sec  = opts->load_time;
+        tv.tv_usec = 0;
+        (*ctx)->ev_stop = event_new(base, -1, 0, (event_fn)
+                sstp_load_stop, *ctx);
+        if (!(*ctx)->ev_stop)
+        {
+            goto done;
+        }
+        event_add((*ctx)->ev_stop, &tv);
+    }
+
+    log_info("Load testing %s with %d sessions, %d per second", server,
+            (*ctx)->count, (*ctx)->rate);
+
+    /* Start the first session right away */
+    gettimeofday(&(*ctx)->start, NULL);
+    sstp_load_ramp(-1, 0, *ctx);
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_load_free(*ctx);
+        *ctx = NULL;
+    }
+
+    return status;
+}
+
+
+void sstp_load_free(sstp_load_st *ctx)
+{
+    int i = 0;
+
+    if (!ctx)
+    {
+        return;
+    }
+
+    if (ctx->ev_ramp)
+    {
+        event_del(ctx->ev_ramp);
+        event_free(ctx->ev_ramp);
+        ctx->ev_ramp = NULL;
+    }
+
+    if (ctx->ev_report)
+    {
+        event_del(ctx->ev_report);
+        event_free(ctx->ev_report);
+        ctx->ev_report = NULL;
+    }
+
+    if (ctx->ev_stop)
+    {
+        event_del(ctx->ev_stop);
+        event_free(ctx->ev_stop);
+        ctx->ev_stop = NULL;
+    }
+
+    /* The sessions failed are reaped already, or never will be */
+    for (i = 0; ctx->sess && i < ctx->started; i++)
+    {
+        sstp_load_release(&ctx->sess[i]);
+    }
+
+    if (ctx->sess)
+    {
+        free(ctx->sess);
+    }
+
+    if (ctx->setup)
+    {
+        free(ctx->setup);
+    }
+
+    free(ctx);
+}
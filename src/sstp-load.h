@@ -0,0 +1,129 @@
+/*!
+ * @brief Load test a server with many sessions, answering PPP ourselves
+ *
+ * @file sstp-load.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_LOAD_H__
+#define __SSTP_LOAD_H__
+
+
+/*< The largest number of sessions of a load test */
+#define SSTP_LOAD_MAX           65536
+
+/*< The sessions started per second, unless given */
+#define SSTP_LOAD_RATE          50
+
+/*< The interval of the progress report (seconds) */
+#define SSTP_LOAD_REPORT        10
+
+/*< The time to wait for the server to answer a PPP request (seconds) */
+#define SSTP_LOAD_RESTART       3
+
+/*< The number of times a PPP request is sent before we give up */
+#define SSTP_LOAD_RETRY         10
+
+/*< The number of frames a session may have queued on the stream */
+#define SSTP_LOAD_TXBUF         8
+
+/*< The largest IP packet sent (bytes) */
+#define SSTP_LOAD_PKTMAX        1500
+
+
+/*!
+ * @brief The traffic pattern of a session
+ */
+typedef enum
+{
+    SSTP_LOAD_IDLE  = 0,
+    SSTP_LOAD_CBR   = 1,
+    SSTP_LOAD_BURST = 2,
+
+} sstp_load_pattern_t;
+
+
+/*!
+ * @brief The traffic of a session, @a count packets of @a size bytes each
+ *  @a interval msec
+ */
+typedef struct
+{
+    /*< The pattern */
+    sstp_load_pattern_t pattern;
+
+    /*< The number of packets sent at once */
+    int count;
+
+    /*< The size of the IP packets (bytes) */
+    int size;
+
+    /*< The interval (msec) */
+    int interval;
+
+} sstp_load_traffic_st;
+
+
+struct sstp_load;
+typedef struct sstp_load sstp_load_st;
+
+
+/*!
+ * @brief Parse a traffic pattern: "idle", "cbr:<pps>:<bytes>" or
+ *  "burst:<count>:<bytes>:<msec>"
+ *
+ * @retval SSTP_OKAY, or SSTP_FAIL if the pattern is invalid
+ */
+status_t sstp_load_traffic(const char *spec, sstp_load_traffic_st *traffic);
+
+
+/*!
+ * @brief Start the sessions of the load test against a server
+ *
+ * @par Note:
+ *  Each session runs the HTTP handshake and the SSTP state machine as the
+ *  client does, then negotiates LCP, authenticates with PAP or MS-CHAPv2
+ *  and negotiates IPCP itself. Once up, the session sends UDP datagrams
+ *  to the discard port of the server's end of the link. The sessions are
+ *  started at opts->load_rate per second, and the progress is logged each
+ *  SSTP_LOAD_REPORT seconds. A session that went down is started again
+ *  after opts->load_reconnect seconds, if given. The event loop is left
+ *  after opts->load_time seconds, if given.
+ */
+status_t sstp_load_create(sstp_load_st **ctx, event_base_st *base,
+        SSL_CTX *ssl, sstp_option_st *opts, const char *server,
+        struct sockaddr *addr, int alen);
+
+
+/*!
+ * @brief Log the handshake rate, the setup time percentiles, the time
+ *  to recover of the sessions reconnected and the throughput since the
+ *  start
+ */
+void sstp_load_report(sstp_load_st *ctx);
+
+
+/*!
+ * @brief Close the sessions and release the load test
+ */
+void sstp_load_free(sstp_load_st *ctx);
+
+
+#endif /* #ifndef __SSTP_LOAD_H__ */
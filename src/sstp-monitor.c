@@ -0,0 +1,336 @@
+/*!
+ * @brief Watch the links and routes for a change of path to the server
+ *
+ * @file sstp-monitor.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#include "sstp-private.h"
+
+#ifdef HAVE_NETLINK
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+
+/*!
+ * @brief The link and route monitor
+ */
+struct sstp_monitor
+{
+    /*< The netlink socket subscribed to the changes */
+    int sock;
+
+    /*< The destination watched */
+    struct sockaddr_storage dst;
+
+    /*< Do we watch a destination */
+    int watch;
+
+    /*< The route to the destination when last looked up */
+    sstp_route_st egress;
+
+    /*< Routes through this interface are ignored */
+    int exclude;
+
+    /*< The route context */
+    sstp_route_ctx_st *route;
+
+    /*< Called when the route moved */
+    sstp_monitor_fn moved_cb;
+
+    /*< The argument to the callback */
+    void *arg;
+
+    /*< Receive the changes */
+    event_st *ev_recv;
+
+    /*< Look up the route once the changes settled */
+    event_st *ev_settle;
+
+    /*< The event base */
+    event_base_st *ev_base;
+};
+
+
+#ifdef HAVE_NETLINK
+
+/*!
+ * @brief Check if the route leaves through another interface or address
+ */
+static int sstp_monitor_moved(sstp_route_st *prev, sstp_route_st *next)
+{
+    if (prev->oif != next->oif)
+    {
+        return 1;
+    }
+
+    if (prev->have.src != next->have.src)
+    {
+        return 1;
+    }
+
+    if (prev->have.src && memcmp(&prev->src, &next->src, next->rt_blen))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+
+/*!
+ * @brief The changes have settled, look up the route again
+ *
+ * @par Note:
+ *  With --save-server-route the lookup finds the host route pinned to
+ *  the server, which outranks a better default route added later. Only
+ *  once the old interface goes away, and the host route with it, does
+ *  the route move.
+ */
+static void sstp_monitor_settle(int fd, short event, sstp_monitor_st *ctx)
+{
+    sstp_route_st route;
+
+    if (!ctx->watch)
+    {
+        return;
+    }
+
+    /* No route at the moment, wait for the next change */
+    if (sstp_route_get(ctx->route, (struct sockaddr*) &ctx->dst, &route))
+    {
+        return;
+    }
+
+    /* The tunnel can't carry its own traffic */
+    if (ctx->exclude && route.oif == ctx->exclude)
+    {
+        return;
+    }
+
+    if (!sstp_monitor_moved(&ctx->egress, &route))
+    {
+        return;
+    }
+
+    memcpy(&ctx->egress, &route, sizeof(route));
+    ctx->moved_cb(ctx->arg, ctx->egress.ifname);
+}
+
+
+/*!
+ * @brief Drain the changes reported by the kernel
+ */
+static void sstp_monitor_recv(int fd, short event, sstp_monitor_st *ctx)
+{
+    timeval_st tv = { 0, SSTP_MONITOR_SETTLE * 1000 };
+    char buf[8192];
+    int changed = 0;
+    int ret = 0;
+
+    while (1)
+    {
+        ret = recv(ctx->sock, buf, sizeof(buf), MSG_DONTWAIT);
+        if (ret > 0)
+        {
+            changed = 1;
+            continue;
+        }
+
+        /* Changes were lost, assume the worst */
+        if (ret < 0 && errno == ENOBUFS)
+        {
+            changed = 1;
+            continue;
+        }
+
+        break;
+    }
+
+    /* Wait for the burst to settle, but don't postpone any further */
+    if (changed && !evtimer_pending(ctx->ev_settle, NULL))
+    {
+        evtimer_add(ctx->ev_settle, &tv);
+    }
+}
+
+
+status_t sstp_monitor_watch(sstp_monitor_st *ctx, struct sockaddr *dst)
+{
+    int alen = (dst->sa_family == AF_INET6)
+            ? sizeof(struct sockaddr_in6)
+            : sizeof(struct sockaddr_in);
+
+    ctx->watch = 0;
+
+    memset(&ctx->dst, 0, sizeof(ctx->dst));
+    memcpy(&ctx->dst, dst, alen);
+
+    if (sstp_route_get(ctx->route, dst, &ctx->egress))
+    {
+        return SSTP_FAIL;
+    }
+
+    ctx->watch = 1;
+    return SSTP_OKAY;
+}
+
+
+void sstp_monitor_exclude(sstp_monitor_st *ctx, const char *ifname)
+{
+    ctx->exclude = if_nametoindex(ifname);
+}
+
+
+status_t sstp_monitor_create(sstp_monitor_st **ctx, event_base_st *base,
+        sstp_route_ctx_st *route, sstp_monitor_fn moved, void *arg)
+{
+    struct sockaddr_nl addr;
+    status_t status = SSTP_FAIL;
+
+    *ctx = calloc(1, sizeof(sstp_monitor_st));
+    if (!*ctx)
+    {
+        goto done;
+    }
+
+    (*ctx)->route    = route;
+    (*ctx)->moved_cb = moved;
+    (*ctx)->arg      = arg;
+    (*ctx)->ev_base  = base;
+
+    (*ctx)->sock = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if ((*ctx)->sock < 0)
+    {
+        goto done;
+    }
+
+    if (fcntl((*ctx)->sock, F_SETFL, O_NONBLOCK))
+    {
+        goto done;
+    }
+
+    /* Subscribe to the changes of links, addresses and routes */
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = RTMGRP_LINK | 
+                     RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR |
+                     RTMGRP_IPV4_ROUTE  | RTMGRP_IPV6_ROUTE;
+
+    if (bind((*ctx)->sock, (struct sockaddr*) &addr, sizeof(addr)))
+    {
+        goto done;
+    }
+
+    (*ctx)->ev_recv = event_new(base, (*ctx)->sock, EV_READ | EV_PERSIST,
+            (event_fn) sstp_monitor_recv, *ctx);
+    if (!(*ctx)->ev_recv)
+    {
+        goto done;
+    }
+
+    (*ctx)->ev_settle = evtimer_new(base, (event_fn) 
+            sstp_monitor_settle, *ctx);
+    if (!(*ctx)->ev_settle)
+    {
+        goto done;
+    }
+
+    event_add((*ctx)->ev_recv, NULL);
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_monitor_free(*ctx);
+        *ctx = NULL;
+    }
+
+    return status;
+}
+
+#else   /* #ifdef HAVE_NETLINK */
+
+
+status_t sstp_monitor_watch(sstp_monitor_st *ctx, struct sockaddr *dst)
+{
+    return SSTP_NOTIMPL;
+}
+
+
+void sstp_monitor_exclude(sstp_monitor_st *ctx, const char *ifname)
+{
+    return;
+}
+
+
+status_t sstp_monitor_create(sstp_monitor_st **ctx, event_base_st *base,
+        sstp_route_ctx_st *route, sstp_monitor_fn moved, void *arg)
+{
+    *ctx = NULL;
+    return SSTP_NOTIMPL;
+}
+
+#endif  /* #ifdef HAVE_NETLINK */
+
+
+void sstp_monitor_free(sstp_monitor_st *ctx)
+{
+    if (!ctx)
+    {
+        return;
+    }
+
+    if (ctx->ev_settle)
+    {
+        event_del(ctx->ev_settle);
+        event_free(ctx->ev_settle);
+        ctx->ev_settle = NULL;
+    }
+
+    if (ctx->ev_recv)
+    {
+        event_del(ctx->ev_recv);
+        event_free(ctx->ev_recv);
+        ctx->ev_recv = NULL;
+    }
+
+    if (ctx->sock > 0)
+    {
+        close(ctx->sock);
+        ctx->sock = 0;
+    }
+
+    free(ctx);
+}
@@ -0,0 +1,81 @@
+/*!
+ * @brief Watch the links and routes for a change of path to the server
+ *
+ * @file sstp-monitor.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_MONITOR_H__
+#define __SSTP_MONITOR_H__
+
+
+/*< The time to let a burst of link and route changes settle (msec) */
+#define SSTP_MONITOR_SETTLE     100
+
+
+struct sstp_monitor;
+typedef struct sstp_monitor sstp_monitor_st;
+
+
+/*!
+ * @brief Called when the route to the destination leaves through another
+ *  interface, or from another source address
+ *
+ * @param arg       The argument given to sstp_monitor_create()
+ * @param ifname    The interface the route now leaves through
+ */
+typedef void (*sstp_monitor_fn)(void *arg, const char *ifname);
+
+
+/*!
+ * @brief Subscribe to the changes of links, addresses and routes
+ *
+ * @param route     The route context used to look up the destination
+ *
+ * @retval SSTP_OKAY, or SSTP_NOTIMPL without netlink
+ */
+status_t sstp_monitor_create(sstp_monitor_st **ctx, event_base_st *base,
+        sstp_route_ctx_st *route, sstp_monitor_fn moved, void *arg);
+
+
+/*!
+ * @brief Watch the route to @a dst, taking its current path as reference
+ *
+ * @par Note:
+ *  The route is looked up again once the changes reported by the kernel 
+ *  have settled for SSTP_MONITOR_SETTLE msec. The reference is kept while
+ *  there is no route at all, as the path may well come back.
+ */
+status_t sstp_monitor_watch(sstp_monitor_st *ctx, struct sockaddr *dst);
+
+
+/*!
+ * @brief Ignore routes leaving through @a ifname, i.e. the tunnel itself
+ */
+void sstp_monitor_exclude(sstp_monitor_st *ctx, const char *ifname);
+
+
+/*!
+ * @brief Release the resources of the monitor
+ */
+void sstp_monitor_free(sstp_monitor_st *ctx);
+
+
+#endif /* #ifndef __SSTP_MONITOR_H__ */
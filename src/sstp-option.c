@@ -75,23 +75,49 @@ void sstp_usage_die(const char *prog, int code,
 
 
     /* Print the usage text */
-    printf("Usage: %s <sstp-options> <hostname> [[--] <pppd-options>]\n", prog);
+    printf("Usage: %s <sstp-options> <hostname>[,<hostname>...] [[--] <pppd-options>]\n", prog);
     printf("   Or: pppd pty \"%s --nolaunchpppd <sstp-options> <hostname>\"\n\n", prog);
     printf("Available sstp options:\n");
+    printf("  --auto-mtu               Size the PPP MTU/MRU to the path to the server\n");
+    printf("  --busy-poll <usec>       Busy poll for a while before sleeping\n");
     printf("  --ca-cert <cert>         Provide the CA certificate in PEM format\n");
     printf("  --ca-path <path>         Provide the CA certificate path\n");
     printf("  --cert-warn              Warn on certificate errors\n");
+    printf("  --config <file>          Read the tunables from this file\n");
+    printf("  --cpu <cpus>             Run on these CPUs, e.g. 2,4-5\n");
     printf("  --ipparam <param>        The unique connection id used w/pppd\n");
     printf("  --help                   Display this menu\n");
     printf("  --debug                  Enable debug mode\n");
+    printf("  --early-pppd             Start pppd while connecting to the server\n");
+    printf("  --flows                  Account the traffic per flow and protocol\n");
+    printf("  --keepalive <sec>        Idle time before probing the server\n");
+    printf("  --keepalive-max <sec>    Maximum idle time before probing the server\n");
+    printf("  --links <count>          Bundle this many connections with multilink PPP\n");
+    printf("  --load <sessions>        Load test the server with these sessions, no pppd\n");
+    printf("  --load-rate <per sec>    Start the load test sessions at this rate\n");
+    printf("  --load-reconnect <sec>   Reconnect a failed load test session after this long\n");
+    printf("  --load-time <sec>        Run the load test this long\n");
+    printf("  --load-traffic <pattern> The traffic of each load test session\n");
+    printf("  --monitor                Reconnect when the route to the server changes\n");
     printf("  --nolaunchpppd           Don't start pppd, for use with pty option\n");
     printf("  --password               Password\n");
+    printf("  --ping <count>           Report the round-trip time to the server\n");
+    printf("  --pppd-cpu <cpus>        Run pppd on these CPUs\n");
     printf("  --priv-user              The user to run as\n");
     printf("  --priv-group             The group to run as\n");
     printf("  --priv-dir               The privilege separation directory\n");
     printf("  --proxy                  Proxy URL\n");
+    printf("  --realtime <prio>        Lock memory and run with SCHED_FIFO priority\n");
+    printf("  --record <file>          Record the session, to replay it later\n");
+    printf("  --replay <file>          Replay a recorded session, no server or pppd\n");
+    printf("  --replay-fast            Replay as fast as possible, not as recorded\n");
+    printf("  --route-file <file>      Route these prefixes through the tunnel\n");
     printf("  --user                   Username\n");
     printf("  --save-server-route      Add route to VPN server\n");
+    printf("  --stall-budget <msec>    Log callbacks stalling the event loop longer\n");
+    printf("  --standby                Keep a standby connection for fail-over\n");
+    printf("  --standby-refresh <sec>  Refresh interval of the standby connection\n");
+    printf("  --standby-server <host>  Keep the standby connection to another server\n");
     printf("  --uuid                   The connection id\n");
     printf("  --version                Display the version information\n\n");
 
@@ -210,6 +236,141 @@ static void sstp_parse_option(sstp_option_st *ctx, int argc, char **argv, int in
         ctx->enable |= SSTP_OPT_SAVEROUTE;
         break;
 
+    case 15:
+        ctx->enable |= SSTP_OPT_STANDBY;
+        break;
+
+    case 16:
+        ctx->standby_refresh = atoi(optarg);
+        if (ctx->standby_refresh <= 0)
+            sstp_usage_die(argv[0], -1, "Invalid standby refresh interval");
+        break;
+
+    case 17:
+        ctx->enable |= SSTP_OPT_STANDBY;
+        ctx->standby = strdup(optarg);
+        break;
+
+    case 18:
+        ctx->enable |= SSTP_OPT_EARLYPPPD;
+        break;
+
+    case 19:
+        ctx->keepalive = atoi(optarg);
+        if (ctx->keepalive <= 0)
+            sstp_usage_die(argv[0], -1, "Invalid keepalive interval");
+        break;
+
+    case 20:
+        ctx->keepalive_max = atoi(optarg);
+        if (ctx->keepalive_max <= 0)
+            sstp_usage_die(argv[0], -1, "Invalid keepalive interval");
+        break;
+
+    case 21:
+        ctx->ping = atoi(optarg);
+        if (ctx->ping <= 0)
+            sstp_usage_die(argv[0], -1, "Invalid ping count");
+        break;
+
+    case 22:
+        ctx->busy_poll = atoi(optarg);
+        if (ctx->busy_poll <= 0)
+            sstp_usage_die(argv[0], -1, "Invalid busy poll time");
+        break;
+
+    case 23:
+        ctx->cpus = strdup(optarg);
+        break;
+
+    case 24:
+        ctx->pppd_cpus = strdup(optarg);
+        break;
+
+    case 25:
+        ctx->realtime = atoi(optarg);
+        if (ctx->realtime <= 0 || ctx->realtime > 99)
+            sstp_usage_die(argv[0], -1, "Invalid real-time priority");
+        break;
+
+    case 26:
+        ctx->stall_budget = atoi(optarg);
+        if (ctx->stall_budget <= 0)
+            sstp_usage_die(argv[0], -1, "Invalid stall budget");
+        break;
+
+    case 27:
+        ctx->enable |= SSTP_OPT_FLOWS;
+        break;
+
+    case 28:
+        ctx->route_file = strdup(optarg);
+        break;
+
+    case 29:
+        ctx->enable |= SSTP_OPT_MONITOR;
+        break;
+
+    case 30:
+        ctx->enable |= SSTP_OPT_AUTOMTU;
+        break;
+
+    case 31:
+        ctx->config = strdup(optarg);
+        break;
+
+    case 32:
+        ctx->load = atoi(optarg);
+        if (ctx->load <= 0 || ctx->load > SSTP_LOAD_MAX)
+            sstp_usage_die(argv[0], -1, "Invalid number of sessions");
+        break;
+
+    case 33:
+        ctx->load_rate = atoi(optarg);
+        if (ctx->load_rate <= 0)
+            sstp_usage_die(argv[0], -1, "Invalid session rate");
+        break;
+
+    case 34:
+    {
+        sstp_load_traffic_st traffic;
+
+        if (SSTP_OKAY != sstp_load_traffic(optarg, &traffic))
+            sstp_usage_die(argv[0], -1, "Invalid traffic pattern: %s", optarg);
+        ctx->load_traffic = strdup(optarg);
+        break;
+    }
+
+    case 35:
+        ctx->load_time = atoi(optarg);
+        if (ctx->load_time <= 0)
+            sstp_usage_die(argv[0], -1, "Invalid load test duration");
+        break;
+
+    case 36:
+        ctx->record = strdup(optarg);
+        break;
+
+    case 37:
+        ctx->replay = strdup(optarg);
+        break;
+
+    case 38:
+        ctx->enable |= SSTP_OPT_REPLAYFAST;
+        break;
+
+    case 39:
+        ctx->links = atoi(optarg);
+        if (ctx->links <= 0 || ctx->links > SSTP_LINK_MAX)
+            sstp_usage_die(argv[0], -1, "Invalid number of links");
+        break;
+
+    case 40:
+        ctx->load_reconnect = atoi(optarg);
+        if (ctx->load_reconnect <= 0)
+            sstp_usage_die(argv[0], -1, "Invalid load test reconnect time");
+        break;
+
     default:
         sstp_usage_die(argv[0], -1, "Unrecognized command line option");
         break;
@@ -219,16 +380,52 @@ static void sstp_parse_option(sstp_option_st *ctx, int argc, char **argv, int in
 }
 
 
+/*!
+ * @brief Split the comma separated list of servers
+ */
+static void sstp_parse_servers(sstp_option_st *ctx, const char *prog, 
+        const char *list)
+{
+    char *copy = strdup(list);
+    char *save = NULL;
+    char *name = NULL;
+
+    for (name = strtok_r(copy, ",", &save); name; 
+         name = strtok_r(NULL, ",", &save))
+    {
+        if (ctx->nservers == SSTP_MAX_SERVERS)
+        {
+            sstp_usage_die(prog, -1, "Too many servers specified, max is %d",
+                    SSTP_MAX_SERVERS);
+        }
+
+        ctx->servers[ctx->nservers++] = strdup(name);
+    }
+
+    free(copy);
+
+    if (!ctx->nservers)
+    {
+        sstp_usage_die(prog, -1, "No server was specified");
+    }
+
+    /* The first server is used unless we probe them all */
+    ctx->server = ctx->servers[0];
+}
+
+
 void sstp_option_free(sstp_option_st *ctx)
 {
+    int i = 0;
+
     if (ctx->ca_cert)
         free(ctx->ca_cert);
 
     if (ctx->ca_path)
         free(ctx->ca_path);
 
-    if (ctx->server)
-        free(ctx->server);
+    for (i = 0; i < ctx->nservers; i++)
+        free(ctx->servers[i]);
 
     if (ctx->ipparam)
         free(ctx->ipparam);
@@ -248,12 +445,36 @@ void sstp_option_free(sstp_option_st *ctx)
     if (ctx->proxy)
         free(ctx->proxy);
 
+    if (ctx->cpus)
+        free(ctx->cpus);
+
+    if (ctx->pppd_cpus)
+        free(ctx->pppd_cpus);
+
+    if (ctx->route_file)
+        free(ctx->route_file);
+
+    if (ctx->config)
+        free(ctx->config);
+
+    if (ctx->load_traffic)
+        free(ctx->load_traffic);
+
+    if (ctx->record)
+        free(ctx->record);
+
+    if (ctx->replay)
+        free(ctx->replay);
+
     if (ctx->uuid)
         free(ctx->uuid);
 
     if (ctx->user)
         free(ctx->user);
 
+    if (ctx->standby)
+        free(ctx->standby);
+
     /* Reset the entire structure */
     memset(ctx, 0, sizeof(sstp_option_st));
 }
@@ -262,6 +483,7 @@ void sstp_option_free(sstp_option_st *ctx)
 int sstp_parse_argv(sstp_option_st *ctx, int argc, char **argv)
 {
     int option_index = 0;
+    int line = 0;
     static struct option option_long[] = 
     {
         { "ca-cert",        required_argument, NULL,  0  }, /* 0 */
@@ -279,6 +501,32 @@ int sstp_parse_argv(sstp_option_st *ctx, int argc, char **argv)
         { "user",           required_argument, NULL,  0  },
         { "uuid",           required_argument, NULL,  0  },
         { "save-server-route", no_argument,    NULL,  0  },
+        { "standby",        no_argument,       NULL,  0  }, /* 15 */
+        { "standby-refresh", required_argument, NULL, 0  },
+        { "standby-server", required_argument, NULL,  0  },
+        { "early-pppd",     no_argument,       NULL,  0  },
+        { "keepalive",      required_argument, NULL,  0  },
+        { "keepalive-max",  required_argument, NULL,  0  }, /* 20 */
+        { "ping",           required_argument, NULL,  0  },
+        { "busy-poll",      required_argument, NULL,  0  },
+        { "cpu",            required_argument, NULL,  0  },
+        { "pppd-cpu",       required_argument, NULL,  0  },
+        { "realtime",       required_argument, NULL,  0  }, /* 25 */
+        { "stall-budget",   required_argument, NULL,  0  },
+        { "flows",          no_argument,       NULL,  0  },
+        { "route-file",     required_argument, NULL,  0  },
+        { "monitor",        no_argument,       NULL,  0  },
+        { "auto-mtu",       no_argument,       NULL,  0  }, /* 30 */
+        { "config",         required_argument, NULL,  0  },
+        { "load",           required_argument, NULL,  0  },
+        { "load-rate",      required_argument, NULL,  0  },
+        { "load-traffic",   required_argument, NULL,  0  },
+        { "load-time",      required_argument, NULL,  0  }, /* 35 */
+        { "record",         required_argument, NULL,  0  },
+        { "replay",         required_argument, NULL,  0  },
+        { "replay-fast",    no_argument,       NULL,  0  },
+        { "links",          required_argument, NULL,  0  },
+        { "load-reconnect", required_argument, NULL,  0  }, /* 40 */
         { "version",        no_argument,       NULL, 'v' },
         { 0, 0, 0, 0 }
     };
@@ -342,20 +590,38 @@ int sstp_parse_argv(sstp_option_st *ctx, int argc, char **argv)
         ctx->priv_dir = strdup(SSTP_RUNTIME_DIR);
     }
 
-    /* At least one argument is required */
-    if (argc <= optind)
+    /* Load the tunables */
+    if (ctx->config && SSTP_OKAY != sstp_tune_load(ctx->config, &line))
+    {
+        sstp_usage_die(argv[0], -1, "Could not load the tunables from %s, "
+                "line %d", ctx->config, line);
+    }
+
+    /* At least one argument is required, unless replaying a recording */
+    if (argc <= optind && !ctx->replay)
     {
         sstp_usage_die(argv[0], -1, "At least one argument is required");
     }
 
+    /* Each link is an sstpc with a pppd of its own */
+    if (ctx->links > 1 && ((ctx->enable & SSTP_OPT_NOLAUNCH) || 
+            ctx->load || ctx->replay || ctx->record))
+    {
+        sstp_usage_die(argv[0], -1, "The links can't be used with "
+                "--nolaunchpppd, --load, --replay or --record");
+    }
+
     /* Don't use the plugin as user-name and password is specified */
     if (ctx->user && ctx->password)
     {
         ctx->enable |= SSTP_OPT_NOPLUGIN;
     }
 
-    /* Copy the server argument */
-    ctx->server = strdup(argv[optind++]);
+    /* Copy the server argument, a comma separated list of servers */
+    if (argc > optind)
+    {
+        sstp_parse_servers(ctx, argv[0], argv[optind++]);
+    }
 
     /* PPPD options to follow */
     ctx->pppdargc = argc - optind;
@@ -33,6 +33,15 @@
 #define SSTP_OPT_NOPLUGIN       0x0008
 #define SSTP_OPT_CERTWARN       0x0010
 #define SSTP_OPT_SAVEROUTE      0x0020
+#define SSTP_OPT_STANDBY        0x0040
+#define SSTP_OPT_EARLYPPPD      0x0080
+#define SSTP_OPT_FLOWS          0x0100
+#define SSTP_OPT_MONITOR        0x0200
+#define SSTP_OPT_AUTOMTU        0x0400
+#define SSTP_OPT_REPLAYFAST     0x1000
+
+/*< The maximum number of servers to choose from */
+#define SSTP_MAX_SERVERS        8
 
 
 /*!
@@ -49,9 +58,15 @@ typedef struct
     /*! The CA certificate path */
     char *ca_path;
 
-    /*! The original server string */
+    /*! The active server, one of @a servers */
     char *server;
 
+    /*! The list of servers to choose from */
+    char *servers[SSTP_MAX_SERVERS];
+
+    /*! The number of servers in the list */
+    int nservers;
+
     /*! Unique connection parameter */
     char *ipparam;
 
@@ -76,6 +91,69 @@ typedef struct
     /*! Use a persistent UUID */
     char *uuid;
 
+    /*! The server to keep a standby connection to */
+    char *standby;
+
+    /*! The refresh interval of the standby connection */
+    int standby_refresh;
+
+    /*! The idle time before probing the server */
+    int keepalive;
+
+    /*! The maximum idle time before probing the server */
+    int keepalive_max;
+
+    /*! The number of Echo-Requests to send in ping mode */
+    int ping;
+
+    /*! Busy poll the descriptors this long before blocking (usec) */
+    int busy_poll;
+
+    /*! The CPUs to run on */
+    char *cpus;
+
+    /*! The CPUs to run pppd on */
+    char *pppd_cpus;
+
+    /*! The SCHED_FIFO priority, if any */
+    int realtime;
+
+    /*! The file of split-tunnel routes to install */
+    char *route_file;
+
+    /*! The file of tunables, if any */
+    char *config;
+
+    /*! The time a callback may hold the event loop before logged (msec) */
+    int stall_budget;
+
+    /*! The number of sessions of a load test, if any */
+    int load;
+
+    /*! The number of load test sessions started per second */
+    int load_rate;
+
+    /*! The traffic of each load test session, if any */
+    char *load_traffic;
+
+    /*! The duration of the load test (seconds), or zero */
+    int load_time;
+
+    /*! The time before a failed load test session reconnects (seconds), or zero */
+    int load_reconnect;
+
+    /*! The file to record the session to, if any */
+    char *record;
+
+    /*! The recorded session to replay, if any */
+    char *replay;
+
+    /*! The number of links of the multilink bundle, if more than one */
+    int links;
+
+    /*! The number of this link of the bundle, zero for the first */
+    int link;
+
     /*! The number of arguments to pppd */
     int pppdargc;
 
@@ -104,9 +104,16 @@ typedef enum
  * @brief Help trace the packet
  */
 #define sstp_pkt_trace(buf, dir)     \
-    if (SSTP_LOG_TRACE <= sstp_log_level()) \
     {                                       \
-        sstp_pkt_dump(buf, dir, __FILE__, __LINE__);    \
+        static sstp_log_site_st __site = { .file = __FILE__ }; \
+        if (sstp_log_site_pass(&__site))                \
+        {                                               \
+            uint64_t __start = sstp_cycle_start();      \
+            sstp_pkt_dump(buf, dir, __FILE__, __LINE__);\
+            sstp_cycle_stop((dir == SSTP_DIR_SEND)      \
+                ? SSTP_CYCLE_TRACE_SEND                 \
+                : SSTP_CYCLE_TRACE_RECV, __start, (buf)->len); \
+        }                                               \
     }
 
 
@@ -47,15 +47,36 @@ struct sstp_pppd
     /*< A buffer we can send data with */
     sstp_buff_st *tx_buf;
 
+    /*< The frames encoded for pppd, waiting to be written */
+    sstp_buff_st *wr_buf;
+
     /*< The SSL stream context */
     sstp_stream_st *stream;
 
     /*< Listener for retrieving data from pppd */
     event_st *ev_recv;
 
+    /*< Writes the frames of wr_buf once pppd can take them */
+    event_st *ev_write;
+
+    /*< The timing probe of the listener */
+    sstp_probe_st probe;
+
+    /*< The timing probe of the writer */
+    sstp_probe_st wr_probe;
+
     /*< The event base */
     event_base_st *ev_base;
 
+    /*< The scheduler, if any */
+    sstp_sched_st *sched;
+
+    /*< The flow accounting, if enabled */
+    sstp_flow_ctx_st *flow;
+
+    /*< The MTU/MRU to start pppd with, or zero */
+    int mtu;
+
     /*< The chap structure */
     sstp_chap_st chap;
 
@@ -97,7 +118,7 @@ struct sstp_pppd
 };
 
 
-static status_t ppp_process_data(sstp_pppd_st *ctx);
+static status_t ppp_process_data(sstp_pppd_st *ctx, int budget);
 
 
 /*!
@@ -136,7 +157,7 @@ static void ppp_send_complete(sstp_stream_st *stream, sstp_buff_st *buf,
     }
 
     /* Continue processing input */
-    status = ppp_process_data(ctx);
+    status = ppp_process_data(ctx, sstp_sched_budget(ctx->sched));
     switch (status)
     {
     case SSTP_INPROG:
@@ -295,14 +316,53 @@ static void sstp_pppd_check_auth(sstp_pppd_st* ctx, sstp_buff_st *tx)
 }
 
 
+/*!
+ * @brief Continue processing the input once we are back in the event loop
+ */
+static void ppp_process_cont(sstp_pppd_st *ctx, int budget)
+{
+    /* Held until we get a new stream */
+    if (!ctx->stream)
+    {
+        return;
+    }
+
+    switch (ppp_process_data(ctx, budget))
+    {
+    case SSTP_INPROG:
+        /* Will be resumed by ppp_send_complete or the scheduler */
+        break;
+
+    case SSTP_OKAY:
+        event_add(ctx->ev_recv, NULL);
+        break;
+
+    case SSTP_FAIL:
+    default:
+        /* The frames can't be sent, drop them and fail the stream; the
+         * call is torn down, or rebound to a new stream */
+        log_err("Could not forward the frames from pppd, aborting");
+        sstp_buff_reset(ctx->rx_buf);
+        sstp_stream_abort(ctx->stream);
+        break;
+    }
+}
+
+
 /*!
  * @brief Process any data in the input buffer and forward them to server
+ *
+ * @par Note:
+ *  With a scheduler, at most @a budget frames are forwarded before we 
+ *  yield to the event loop; the remaining frames are processed by the
+ *  ppp_process_cont() and SSTP_INPROG is returned.
  */
-static status_t ppp_process_data(sstp_pppd_st *ctx)
+static status_t ppp_process_data(sstp_pppd_st *ctx, int budget)
 {
     sstp_buff_st *rx = ctx->rx_buf;
     sstp_buff_st *tx = ctx->tx_buf;
     status_t ret = SSTP_FAIL;
+    uint64_t start = 0;
 
     /* Initialize TX-buffer */
     sstp_buff_reset(tx);
@@ -313,6 +373,17 @@ static status_t ppp_process_data(sstp_pppd_st *ctx)
         int max = 0;
         int off = 0;
 
+        /* Give the other direction a chance */
+        if (ctx->sched && budget-- <= 0)
+        {
+            ret = sstp_sched_defer(ctx->sched, SSTP_SCHED_UPLINK, 
+                    (sstp_sched_fn) ppp_process_cont, ctx);
+            if (SSTP_OKAY == ret)
+            {
+                return SSTP_INPROG;
+            }
+        }
+
         /* Initialize send buffer */
         ret = sstp_pkt_init(tx, SSTP_MSG_DATA);
         if (SSTP_OKAY != ret)
@@ -323,8 +394,10 @@ static status_t ppp_process_data(sstp_pppd_st *ctx)
         /* Copy a single frame to the tx-buffer */
         max = tx->max - tx->len;
         off = rx->len - rx->off;
+        start = sstp_cycle_start();
         ret = sstp_frame_decode((unsigned char*) rx->data + rx->off, &off,
             (unsigned char*) tx->data + tx->len, &max);
+        sstp_cycle_stop(SSTP_CYCLE_DECODE, start, off);
         if (SSTP_OKAY != ret)
         {
             /* We needed to read more ... */
@@ -345,6 +418,13 @@ static status_t ppp_process_data(sstp_pppd_st *ctx)
             continue;
         }
 
+        /* Account the frame before it's sent */
+        if (ctx->flow)
+        {
+            sstp_flow_account(ctx->flow, SSTP_FLOW_SEND, (unsigned char*) 
+                    tx->data + tx->len, max);
+        }
+
         /* Update length */
         tx->len += max;
         rx->off += off;
@@ -352,13 +432,13 @@ static status_t ppp_process_data(sstp_pppd_st *ctx)
         /* Update the final length of the packet */
         sstp_pkt_update(tx);
 
-        /* If plugin is not enabled, then we need to check for auth */
+        /* Unless the plugin reports it, we need to check for auth */
         if (ctx->auth_check && !ctx->auth_done) 
         {
             sstp_pppd_check_auth(ctx, tx);
         }
 
-        /* If plugin is not enabled, then we need to send ip-up */
+        /* Unless the plugin reports it, we need to send ip-up */
         if (ctx->auth_check && ctx->auth_done && !ctx->ip_up)
         {
             sstp_pppd_ipup(ctx, tx);
@@ -396,10 +476,14 @@ static void sstp_pppd_recv(int fd, short event, sstp_pppd_st *ctx)
 {
     sstp_buff_st *rx = ctx->rx_buf;
     status_t ret = SSTP_FAIL;
+    uint64_t start = 0;
+    int len = 0;
 
     /* Receive a chunk */
-    rx->len += read(fd, rx->data + rx->len, rx->max - rx->len);
-    if (rx->len <= 0)
+    start = sstp_cycle_start();
+    len = read(fd, rx->data + rx->len, rx->max - rx->len);
+    sstp_cycle_stop(SSTP_CYCLE_PTY_READ, start, len);
+    if (len <= 0)
     {
         if (ctx->notify)
         {
@@ -407,9 +491,21 @@ static void sstp_pppd_recv(int fd, short event, sstp_pppd_st *ctx)
         }
         goto done;
     }
+    sstp_record(SSTP_RECORD_PPP, SSTP_RECORD_IN, rx->data + rx->len, len);
+    rx->len += len;
+
+    /* Hold the frames until we have a stream to send them on */
+    if (!ctx->stream)
+    {
+        if (rx->len < rx->max)
+        {
+            event_add(ctx->ev_recv, NULL);
+        }
+        goto done;
+    }
 
     /* Process the input */
-    ret = ppp_process_data(ctx);
+    ret = ppp_process_data(ctx, sstp_sched_budget(ctx->sched));
     switch (ret)
     {
     case SSTP_INPROG:
@@ -433,43 +529,125 @@ done:
 }
 
 
+/*!
+ * @brief Write the frames held in wr_buf to pppd
+ *
+ * @return SSTP_OKAY when all were written, SSTP_INPROG if the rest waits 
+ *  for ev_write, or SSTP_FAIL on error (the frames are then dropped)
+ */
+static status_t sstp_pppd_flush(sstp_pppd_st *ctx)
+{
+    sstp_buff_st *wr = ctx->wr_buf;
+    uint64_t start = 0;
+    int ret = 0;
+
+    while (wr->off < wr->len)
+    {
+        start = sstp_cycle_start();
+        ret = write(ctx->sock, wr->data + wr->off, wr->len - wr->off);
+        sstp_cycle_stop(SSTP_CYCLE_PTY_WRITE, start, ret);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                break;
+            }
+
+            log_err("Could not complete write of frame, %s (%d)", 
+                    strerror(errno), errno);
+            sstp_buff_reset(wr);
+            return SSTP_FAIL;
+        }
+
+        wr->off += ret;
+    }
+
+    if (wr->off < wr->len)
+    {
+        /* Move the rest to the front, making room behind it */
+        memmove(wr->data, wr->data + wr->off, wr->len - wr->off);
+        wr->len -= wr->off;
+        wr->off  = 0;
+
+        event_add(ctx->ev_write, NULL);
+        return SSTP_INPROG;
+    }
+
+    sstp_buff_reset(wr);
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Write the rest of the frames, pppd can take more
+ */
+static void sstp_pppd_write_cont(int fd, short event, sstp_pppd_st *ctx)
+{
+    sstp_pppd_flush(ctx);
+}
+
+
 /*!
  * @brief Send data received from the sstp peer back through pppd/pppX
+ *
+ * @par Note:
+ *  The frame is encoded straight into wr_buf, behind the frames not yet
+ *  written. These are written together as the event loop turns, once the
+ *  packets at hand are handled, or as soon as wr_buf runs out of room.
  */
 status_t sstp_pppd_send(sstp_pppd_st *ctx, const char *buf, int len)
 {
+    sstp_buff_st *wr = ctx->wr_buf;
     status_t status = SSTP_FAIL;
-    unsigned char *frame = NULL;
+    uint64_t start = 0;
     int flen = 0;
     int ret  = 0;
 
-    /* Get the maximum size of the frame */
-    flen = (len << 1) + 4;
+    /* Get the maximum size of the frame, all escaped and both flags */
+    flen = (len << 1) + 6;
 
-    /* Allocate some stack space (do not free!) */
-    frame = alloca(flen);
-    if (!frame)
+    /* Write the frames held to make room for it */
+    if (wr->max - wr->len < flen)
     {
-        goto done;
+        sstp_pppd_flush(ctx);
+        if (wr->max - wr->len < flen)
+        {
+            log_err("Could not complete write of frame");
+            goto done;
+        }
     }
 
     /* Perform the HDLC encoding of the frame */
-    ret = sstp_frame_encode((const unsigned char*) buf, len, frame, &flen);
+    start = sstp_cycle_start();
+    ret = sstp_frame_encode((const unsigned char*) buf, len, 
+            (unsigned char*) wr->data + wr->len, &flen);
+    sstp_cycle_stop(SSTP_CYCLE_ENCODE, start, len);
     if (SSTP_OKAY != ret)
     {
         log_err("Could not encode frame");
         goto done;
     }
+    sstp_record(SSTP_RECORD_PPP, SSTP_RECORD_OUT, wr->data + wr->len, flen);
+    wr->len += flen;
 
     /* Record the number of bytes received */
     ppp_record_recv(ctx, len);
 
-    /* Write the data back to the pppd */
-    ret = write(ctx->sock, frame, flen);
-    if (ret != flen)
+    if (ctx->flow)
     {
-        log_err("Could not complete write of frame");
-        goto done;
+        sstp_flow_account(ctx->flow, SSTP_FLOW_RECV, 
+                (const unsigned char*) buf, len);
+    }
+
+    /* Write it along with the frames that follow */
+    if (!event_pending(ctx->ev_write, EV_WRITE, NULL))
+    {
+        event_add(ctx->ev_write, NULL);
     }
 
     /* Success */
@@ -481,6 +659,34 @@ done:
 }
 
 
+/*!
+ * @brief Start receiving the frames from pppd
+ */
+static status_t sstp_pppd_listen(sstp_pppd_st *ctx)
+{
+    /* Add the event context */
+    ctx->ev_recv = event_new(ctx->ev_base, ctx->sock, EV_READ, (event_fn) 
+            sstp_probe_call, SSTP_PROBE(&ctx->probe, sstp_pppd_recv, ctx));
+    if (!ctx->ev_recv)
+    {
+        return SSTP_FAIL;
+    }
+
+    /* The frames from the server are written as pppd takes them */
+    ctx->ev_write = event_new(ctx->ev_base, ctx->sock, EV_WRITE, (event_fn)
+            sstp_probe_call, SSTP_PROBE(&ctx->wr_probe, sstp_pppd_write_cont, 
+                ctx));
+    if (!ctx->ev_write)
+    {
+        return SSTP_FAIL;
+    }
+
+    /* Add the receive event */
+    event_add(ctx->ev_recv, NULL);
+    return SSTP_OKAY;
+}
+
+
 status_t sstp_pppd_start(sstp_pppd_st *ctx, sstp_option_st *opts, 
         const char *sockname)
 {
@@ -490,7 +696,8 @@ status_t sstp_pppd_start(sstp_pppd_st *ctx, sstp_option_st *opts,
     /* Launch PPPd, unless PPPd launched us */
     if (!(SSTP_OPT_NOLAUNCH & opts->enable))
     {
-        const char *args[20];
+        const char *args[24 + opts->pppdargc];
+        char mtu[16];
         int i = 0;
         int j = 0;
  
@@ -558,6 +765,22 @@ status_t sstp_pppd_start(sstp_pppd_st *ctx, sstp_option_st *opts,
             args[i++] = sockname;
         }
 
+        /* Size the frames to the path, the arguments given take precedence */
+        if (ctx->mtu)
+        {
+            snprintf(mtu, sizeof(mtu), "%d", ctx->mtu);
+            args[i++] = "mtu";
+            args[i++] = mtu;
+            args[i++] = "mru";
+            args[i++] = mtu;
+        }
+
+        /* Join the bundle of the other links */
+        if (opts->links > 1)
+        {
+            args[i++] = "multilink";
+        }
+
         /* Copy all the arguments to pppd */
         for (j = 0; j < opts->pppdargc; j++)
         {
@@ -576,6 +799,12 @@ status_t sstp_pppd_start(sstp_pppd_st *ctx, sstp_option_st *opts,
 
         /* Get the socket to listen on */
         ctx->sock    = sstp_task_stdout(ctx->task);
+
+        /* Keep pppd on its own cores */
+        if (opts->pppd_cpus)
+        {
+            sstp_set_affinity(sstp_task_pid(ctx->task), opts->pppd_cpus);
+        }
     }
     else
     {
@@ -586,15 +815,8 @@ status_t sstp_pppd_start(sstp_pppd_st *ctx, sstp_option_st *opts,
     /* Need to record approximate time */
     ctx->t_start = time(NULL);
 
-    /* Add the event context */
-    ctx->ev_recv = event_new(ctx->ev_base, ctx->sock, EV_READ, (event_fn) 
-            sstp_pppd_recv, ctx);
-
-    /* Add the receive event */
-    event_add(ctx->ev_recv, NULL);
-
-    /* Success! */
-    status = SSTP_OKAY;
+    /* Start receiving from pppd */
+    status = sstp_pppd_listen(ctx);
 
 done:
 
@@ -602,6 +824,104 @@ done:
 }
 
 
+status_t sstp_pppd_attach(sstp_pppd_st *ctx, int sock)
+{
+    /* Snoop the authentication to tell when the call is up */
+    ctx->auth_check = 1;
+    ctx->sock       = sock;
+    ctx->t_start    = time(NULL);
+
+    return sstp_pppd_listen(ctx);
+}
+
+
+int sstp_pppd_sock(sstp_pppd_st *ctx)
+{
+    return (ctx->sock);
+}
+
+
+int sstp_pppd_unsent(sstp_pppd_st *ctx)
+{
+    return (ctx->wr_buf->len - ctx->wr_buf->off);
+}
+
+
+void sstp_pppd_setsched(sstp_pppd_st *ctx, sstp_sched_st *sched)
+{
+    ctx->sched = sched;
+}
+
+
+void sstp_pppd_setflow(sstp_pppd_st *ctx, sstp_flow_ctx_st *flow)
+{
+    ctx->flow = flow;
+}
+
+
+void sstp_pppd_setmtu(sstp_pppd_st *ctx, int mtu)
+{
+    ctx->mtu = mtu;
+}
+
+
+void sstp_pppd_plugin(sstp_pppd_st *ctx)
+{
+    /* pppd read its options long before LCP came up */
+    sstp_pppd_deltmp(ctx);
+    ctx->auth_check = 0;
+}
+
+
+void sstp_pppd_rebind(sstp_pppd_st *ctx, sstp_stream_st *stream)
+{
+    /* Forward any further frames on the new stream */
+    ctx->stream = stream;
+
+    /* Leave the frames with pppd until we get a new stream */
+    if (!stream)
+    {
+        if (ctx->ev_recv)
+        {
+            event_del(ctx->ev_recv);
+        }
+
+        if (ctx->sched)
+        {
+            sstp_sched_cancel(ctx->sched, ctx);
+        }
+        return;
+    }
+
+    /* The server re-negotiates the link, snoop the authentication again */
+    ctx->auth_done = 0;
+    ctx->ip_up     = 0;
+
+    /* Anything queued on the old stream is lost */
+    sstp_buff_reset(ctx->tx_buf);
+
+    /* Flush the frames held while waiting for the stream */
+    if (ctx->rx_buf->len > 0)
+    {
+        log_debug("Forwarding %d bytes held from pppd", 
+                ctx->rx_buf->len - ctx->rx_buf->off);
+
+        if (SSTP_INPROG == ppp_process_data(ctx, 
+                sstp_sched_budget(ctx->sched)))
+        {
+            /* Let the ppp_send_complete resume receive */
+            return;
+        }
+    }
+
+    /* Resume the receive if it was throttled by the old stream */
+    if (ctx->ev_recv)
+    {
+        event_add(ctx->ev_recv, NULL);
+    }
+}
+
+
 status_t sstp_pppd_stop(sstp_pppd_st *ctx)
 {
     /* Cleanup the task */
@@ -635,13 +955,20 @@ status_t sstp_pppd_create(sstp_pppd_st **ctx, event_base_st *base,
         goto done;
     }
 
-    ret = sstp_buff_create(&(*ctx)->tx_buf, 16384);
+    ret = sstp_buff_create(&(*ctx)->tx_buf, sstp_tune()->pppd_buf);
     if (SSTP_OKAY != ret)
     {
         goto done;
     }
 
-    ret = sstp_buff_create(&(*ctx)->rx_buf, 16384);
+    ret = sstp_buff_create(&(*ctx)->rx_buf, sstp_tune()->pppd_buf);
+    if (SSTP_OKAY != ret)
+    {
+        goto done;
+    }
+
+    /* The frames grow to twice the size of the packets as escaped */
+    ret = sstp_buff_create(&(*ctx)->wr_buf, sstp_tune()->pppd_buf << 1);
     if (SSTP_OKAY != ret)
     {
         goto done;
@@ -676,6 +1003,19 @@ void sstp_pppd_free(sstp_pppd_st *ctx)
 
     sstp_pppd_deltmp(ctx);
 
+    /* Drop any pending continuation */
+    if (ctx->sched)
+    {
+        sstp_sched_cancel(ctx->sched, ctx);
+    }
+
+    /* Dispose of write event, before the pty is closed */
+    if (ctx->ev_write)
+    {
+        event_del(ctx->ev_write);
+        event_free(ctx->ev_write);
+    }
+
     /* Cleanup the task */
     if (ctx->task)
     {
@@ -705,6 +1045,13 @@ void sstp_pppd_free(sstp_pppd_st *ctx)
         ctx->rx_buf = NULL;
     }
 
+    /* Dispose the frames not written */
+    if (ctx->wr_buf)
+    {
+        sstp_buff_destroy(ctx->wr_buf);
+        ctx->wr_buf = NULL;
+    }
+
     /* Dispose of receive event */
     if (ctx->ev_recv)
     {
@@ -33,6 +33,15 @@
 /*! Check when IPCP layer is up */
 #define SSTP_PPP_IPCP       0x8021
 
+/*! The SSTP data header, and the PPP address, control and protocol fields */
+#define SSTP_PPP_FRAMING    8
+
+/*! The smallest MTU/MRU sized to the path */
+#define SSTP_PPP_MTU_MIN    576
+
+/*! The largest MTU/MRU sized to the path */
+#define SSTP_PPP_MTU_MAX    1500
+
 struct sstp_pppd;
 typedef struct sstp_pppd sstp_pppd_st;
 
@@ -90,6 +99,66 @@ sstp_chap_st *sstp_pppd_getchap(sstp_pppd_st *ctx);
 status_t sstp_pppd_start(sstp_pppd_st *ctx, sstp_option_st *opts, 
     const char *sockname);
 
+/*!
+ * @brief Exchange the frames over @a sock, with no pppd behind it
+ *
+ * @par Note:
+ *  Used to replay a recording with a socket pair standing in for the
+ *  pty. The socket is left open by sstp_pppd_free().
+ */
+status_t sstp_pppd_attach(sstp_pppd_st *ctx, int sock);
+
+
+/*!
+ * @brief Move a running pppd over to a new stream (fail-over)
+ *
+ * @par Note:
+ *  The pppd keeps running, the new server will renegotiate LCP and 
+ *  authentication with it. Passing a NULL @a stream stops reading from
+ *  pppd until a new stream is provided. Any frames held since pppd was 
+ *  started without a stream are forwarded on @a stream.
+ */
+void sstp_pppd_rebind(sstp_pppd_st *ctx, sstp_stream_st *stream);
+
+
+/*!
+ * @brief Get the descriptor we communicate with pppd on
+ */
+int sstp_pppd_sock(sstp_pppd_st *ctx);
+
+
+/*!
+ * @brief Get the number of bytes of frames waiting to be written to pppd
+ */
+int sstp_pppd_unsent(sstp_pppd_st *ctx);
+
+
+/*!
+ * @brief Forward at most the budget of @a sched in frames at a time to the
+ *  server, sharing the event loop with the other work of @a sched
+ */
+void sstp_pppd_setsched(sstp_pppd_st *ctx, sstp_sched_st *sched);
+
+
+/*!
+ * @brief Account the frames exchanged with pppd per flow and protocol
+ */
+void sstp_pppd_setflow(sstp_pppd_st *ctx, sstp_flow_ctx_st *flow);
+
+
+/*!
+ * @brief Start pppd with this MTU and MRU, ahead of the pppd options given
+ */
+void sstp_pppd_setmtu(sstp_pppd_st *ctx, int mtu);
+
+
+/*!
+ * @brief Stop snooping the frames for the authentication and IPCP, as 
+ *  sstp-plugin reports them
+ */
+void sstp_pppd_plugin(sstp_pppd_st *ctx);
+
+
 /*!
  * @brief Try to terminate the PPP process
  */
@@ -104,6 +173,12 @@ status_t sstp_pppd_send(sstp_pppd_st *ctx, const char *buf, int len);
 
 /*!
  * @brief Create the pppd context
+ *
+ * @par Note:
+ *  The @a stream can be NULL to start pppd ahead of the connection, the
+ *  frames from pppd are held in the receive buffer until the stream is 
+ *  provided with sstp_pppd_rebind(). Once the buffer fills up, pppd is
+ *  left blocking on the pty.
  */
 status_t sstp_pppd_create(sstp_pppd_st **ctx, event_base_st *base, 
     sstp_stream_st *stream, sstp_pppd_fn notify, void *arg);
@@ -65,19 +65,32 @@ typedef struct timeval timeval_st;
 #include <sstp-log.h>
 
 #include "sstp-buff.h"
+#include "sstp-probe.h"
+#include "sstp-cycle.h"
+#include "sstp-sched.h"
+#include "sstp-flow.h"
 #include "sstp-stream.h"
 #include "sstp-chap.h"
 #include "sstp-state.h"
 #include "sstp-util.h"
 #include "sstp-option.h"
+#include "sstp-tune.h"
 #include "sstp-event.h"
 #include "sstp-pppd.h"
 #include "sstp-cmac.h"
 #include "sstp-packet.h"
 #include "sstp-route.h"
+#include "sstp-rset.h"
+#include "sstp-monitor.h"
+#include "sstp-load.h"
+#include "sstp-record.h"
+#include "sstp-replay.h"
+#include "sstp-link.h"
 #include "sstp-task.h"
 #include "sstp-fcs.h"
 #include "sstp-http.h"
+#include "sstp-standby.h"
+#include "sstp-select.h"
 #include "sstp-dump.h"
 
 #endif /* #ifndef __SSTP_PRIVATE_H__ */
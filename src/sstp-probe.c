@@ -0,0 +1,137 @@
+/*!
+ * @brief Detect callbacks stalling the event loop
+ *
+ * @file sstp-probe.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "sstp-private.h"
+
+
+/*!
+ * @brief The callback statistics
+ */
+static struct
+{
+    /*< The number of callbacks per duration bucket */
+    unsigned long hist[SSTP_PROBE_BUCKETS];
+
+    /*< The number of callbacks over budget */
+    unsigned long stalls;
+
+    /*< The longest callback (usec) */
+    long worst;
+
+    /*< The name of the longest callback */
+    const char *worst_name;
+
+    /*< The budget (usec) */
+    long budget;
+
+} sstp_probe = { { 0 }, 0, 0, NULL, SSTP_PROBE_BUDGET };
+
+
+sstp_probe_st *sstp_probe_init(sstp_probe_st *probe, event_fn func, 
+        void *arg, const char *name)
+{
+    probe->func = func;
+    probe->arg  = arg;
+    probe->name = name;
+    return probe;
+}
+
+
+void sstp_probe_call(int fd, short event, sstp_probe_st *probe)
+{
+    const char *name = probe->name;
+    struct timespec start;
+    struct timespec end;
+    long usec   = 0;
+    int  bucket = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    /* The probe may be gone once this returns */
+    probe->func(fd, event, probe->arg);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    usec = (end.tv_sec - start.tv_sec) * 1000000 + 
+           (end.tv_nsec - start.tv_nsec) / 1000;
+
+    /* Find the log2 bucket */
+    while (bucket < SSTP_PROBE_BUCKETS - 1 && (usec >> (bucket + 1)))
+    {
+        bucket++;
+    }
+    sstp_probe.hist[bucket]++;
+
+    if (usec > sstp_probe.worst)
+    {
+        sstp_probe.worst      = usec;
+        sstp_probe.worst_name = name;
+    }
+
+    if (usec > sstp_probe.budget)
+    {
+        sstp_probe.stalls++;
+        log_warn("Event loop stalled for %ld.%03ld ms in %s", 
+                usec / 1000, usec % 1000, name);
+    }
+}
+
+
+void sstp_probe_budget(int usec)
+{
+    sstp_probe.budget = usec;
+}
+
+
+void sstp_probe_dump(void)
+{
+    char buf[SSTP_PROBE_BUCKETS * 24];
+    int len = 0;
+    int i   = 0;
+
+    for (i = 0; i < SSTP_PROBE_BUCKETS; i++)
+    {
+        if (sstp_probe.hist[i] == 0)
+        {
+            continue;
+        }
+
+        len += snprintf(buf + len, sizeof(buf) - len, " %s%ldus:%lu", 
+                (i < SSTP_PROBE_BUCKETS - 1) ? "<" : ">=", 
+                (i < SSTP_PROBE_BUCKETS - 1) ? 2L << i : 1L << i, 
+                sstp_probe.hist[i]);
+    }
+    buf[len] = '\0';
+
+    log_info("Callback durations:%s", (len) ? buf : " none");
+    log_info("Callbacks over budget: %lu, longest %ld.%03ld ms in %s", 
+            sstp_probe.stalls, sstp_probe.worst / 1000, 
+            sstp_probe.worst % 1000, (sstp_probe.worst_name)
+                ? sstp_probe.worst_name
+                : "none");
+}
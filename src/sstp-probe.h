@@ -0,0 +1,92 @@
+/*!
+ * @brief Detect callbacks stalling the event loop
+ *
+ * @file sstp-probe.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_PROBE_H__
+#define __SSTP_PROBE_H__
+
+
+/*< The default time a callback may run before it's reported (usec) */
+#define SSTP_PROBE_BUDGET       100000
+
+/*< The number of histogram buckets, bucket i holds [2^i, 2^(i+1)) usec */
+#define SSTP_PROBE_BUCKETS      24
+
+
+/*!
+ * @brief A libevent callback with its identity
+ */
+typedef struct sstp_probe
+{
+    /*< The callback function */
+    event_fn func;
+
+    /*< The argument to the callback */
+    void *arg;
+
+    /*< The name of the callback */
+    const char *name;
+
+} sstp_probe_st;
+
+
+/*!
+ * @brief Setup @a probe to call @a fn with @a arg, naming it after @a fn
+ *
+ * @return The probe, for use as the argument to sstp_probe_call()
+ */
+#define SSTP_PROBE(probe, fn, arg)                      \
+    sstp_probe_init((probe), (event_fn) (fn), (arg), #fn)
+
+
+/*!
+ * @brief Initialize a probe, see SSTP_PROBE()
+ */
+sstp_probe_st *sstp_probe_init(sstp_probe_st *probe, event_fn func, 
+        void *arg, const char *name);
+
+
+/*!
+ * @brief Register this with libevent, and the probe as its argument
+ *
+ * @par Note:
+ *  Measures the time spent in the callback with the monotonic clock, 
+ *  records it in the histogram and logs the callback if it ran over 
+ *  the budget. The callback may release the probe.
+ */
+void sstp_probe_call(int fd, short event, sstp_probe_st *probe);
+
+
+/*!
+ * @brief Set the time a callback may run before it's reported (usec)
+ */
+void sstp_probe_budget(int usec);
+
+
+/*!
+ * @brief Log the histogram of callback durations and the worst offender
+ */
+void sstp_probe_dump(void);
+
+
+#endif /* #ifndef __SSTP_PROBE_H__ */
@@ -0,0 +1,339 @@
+/*!
+ * @brief Record the byte streams of a session, to replay them later
+ *
+ * @file sstp-record.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sstp-private.h"
+
+
+/*< The stdio buffer of the recording (bytes) */
+#define SSTP_RECORD_BUFSZ       (256 * 1024)
+
+
+/*!
+ * @brief The recording in progress
+ */
+static struct
+{
+    /*< The file recorded to, or NULL */
+    FILE *file;
+
+    /*< The time the recording started */
+    struct timespec start;
+
+} sstp_recorder;
+
+
+/*!
+ * @brief A recording loaded into memory
+ */
+struct sstp_record_file
+{
+    /*< The header */
+    sstp_record_hdr_st hdr;
+
+    /*< The records */
+    uint8_t *data;
+
+    /*< The bytes of records */
+    size_t size;
+
+    /*< The offset of the next record */
+    size_t off;
+};
+
+
+status_t sstp_record_open(const char *path, const char *server)
+{
+    sstp_record_hdr_st hdr;
+    int fd = -1;
+
+    /* The session is recorded in the clear, for the owner's eyes only */
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0)
+    {
+        log_err("Could not open %s, %s (%d)", path, strerror(errno), errno);
+        return SSTP_FAIL;
+    }
+
+    /* An older recording may have been readable by others */
+    if (fchmod(fd, 0600) < 0)
+    {
+        log_warn("Could not restrict access to %s, %s (%d)", path, 
+                strerror(errno), errno);
+    }
+
+    sstp_recorder.file = fdopen(fd, "w");
+    if (!sstp_recorder.file)
+    {
+        log_err("Could not open %s, %s (%d)", path, strerror(errno), errno);
+        close(fd);
+        return SSTP_FAIL;
+    }
+
+    /* Keep the writes off the data path */
+    setvbuf(sstp_recorder.file, NULL, _IOFBF, SSTP_RECORD_BUFSZ);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, SSTP_RECORD_MAGIC, sizeof(hdr.magic));
+    strncpy(hdr.server, server, sizeof(hdr.server) - 1);
+
+    if (fwrite(&hdr, sizeof(hdr), 1, sstp_recorder.file) != 1)
+    {
+        log_err("Could not write to %s", path);
+        sstp_record_close();
+        return SSTP_FAIL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &sstp_recorder.start);
+    return SSTP_OKAY;
+}
+
+
+void sstp_record(sstp_record_chan_t chan, sstp_record_dir_t dir,
+        const void *data, int len)
+{
+    sstp_record_st rec;
+    struct timespec now;
+
+    if (!sstp_recorder.file || len <= 0)
+    {
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    memset(&rec, 0, sizeof(rec));
+    rec.usec = (uint64_t) (now.tv_sec - sstp_recorder.start.tv_sec) * 1000000 +
+            (now.tv_nsec - sstp_recorder.start.tv_nsec) / 1000;
+    rec.len  = len;
+    rec.chan = chan;
+    rec.dir  = dir;
+
+    /* Stop at the first error rather than leave a truncated record */
+    if (fwrite(&rec, sizeof(rec), 1, sstp_recorder.file) != 1 ||
+        fwrite(data, len, 1, sstp_recorder.file) != 1)
+    {
+        log_err("Could not write the recording, stopped recording");
+        sstp_record_close();
+    }
+}
+
+
+void sstp_record_close(void)
+{
+    if (sstp_recorder.file)
+    {
+        fclose(sstp_recorder.file);
+        sstp_recorder.file = NULL;
+    }
+}
+
+
+status_t sstp_record_load(sstp_record_file_st **file, const char *path)
+{
+    status_t status = SSTP_FAIL;
+    struct stat st;
+    FILE *fp = NULL;
+
+    *file = calloc(1, sizeof(sstp_record_file_st));
+    if (!*file)
+    {
+        goto done;
+    }
+
+    fp = fopen(path, "r");
+    if (!fp || fstat(fileno(fp), &st))
+    {
+        log_err("Could not open %s, %s (%d)", path, strerror(errno), errno);
+        goto done;
+    }
+
+    if (fread(&(*file)->hdr, sizeof((*file)->hdr), 1, fp) != 1 ||
+        memcmp((*file)->hdr.magic, SSTP_RECORD_MAGIC, 8))
+    {
+        log_err("%s is not a recording", path);
+        goto done;
+    }
+    (*file)->hdr.server[sizeof((*file)->hdr.server) - 1] = '\0';
+
+    /* Read it all up front, the replay should not wait for the disk */
+    (*file)->size = st.st_size - sizeof((*file)->hdr);
+    (*file)->data = malloc((*file)->size + 1);
+    if (!(*file)->data)
+    {
+        goto done;
+    }
+
+    if ((*file)->size && fread((*file)->data, (*file)->size, 1, fp) != 1)
+    {
+        log_err("Could not read %s", path);
+        goto done;
+    }
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    if (fp)
+    {
+        fclose(fp);
+    }
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_record_free(*file);
+        *file = NULL;
+    }
+
+    return status;
+}
+
+
+const char *sstp_record_server(sstp_record_file_st *file)
+{
+    return file->hdr.server;
+}
+
+
+const sstp_record_st *sstp_record_next(sstp_record_file_st *file)
+{
+    const sstp_record_st *rec = NULL;
+
+    if (file->off + sizeof(sstp_record_st) > file->size)
+    {
+        return NULL;
+    }
+
+    /* A record cut short, the recording was interrupted */
+    rec = (const sstp_record_st*) (file->data + file->off);
+    if (file->off + sizeof(sstp_record_st) + rec->len > file->size)
+    {
+        return NULL;
+    }
+
+    file->off += sizeof(sstp_record_st) + rec->len;
+    return rec;
+}
+
+
+void sstp_record_free(sstp_record_file_st *file)
+{
+    if (!file)
+    {
+        return;
+    }
+
+    if (file->data)
+    {
+        free(file->data);
+    }
+
+    free(file);
+}
+
+
+#ifdef __SSTP_UNIT_TEST_RECORD
+
+int main(void)
+{
+    sstp_record_file_st *file = NULL;
+    const sstp_record_st *rec = NULL;
+    char path[] = "/tmp/utest-record.XXXXXX";
+    int fd = -1;
+
+    fd = mkstemp(path);
+    if (fd < 0)
+    {
+        printf("Could not create %s\n", path);
+        return EXIT_FAILURE;
+    }
+    close(fd);
+
+    /* Nothing is recorded before the recording is opened */
+    sstp_record(SSTP_RECORD_SSTP, SSTP_RECORD_IN, "lost", 4);
+
+    if (SSTP_OKAY != sstp_record_open(path, "vpn.example.com"))
+    {
+        printf("Could not record to %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    sstp_record(SSTP_RECORD_SSTP, SSTP_RECORD_OUT, "hello", 5);
+    sstp_record(SSTP_RECORD_PPP,  SSTP_RECORD_IN,  "world!", 6);
+    sstp_record_close();
+
+    /* Recorded after close */
+    sstp_record(SSTP_RECORD_PPP,  SSTP_RECORD_OUT, "lost", 4);
+
+    if (SSTP_OKAY != sstp_record_load(&file, path))
+    {
+        printf("Could not load %s\n", path);
+        return EXIT_FAILURE;
+    }
+    unlink(path);
+
+    if (strcmp(sstp_record_server(file), "vpn.example.com"))
+    {
+        printf("Unexpected server: %s\n", sstp_record_server(file));
+        return EXIT_FAILURE;
+    }
+
+    rec = sstp_record_next(file);
+    if (!rec || rec->chan != SSTP_RECORD_SSTP || rec->dir != SSTP_RECORD_OUT ||
+        rec->len != 5 || memcmp(rec->data, "hello", 5))
+    {
+        printf("Unexpected first record\n");
+        return EXIT_FAILURE;
+    }
+
+    rec = sstp_record_next(file);
+    if (!rec || rec->chan != SSTP_RECORD_PPP || rec->dir != SSTP_RECORD_IN ||
+        rec->len != 6 || memcmp(rec->data, "world!", 6))
+    {
+        printf("Unexpected second record\n");
+        return EXIT_FAILURE;
+    }
+
+    if (sstp_record_next(file))
+    {
+        printf("Unexpected record past the end\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Successfully recorded and loaded the session\n");
+    sstp_record_free(file);
+    return EXIT_SUCCESS;
+}
+
+#endif /* #ifdef __SSTP_UNIT_TEST_RECORD */
@@ -0,0 +1,152 @@
+/*!
+ * @brief Record the byte streams of a session, to replay them later
+ *
+ * @file sstp-record.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_RECORD_H__
+#define __SSTP_RECORD_H__
+
+#include <stdint.h>
+
+
+/*< Identifies a recording, and the version of its format */
+#define SSTP_RECORD_MAGIC       "SSTPREC1"
+
+
+/*!
+ * @brief The byte streams recorded
+ */
+typedef enum
+{
+    /*< The SSTP stream, in the clear after TLS */
+    SSTP_RECORD_SSTP    = 0,
+
+    /*< The pty to pppd */
+    SSTP_RECORD_PPP     = 1,
+
+} sstp_record_chan_t;
+
+
+/*!
+ * @brief The direction, as seen by sstpc
+ */
+typedef enum
+{
+    /*< Read by sstpc, from the server or from pppd */
+    SSTP_RECORD_IN      = 0,
+
+    /*< Written by sstpc, to the server or to pppd */
+    SSTP_RECORD_OUT     = 1,
+
+} sstp_record_dir_t;
+
+
+/*!
+ * @brief The header of the recording
+ */
+typedef struct
+{
+    /*< SSTP_RECORD_MAGIC */
+    char magic[8];
+
+    /*< The server the session was connected to */
+    char server[128];
+
+} __attribute__((packed)) sstp_record_hdr_st;
+
+
+/*!
+ * @brief The bytes of a single read or write, as recorded
+ */
+typedef struct
+{
+    /*< The time since the start of the recording (usec) */
+    uint64_t usec;
+
+    /*< The number of bytes */
+    uint32_t len;
+
+    /*< The stream, sstp_record_chan_t */
+    uint8_t chan;
+
+    /*< The direction, sstp_record_dir_t */
+    uint8_t dir;
+
+    /*< Reserved, zero */
+    uint16_t reserved;
+
+    /*< The bytes */
+    uint8_t data[0];
+
+} __attribute__((packed)) sstp_record_st;
+
+
+struct sstp_record_file;
+typedef struct sstp_record_file sstp_record_file_st;
+
+
+/*!
+ * @brief Start recording to @a path
+ */
+status_t sstp_record_open(const char *path, const char *server);
+
+
+/*!
+ * @brief Record the bytes of a read or write, if recording
+ */
+void sstp_record(sstp_record_chan_t chan, sstp_record_dir_t dir,
+        const void *data, int len);
+
+
+/*!
+ * @brief Stop recording, flushing the bytes recorded
+ */
+void sstp_record_close(void);
+
+
+/*!
+ * @brief Load a recording into memory
+ */
+status_t sstp_record_load(sstp_record_file_st **file, const char *path);
+
+
+/*!
+ * @brief Get the server of the recording
+ */
+const char *sstp_record_server(sstp_record_file_st *file);
+
+
+/*!
+ * @brief Get the next read or write of the recording
+ *
+ * @retval The record, or NULL at the end of the recording
+ */
+const sstp_record_st *sstp_record_next(sstp_record_file_st *file);
+
+
+/*!
+ * @brief Release a recording loaded by sstp_record_load()
+ */
+void sstp_record_free(sstp_record_file_st *file);
+
+
+#endif /* #ifndef __SSTP_RECORD_H__ */
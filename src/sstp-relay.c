@@ -0,0 +1,960 @@
+/*!
+ * @brief A TCP relay impairing the path between sstpc and the server
+ *
+ * @file sstp-relay.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ * @par Impairments:
+ *  Each direction is delayed by --delay msec plus up to --jitter msec,
+ *  keeping the order of the bytes as TCP would, and is paced to --rate
+ *  kbit/s. Every --stall-every seconds, nothing is delivered for
+ *  --stall-time msec, as when a burst of loss holds up the stream until
+ *  retransmitted. A connection is reset --reset-after seconds after it
+ *  was accepted. The bytes relayed and the time to recover are logged:
+ *  from a reset, until the server answers on the next connection, and
+ *  from a stall, until the bytes of either direction are delivered on
+ *  time again.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "sstp-private.h"
+
+
+/*< The bytes read at a time */
+#define SSTP_RELAY_CHUNK        16384
+
+/*< Stop reading once this much is queued in one direction (bytes) */
+#define SSTP_RELAY_QUEUE        (4 * 1024 * 1024)
+
+/*< A chunk delivered this late after its due time is held up (msec) */
+#define SSTP_RELAY_LATE         10
+
+/*< The port of the server, unless given */
+#define SSTP_RELAY_PORT         "443"
+
+
+/*!
+ * @brief The impairments, as given on the command line
+ */
+typedef struct
+{
+    /*< The delay added in each direction (msec) */
+    int delay;
+
+    /*< The most added on top of the delay (msec) */
+    int jitter;
+
+    /*< The bandwidth of each direction (kbit/s), or zero */
+    int rate;
+
+    /*< The interval between stalls (seconds), or zero */
+    int stall_every;
+
+    /*< The length of a stall (msec) */
+    int stall_time;
+
+    /*< The lifetime of a connection before reset (seconds), or zero */
+    int reset_after;
+
+} sstp_relay_opts_st;
+
+
+/*!
+ * @brief The bytes of a read, held until due
+ */
+typedef struct sstp_relay_chunk
+{
+    /*< The next chunk in line */
+    struct sstp_relay_chunk *next;
+
+    /*< The time to deliver the chunk */
+    struct timeval due;
+
+    /*< The bytes delivered so far */
+    int off;
+
+    /*< The number of bytes */
+    int len;
+
+    /*< The bytes */
+    uint8_t data[0];
+
+} sstp_relay_chunk_st;
+
+
+struct sstp_relay_conn;
+
+
+/*!
+ * @brief One direction of a connection
+ */
+typedef struct
+{
+    /*< The connection */
+    struct sstp_relay_conn *conn;
+
+    /*< The socket read from */
+    int from;
+
+    /*< The socket written to */
+    int to;
+
+    /*< The chunks in line, oldest first */
+    sstp_relay_chunk_st *head;
+    sstp_relay_chunk_st *tail;
+
+    /*< The bytes queued */
+    int queued;
+
+    /*< The time the last chunk is due, to keep them in order */
+    struct timeval last;
+
+    /*< The time the link is free to send the next chunk */
+    struct timeval free;
+
+    /*< The bytes delivered */
+    uint64_t bytes;
+
+    /*< The sender is done */
+    int eof;
+
+    /*< The events of the direction */
+    event_st *ev_read;
+    event_st *ev_write;
+    event_st *ev_due;
+
+} sstp_relay_pipe_st;
+
+
+/*!
+ * @brief A connection relayed to the server
+ */
+typedef struct sstp_relay_conn
+{
+    /*< The relay */
+    struct sstp_relay *relay;
+
+    /*< The number of the connection */
+    int id;
+
+    /*< The socket of the client and the server */
+    int csock;
+    int ssock;
+
+    /*< Towards the server, and towards the client */
+    sstp_relay_pipe_st up;
+    sstp_relay_pipe_st down;
+
+    /*< The time the connection was accepted */
+    struct timeval start;
+
+    /*< Resets the connection */
+    event_st *ev_reset;
+
+} sstp_relay_conn_st;
+
+
+/*!
+ * @brief The relay
+ */
+typedef struct sstp_relay
+{
+    /*< The impairments */
+    sstp_relay_opts_st opts;
+
+    /*< The address of the server */
+    struct sockaddr_storage addr;
+    socklen_t alen;
+
+    /*< The listening socket */
+    int sock;
+
+    /*< The number of connections accepted */
+    int count;
+
+    /*< The connections open */
+    int active;
+
+    /*< Nothing is delivered until this time */
+    struct timeval stall;
+
+    /*< The last stall is over, but the delivery is still held up */
+    int stalled;
+
+    /*< The time of the last reset, until the server answers again */
+    struct timeval reset;
+
+    /*< The number of resets, and the recoveries measured */
+    int resets;
+    int recovered;
+
+    /*< The shortest, the longest and the sum of the recoveries (msec) */
+    int rec_min;
+    int rec_max;
+    int rec_sum;
+
+    /*< The bytes relayed by the connections closed */
+    uint64_t bytes_up;
+    uint64_t bytes_down;
+
+    /*< The event base */
+    event_base_st *ev_base;
+
+    /*< The events of the relay */
+    event_st *ev_accept;
+    event_st *ev_stall;
+    event_st *ev_sigint;
+    event_st *ev_sigterm;
+
+} sstp_relay_st;
+
+
+static void sstp_relay_flush(int fd, short event, sstp_relay_pipe_st *pipe);
+
+
+/*!
+ * @brief The milliseconds from @a start to @a end
+ */
+static int sstp_relay_msec(struct timeval *start, struct timeval *end)
+{
+    return ((end->tv_sec  - start->tv_sec) * 1000) +
+           ((end->tv_usec - start->tv_usec) / 1000);
+}
+
+
+/*!
+ * @brief Add @a usec to @a tv
+ */
+static void sstp_relay_add(struct timeval *tv, long long usec)
+{
+    usec += tv->tv_usec;
+    tv->tv_sec += usec / 1000000;
+    tv->tv_usec = usec % 1000000;
+}
+
+
+/*!
+ * @brief Close a connection, with a reset if @a abort
+ */
+static void sstp_relay_close(sstp_relay_conn_st *conn, int abort)
+{
+    sstp_relay_st *relay = conn->relay;
+    sstp_relay_pipe_st *pipes[2] = { &conn->up, &conn->down };
+    struct linger linger = { 1, 0 };
+    struct timeval now;
+    int msec = 0;
+    int i = 0;
+
+    gettimeofday(&now, NULL);
+    msec = sstp_relay_msec(&conn->start, &now);
+    if (msec <= 0)
+    {
+        msec = 1;
+    }
+
+    log_info("Connection %d %s after %d ms, %llu bytes up (%.2f Mbit/s), "
+            "%llu bytes down (%.2f Mbit/s)", conn->id,
+            abort ? "reset" : "closed", msec,
+            (unsigned long long) conn->up.bytes,
+            conn->up.bytes * 8.0 / msec / 1000.0,
+            (unsigned long long) conn->down.bytes,
+            conn->down.bytes * 8.0 / msec / 1000.0);
+
+    relay->bytes_up   += conn->up.bytes;
+    relay->bytes_down += conn->down.bytes;
+    relay->active--;
+
+    for (i = 0; i < 2; i++)
+    {
+        sstp_relay_pipe_st *pipe = pipes[i];
+
+        while (pipe->head)
+        {
+            sstp_relay_chunk_st *next = pipe->head->next;
+            free(pipe->head);
+            pipe->head = next;
+        }
+
+        if (pipe->ev_read)
+        {
+            event_del(pipe->ev_read);
+            event_free(pipe->ev_read);
+        }
+
+        if (pipe->ev_write)
+        {
+            event_del(pipe->ev_write);
+            event_free(pipe->ev_write);
+        }
+
+        if (pipe->ev_due)
+        {
+            event_del(pipe->ev_due);
+            event_free(pipe->ev_due);
+        }
+    }
+
+    if (conn->ev_reset)
+    {
+        event_del(conn->ev_reset);
+        event_free(conn->ev_reset);
+    }
+
+    if (abort)
+    {
+        setsockopt(conn->csock, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+        setsockopt(conn->ssock, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    }
+
+    close(conn->csock);
+    close(conn->ssock);
+    free(conn);
+}
+
+
+/*!
+ * @brief The lifetime of the connection is up, reset it
+ */
+static void sstp_relay_reset(int fd, short event, sstp_relay_conn_st *conn)
+{
+    sstp_relay_st *relay = conn->relay;
+
+    gettimeofday(&relay->reset, NULL);
+    relay->resets++;
+
+    sstp_relay_close(conn, 1);
+}
+
+
+/*!
+ * @brief Add a recovery of @a msec from a reset or stall to the summary
+ */
+static void sstp_relay_recovered(sstp_relay_st *relay, int msec,
+        const char *what)
+{
+    log_info("Recovered %d ms after the %s", msec, what);
+    if (!relay->recovered || msec < relay->rec_min)
+    {
+        relay->rec_min = msec;
+    }
+    if (msec > relay->rec_max)
+    {
+        relay->rec_max = msec;
+    }
+    relay->rec_sum += msec;
+    relay->recovered++;
+}
+
+
+/*!
+ * @brief Hold the bytes until they are due
+ */
+static void sstp_relay_read(int fd, short event, sstp_relay_pipe_st *pipe)
+{
+    sstp_relay_conn_st *conn = pipe->conn;
+    sstp_relay_st *relay = conn->relay;
+    sstp_relay_opts_st *opts = &relay->opts;
+    sstp_relay_chunk_st *chunk = NULL;
+    struct timeval now;
+    int ret = 0;
+
+    chunk = malloc(sizeof(sstp_relay_chunk_st) + SSTP_RELAY_CHUNK);
+    if (!chunk)
+    {
+        sstp_relay_close(conn, 1);
+        return;
+    }
+
+    ret = read(fd, chunk->data, SSTP_RELAY_CHUNK);
+    if (ret < 0 && errno == EAGAIN)
+    {
+        free(chunk);
+        return;
+    }
+
+    if (ret < 0)
+    {
+        log_info("Connection %d, %s, %s (%d)", conn->id,
+                (pipe == &conn->up) ? "client" : "server",
+                strerror(errno), errno);
+        free(chunk);
+        sstp_relay_close(conn, 1);
+        return;
+    }
+
+    /* Deliver what is queued, then pass on the close */
+    if (ret == 0)
+    {
+        free(chunk);
+        pipe->eof = 1;
+        event_del(pipe->ev_read);
+        sstp_relay_flush(-1, 0, pipe);
+        return;
+    }
+
+    gettimeofday(&now, NULL);
+
+    /* The server answered the client that came back after the reset */
+    if (pipe == &conn->down && relay->reset.tv_sec &&
+        timercmp(&conn->start, &relay->reset, >))
+    {
+        sstp_relay_recovered(relay, sstp_relay_msec(&relay->reset, &now),
+                "reset");
+        timerclear(&relay->reset);
+    }
+
+    /* Pace the chunk to the bandwidth of the link */
+    if (opts->rate > 0)
+    {
+        if (timercmp(&pipe->free, &now, <))
+        {
+            pipe->free = now;
+        }
+        sstp_relay_add(&pipe->free, (long long) ret * 8000 / opts->rate);
+        now = pipe->free;
+    }
+
+    /* Add the delay and jitter, but keep the bytes in order */
+    chunk->next = NULL;
+    chunk->off  = 0;
+    chunk->len  = ret;
+    chunk->due  = now;
+    sstp_relay_add(&chunk->due, (long long) opts->delay * 1000 +
+            ((opts->jitter > 0) ? (rand() % (opts->jitter * 1000)) : 0));
+    if (timercmp(&chunk->due, &pipe->last, <))
+    {
+        chunk->due = pipe->last;
+    }
+    pipe->last = chunk->due;
+
+    if (pipe->tail)
+    {
+        pipe->tail->next = chunk;
+    }
+    else
+    {
+        pipe->head = chunk;
+    }
+    pipe->tail = chunk;
+    pipe->queued += ret;
+
+    /* Let the receiver hold back the sender, as the path would */
+    if (pipe->queued >= SSTP_RELAY_QUEUE)
+    {
+        event_del(pipe->ev_read);
+    }
+
+    if (pipe->head == chunk)
+    {
+        sstp_relay_flush(-1, 0, pipe);
+    }
+}
+
+
+/*!
+ * @brief Deliver the chunks that are due
+ */
+static void sstp_relay_flush(int fd, short event, sstp_relay_pipe_st *pipe)
+{
+    sstp_relay_conn_st *conn = pipe->conn;
+    sstp_relay_st *relay = conn->relay;
+    struct timeval now;
+    struct timeval tv;
+    int ret = 0;
+
+    gettimeofday(&now, NULL);
+
+    while (pipe->head)
+    {
+        sstp_relay_chunk_st *chunk = pipe->head;
+
+        /* Not yet due, or held up by a stall */
+        if (timercmp(&chunk->due, &now, >) || timercmp(&relay->stall, &now, >))
+        {
+            timersub(timercmp(&chunk->due, &relay->stall, >)
+                    ? &chunk->due : &relay->stall, &now, &tv);
+            event_add(pipe->ev_due, &tv);
+            return;
+        }
+
+        ret = write(pipe->to, chunk->data + chunk->off, chunk->len - chunk->off);
+        if (ret < 0 && errno == EAGAIN)
+        {
+            event_add(pipe->ev_write, NULL);
+            return;
+        }
+
+        if (ret < 0)
+        {
+            log_info("Connection %d, %s, %s (%d)", conn->id,
+                    (pipe == &conn->up) ? "server" : "client",
+                    strerror(errno), errno);
+            sstp_relay_close(conn, 1);
+            return;
+        }
+
+        chunk->off  += ret;
+        pipe->bytes += ret;
+        if (chunk->off < chunk->len)
+        {
+            continue;
+        }
+
+        /* Once the backlog of the stall is out, the bytes are on time again */
+        if (relay->stalled &&
+            sstp_relay_msec(&chunk->due, &now) <= SSTP_RELAY_LATE)
+        {
+            sstp_relay_recovered(relay, sstp_relay_msec(&relay->stall, &now),
+                    "stall");
+            relay->stalled = 0;
+        }
+
+        pipe->head = chunk->next;
+        if (!pipe->head)
+        {
+            pipe->tail = NULL;
+        }
+        pipe->queued -= chunk->len;
+        free(chunk);
+
+        if (!pipe->eof && pipe->queued < SSTP_RELAY_QUEUE / 2)
+        {
+            event_add(pipe->ev_read, NULL);
+        }
+    }
+
+    if (!pipe->eof)
+    {
+        return;
+    }
+
+    /* Pass on the close, and close the connection once both are done */
+    shutdown(pipe->to, SHUT_WR);
+    if (conn->up.eof && conn->down.eof &&
+        !conn->up.head && !conn->down.head)
+    {
+        sstp_relay_close(conn, 0);
+    }
+}
+
+
+/*!
+ * @brief Setup one direction of a connection
+ */
+static status_t sstp_relay_pipe(sstp_relay_conn_st *conn,
+        sstp_relay_pipe_st *pipe, int from, int to)
+{
+    event_base_st *base = conn->relay->ev_base;
+
+    pipe->conn = conn;
+    pipe->from = from;
+    pipe->to   = to;
+
+    pipe->ev_read  = event_new(base, from, EV_READ | EV_PERSIST,
+            (event_fn) sstp_relay_read, pipe);
+    pipe->ev_write = event_new(base, to, EV_WRITE,
+            (event_fn) sstp_relay_flush, pipe);
+    pipe->ev_due   = event_new(base, -1, 0,
+            (event_fn) sstp_relay_flush, pipe);
+    if (!pipe->ev_read || !pipe->ev_write || !pipe->ev_due)
+    {
+        return SSTP_FAIL;
+    }
+
+    event_add(pipe->ev_read, NULL);
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Accept a client, and connect it to the server
+ */
+static void sstp_relay_accept(int fd, short event, sstp_relay_st *relay)
+{
+    sstp_relay_conn_st *conn = NULL;
+    int one = 1;
+    int csock = -1;
+    int ssock = -1;
+
+    csock = accept(fd, NULL, NULL);
+    if (csock < 0)
+    {
+        return;
+    }
+
+    ssock = socket(relay->addr.ss_family, SOCK_STREAM, 0);
+    if (ssock < 0)
+    {
+        log_err("Could not create socket, %s (%d)", strerror(errno), errno);
+        close(csock);
+        return;
+    }
+
+    /* The delay is ours to add, don't let Nagle add to it */
+    setsockopt(csock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(ssock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    fcntl(csock, F_SETFL, fcntl(csock, F_GETFL) | O_NONBLOCK);
+    fcntl(ssock, F_SETFL, fcntl(ssock, F_GETFL) | O_NONBLOCK);
+
+    /* A failed connect shows up on the first read or write */
+    if (connect(ssock, (struct sockaddr*) &relay->addr, relay->alen) &&
+        errno != EINPROGRESS)
+    {
+        log_warn("Could not connect to the server, %s (%d)",
+                strerror(errno), errno);
+        close(ssock);
+        close(csock);
+        return;
+    }
+
+    conn = calloc(1, sizeof(sstp_relay_conn_st));
+    if (!conn)
+    {
+        close(ssock);
+        close(csock);
+        return;
+    }
+
+    conn->relay = relay;
+    conn->id    = ++relay->count;
+    conn->csock = csock;
+    conn->ssock = ssock;
+    gettimeofday(&conn->start, NULL);
+    relay->active++;
+
+    if (SSTP_OKAY != sstp_relay_pipe(conn, &conn->up, csock, ssock) ||
+        SSTP_OKAY != sstp_relay_pipe(conn, &conn->down, ssock, csock))
+    {
+        sstp_relay_close(conn, 1);
+        return;
+    }
+
+    if (relay->opts.reset_after > 0)
+    {
+        timeval_st tv = { relay->opts.reset_after, 0 };
+
+        conn->ev_reset = event_new(relay->ev_base, -1, 0,
+                (event_fn) sstp_relay_reset, conn);
+        if (!conn->ev_reset)
+        {
+            sstp_relay_close(conn, 1);
+            return;
+        }
+        event_add(conn->ev_reset, &tv);
+    }
+
+    log_info("Connection %d accepted", conn->id);
+}
+
+
+/*!
+ * @brief Hold up the delivery for a while
+ */
+static void sstp_relay_stall(int fd, short event, sstp_relay_st *relay)
+{
+    gettimeofday(&relay->stall, NULL);
+    sstp_relay_add(&relay->stall, (long long) relay->opts.stall_time * 1000);
+    relay->stalled = 1;
+
+    log_info("Stalling for %d ms", relay->opts.stall_time);
+}
+
+
+/*!
+ * @brief Stop relaying
+ */
+static void sstp_relay_stop(int sig, short event, sstp_relay_st *relay)
+{
+    event_base_loopbreak(relay->ev_base);
+}
+
+
+/*!
+ * @brief Resolve [host:]port, or host[:port] with @a port as the default
+ */
+static status_t sstp_relay_resolve(const char *spec, const char *port,
+        int passive, struct sockaddr_storage *addr, socklen_t *alen)
+{
+    struct addrinfo hints;
+    struct addrinfo *list = NULL;
+    char host[256];
+    char *ptr = NULL;
+    int ret = 0;
+
+    strncpy(host, spec, sizeof(host) - 1);
+    host[sizeof(host) - 1] = '\0';
+
+    /* A bare port number to listen on, on all addresses */
+    if (passive && !strchr(host, ':') && strspn(host, "0123456789") == strlen(host))
+    {
+        port = spec;
+        host[0] = '\0';
+    }
+
+    /* Split the port off, but not from a bare IPv6 address */
+    ptr = strrchr(host, ':');
+    if (ptr && (host[0] == '[' || ptr == strchr(host, ':')))
+    {
+        *ptr++ = '\0';
+        port = ptr;
+    }
+
+    if (host[0] == '[')
+    {
+        memmove(host, host + 1, strlen(host));
+        host[strcspn(host, "]")] = '\0';
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = (passive) ? AI_PASSIVE : 0;
+
+    ret = getaddrinfo(host[0] ? host : NULL, port, &hints, &list);
+    if (ret != 0 || !list)
+    {
+        log_err("Could not resolve %s, %s", spec, gai_strerror(ret));
+        return SSTP_FAIL;
+    }
+
+    memcpy(addr, list->ai_addr, list->ai_addrlen);
+    *alen = list->ai_addrlen;
+
+    freeaddrinfo(list);
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Listen for the clients
+ */
+static status_t sstp_relay_listen(sstp_relay_st *relay, const char *spec)
+{
+    struct sockaddr_storage addr;
+    socklen_t alen = 0;
+    int one = 1;
+
+    if (SSTP_OKAY != sstp_relay_resolve(spec, NULL, 1, &addr, &alen))
+    {
+        return SSTP_FAIL;
+    }
+
+    relay->sock = socket(addr.ss_family, SOCK_STREAM, 0);
+    if (relay->sock < 0)
+    {
+        return SSTP_FAIL;
+    }
+
+    setsockopt(relay->sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(relay->sock, (struct sockaddr*) &addr, alen) ||
+        listen(relay->sock, 64))
+    {
+        log_err("Could not listen on %s, %s (%d)", spec, strerror(errno),
+                errno);
+        return SSTP_FAIL;
+    }
+
+    fcntl(relay->sock, F_SETFL, fcntl(relay->sock, F_GETFL) | O_NONBLOCK);
+
+    relay->ev_accept = event_new(relay->ev_base, relay->sock,
+            EV_READ | EV_PERSIST, (event_fn) sstp_relay_accept, relay);
+    if (!relay->ev_accept)
+    {
+        return SSTP_FAIL;
+    }
+
+    event_add(relay->ev_accept, NULL);
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Log the bytes relayed and the recoveries
+ */
+static void sstp_relay_report(sstp_relay_st *relay)
+{
+    log_info("Relay: %d connections, %d resets, %llu bytes up, "
+            "%llu bytes down", relay->count, relay->resets,
+            (unsigned long long) relay->bytes_up,
+            (unsigned long long) relay->bytes_down);
+
+    if (relay->recovered)
+    {
+        log_info("Relay: recovered %d times, min %d ms, avg %d ms, "
+                "max %d ms", relay->recovered, relay->rec_min,
+                relay->rec_sum / relay->recovered, relay->rec_max);
+    }
+}
+
+
+static void sstp_relay_usage(const char *prog, int code)
+{
+    printf("Usage: %s [options] <[address:]port> <server>[:port]\n\n", prog);
+    printf("Relay the connections to the server, impairing the path:\n");
+    printf("  --delay <msec>           Delay each direction this long\n");
+    printf("  --help                   Display this menu\n");
+    printf("  --jitter <msec>          Delay up to this much more, keeping the order\n");
+    printf("  --rate <kbit/s>          Cap the bandwidth of each direction\n");
+    printf("  --reset-after <sec>      Reset each connection after this long\n");
+    printf("  --stall-every <sec>      Stall the delivery this often\n");
+    printf("  --stall-time <msec>      Stall the delivery this long, default 1000\n");
+    printf("\n");
+    sstp_log_usage();
+    exit(code);
+}
+
+
+int main(int argc, char *argv[])
+{
+    sstp_relay_st relay;
+    int option_index = 0;
+    int ret = 0;
+
+    struct option option_long[] =
+    {
+        { "delay",          required_argument, NULL,  0  }, /* 0 */
+        { "help",           no_argument,       NULL,  0  },
+        { "jitter",         required_argument, NULL,  0  },
+        { "rate",           required_argument, NULL,  0  },
+        { "reset-after",    required_argument, NULL,  0  },
+        { "stall-every",    required_argument, NULL,  0  }, /* 5 */
+        { "stall-time",     required_argument, NULL,  0  },
+        { 0, 0, 0, 0 }
+    };
+
+    memset(&relay, 0, sizeof(relay));
+    relay.opts.stall_time = 1000;
+    relay.sock = -1;
+
+    if (SSTP_OKAY != sstp_log_init_argv(&argc, argv))
+    {
+        fprintf(stderr, "Could not initialize logging\n");
+        return EXIT_FAILURE;
+    }
+
+    while (1)
+    {
+        ret = getopt_long(argc, argv, "", option_long, &option_index);
+        if (ret == -1)
+        {
+            break;
+        }
+
+        if (ret != 0)
+        {
+            sstp_relay_usage(argv[0], EXIT_FAILURE);
+        }
+
+        switch (option_index)
+        {
+        case 0:
+            relay.opts.delay = atoi(optarg);
+            break;
+
+        case 1:
+            sstp_relay_usage(argv[0], EXIT_SUCCESS);
+            break;
+
+        case 2:
+            relay.opts.jitter = atoi(optarg);
+            break;
+
+        case 3:
+            relay.opts.rate = atoi(optarg);
+            break;
+
+        case 4:
+            relay.opts.reset_after = atoi(optarg);
+            break;
+
+        case 5:
+            relay.opts.stall_every = atoi(optarg);
+            break;
+
+        case 6:
+            relay.opts.stall_time = atoi(optarg);
+            break;
+        }
+    }
+
+    if (argc - optind != 2 || relay.opts.delay < 0 || relay.opts.jitter < 0 ||
+        relay.opts.rate < 0 || relay.opts.reset_after < 0 ||
+        relay.opts.stall_every < 0 || relay.opts.stall_time < 0)
+    {
+        sstp_relay_usage(argv[0], EXIT_FAILURE);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    srand(time(NULL));
+
+    relay.ev_base = event_base_new();
+    if (!relay.ev_base)
+    {
+        log_err("Could not create the event base");
+        return EXIT_FAILURE;
+    }
+
+    if (SSTP_OKAY != sstp_relay_resolve(argv[optind + 1], SSTP_RELAY_PORT, 0,
+            &relay.addr, &relay.alen) ||
+        SSTP_OKAY != sstp_relay_listen(&relay, argv[optind]))
+    {
+        return EXIT_FAILURE;
+    }
+
+    if (relay.opts.stall_every > 0)
+    {
+        timeval_st tv = { relay.opts.stall_every, 0 };
+
+        relay.ev_stall = event_new(relay.ev_base, -1, EV_PERSIST,
+                (event_fn) sstp_relay_stall, &relay);
+        event_add(relay.ev_stall, &tv);
+    }
+
+    relay.ev_sigint  = event_new(relay.ev_base, SIGINT, EV_SIGNAL | EV_PERSIST,
+            (event_fn) sstp_relay_stop, &relay);
+    relay.ev_sigterm = event_new(relay.ev_base, SIGTERM, EV_SIGNAL | EV_PERSIST,
+            (event_fn) sstp_relay_stop, &relay);
+    event_add(relay.ev_sigint, NULL);
+    event_add(relay.ev_sigterm, NULL);
+
+    log_info("Relaying %s to %s, delay %d+%d ms, rate %d kbit/s", argv[optind],
+            argv[optind + 1], relay.opts.delay, relay.opts.jitter,
+            relay.opts.rate);
+
+    event_base_dispatch(relay.ev_base);
+
+    sstp_relay_report(&relay);
+    return EXIT_SUCCESS;
+}
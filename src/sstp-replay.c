@@ -0,0 +1,667 @@
+/*!
+ * @brief Replay a recorded session through the data path, as a benchmark
+ *
+ * @file sstp-replay.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "sstp-private.h"
+
+
+/*< The socket buffers of the socket pairs (bytes) */
+#define SSTP_REPLAY_SOCKBUF     (1024 * 1024)
+
+/*< The number of byte streams replayed */
+#define SSTP_REPLAY_CHAN        2
+
+
+/*!
+ * @brief The replay of a recording
+ */
+struct sstp_replay
+{
+    /*< The recording */
+    sstp_record_file_st *file;
+
+    /*< The record being fed, or NULL */
+    const sstp_record_st *rec;
+
+    /*< The bytes of the record fed so far */
+    int off;
+
+    /*< Waiting for sstpc to catch up with the record */
+    int wait;
+
+    /*< Feed as fast as sstpc takes it */
+    int fast;
+
+    /*< All of the recording was replayed */
+    int complete;
+
+    /*< The socket pairs, ours at [0] and the end of sstpc at [1] */
+    int sock[SSTP_REPLAY_CHAN][2];
+
+    /*< The bytes sstpc wrote when recorded */
+    uint64_t expect[SSTP_REPLAY_CHAN];
+
+    /*< The bytes sstpc wrote, less any shortfall we gave up waiting on */
+    uint64_t drained[SSTP_REPLAY_CHAN];
+
+    /*< The bytes fed to sstpc */
+    uint64_t bytes_in[SSTP_REPLAY_CHAN];
+
+    /*< The bytes written by sstpc */
+    uint64_t bytes_out[SSTP_REPLAY_CHAN];
+
+    /*< The records replayed */
+    uint64_t records;
+
+    /*< The times we gave up waiting on sstpc */
+    int desync;
+
+    /*< The start and the end of the replay */
+    struct timeval start;
+    struct timeval end;
+
+    /*< The CPU time used at the start */
+    struct rusage usage;
+
+    /*< The event base */
+    event_base_st *ev_base;
+
+    /*< Feeds the next record, on time or once sstpc caught up */
+    event_st *ev_feed;
+
+    /*< Resumes a write cut short */
+    event_st *ev_write[SSTP_REPLAY_CHAN];
+
+    /*< Reads what sstpc writes */
+    event_st *ev_drain[SSTP_REPLAY_CHAN];
+
+    /*< The options */
+    sstp_option_st *opts;
+
+    /*< The scheduler shared by the stream and pppd */
+    sstp_sched_st *sched;
+
+    /*< The data path under test */
+    sstp_stream_st *stream;
+    sstp_http_st *http;
+    sstp_state_st *state;
+    sstp_pppd_st *pppd;
+};
+
+
+/*!
+ * @brief The milliseconds since @a start
+ */
+static int sstp_replay_elapsed(struct timeval *start, struct timeval *end)
+{
+    return ((end->tv_sec  - start->tv_sec) * 1000) +
+           ((end->tv_usec - start->tv_usec) / 1000);
+}
+
+
+/*!
+ * @brief Leave the event loop, the replay is over
+ */
+static void sstp_replay_finish(sstp_replay_st *ctx)
+{
+    if (!ctx->end.tv_sec)
+    {
+        gettimeofday(&ctx->end, NULL);
+    }
+
+    event_base_loopexit(ctx->ev_base, NULL);
+}
+
+
+/*!
+ * @brief Feed the next record in the next round of the event loop
+ */
+static void sstp_replay_resume(sstp_replay_st *ctx)
+{
+    timeval_st tv = { 0, 0 };
+
+    event_add(ctx->ev_feed, &tv);
+}
+
+
+/*!
+ * @brief Feed the records to sstpc, a budget at a time
+ */
+static void sstp_replay_feed(int fd, short event, sstp_replay_st *ctx)
+{
+    const sstp_record_st *rec = NULL;
+    struct timeval now;
+    int budget = SSTP_REPLAY_BUDGET;
+    int ret = 0;
+
+    while (budget-- > 0)
+    {
+        if (!ctx->rec)
+        {
+            ctx->rec = sstp_record_next(ctx->file);
+            ctx->off = 0;
+            if (!ctx->rec)
+            {
+                log_info("Replayed all of the %llu records",
+                        (unsigned long long) ctx->records);
+                ctx->complete = 1;
+                sstp_replay_finish(ctx);
+                return;
+            }
+            ctx->records++;
+        }
+        rec = ctx->rec;
+
+        /* Wait for sstpc to write what it wrote when recorded */
+        if (rec->dir == SSTP_RECORD_OUT)
+        {
+            if (!ctx->wait)
+            {
+                ctx->expect[rec->chan] += rec->len;
+            }
+
+            if (ctx->drained[rec->chan] < ctx->expect[rec->chan])
+            {
+                if (!ctx->wait)
+                {
+                    timeval_st tv = { SSTP_REPLAY_SYNC / 1000,
+                            (SSTP_REPLAY_SYNC % 1000) * 1000 };
+
+                    ctx->wait = 1;
+                    event_add(ctx->ev_feed, &tv);
+                    return;
+                }
+
+                /* Move on, don't wait for the same bytes again */
+                log_debug("Replay is %llu bytes short at record %llu",
+                        (unsigned long long) (ctx->expect[rec->chan] -
+                        ctx->drained[rec->chan]),
+                        (unsigned long long) ctx->records);
+                ctx->drained[rec->chan] = ctx->expect[rec->chan];
+                ctx->desync++;
+            }
+
+            ctx->wait = 0;
+            ctx->rec  = NULL;
+            continue;
+        }
+
+        /* Feed the bytes at the time they were read when recorded */
+        if (!ctx->fast && !ctx->off)
+        {
+            uint64_t due = 0;
+            uint64_t usec = 0;
+
+            gettimeofday(&now, NULL);
+            usec = (uint64_t) (now.tv_sec - ctx->start.tv_sec) * 1000000 +
+                    (now.tv_usec - ctx->start.tv_usec);
+            due  = rec->usec;
+            if (usec < due)
+            {
+                timeval_st tv = { (due - usec) / 1000000,
+                        (due - usec) % 1000000 };
+
+                event_add(ctx->ev_feed, &tv);
+                return;
+            }
+        }
+
+        ret = write(ctx->sock[rec->chan][0], rec->data + ctx->off,
+                rec->len - ctx->off);
+        if (ret < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                event_add(ctx->ev_write[rec->chan], NULL);
+                return;
+            }
+
+            log_err("Could not feed the record, %s (%d)", strerror(errno),
+                    errno);
+            sstp_replay_finish(ctx);
+            return;
+        }
+
+        ctx->bytes_in[rec->chan] += ret;
+        ctx->off += ret;
+        if (ctx->off < rec->len)
+        {
+            event_add(ctx->ev_write[rec->chan], NULL);
+            return;
+        }
+
+        ctx->rec = NULL;
+    }
+
+    /* Let sstpc have a go at what we fed it */
+    sstp_replay_resume(ctx);
+}
+
+
+/*!
+ * @brief Read what sstpc wrote, resuming the feed once it caught up
+ */
+static void sstp_replay_drain(int fd, short event, sstp_replay_st *ctx)
+{
+    uint8_t buf[16384];
+    int chan = (fd == ctx->sock[SSTP_RECORD_PPP][0])
+            ? SSTP_RECORD_PPP
+            : SSTP_RECORD_SSTP;
+    int ret = 0;
+
+    while ((ret = read(fd, buf, sizeof(buf))) > 0)
+    {
+        ctx->drained[chan]   += ret;
+        ctx->bytes_out[chan] += ret;
+    }
+
+    /* sstpc closed its end */
+    if (ret == 0)
+    {
+        event_del(ctx->ev_drain[chan]);
+    }
+
+    if (ctx->wait && ctx->rec && ctx->rec->chan == chan &&
+        ctx->drained[chan] >= ctx->expect[chan])
+    {
+        sstp_replay_resume(ctx);
+    }
+}
+
+
+static void sstp_replay_pppd_cb(sstp_replay_st *ctx, sstp_pppd_event_t ev)
+{
+    switch (ev)
+    {
+    case SSTP_PPP_DOWN:
+        log_info("The PPP link was closed");
+        sstp_replay_finish(ctx);
+        break;
+
+    case SSTP_PPP_UP:
+        if (SSTP_FAIL == sstp_state_accept(ctx->state))
+        {
+            log_warn("Could not accept the call");
+            sstp_replay_finish(ctx);
+        }
+        break;
+
+    case SSTP_PPP_AUTH:
+    {
+        uint8_t skey[16];
+        uint8_t rkey[16];
+
+        /* Without the password the keys stay zero, as with PAP */
+        if (!ctx->opts->password ||
+            SSTP_FAIL == sstp_chap_mppe_get(sstp_pppd_getchap(ctx->pppd),
+                ctx->opts->password, skey, rkey, 0))
+        {
+            break;
+        }
+
+        sstp_state_mppe_keys(ctx->state, skey, 16, rkey, 16);
+        break;
+    }
+
+    default:
+        break;
+    }
+}
+
+
+static void sstp_replay_state_cb(sstp_replay_st *ctx, sstp_state_t event)
+{
+    status_t status = SSTP_FAIL;
+
+    switch (event)
+    {
+    case SSTP_CALL_CONNECT:
+
+        status = sstp_pppd_create(&ctx->pppd, ctx->ev_base, ctx->stream,
+                (sstp_pppd_fn) sstp_replay_pppd_cb, ctx);
+        if (SSTP_OKAY != status ||
+            SSTP_OKAY != sstp_pppd_attach(ctx->pppd,
+                ctx->sock[SSTP_RECORD_PPP][1]))
+        {
+            log_err("Could not attach the PPP link");
+            sstp_replay_finish(ctx);
+            break;
+        }
+
+        sstp_pppd_setsched(ctx->pppd, ctx->sched);
+        sstp_state_set_forward(ctx->state, (sstp_state_forward_fn)
+                sstp_pppd_send, ctx->pppd);
+        break;
+
+    case SSTP_CALL_ESTABLISHED:
+        log_info("Replayed the call setup");
+        break;
+
+    case SSTP_CALL_ABORT:
+    default:
+        log_warn("The call was aborted, %s", sstp_state_reason(ctx->state));
+        sstp_replay_finish(ctx);
+        break;
+    }
+}
+
+
+static void sstp_replay_http_done(sstp_replay_st *ctx, int status)
+{
+    sstp_http_free(ctx->http);
+    ctx->http = NULL;
+
+    if (SSTP_OKAY != status)
+    {
+        log_warn("The HTTP handshake failed");
+        sstp_replay_finish(ctx);
+        return;
+    }
+
+    status = sstp_state_create(&ctx->state, ctx->stream, (sstp_state_change_fn)
+            sstp_replay_state_cb, ctx, SSTP_MODE_CLIENT);
+    if (SSTP_OKAY != status ||
+        SSTP_FAIL == sstp_state_start(ctx->state))
+    {
+        log_err("Could not start the state machine");
+        sstp_replay_finish(ctx);
+    }
+}
+
+
+/*!
+ * @brief Create a socket pair with room for the bursts of the recording
+ */
+static status_t sstp_replay_pair(int sock[2])
+{
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sock))
+    {
+        sock[0] = sock[1] = -1;
+        return SSTP_FAIL;
+    }
+
+    /* Don't stall sstpc on a write to the pty in the middle of a burst */
+    sstp_set_sndbuf(sock[0], SSTP_REPLAY_SOCKBUF);
+    sstp_set_sndbuf(sock[1], SSTP_REPLAY_SOCKBUF);
+
+    return sstp_set_nonbl(sock[0], 1);
+}
+
+
+status_t sstp_replay_create(sstp_replay_st **ctx, event_base_st *base,
+        sstp_sched_st *sched, sstp_option_st *opts)
+{
+    status_t status = SSTP_FAIL;
+    sstp_url_st *url = NULL;
+    int i = 0;
+
+    *ctx = calloc(1, sizeof(sstp_replay_st));
+    if (!*ctx)
+    {
+        goto done;
+    }
+
+    (*ctx)->ev_base = base;
+    (*ctx)->sched   = sched;
+    (*ctx)->opts    = opts;
+    (*ctx)->fast    = !!(opts->enable & SSTP_OPT_REPLAYFAST);
+
+    for (i = 0; i < SSTP_REPLAY_CHAN; i++)
+    {
+        (*ctx)->sock[i][0] = (*ctx)->sock[i][1] = -1;
+    }
+
+    if (SSTP_OKAY != sstp_record_load(&(*ctx)->file, opts->replay))
+    {
+        goto done;
+    }
+
+    if (SSTP_OKAY != sstp_url_parse(&url, sstp_record_server((*ctx)->file)))
+    {
+        log_err("Invalid server in the recording: %s",
+                sstp_record_server((*ctx)->file));
+        goto done;
+    }
+
+    for (i = 0; i < SSTP_REPLAY_CHAN; i++)
+    {
+        if (SSTP_OKAY != sstp_replay_pair((*ctx)->sock[i]))
+        {
+            log_err("Could not create a socket pair, %s (%d)",
+                    strerror(errno), errno);
+            goto done;
+        }
+
+        (*ctx)->ev_write[i] = event_new(base, (*ctx)->sock[i][0], EV_WRITE,
+                (event_fn) sstp_replay_feed, *ctx);
+        (*ctx)->ev_drain[i] = event_new(base, (*ctx)->sock[i][0],
+                EV_READ | EV_PERSIST, (event_fn) sstp_replay_drain, *ctx);
+        if (!(*ctx)->ev_write[i] || !(*ctx)->ev_drain[i])
+        {
+            goto done;
+        }
+        event_add((*ctx)->ev_drain[i], NULL);
+    }
+
+    (*ctx)->ev_feed = event_new(base, -1, 0, (event_fn) sstp_replay_feed,
+            *ctx);
+    if (!(*ctx)->ev_feed)
+    {
+        goto done;
+    }
+
+    /* The stream takes its end of the pair, and closes it */
+    if (SSTP_OKAY != sstp_stream_create(&(*ctx)->stream, base, NULL))
+    {
+        goto done;
+    }
+
+    status = sstp_stream_attach((*ctx)->stream, (*ctx)->sock[SSTP_RECORD_SSTP][1]);
+    (*ctx)->sock[SSTP_RECORD_SSTP][1] = -1;
+    if (SSTP_OKAY != status)
+    {
+        goto done;
+    }
+    sstp_stream_setsched((*ctx)->stream, sched);
+
+    status = sstp_http_create(&(*ctx)->http, url->host, (sstp_http_done_fn)
+            sstp_replay_http_done, *ctx, SSTP_MODE_CLIENT);
+    if (SSTP_OKAY != status)
+    {
+        goto done;
+    }
+
+    log_info("Replaying %s, recorded against %s%s", opts->replay,
+            sstp_record_server((*ctx)->file),
+            (*ctx)->fast ? ", as fast as possible" : "");
+
+    /* Measure the replay alone */
+    gettimeofday(&(*ctx)->start, NULL);
+    getrusage(RUSAGE_SELF, &(*ctx)->usage);
+    sstp_cycle_enable(1);
+
+    status = sstp_http_handshake((*ctx)->http, (*ctx)->stream);
+    if (SSTP_FAIL == status)
+    {
+        goto done;
+    }
+
+    sstp_replay_feed(-1, 0, *ctx);
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    if (url)
+    {
+        sstp_url_free(url);
+    }
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_replay_free(*ctx);
+        *ctx = NULL;
+    }
+
+    return status;
+}
+
+
+status_t sstp_replay_report(sstp_replay_st *ctx)
+{
+    struct rusage usage;
+    uint64_t total = 0;
+    int elapsed = 0;
+    int i = 0;
+
+    if (!ctx->end.tv_sec)
+    {
+        gettimeofday(&ctx->end, NULL);
+    }
+
+    getrusage(RUSAGE_SELF, &usage);
+
+    elapsed = sstp_replay_elapsed(&ctx->start, &ctx->end);
+    if (elapsed <= 0)
+    {
+        elapsed = 1;
+    }
+
+    for (i = 0; i < SSTP_REPLAY_CHAN; i++)
+    {
+        total += ctx->bytes_in[i] + ctx->bytes_out[i];
+    }
+
+    log_info("Replay: %llu records in %d ms, %s",
+            (unsigned long long) ctx->records, elapsed,
+            ctx->complete ? "complete" : "incomplete");
+
+    log_info("Replay: sstp %llu bytes in, %llu bytes out; "
+            "ppp %llu bytes in, %llu bytes out",
+            (unsigned long long) ctx->bytes_in[SSTP_RECORD_SSTP],
+            (unsigned long long) ctx->bytes_out[SSTP_RECORD_SSTP],
+            (unsigned long long) ctx->bytes_in[SSTP_RECORD_PPP],
+            (unsigned long long) ctx->bytes_out[SSTP_RECORD_PPP]);
+
+    /* The process does nothing else, its CPU time is that of the replay */
+    log_info("Replay: %.2f Mbit/s, %d ms user, %d ms system, %d out of sync",
+            total * 8.0 / elapsed / 1000.0,
+            sstp_replay_elapsed(&ctx->usage.ru_utime, &usage.ru_utime),
+            sstp_replay_elapsed(&ctx->usage.ru_stime, &usage.ru_stime),
+            ctx->desync);
+
+    if (sstp_cycle_enabled())
+    {
+        sstp_cycle_dump();
+    }
+
+    return (ctx->complete)
+        ? SSTP_OKAY
+        : SSTP_FAIL;
+}
+
+
+void sstp_replay_free(sstp_replay_st *ctx)
+{
+    int i = 0;
+
+    if (!ctx)
+    {
+        return;
+    }
+
+    if (ctx->http)
+    {
+        sstp_http_free(ctx->http);
+        ctx->http = NULL;
+    }
+
+    if (ctx->state)
+    {
+        sstp_state_free(ctx->state);
+        ctx->state = NULL;
+    }
+
+    if (ctx->pppd)
+    {
+        sstp_pppd_free(ctx->pppd);
+        ctx->pppd = NULL;
+    }
+
+    if (ctx->stream)
+    {
+        sstp_stream_destroy(ctx->stream);
+        ctx->stream = NULL;
+    }
+
+    if (ctx->ev_feed)
+    {
+        event_del(ctx->ev_feed);
+        event_free(ctx->ev_feed);
+        ctx->ev_feed = NULL;
+    }
+
+    for (i = 0; i < SSTP_REPLAY_CHAN; i++)
+    {
+        if (ctx->ev_write[i])
+        {
+            event_del(ctx->ev_write[i]);
+            event_free(ctx->ev_write[i]);
+        }
+
+        if (ctx->ev_drain[i])
+        {
+            event_del(ctx->ev_drain[i]);
+            event_free(ctx->ev_drain[i]);
+        }
+
+        if (ctx->sock[i][0] >= 0)
+        {
+            close(ctx->sock[i][0]);
+        }
+
+        if (ctx->sock[i][1] >= 0)
+        {
+            close(ctx->sock[i][1]);
+        }
+    }
+
+    if (ctx->file)
+    {
+        sstp_record_free(ctx->file);
+        ctx->file = NULL;
+    }
+
+    free(ctx);
+}
@@ -0,0 +1,70 @@
+/*!
+ * @brief Replay a recorded session through the data path, as a benchmark
+ *
+ * @file sstp-replay.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_REPLAY_H__
+#define __SSTP_REPLAY_H__
+
+
+/*< The time to wait for sstpc to write what it wrote when recorded (msec) */
+#define SSTP_REPLAY_SYNC        1000
+
+/*< The records fed at a time before yielding to the event loop */
+#define SSTP_REPLAY_BUDGET      64
+
+
+struct sstp_replay;
+typedef struct sstp_replay sstp_replay_st;
+
+
+/*!
+ * @brief Replay the recording of opts->replay
+ *
+ * @par Note:
+ *  Socket pairs stand in for the TLS connection and the pty to pppd. The
+ *  bytes sstpc read when recorded are fed to it at the recorded times, or
+ *  as fast as it takes them with SSTP_OPT_REPLAYFAST. Before feeding what
+ *  came after a write, we wait until sstpc wrote as much again, for at
+ *  most SSTP_REPLAY_SYNC msec. The bytes run through the HTTP handshake,
+ *  sstp_state, ppp_process_data() and sstp_pppd_send() as when recorded.
+ *  The event loop is left once the recording is replayed.
+ */
+status_t sstp_replay_create(sstp_replay_st **ctx, event_base_st *base,
+        sstp_sched_st *sched, sstp_option_st *opts);
+
+
+/*!
+ * @brief Log the bytes replayed, the throughput and the CPU time used
+ *
+ * @retval SSTP_OKAY if all of the recording was replayed
+ */
+status_t sstp_replay_report(sstp_replay_st *ctx);
+
+
+/*!
+ * @brief Release the replay
+ */
+void sstp_replay_free(sstp_replay_st *ctx);
+
+
+#endif /* #ifndef __SSTP_REPLAY_H__ */
@@ -68,6 +68,9 @@ struct sstp_route_ctx
     /* The sequence number */
     int seq;
 
+    /* The netlink port of the socket, getpid() unless already taken */
+    uint32_t port;
+
     /* The current length of the message */
     int len;
 
@@ -448,7 +451,7 @@ static int sstp_route_recv(sstp_route_ctx_st *ctx)
             continue;
         }
 
-        if (nlh->nlmsg_pid != getpid())
+        if (nlh->nlmsg_pid != ctx->port)
         {
             continue;
         }
@@ -531,7 +534,7 @@ static int sstp_route_newmsg(sstp_route_ctx_st *ctx,
     nlh->nlmsg_type  = cmd;
     nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK | flags;
     nlh->nlmsg_seq   = ++ctx->seq;
-    nlh->nlmsg_pid   = getpid();
+    nlh->nlmsg_pid   = ctx->port;
 
     /* Setup the netlink route message */
     rtm = (struct rtmsg*) NLMSG_DATA(nlh);
@@ -644,7 +647,7 @@ int sstp_route_get(sstp_route_ctx_st *ctx, struct sockaddr *dst,
     nlh->nlmsg_type  = RTM_GETROUTE;
     nlh->nlmsg_flags = NLM_F_REQUEST;
     nlh->nlmsg_seq   = ++ctx->seq;
-    nlh->nlmsg_pid   = getpid();
+    nlh->nlmsg_pid   = ctx->port;
 
     /* Setup the netlink route message */
     rtm = (struct rtmsg*) NLMSG_DATA(nlh);
@@ -747,6 +750,9 @@ done:
  */
 int sstp_route_init(sstp_route_ctx_st **ctx)
 {
+    struct sockaddr_nl addr;
+    socklen_t alen = sizeof(addr);
+
     sstp_route_ctx_st *r = calloc(1, sizeof(sstp_route_ctx_st));
     if (!r)
     {
@@ -759,6 +765,16 @@ int sstp_route_init(sstp_route_ctx_st **ctx)
         goto done;
     }
 
+    /* Have the kernel assign the port, other sockets may hold getpid() */
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(r->sock, (struct sockaddr*) &addr, sizeof(addr)) ||
+        getsockname(r->sock, (struct sockaddr*) &addr, &alen))
+    {
+        goto done;
+    }
+    r->port = addr.nl_pid;
+
     *ctx = r;
     return 0;
 
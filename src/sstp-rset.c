@@ -0,0 +1,884 @@
+/*!
+ * @brief Install a large set of split-tunnel routes through the tunnel
+ *
+ * @file sstp-rset.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "sstp-private.h"
+
+#ifdef HAVE_NETLINK
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+
+/*!
+ * @brief A node of the radix trie, a prefix node has no children
+ */
+typedef struct sstp_rset_node
+{
+    /*< The next bit, zero or one */
+    struct sstp_rset_node *child[2];
+
+    /*< A prefix ends here */
+    int prefix;
+
+} sstp_rset_node_st;
+
+
+/*!
+ * @brief The route set
+ */
+struct sstp_rset
+{
+    /*< The trie of IPv4 and IPv6 prefixes */
+    sstp_rset_node_st *root[2];
+
+    /*< The prefixes after aggregation */
+    sstp_prefix_st *list;
+
+    /*< The number of prefixes in the list */
+    int count;
+
+    /*< The size of the list */
+    int size;
+
+    /*< The list is out of date */
+    int dirty;
+
+    /*< The netlink socket */
+    int sock;
+
+    /*< The buffer of a batch */
+    char *buf;
+
+    /*< The routes are installed through this interface */
+    int oif;
+
+    /*< The netlink command in progress */
+    int cmd;
+
+    /*< The next prefix to send */
+    int next;
+
+    /*< The sequence number of the last message sent */
+    uint32_t seq;
+
+    /*< The number of routes refused */
+    int failed;
+
+    /*< Called when done */
+    sstp_rset_done_fn done_cb;
+
+    /*< The argument to the done function */
+    void *arg;
+
+    /*< The acknowledgement listener */
+    event_st *ev_ack;
+
+    /*< The event base */
+    event_base_st *ev_base;
+};
+
+
+/*!
+ * @brief Release a trie
+ */
+static void sstp_rset_prune(sstp_rset_node_st *node)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    sstp_rset_prune(node->child[0]);
+    sstp_rset_prune(node->child[1]);
+    free(node);
+}
+
+
+/*!
+ * @brief Get bit @a index of an address, counting from the left
+ */
+static int sstp_rset_bit(const uint8_t *addr, int index)
+{
+    return (addr[index >> 3] >> (7 - (index & 7))) & 1;
+}
+
+
+/*!
+ * @brief Insert a prefix into the trie
+ */
+static status_t sstp_rset_insert(sstp_rset_node_st **root,
+        const uint8_t *addr, int len)
+{
+    sstp_rset_node_st *path[129];
+    sstp_rset_node_st *node = NULL;
+    int depth = 0;
+    int bit   = 0;
+
+    if (!*root)
+    {
+        *root = calloc(1, sizeof(sstp_rset_node_st));
+        if (!*root)
+        {
+            return SSTP_FAIL;
+        }
+    }
+
+    node = *root;
+    for (depth = 0; depth < len; depth++)
+    {
+        /* Covered by a shorter prefix */
+        if (node->prefix)
+        {
+            return SSTP_OKAY;
+        }
+
+        path[depth] = node;
+        bit = sstp_rset_bit(addr, depth);
+        if (!node->child[bit])
+        {
+            node->child[bit] = calloc(1, sizeof(sstp_rset_node_st));
+            if (!node->child[bit])
+            {
+                return SSTP_FAIL;
+            }
+        }
+
+        node = node->child[bit];
+    }
+
+    /* The longer prefixes below are covered by this one */
+    node->prefix = 1;
+    sstp_rset_prune(node->child[0]);
+    sstp_rset_prune(node->child[1]);
+    node->child[0] = NULL;
+    node->child[1] = NULL;
+
+    /* Merge with the sibling into the parent, as far up as we can */
+    while (depth-- > 0)
+    {
+        node = path[depth];
+        if (!node->child[0] || !node->child[0]->prefix ||
+            !node->child[1] || !node->child[1]->prefix)
+        {
+            break;
+        }
+
+        free(node->child[0]);
+        free(node->child[1]);
+        node->child[0] = NULL;
+        node->child[1] = NULL;
+        node->prefix   = 1;
+    }
+
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Append the prefixes below @a node to the list
+ */
+static status_t sstp_rset_walk(sstp_rset_st *ctx, sstp_rset_node_st *node,
+        sstp_prefix_st *cur)
+{
+    sstp_prefix_st *list = NULL;
+    int depth = cur->len;
+    int i = 0;
+
+    if (node->prefix)
+    {
+        if (ctx->count == ctx->size)
+        {
+            ctx->size = (ctx->size) ? ctx->size << 1 : 256;
+            list = realloc(ctx->list, ctx->size * sizeof(sstp_prefix_st));
+            if (!list)
+            {
+                return SSTP_FAIL;
+            }
+            ctx->list = list;
+        }
+
+        /* Clear the bits left behind by the longer prefixes walked */
+        list = &ctx->list[ctx->count++];
+        *list = *cur;
+        i = depth >> 3;
+        if (depth & 7)
+        {
+            list->addr[i++] &= 0xff << (8 - (depth & 7));
+        }
+        memset(list->addr + i, 0, sizeof(list->addr) - i);
+        return SSTP_OKAY;
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        if (!node->child[i])
+        {
+            continue;
+        }
+
+        cur->len = depth + 1;
+        cur->addr[depth >> 3] &= ~(0x80 >> (depth & 7));
+        cur->addr[depth >> 3] |= (i << (7 - (depth & 7)));
+
+        if (SSTP_OKAY != sstp_rset_walk(ctx, node->child[i], cur))
+        {
+            return SSTP_FAIL;
+        }
+    }
+
+    cur->len = depth;
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Bring the list of prefixes up to date with the tries
+ */
+static status_t sstp_rset_flatten(sstp_rset_st *ctx)
+{
+    sstp_prefix_st cur;
+    int i = 0;
+
+    if (!ctx->dirty)
+    {
+        return SSTP_OKAY;
+    }
+
+    ctx->count = 0;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (!ctx->root[i])
+        {
+            continue;
+        }
+
+        memset(&cur, 0, sizeof(cur));
+        cur.family = (i == 0) ? AF_INET : AF_INET6;
+        if (SSTP_OKAY != sstp_rset_walk(ctx, ctx->root[i], &cur))
+        {
+            return SSTP_FAIL;
+        }
+    }
+
+    ctx->dirty = 0;
+    return SSTP_OKAY;
+}
+
+
+status_t sstp_rset_add(sstp_rset_st *ctx, const char *prefix)
+{
+    char buf[INET6_ADDRSTRLEN + 8];
+    uint8_t addr[16];
+    char *ptr = NULL;
+    char *end = NULL;
+    int family = AF_INET;
+    long len   = 32;
+
+    if (strlen(prefix) >= sizeof(buf))
+    {
+        return SSTP_FAIL;
+    }
+    strcpy(buf, prefix);
+
+    if (strchr(buf, ':'))
+    {
+        family = AF_INET6;
+        len    = 128;
+    }
+
+    /* Without a length, it's a host route */
+    ptr = strchr(buf, '/');
+    if (ptr)
+    {
+        *ptr++ = '\0';
+        len = strtol(ptr, &end, 10);
+        if (end == ptr || *end != '\0' || len < 0 ||
+            len > ((AF_INET == family) ? 32 : 128))
+        {
+            return SSTP_FAIL;
+        }
+    }
+
+    if (inet_pton(family, buf, addr) != 1)
+    {
+        return SSTP_FAIL;
+    }
+
+    ctx->dirty = 1;
+    return sstp_rset_insert(&ctx->root[(AF_INET == family) ? 0 : 1],
+            addr, len);
+}
+
+
+status_t sstp_rset_load(sstp_rset_st *ctx, const char *file, int *line)
+{
+    status_t status = SSTP_FAIL;
+    FILE *fp  = NULL;
+    char buf[256];
+    char *ptr = NULL;
+    char *end = NULL;
+
+    *line = 0;
+
+    fp = fopen(file, "r");
+    if (!fp)
+    {
+        goto done;
+    }
+
+    while (fgets(buf, sizeof(buf), fp))
+    {
+        (*line)++;
+
+        /* Strip the comments and the white space */
+        ptr = strchr(buf, '#');
+        if (ptr)
+        {
+            *ptr = '\0';
+        }
+
+        for (ptr = buf; isspace((unsigned char) *ptr); ptr++);
+        for (end = ptr + strlen(ptr); end > ptr &&
+                isspace((unsigned char) end[-1]); end--);
+        *end = '\0';
+
+        if (*ptr == '\0')
+        {
+            continue;
+        }
+
+        if (SSTP_OKAY != sstp_rset_add(ctx, ptr))
+        {
+            goto done;
+        }
+    }
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    if (fp)
+    {
+        fclose(fp);
+    }
+
+    return status;
+}
+
+
+int sstp_rset_count(sstp_rset_st *ctx)
+{
+    if (SSTP_OKAY != sstp_rset_flatten(ctx))
+    {
+        return 0;
+    }
+
+    return ctx->count;
+}
+
+
+int sstp_rset_list(sstp_rset_st *ctx, sstp_prefix_st *list, int max)
+{
+    if (SSTP_OKAY != sstp_rset_flatten(ctx))
+    {
+        return 0;
+    }
+
+    if (max > ctx->count)
+    {
+        max = ctx->count;
+    }
+
+    memcpy(list, ctx->list, max * sizeof(sstp_prefix_st));
+    return max;
+}
+
+
+#ifdef HAVE_NETLINK
+
+/*!
+ * @brief Add an attribute to the netlink message
+ */
+static void sstp_rset_addattr(struct nlmsghdr *nlh, int type, int len,
+        const void *value)
+{
+    struct rtattr *rta = NULL;
+
+    rta = (struct rtattr*) (((char*) nlh) + NLMSG_ALIGN(nlh->nlmsg_len));
+    rta->rta_type  = type;
+    rta->rta_len   = RTA_LENGTH(len);
+    nlh->nlmsg_len = NLMSG_ALIGN(nlh->nlmsg_len) + RTA_SPACE(len);
+    memcpy(RTA_DATA(rta), value, len);
+}
+
+
+/*!
+ * @brief Write the route message of a prefix to @a buf
+ *
+ * @retval The length of the message
+ */
+static int sstp_rset_msg(sstp_rset_st *ctx, char *buf,
+        sstp_prefix_st *prefix, int last)
+{
+    struct nlmsghdr *nlh = (struct nlmsghdr*) buf;
+    struct rtmsg *rtm    = NULL;
+
+    memset(buf, 0, SSTP_RSET_MSGMAX);
+
+    /* Errors are always reported, the last message is acknowledged */
+    nlh->nlmsg_len   = NLMSG_LENGTH(sizeof(struct rtmsg));
+    nlh->nlmsg_type  = ctx->cmd;
+    nlh->nlmsg_flags = NLM_F_REQUEST | ((last) ? NLM_F_ACK : 0);
+    nlh->nlmsg_seq   = ++ctx->seq;
+    if (RTM_NEWROUTE == ctx->cmd)
+    {
+        nlh->nlmsg_flags |= NLM_F_CREATE | NLM_F_REPLACE;
+    }
+
+    rtm = (struct rtmsg*) NLMSG_DATA(nlh);
+    rtm->rtm_family  = prefix->family;
+    rtm->rtm_dst_len = prefix->len;
+    rtm->rtm_table   = RT_TABLE_MAIN;
+    rtm->rtm_scope   = RT_SCOPE_LINK;
+    if (RTM_NEWROUTE == ctx->cmd)
+    {
+        rtm->rtm_protocol = RTPROT_BOOT;
+        rtm->rtm_type     = RTN_UNICAST;
+    }
+
+    sstp_rset_addattr(nlh, RTA_DST, (AF_INET == prefix->family) ? 4 : 16,
+            prefix->addr);
+    sstp_rset_addattr(nlh, RTA_OIF, sizeof(ctx->oif), &ctx->oif);
+
+    return nlh->nlmsg_len;
+}
+
+
+/*!
+ * @brief Send the next batch of route messages
+ *
+ * @retval SSTP_INPROG if a batch was sent, SSTP_OKAY if all were sent
+ */
+static status_t sstp_rset_send(sstp_rset_st *ctx)
+{
+    int first = ctx->next;
+    int last  = 0;
+    int off   = 0;
+    int ret   = 0;
+
+    /* The batch ends with the last prefix, or when the buffer is full */
+    while (!last && ctx->next < ctx->count)
+    {
+        last = (ctx->next + 1 == ctx->count ||
+                off + (SSTP_RSET_MSGMAX << 1) > SSTP_RSET_BATCH);
+        off += sstp_rset_msg(ctx, ctx->buf + off, &ctx->list[ctx->next],
+                last);
+        ctx->next++;
+    }
+
+    if (!off)
+    {
+        return SSTP_OKAY;
+    }
+
+    do
+    {
+        ret = send(ctx->sock, ctx->buf, off, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret != off)
+    {
+        ctx->failed += ctx->next - first;
+        return SSTP_FAIL;
+    }
+
+    return SSTP_INPROG;
+}
+
+
+/*!
+ * @brief Receive the errors and the acknowledgement of a batch
+ *
+ * @par Note:
+ *  The errors lost to an overrun of the receive buffer are not counted.
+ *
+ * @retval SSTP_OKAY if the batch was acknowledged, SSTP_INPROG if
+ *  we must wait for more.
+ */
+static status_t sstp_rset_recv(sstp_rset_st *ctx, int flags)
+{
+    struct nlmsghdr *nlh = NULL;
+    struct nlmsgerr *err = NULL;
+    char buf[8192];
+    int len = 0;
+
+    for (;;)
+    {
+        len = recv(ctx->sock, buf, sizeof(buf), flags);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return SSTP_INPROG;
+            }
+
+            return (errno == ENOBUFS)
+                ? SSTP_OKAY
+                : SSTP_FAIL;
+        }
+
+        for (nlh = (struct nlmsghdr*) buf; NLMSG_OK(nlh, len);
+             nlh = NLMSG_NEXT(nlh, len))
+        {
+            if (nlh->nlmsg_type != NLMSG_ERROR)
+            {
+                continue;
+            }
+
+            /* A route already gone is as good as removed */
+            err = (struct nlmsgerr*) NLMSG_DATA(nlh);
+            if (err->error && !(RTM_DELROUTE == ctx->cmd &&
+                    -ESRCH == err->error))
+            {
+                ctx->failed++;
+            }
+
+            if (nlh->nlmsg_seq == ctx->seq)
+            {
+                return SSTP_OKAY;
+            }
+        }
+    }
+}
+
+
+/*!
+ * @brief Report the outcome of the installation
+ */
+static void sstp_rset_finish(sstp_rset_st *ctx, status_t status)
+{
+    if (SSTP_OKAY != status)
+    {
+        ctx->failed += ctx->count - ctx->next;
+    }
+
+    if (ctx->done_cb)
+    {
+        ctx->done_cb(ctx->arg, ctx->count - ctx->failed, ctx->failed);
+    }
+}
+
+
+/*!
+ * @brief Process the acknowledgement of a batch, and send the next one
+ */
+static void sstp_rset_ack(int fd, short event, sstp_rset_st *ctx)
+{
+    status_t ret = SSTP_FAIL;
+
+    ret = sstp_rset_recv(ctx, MSG_DONTWAIT);
+    if (SSTP_OKAY == ret)
+    {
+        ret = sstp_rset_send(ctx);
+    }
+
+    /* Wait for the next acknowledgement */
+    if (SSTP_INPROG == ret)
+    {
+        return;
+    }
+
+    event_del(ctx->ev_ack);
+    sstp_rset_finish(ctx, ret);
+}
+
+
+/*!
+ * @brief Open the netlink socket, and listen for acknowledgements
+ */
+static status_t sstp_rset_open(sstp_rset_st *ctx)
+{
+    int size = SSTP_RSET_RCVBUF;
+
+    if (ctx->ev_ack)
+    {
+        return SSTP_OKAY;
+    }
+
+    ctx->buf = malloc(SSTP_RSET_BATCH);
+    if (!ctx->buf)
+    {
+        return SSTP_FAIL;
+    }
+
+    ctx->sock = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+    if (ctx->sock < 0)
+    {
+        return SSTP_FAIL;
+    }
+
+    /* Room for the errors of a batch, beyond rmem_max if we may */
+    if (setsockopt(ctx->sock, SOL_SOCKET, SO_RCVBUFFORCE, &size,
+            sizeof(size)))
+    {
+        setsockopt(ctx->sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    }
+
+    ctx->ev_ack = event_new(ctx->ev_base, ctx->sock, EV_READ | EV_PERSIST,
+            (event_fn) sstp_rset_ack, ctx);
+    if (!ctx->ev_ack)
+    {
+        return SSTP_FAIL;
+    }
+
+    return SSTP_OKAY;
+}
+
+
+status_t sstp_rset_install(sstp_rset_st *ctx, const char *ifname,
+        sstp_rset_done_fn done, void *arg)
+{
+    status_t ret = SSTP_FAIL;
+    int oif = 0;
+
+    oif = if_nametoindex(ifname);
+    if (!oif)
+    {
+        return SSTP_FAIL;
+    }
+
+    if (SSTP_OKAY != sstp_rset_open(ctx) ||
+        SSTP_OKAY != sstp_rset_flatten(ctx))
+    {
+        return SSTP_FAIL;
+    }
+
+    /* Start over if a previous installation is still in progress */
+    event_del(ctx->ev_ack);
+
+    ctx->cmd     = RTM_NEWROUTE;
+    ctx->oif     = oif;
+    ctx->next    = 0;
+    ctx->failed  = 0;
+    ctx->done_cb = done;
+    ctx->arg     = arg;
+
+    ret = sstp_rset_send(ctx);
+    if (SSTP_INPROG == ret)
+    {
+        event_add(ctx->ev_ack, NULL);
+        return SSTP_OKAY;
+    }
+
+    sstp_rset_finish(ctx, ret);
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Remove the routes installed, waiting for each batch
+ */
+static void sstp_rset_remove(sstp_rset_st *ctx)
+{
+    status_t ret = SSTP_FAIL;
+
+    event_del(ctx->ev_ack);
+
+    ctx->cmd  = RTM_DELROUTE;
+    ctx->next = 0;
+
+    do
+    {
+        ret = sstp_rset_send(ctx);
+        if (SSTP_INPROG == ret)
+        {
+            ret = sstp_rset_recv(ctx, 0);
+        }
+
+    } while (SSTP_OKAY == ret && ctx->next < ctx->count);
+}
+
+#else   /* #ifdef HAVE_NETLINK */
+
+
+status_t sstp_rset_install(sstp_rset_st *ctx, const char *ifname,
+        sstp_rset_done_fn done, void *arg)
+{
+    return SSTP_NOTIMPL;
+}
+
+#endif  /* #ifdef HAVE_NETLINK */
+
+
+void sstp_rset_free(sstp_rset_st *ctx)
+{
+    if (!ctx)
+    {
+        return;
+    }
+
+#ifdef HAVE_NETLINK
+    if (ctx->oif)
+    {
+        sstp_rset_remove(ctx);
+    }
+#endif
+
+    if (ctx->ev_ack)
+    {
+        event_del(ctx->ev_ack);
+        event_free(ctx->ev_ack);
+        ctx->ev_ack = NULL;
+    }
+
+    if (ctx->sock > 0)
+    {
+        close(ctx->sock);
+        ctx->sock = 0;
+    }
+
+    sstp_rset_prune(ctx->root[0]);
+    sstp_rset_prune(ctx->root[1]);
+
+    if (ctx->list)
+    {
+        free(ctx->list);
+        ctx->list = NULL;
+    }
+
+    if (ctx->buf)
+    {
+        free(ctx->buf);
+        ctx->buf = NULL;
+    }
+
+    free(ctx);
+}
+
+
+status_t sstp_rset_create(sstp_rset_st **ctx, event_base_st *base)
+{
+    *ctx = calloc(1, sizeof(sstp_rset_st));
+    if (!*ctx)
+    {
+        return SSTP_FAIL;
+    }
+
+    (*ctx)->ev_base = base;
+    (*ctx)->sock    = -1;
+    return SSTP_OKAY;
+}
+
+
+#ifdef __SSTP_UNIT_TEST_RSET
+
+int main(void)
+{
+    sstp_rset_st *ctx = NULL;
+    sstp_prefix_st list[8];
+    char addr[INET6_ADDRSTRLEN];
+    char line[512] = {};
+    int count = 0;
+    int i = 0;
+
+    static const char *prefixes[] =
+    {
+        "10.0.0.0/9",           /* Merged with its sibling below */
+        "10.1.2.0/24",          /* Covered by 10.0.0.0/9 */
+        "10.128.0.0/9",
+        "192.168.1.0/24",
+        "192.168.1.0/24",       /* Duplicate */
+        "192.168.0.0/24",       /* Merged with 192.168.1.0/24 */
+        "172.16.5.5",
+        "172.16.0.0/12",        /* Covers 172.16.5.5 */
+        "2001:db8:8000::/33",
+        "2001:db8::/33",
+        NULL
+    };
+
+    static const char *expect =
+        "10.0.0.0/8 172.16.0.0/12 192.168.0.0/23 2001:db8::/32 ";
+
+    if (SSTP_OKAY != sstp_rset_create(&ctx, NULL))
+    {
+        printf("Could not create the route set\n");
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; prefixes[i]; i++)
+    {
+        if (SSTP_OKAY != sstp_rset_add(ctx, prefixes[i]))
+        {
+            printf("Could not add %s\n", prefixes[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (SSTP_OKAY == sstp_rset_add(ctx, "10.0.0.0/33") ||
+        SSTP_OKAY == sstp_rset_add(ctx, "10.0.0.0/") ||
+        SSTP_OKAY == sstp_rset_add(ctx, "bogus"))
+    {
+        printf("Accepted an invalid prefix\n");
+        return EXIT_FAILURE;
+    }
+
+    count = sstp_rset_list(ctx, list, 8);
+    for (i = 0; i < count; i++)
+    {
+        inet_ntop(list[i].family, list[i].addr, addr, sizeof(addr));
+        sprintf(line + strlen(line), "%s/%d ", addr, list[i].len);
+    }
+
+    if (strcmp(line, expect) || count != sstp_rset_count(ctx))
+    {
+        printf("Unexpected prefixes: %s\n", line);
+        return EXIT_FAILURE;
+    }
+
+    printf("Successfully aggregated the prefixes: %s\n", line);
+
+    sstp_rset_free(ctx);
+    return EXIT_SUCCESS;
+}
+
+#endif /* #ifdef __SSTP_UNIT_TEST_RSET */
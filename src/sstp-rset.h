@@ -0,0 +1,143 @@
+/*!
+ * @brief Install a large set of split-tunnel routes through the tunnel
+ *
+ * @file sstp-rset.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_RSET_H__
+#define __SSTP_RSET_H__
+
+#include <stdint.h>
+
+
+/*< The size of a batch of route messages sent at once (bytes) */
+#define SSTP_RSET_BATCH         32768
+
+/*< The maximum size of a single route message (bytes) */
+#define SSTP_RSET_MSGMAX        64
+
+/*< The receive buffer requested for the errors of a batch (bytes) */
+#define SSTP_RSET_RCVBUF        (1 << 20)
+
+
+/*!
+ * @brief A prefix of the route set
+ */
+typedef struct
+{
+    /*< AF_INET or AF_INET6 */
+    int family;
+
+    /*< The prefix length */
+    int len;
+
+    /*< The address, in network byte order */
+    uint8_t addr[16];
+
+} sstp_prefix_st;
+
+
+struct sstp_rset;
+typedef struct sstp_rset sstp_rset_st;
+
+
+/*!
+ * @brief Called when all the routes are installed or removed
+ *
+ * @param arg       The argument given to sstp_rset_install()
+ * @param done      The number of routes acknowledged by the kernel
+ * @param failed    The number of routes the kernel refused
+ */
+typedef void (*sstp_rset_done_fn)(void *arg, int done, int failed);
+
+
+/*!
+ * @brief Create an empty route set
+ */
+status_t sstp_rset_create(sstp_rset_st **ctx, event_base_st *base);
+
+
+/*!
+ * @brief Add a prefix, e.g. "10.0.0.0/8", "2001:db8::/32" or "10.1.2.3"
+ *
+ * @par Note:
+ *  The prefixes are kept in a radix trie per address family; a prefix
+ *  covered by another is dropped, and two sibling prefixes are merged
+ *  into their parent.
+ *
+ * @retval SSTP_OKAY, or SSTP_FAIL if the prefix is invalid
+ */
+status_t sstp_rset_add(sstp_rset_st *ctx, const char *prefix);
+
+
+/*!
+ * @brief Add the prefixes of a file, one per line; '#' starts a comment
+ *
+ * @param line      [OUT] The line of the first invalid prefix
+ *
+ * @retval SSTP_OKAY, or SSTP_FAIL if the file could not be read or an
+ *  invalid prefix was found
+ */
+status_t sstp_rset_load(sstp_rset_st *ctx, const char *file, int *line);
+
+
+/*!
+ * @brief Get the number of prefixes after aggregation
+ */
+int sstp_rset_count(sstp_rset_st *ctx);
+
+
+/*!
+ * @brief Get the prefixes after aggregation, IPv4 first in address order
+ *
+ * @retval The number of prefixes copied to @a list
+ */
+int sstp_rset_list(sstp_rset_st *ctx, sstp_prefix_st *list, int max);
+
+
+/*!
+ * @brief Install the routes through interface @a ifname
+ *
+ * @par Note:
+ *  The route messages are sent SSTP_RSET_BATCH bytes at a time in a
+ *  single send() on a netlink socket. Only the last message of a batch
+ *  asks for an acknowledgement, the kernel reports the errors of the 
+ *  others; these are processed from the event loop, and the next batch
+ *  is sent once the previous batch is acknowledged. Any routes installed
+ *  through a previous interface are replaced.
+ *
+ * @retval SSTP_OKAY if in progress, SSTP_NOTIMPL without netlink
+ */
+status_t sstp_rset_install(sstp_rset_st *ctx, const char *ifname,
+        sstp_rset_done_fn done, void *arg);
+
+
+/*!
+ * @brief Release the route set, removing the routes still installed
+ *
+ * @par Note:
+ *  The removal is batched as the installation, but waits for the
+ *  acknowledgements as we may no longer be in the event loop.
+ */
+void sstp_rset_free(sstp_rset_st *ctx);
+
+
+#endif /* #ifndef __SSTP_RSET_H__ */
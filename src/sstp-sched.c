@@ -0,0 +1,399 @@
+/*!
+ * @brief Share the event loop fairly between uplink, downlink and control
+ *
+ * @file sstp-sched.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sstp-private.h"
+
+
+/*!
+ * @brief A deferred job
+ */
+typedef struct sstp_sched_job
+{
+    /*< The continuation function */
+    sstp_sched_fn func;
+
+    /*< The argument to the function */
+    void *arg;
+
+} sstp_sched_job_st;
+
+
+/*!
+ * @brief The scheduler context
+ */
+struct sstp_sched
+{
+    /*< The jobs queued for the next turn, per class */
+    sstp_sched_job_st queue[SSTP_SCHED_MAX][SSTP_SCHED_MAX_JOBS];
+
+    /*< The number of jobs queued, per class */
+    int count[SSTP_SCHED_MAX];
+
+    /*< The jobs of the current turn, per class */
+    sstp_sched_job_st run[SSTP_SCHED_MAX][SSTP_SCHED_MAX_JOBS];
+
+    /*< The number of jobs in the current turn, per class */
+    int nrun[SSTP_SCHED_MAX];
+
+    /*< The class to serve first on the next turn */
+    int next;
+
+    /*< Is the run event activated */
+    int active;
+
+    /*< The number of packets a job may process per turn */
+    int budget;
+
+    /*< The event to run the jobs from the event loop */
+    event_st *ev_run;
+
+    /*< The timing probe of the run event */
+    sstp_probe_st probe;
+
+    /*< The event base */
+    event_base_st *ev_base;
+};
+
+
+int sstp_sched_pending(sstp_sched_st *ctx)
+{
+    int i = 0;
+
+    for (i = 0; i < SSTP_SCHED_MAX; i++)
+    {
+        if (ctx->count[i] > 0)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+
+/*!
+ * @brief Have the event loop call us back on its next turn
+ */
+static void sstp_sched_activate(sstp_sched_st *ctx)
+{
+    if (!ctx->active)
+    {
+        ctx->active = 1;
+        event_active(ctx->ev_run, EV_TIMEOUT, 1);
+    }
+}
+
+
+/*!
+ * @brief Run the jobs queued, one of each class in turn
+ */
+static void sstp_sched_run(int fd, short event, sstp_sched_st *ctx)
+{
+    sstp_sched_job_st *job = NULL;
+    int more  = 1;
+    int round = 0;
+    int type  = 0;
+    int i     = 0;
+
+    ctx->active = 0;
+
+    /* Take the jobs of this turn, new jobs wait for the next */
+    memcpy(ctx->run, ctx->queue, sizeof(ctx->run));
+    memcpy(ctx->nrun, ctx->count, sizeof(ctx->nrun));
+    memset(ctx->count, 0, sizeof(ctx->count));
+
+    for (round = 0; more; round++)
+    {
+        more = 0;
+
+        for (i = 0; i < SSTP_SCHED_MAX; i++)
+        {
+            type = (ctx->next + i) % SSTP_SCHED_MAX;
+            if (round >= ctx->nrun[type])
+            {
+                continue;
+            }
+            more = 1;
+
+            /* The job may have been cancelled by a previous job */
+            job = &ctx->run[type][round];
+            if (job->func)
+            {
+                job->func(job->arg, ctx->budget);
+            }
+        }
+    }
+
+    memset(ctx->nrun, 0, sizeof(ctx->nrun));
+
+    /* Rotate the class served first */
+    ctx->next = (ctx->next + 1) % SSTP_SCHED_MAX;
+
+    if (sstp_sched_pending(ctx))
+    {
+        sstp_sched_activate(ctx);
+    }
+}
+
+
+status_t sstp_sched_defer(sstp_sched_st *ctx, sstp_sched_class_t type,
+        sstp_sched_fn func, void *arg)
+{
+    sstp_sched_job_st *job = NULL;
+    int i = 0;
+
+    /* Already queued */
+    for (i = 0; i < ctx->count[type]; i++)
+    {
+        job = &ctx->queue[type][i];
+        if (job->func == func && job->arg == arg)
+        {
+            return SSTP_OKAY;
+        }
+    }
+
+    if (ctx->count[type] == SSTP_SCHED_MAX_JOBS)
+    {
+        return SSTP_OVERFLOW;
+    }
+
+    job = &ctx->queue[type][ctx->count[type]++];
+    job->func = func;
+    job->arg  = arg;
+
+    sstp_sched_activate(ctx);
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief Remove the jobs with @a arg from a list of jobs
+ */
+static void sstp_sched_remove(sstp_sched_job_st *jobs, int *count, void *arg)
+{
+    int i = 0;
+    int j = 0;
+
+    for (i = 0; i < *count; i++)
+    {
+        if (jobs[i].arg != arg)
+        {
+            jobs[j++] = jobs[i];
+        }
+    }
+
+    *count = j;
+}
+
+
+void sstp_sched_setbudget(sstp_sched_st *ctx, int budget)
+{
+    ctx->budget = budget;
+}
+
+
+int sstp_sched_budget(sstp_sched_st *ctx)
+{
+    return (ctx)
+        ? ctx->budget
+        : SSTP_SCHED_BUDGET;
+}
+
+
+void sstp_sched_cancel(sstp_sched_st *ctx, void *arg)
+{
+    int type = 0;
+    int i    = 0;
+
+    for (type = 0; type < SSTP_SCHED_MAX; type++)
+    {
+        sstp_sched_remove(ctx->queue[type], &ctx->count[type], arg);
+
+        /* Keep the positions of the current turn, just disarm */
+        for (i = 0; i < ctx->nrun[type]; i++)
+        {
+            if (ctx->run[type][i].arg == arg)
+            {
+                ctx->run[type][i].func = NULL;
+            }
+        }
+    }
+}
+
+
+void sstp_sched_free(sstp_sched_st *ctx)
+{
+    if (!ctx)
+    {
+        return;
+    }
+
+    if (ctx->ev_run)
+    {
+        event_del(ctx->ev_run);
+        event_free(ctx->ev_run);
+        ctx->ev_run = NULL;
+    }
+
+    free(ctx);
+}
+
+
+status_t sstp_sched_create(sstp_sched_st **ctx, event_base_st *base)
+{
+    status_t status = SSTP_FAIL;
+
+    *ctx = calloc(1, sizeof(sstp_sched_st));
+    if (!*ctx)
+    {
+        goto done;
+    }
+
+    (*ctx)->ev_base = base;
+    (*ctx)->budget  = SSTP_SCHED_BUDGET;
+    (*ctx)->ev_run  = event_new(base, -1, 0, (event_fn) sstp_probe_call,
+            SSTP_PROBE(&(*ctx)->probe, sstp_sched_run, *ctx));
+    if (!(*ctx)->ev_run)
+    {
+        goto done;
+    }
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_sched_free(*ctx);
+        *ctx = NULL;
+    }
+
+    return status;
+}
+
+
+#ifdef __SSTP_UNIT_TEST_SCHED
+
+#include <stdio.h>
+
+/*!
+ * @brief A job that records its name and runs a number of turns
+ */
+typedef struct
+{
+    sstp_sched_st *sched;
+    sstp_sched_class_t type;
+    char name;
+    int turns;
+    char *trace;
+
+} sstp_test_job_st;
+
+
+static void sstp_test_run(sstp_test_job_st *job, int budget)
+{
+    int len = strlen(job->trace);
+
+    job->trace[len] = job->name;
+
+    if (budget != SSTP_SCHED_BUDGET)
+    {
+        job->trace[len] = '!';
+    }
+
+    if (--job->turns > 0)
+    {
+        sstp_sched_defer(job->sched, job->type, (sstp_sched_fn)
+                sstp_test_run, job);
+    }
+}
+
+
+int main(void)
+{
+    event_base_st *base = NULL;
+    sstp_sched_st *sched = NULL;
+    char trace[32] = {};
+    int ret = 0;
+
+    sstp_test_job_st up   = { NULL, SSTP_SCHED_UPLINK,   'U', 3, trace };
+    sstp_test_job_st down = { NULL, SSTP_SCHED_DOWNLINK, 'D', 2, trace };
+    sstp_test_job_st ctrl = { NULL, SSTP_SCHED_CONTROL,  'C', 1, trace };
+    sstp_test_job_st gone = { NULL, SSTP_SCHED_CONTROL,  'X', 1, trace };
+
+    base = event_base_new();
+    if (!base)
+    {
+        printf("Could not create event base\n");
+        return EXIT_FAILURE;
+    }
+
+    ret = sstp_sched_create(&sched, base);
+    if (SSTP_OKAY != ret)
+    {
+        printf("Could not create the scheduler\n");
+        return EXIT_FAILURE;
+    }
+    up.sched = down.sched = ctrl.sched = gone.sched = sched;
+
+    /* Queue the jobs, the duplicate and cancelled jobs must not run */
+    sstp_sched_defer(sched, up.type, (sstp_sched_fn) sstp_test_run, &up);
+    sstp_sched_defer(sched, up.type, (sstp_sched_fn) sstp_test_run, &up);
+    sstp_sched_defer(sched, down.type, (sstp_sched_fn) sstp_test_run, &down);
+    sstp_sched_defer(sched, gone.type, (sstp_sched_fn) sstp_test_run, &gone);
+    sstp_sched_defer(sched, ctrl.type, (sstp_sched_fn) sstp_test_run, &ctrl);
+    sstp_sched_cancel(sched, &gone);
+
+    /* Runs until no jobs are left */
+    event_base_dispatch(base);
+
+    /* One job of each class per turn, rotating the class served first */
+    if (strcmp(trace, "UDCDUU"))
+    {
+        printf("Unexpected order of jobs: %s\n", trace);
+        return EXIT_FAILURE;
+    }
+
+    printf("Successfully scheduled the jobs: %s\n", trace);
+
+    /* The budget set is the one the events work to */
+    sstp_sched_setbudget(sched, 4);
+    if (sstp_sched_budget(sched) != 4 ||
+        sstp_sched_budget(NULL) != SSTP_SCHED_BUDGET)
+    {
+        printf("The budget set was not returned\n");
+        return EXIT_FAILURE;
+    }
+
+    sstp_sched_free(sched);
+    event_base_free(base);
+    return EXIT_SUCCESS;
+}
+
+#endif /* #ifdef __SSTP_UNIT_TEST_SCHED */
@@ -0,0 +1,116 @@
+/*!
+ * @brief Share the event loop fairly between uplink, downlink and control
+ *
+ * @file sstp-sched.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_SCHED_H__
+#define __SSTP_SCHED_H__
+
+
+/*< The default number of packets a job may process before it must yield */
+#define SSTP_SCHED_BUDGET       16
+
+/*< The maximum number of jobs queued per class */
+#define SSTP_SCHED_MAX_JOBS     8
+
+
+/*!
+ * @brief The classes of work, served round-robin
+ */
+typedef enum
+{
+    SSTP_SCHED_UPLINK   = 0,
+    SSTP_SCHED_DOWNLINK = 1,
+    SSTP_SCHED_CONTROL  = 2,
+    SSTP_SCHED_MAX      = 3,
+
+} sstp_sched_class_t;
+
+
+struct sstp_sched;
+typedef struct sstp_sched sstp_sched_st;
+
+
+/*!
+ * @brief A deferred continuation
+ *
+ * @param arg       The argument given to sstp_sched_defer()
+ * @param budget    The number of packets the job may process, a job with
+ *  more work left must call sstp_sched_defer() again and return.
+ */
+typedef void (*sstp_sched_fn)(void *arg, int budget);
+
+
+/*!
+ * @brief Create the scheduler
+ */
+status_t sstp_sched_create(sstp_sched_st **ctx, event_base_st *base);
+
+
+/*!
+ * @brief Continue a job once we are back in the event loop
+ *
+ * @par Note:
+ *  A job already queued is not queued again. Each turn of the event loop,
+ *  the scheduler runs the jobs queued before the turn started, taking one
+ *  job of each class in turn; jobs queued while running wait for the next
+ *  turn, letting the event loop handle I/O in between.
+ *
+ * @retval SSTP_OKAY, or SSTP_OVERFLOW if the class queue is full
+ */
+status_t sstp_sched_defer(sstp_sched_st *ctx, sstp_sched_class_t type,
+        sstp_sched_fn func, void *arg);
+
+
+/*!
+ * @brief Check if any jobs are queued for the next turn
+ */
+int sstp_sched_pending(sstp_sched_st *ctx);
+
+
+/*!
+ * @brief Set the number of packets a job may process per turn, the default
+ *  is SSTP_SCHED_BUDGET
+ */
+void sstp_sched_setbudget(sstp_sched_st *ctx, int budget);
+
+
+/*!
+ * @brief Get the number of packets a job may process per turn, also for
+ *  the work done straight from an event. Without @a ctx, the default.
+ */
+int sstp_sched_budget(sstp_sched_st *ctx);
+
+
+/*!
+ * @brief Remove any jobs queued with @a arg
+ */
+void sstp_sched_cancel(sstp_sched_st *ctx, void *arg);
+
+
+/*!
+ * @brief Release resources associated with the scheduler
+ */
+void sstp_sched_free(sstp_sched_st *ctx);
+
+
+#endif /* #ifndef __SSTP_SCHED_H__ */
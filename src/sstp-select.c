@@ -0,0 +1,685 @@
+/*!
+ * @brief Select the best server among a list of servers
+ *
+ * @file sstp-select.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <openssl/ssl.h>
+
+#include "sstp-private.h"
+#include "sstp-select.h"
+
+
+/*!
+ * @brief The probe of a server is in any of these states
+ */
+typedef enum
+{
+    SSTP_PROBE_IDLE     = 0,
+    SSTP_PROBE_CONNECT  = 1,
+    SSTP_PROBE_HANDSHAKE= 2,
+
+} sstp_probe_t;
+
+
+/*!
+ * @brief A server in the list
+ */
+typedef struct sstp_server
+{
+    /*< The server as given on the command line */
+    const char *name;
+
+    /*< The parsed server url */
+    sstp_url_st *url;
+
+    /*< The resolved address */
+    struct sockaddr_storage addr;
+
+    /*< The address length, zero if it could not be resolved */
+    int alen;
+
+    /*< The moving average of the connect + handshake time (ms) */
+    double score;
+
+    /*< The number of failures in a row */
+    int failures;
+
+    /*< Did we already try this server */
+    int tried;
+
+    /*< The probe state */
+    sstp_probe_t state;
+
+    /*< The probe socket */
+    int sock;
+
+    /*< The probe SSL connection */
+    SSL *ssl;
+
+    /*< The probe event */
+    event_st *ev;
+
+    /*< The time the current probe step started */
+    struct timeval start;
+
+    /*< The measured TCP connect time (ms) */
+    int tcp_ms;
+
+    /*< The selection context we belong to */
+    struct sstp_select *owner;
+
+} sstp_server_st;
+
+
+/*!
+ * @brief The server selection context
+ */
+struct sstp_select
+{
+    /*< The list of servers */
+    sstp_server_st server[SSTP_MAX_SERVERS];
+
+    /*< The number of servers */
+    int count;
+
+    /*< The index of the current server */
+    int current;
+
+    /*< The number of probes in progress */
+    int pending;
+
+    /*< The probe timeout (seconds) */
+    int timeout;
+
+    /*< The probe complete callback */
+    sstp_select_done_fn done_cb;
+
+    /*< The argument to the probe complete callback */
+    void *arg;
+
+    /*< The event base */
+    event_base_st *ev_base;
+
+    /*< The SSL context */
+    SSL_CTX *ssl_ctx;
+
+    /*< The options */
+    sstp_option_st *opts;
+
+    /*< The file to keep the scores */
+    char path[SSTP_PATH_MAX+1];
+};
+
+
+/*!
+ * @brief Get the milliseconds elapsed since @a start
+ */
+static int sstp_select_elapsed(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return ((now.tv_sec  - start->tv_sec) * 1000) +
+           ((now.tv_usec - start->tv_usec) / 1000);
+}
+
+
+/*!
+ * @brief Add a sample to the moving average of the server
+ */
+static void sstp_select_sample(sstp_server_st *server, int sample)
+{
+    if (server->score <= 0)
+    {
+        server->score = sample;
+        return;
+    }
+
+    server->score += SSTP_SELECT_WEIGHT * (sample - server->score);
+}
+
+
+/*!
+ * @brief Load the scores of previous runs
+ */
+static void sstp_select_load(sstp_select_st *ctx)
+{
+    char name[SSTP_DFLT_BUFSZ+1];
+    char line[SSTP_DFLT_BUFSZ+1];
+    double score = 0;
+    int failures = 0;
+    FILE *file   = NULL;
+    int i = 0;
+
+    file = fopen(ctx->path, "r");
+    if (!file)
+    {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), file))
+    {
+        if (line[0] == '#')
+        {
+            continue;
+        }
+
+        if (3 != sscanf(line, "%255s %lf %d", name, &score, &failures))
+        {
+            continue;
+        }
+
+        for (i = 0; i < ctx->count; i++)
+        {
+            if (strcmp(name, ctx->server[i].name))
+            {
+                continue;
+            }
+
+            ctx->server[i].score    = score;
+            ctx->server[i].failures = failures;
+            log_debug("Loaded score of %s: %.0f ms, %d failure(s)",
+                    name, score, failures);
+        }
+    }
+
+    fclose(file);
+}
+
+
+/*!
+ * @brief Save the scores for the next run
+ */
+static void sstp_select_save(sstp_select_st *ctx)
+{
+    const char *name = ctx->path;
+    FILE *file = NULL;
+    int i = 0;
+
+    file = fopen(name, "w");
+    if (!file && errno == ENOENT)
+    {
+        /* In case we are running in a sandbox */
+        name = rindex(ctx->path, '/') + 1;
+        file = fopen(name, "w");
+    }
+
+    if (!file)
+    {
+        log_debug("Could not save server scores, %s (%d)",
+                strerror(errno), errno);
+        return;
+    }
+
+    fprintf(file, "# server score(ms) failures\n");
+    for (i = 0; i < ctx->count; i++)
+    {
+        fprintf(file, "%s %.1f %d\n", ctx->server[i].name,
+                ctx->server[i].score, ctx->server[i].failures);
+    }
+
+    /* Allow us to update the file after dropping privileges */
+    if (getuid() == 0)
+    {
+        if (fchown(fileno(file), sstp_get_uid(ctx->opts->priv_user),
+                sstp_get_gid(ctx->opts->priv_group)))
+        {
+            log_debug("Could not change ownership of %s", name);
+        }
+    }
+
+    fclose(file);
+}
+
+
+/*!
+ * @brief Resolve the address of the server
+ */
+static status_t sstp_select_lookup(sstp_server_st *server)
+{
+    const char *service= NULL;
+    addrinfo_st *list  = NULL;
+    addrinfo_st hints  =
+    {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+    };
+    int ret;
+
+    /* Get the service string */
+    service = (server->url->port)
+        ? server->url->port
+        : server->url->schema;
+
+    /* Resolve the server address */
+    ret = getaddrinfo(server->url->host, service, &hints, &list);
+    if (ret != 0 || !list)
+    {
+        log_warn("Could not resolve host: %s, %s (%d)",
+                server->url->host, gai_strerror(ret), ret);
+        return SSTP_FAIL;
+    }
+
+    memcpy(&server->addr, list->ai_addr, list->ai_addrlen);
+    server->alen = list->ai_addrlen;
+    freeaddrinfo(list);
+
+    return SSTP_OKAY;
+}
+
+
+/*!
+ * @brief The probe of a server completed, record the result
+ */
+static void sstp_select_probe_done(sstp_server_st *server, status_t status)
+{
+    sstp_select_st *ctx = server->owner;
+    int tls_ms = 0;
+
+    if (SSTP_OKAY == status)
+    {
+        tls_ms = sstp_select_elapsed(&server->start);
+        sstp_select_sample(server, server->tcp_ms + tls_ms);
+        log_info("Probed %s: connect %d ms, handshake %d ms, score %.0f ms",
+                server->name, server->tcp_ms, tls_ms, server->score);
+    }
+    else
+    {
+        sstp_select_sample(server, SSTP_SELECT_PENALTY);
+        log_info("Probe of %s failed, score %.0f ms", server->name,
+                server->score);
+    }
+
+    /* Cleanup after the probe */
+    if (server->ev)
+    {
+        event_del(server->ev);
+        event_free(server->ev);
+        server->ev = NULL;
+    }
+
+    if (server->ssl)
+    {
+        SSL_free(server->ssl);
+        server->ssl = NULL;
+    }
+
+    if (server->sock >= 0)
+    {
+        close(server->sock);
+        server->sock = -1;
+    }
+
+    server->state = SSTP_PROBE_IDLE;
+
+    /* Report back when all the probes are complete */
+    if (--ctx->pending == 0)
+    {
+        sstp_select_save(ctx);
+        ctx->done_cb(ctx->arg);
+    }
+}
+
+
+/*!
+ * @brief Wait for the socket to become readable or writable
+ */
+static void sstp_select_wait(sstp_server_st *server, short event);
+
+
+/*!
+ * @brief Drive the probe forward on socket events
+ */
+static void sstp_select_probe_cont(int sock, short event,
+        sstp_server_st *server)
+{
+    socklen_t len = sizeof(int);
+    int error = 0;
+    int ret   = 0;
+
+    if (EV_TIMEOUT & event)
+    {
+        log_debug("Probe of %s timed out", server->name);
+        sstp_select_probe_done(server, SSTP_TIMEOUT);
+        return;
+    }
+
+    switch (server->state)
+    {
+    case SSTP_PROBE_CONNECT:
+
+        /* Check the outcome of the connect */
+        ret = getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &len);
+        if (ret != 0 || error != 0)
+        {
+            sstp_select_probe_done(server, SSTP_FAIL);
+            return;
+        }
+
+        server->tcp_ms = sstp_select_elapsed(&server->start);
+        gettimeofday(&server->start, NULL);
+
+        /* Setup the SSL connection */
+        server->ssl = SSL_new(server->owner->ssl_ctx);
+        if (!server->ssl || 1 != SSL_set_fd(server->ssl, sock))
+        {
+            sstp_select_probe_done(server, SSTP_FAIL);
+            return;
+        }
+
+        SSL_set_connect_state(server->ssl);
+        server->state = SSTP_PROBE_HANDSHAKE;
+
+        /* Fall through */
+
+    case SSTP_PROBE_HANDSHAKE:
+
+        ret = SSL_do_handshake(server->ssl);
+        switch (SSL_get_error(server->ssl, ret))
+        {
+        case SSL_ERROR_NONE:
+            sstp_select_probe_done(server, SSTP_OKAY);
+            break;
+
+        case SSL_ERROR_WANT_READ:
+            sstp_select_wait(server, EV_READ);
+            break;
+
+        case SSL_ERROR_WANT_WRITE:
+            sstp_select_wait(server, EV_WRITE);
+            break;
+
+        default:
+            sstp_select_probe_done(server, SSTP_FAIL);
+            break;
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+static void sstp_select_wait(sstp_server_st *server, short event)
+{
+    timeval_st tv = { server->owner->timeout, 0 };
+
+    event_set(server->ev, server->sock, event | EV_TIMEOUT,
+            (event_fn) sstp_select_probe_cont, server);
+    event_base_set(server->owner->ev_base, server->ev);
+    event_add(server->ev, &tv);
+}
+
+
+/*!
+ * @brief Start the probe of a single server
+ */
+static status_t sstp_select_probe_start(sstp_server_st *server)
+{
+    int ret = 0;
+
+    if (!server->alen)
+    {
+        return SSTP_FAIL;
+    }
+
+    server->sock = socket(server->addr.ss_family, SOCK_STREAM, 0);
+    if (server->sock < 0)
+    {
+        return SSTP_FAIL;
+    }
+
+    ret = sstp_set_nonbl(server->sock, 1);
+    if (SSTP_OKAY != ret)
+    {
+        return SSTP_FAIL;
+    }
+
+    server->ev = event_new(server->owner->ev_base, -1, 0, NULL, NULL);
+    if (!server->ev)
+    {
+        return SSTP_FAIL;
+    }
+
+    gettimeofday(&server->start, NULL);
+
+    ret = connect(server->sock, (struct sockaddr*) &server->addr,
+            server->alen);
+    if (ret != 0 && errno != EINPROGRESS)
+    {
+        return SSTP_FAIL;
+    }
+
+    /* Wait for the connect to complete */
+    server->state = SSTP_PROBE_CONNECT;
+    sstp_select_wait(server, EV_WRITE);
+
+    return SSTP_OKAY;
+}
+
+
+status_t sstp_select_probe(sstp_select_st *ctx, sstp_select_done_fn done,
+        void *arg, int timeout)
+{
+    status_t ret = SSTP_FAIL;
+    int i = 0;
+
+    ctx->done_cb = done;
+    ctx->arg     = arg;
+    ctx->timeout = timeout;
+    ctx->pending = 1;
+
+    for (i = 0; i < ctx->count; i++)
+    {
+        sstp_server_st *server = &ctx->server[i];
+
+        ctx->pending++;
+        ret = sstp_select_probe_start(server);
+        if (SSTP_OKAY != ret)
+        {
+            sstp_select_probe_done(server, SSTP_FAIL);
+        }
+    }
+
+    /* Account for the case where all probes failed right away */
+    if (--ctx->pending == 0)
+    {
+        sstp_select_save(ctx);
+        ctx->done_cb(ctx->arg);
+    }
+
+    return SSTP_OKAY;
+}
+
+
+status_t sstp_select_next(sstp_select_st *ctx, const char **server,
+        const char **host, struct sockaddr **addr, int *alen)
+{
+    sstp_server_st *best = NULL;
+    int index = -1;
+    int i = 0;
+
+    /* Find the server with the lowest score not yet tried */
+    for (i = 0; i < ctx->count; i++)
+    {
+        sstp_server_st *entry = &ctx->server[i];
+        if (entry->tried || !entry->alen)
+        {
+            continue;
+        }
+
+        if (!best || entry->score < best->score)
+        {
+            best  = entry;
+            index = i;
+        }
+    }
+
+    if (!best)
+    {
+        return SSTP_FAIL;
+    }
+
+    best->tried  = 1;
+    ctx->current = index;
+
+    *server = best->name;
+    *host   = best->url->host;
+    *addr   = (struct sockaddr*) &best->addr;
+    *alen   = best->alen;
+
+    log_info("Selected server %s, score %.0f ms", best->name, best->score);
+    return SSTP_OKAY;
+}
+
+
+void sstp_select_result(sstp_select_st *ctx, status_t status)
+{
+    sstp_server_st *server = &ctx->server[ctx->current];
+    int i = 0;
+
+    if (SSTP_OKAY == status)
+    {
+        server->failures = 0;
+
+        /* Fail over to any of the other servers from now on */
+        for (i = 0; i < ctx->count; i++)
+        {
+            ctx->server[i].tried = (i == ctx->current);
+        }
+    }
+    else
+    {
+        server->failures++;
+        sstp_select_sample(server, SSTP_SELECT_PENALTY);
+    }
+
+    sstp_select_save(ctx);
+}
+
+
+void sstp_select_free(sstp_select_st *ctx)
+{
+    int i = 0;
+
+    if (!ctx)
+    {
+        return;
+    }
+
+    for (i = 0; i < ctx->count; i++)
+    {
+        sstp_server_st *server = &ctx->server[i];
+
+        if (server->ev)
+        {
+            event_del(server->ev);
+            event_free(server->ev);
+        }
+
+        if (server->ssl)
+        {
+            SSL_free(server->ssl);
+        }
+
+        if (server->sock >= 0)
+        {
+            close(server->sock);
+        }
+
+        if (server->url)
+        {
+            sstp_url_free(server->url);
+        }
+    }
+
+    free(ctx);
+}
+
+
+status_t sstp_select_create(sstp_select_st **ctx, event_base_st *base,
+        SSL_CTX *ssl, sstp_option_st *opts)
+{
+    sstp_select_st *obj = NULL;
+    status_t status = SSTP_FAIL;
+    int ret = 0;
+    int i = 0;
+
+    obj = calloc(1, sizeof(sstp_select_st));
+    if (!obj)
+    {
+        goto done;
+    }
+
+    obj->ev_base = base;
+    obj->ssl_ctx = ssl;
+    obj->opts    = opts;
+    snprintf(obj->path, sizeof(obj->path), "%s/sstpc-%s.servers",
+            SSTP_RUNTIME_DIR, (opts->ipparam) ? opts->ipparam
+                                              : SSTP_SOCK_NAME);
+
+    /* Resolve all the servers up front */
+    for (i = 0; i < opts->nservers; i++)
+    {
+        sstp_server_st *server = &obj->server[obj->count++];
+        server->owner = obj;
+        server->name  = opts->servers[i];
+        server->sock  = -1;
+
+        ret = sstp_url_parse(&server->url, server->name);
+        if (SSTP_OKAY != ret)
+        {
+            log_err("Could not parse the server URL: %s", server->name);
+            goto done;
+        }
+
+        sstp_select_lookup(server);
+    }
+
+    /* Get the scores of previous runs */
+    sstp_select_load(obj);
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_select_free(obj);
+        obj = NULL;
+    }
+
+    *ctx = obj;
+    return status;
+}
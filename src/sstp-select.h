@@ -0,0 +1,104 @@
+/*!
+ * @brief Select the best server among a list of servers
+ *
+ * @file sstp-select.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_SELECT_H__
+#define __SSTP_SELECT_H__
+
+
+/*< The time allowed to probe the servers (seconds) */
+#define SSTP_SELECT_TIMEOUT     5
+
+/*< The score (ms) recorded for a failed probe or connection */
+#define SSTP_SELECT_PENALTY     10000
+
+/*< The weight of a new sample in the moving average */
+#define SSTP_SELECT_WEIGHT      0.25
+
+
+struct sstp_select;
+typedef struct sstp_select sstp_select_st;
+
+
+/*!
+ * @brief Called when the probe of all the servers is complete
+ */
+typedef void (*sstp_select_done_fn)(void *arg);
+
+
+/*!
+ * @brief Create the server selection context
+ *
+ * @par Note:
+ *  The servers are taken from @a opts, and the scores of previous runs are
+ *  loaded from the runtime directory.
+ */
+status_t sstp_select_create(sstp_select_st **ctx, event_base_st *base,
+        SSL_CTX *ssl, sstp_option_st *opts);
+
+
+/*!
+ * @brief Probe all the servers in parallel
+ *
+ * @par Note:
+ *  Measures the TCP connect time and the SSL handshake time of each of the
+ *  servers; the handshake time includes the time the server spends on it,
+ *  and reflects how busy the server is. The samples update the moving
+ *  average of each server.
+ */
+status_t sstp_select_probe(sstp_select_st *ctx, sstp_select_done_fn done,
+        void *arg, int timeout);
+
+
+/*!
+ * @brief Get the best ranked server not yet tried
+ *
+ * @param ctx       [IN] The selection context
+ * @param server    [OUT] The server as specified on the command line
+ * @param host      [OUT] The host name of the server
+ * @param addr      [OUT] The resolved address of the server
+ * @param alen      [OUT] The length of @a addr
+ *
+ * @retval SSTP_OKAY, or SSTP_FAIL if all servers were tried
+ */
+status_t sstp_select_next(sstp_select_st *ctx, const char **server,
+        const char **host, struct sockaddr **addr, int *alen);
+
+
+/*!
+ * @brief Record the outcome of the connection to the current server
+ *
+ * @par Note:
+ *  A successful connection makes all the other servers eligible again
+ *  for sstp_select_next().
+ */
+void sstp_select_result(sstp_select_st *ctx, status_t status);
+
+
+/*!
+ * @brief Release resources associated with the selection context
+ */
+void sstp_select_free(sstp_select_st *ctx);
+
+
+#endif /* #ifndef __SSTP_SELECT_H__ */
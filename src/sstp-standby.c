@@ -0,0 +1,492 @@
+/*!
+ * @brief Keep a pre-established connection ready for fail-over
+ *
+ * @file sstp-standby.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <openssl/ssl.h>
+
+#include "sstp-private.h"
+#include "sstp-standby.h"
+
+
+/*!
+ * @brief A single connection warmed up to the HTTP handshake
+ */
+typedef struct sstp_standby_conn
+{
+    /*< The SSL stream */
+    sstp_stream_st *stream;
+
+    /*< The HTTP handshake context */
+    sstp_http_st *http;
+
+    /*< Buffer to detect the server closing the connection */
+    sstp_buff_st *buf;
+
+    /*< The standby context we belong to */
+    struct sstp_standby *owner;
+
+    /*< The connection failed, and waits to be released */
+    int failed;
+
+} sstp_standby_conn_st;
+
+
+/*!
+ * @brief The standby context
+ */
+struct sstp_standby
+{
+    /*< The connection ready to be promoted */
+    sstp_standby_conn_st *ready;
+
+    /*< The connection currently being warmed up */
+    sstp_standby_conn_st *warm;
+
+    /*< The session to resume on refresh */
+    SSL_SESSION *session;
+
+    /*< The refresh / retry timer */
+    event_st *ev_timer;
+
+    /*< The event base */
+    event_base_st *ev_base;
+
+    /*< The SSL context */
+    SSL_CTX *ssl_ctx;
+
+    /*< The options */
+    sstp_option_st *opts;
+
+    /*< The server name */
+    char server[128];
+
+    /*< The server address */
+    struct sockaddr_storage addr;
+
+    /*< The server address length */
+    int alen;
+
+    /*< The refresh interval in seconds */
+    int refresh;
+};
+
+
+/*!
+ * @brief Release the connection and its resources
+ */
+static void sstp_standby_conn_free(sstp_standby_conn_st *conn)
+{
+    if (conn->http)
+    {
+        sstp_http_free(conn->http);
+        conn->http = NULL;
+    }
+
+    if (conn->stream)
+    {
+        sstp_stream_destroy(conn->stream);
+        conn->stream = NULL;
+    }
+
+    if (conn->buf)
+    {
+        sstp_buff_destroy(conn->buf);
+        conn->buf = NULL;
+    }
+
+    free(conn);
+}
+
+
+/*!
+ * @brief Deferred release of a connection, called from the event loop
+ */
+static void sstp_standby_reap(int fd, short event, sstp_standby_conn_st *conn)
+{
+    sstp_standby_conn_free(conn);
+}
+
+
+/*!
+ * @brief Arm the refresh / retry timer
+ */
+static void sstp_standby_schedule(sstp_standby_st *ctx, int seconds)
+{
+    timeval_st tv = { seconds, 0 };
+
+    event_del(ctx->ev_timer);
+    event_add(ctx->ev_timer, &tv);
+}
+
+
+/*!
+ * @brief Drop a connection that failed, retry later
+ *
+ * @par Note:
+ *  We are called from within the stream callbacks, the connection is
+ *  released once we are back in the event loop. Until then the receive
+ *  may complete again, the connection is only released once.
+ */
+static void sstp_standby_fail(sstp_standby_conn_st *conn, const char *reason)
+{
+    sstp_standby_st *ctx = conn->owner;
+    timeval_st tv = { 0, 0 };
+
+    if (conn->failed)
+    {
+        return;
+    }
+    conn->failed = 1;
+
+    log_warn("Standby connection to %s failed, %s", ctx->server, reason);
+
+    if (ctx->ready == conn)
+    {
+        ctx->ready = NULL;
+    }
+
+    if (ctx->warm == conn)
+    {
+        ctx->warm = NULL;
+    }
+
+    event_base_once(ctx->ev_base, -1, EV_TIMEOUT, (event_fn)
+            sstp_standby_reap, conn, &tv);
+
+    sstp_standby_schedule(ctx, SSTP_STANDBY_RETRY);
+}
+
+
+/*!
+ * @brief Any activity on a ready connection means it's gone
+ */
+static void sstp_standby_watch(sstp_stream_st *stream, sstp_buff_st *buf,
+        sstp_standby_conn_st *conn, status_t status)
+{
+    sstp_standby_fail(conn, (SSTP_OKAY == status)
+            ? "unexpected message from server"
+            : "connection closed by server");
+}
+
+
+/*!
+ * @brief Called upon HTTP handshake complete w/result
+ */
+static void sstp_standby_http_done(sstp_standby_conn_st *conn, int status)
+{
+    sstp_standby_st *ctx = conn->owner;
+    int opts = SSTP_VERIFY_NAME;
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_standby_fail(conn, "HTTP handshake failed");
+        return;
+    }
+
+    /* Free the handshake data */
+    sstp_http_free(conn->http);
+    conn->http = NULL;
+
+    /* Verify the server certificate, same rules as the active stream */
+    if (ctx->opts->ca_cert || ctx->opts->ca_path)
+    {
+        opts = SSTP_VERIFY_CERT;
+    }
+
+    status = sstp_verify_cert(conn->stream, ctx->server, opts);
+    if (SSTP_OKAY != status &&
+        !(SSTP_OPT_CERTWARN & ctx->opts->enable))
+    {
+        sstp_standby_fail(conn, "certificate verification failed");
+        return;
+    }
+
+    /* Keep the session around for the next refresh */
+    if (ctx->session)
+    {
+        SSL_SESSION_free(ctx->session);
+    }
+    ctx->session = sstp_stream_getsession(conn->stream);
+
+    log_info("Standby connection to %s is ready%s", ctx->server,
+            sstp_stream_resumed(conn->stream) ? " (resumed)" : "");
+
+    /* Replace the previous standby connection */
+    if (ctx->ready)
+    {
+        sstp_standby_conn_free(ctx->ready);
+    }
+    ctx->ready = conn;
+    ctx->warm  = NULL;
+
+    /* Watch for the server closing the connection */
+    sstp_stream_setrecv(conn->stream, sstp_stream_recv_sstp, conn->buf,
+            (sstp_complete_fn) sstp_standby_watch, conn, 0);
+
+    /* Replace it before the server gives up on us */
+    sstp_standby_schedule(ctx, ctx->refresh);
+}
+
+
+/*!
+ * @brief Called upon connect complete w/result
+ */
+static void sstp_standby_connected(sstp_stream_st *stream, sstp_buff_st *buf,
+        sstp_standby_conn_st *conn, status_t status)
+{
+    sstp_standby_st *ctx = conn->owner;
+    int ret = 0;
+
+    if (SSTP_CONNECTED != status)
+    {
+        sstp_standby_fail(conn, "could not connect");
+        return;
+    }
+
+    /* Create the HTTP handshake context */
+    ret = sstp_http_create(&conn->http, ctx->server, (sstp_http_done_fn)
+            sstp_standby_http_done, conn, SSTP_MODE_CLIENT);
+    if (SSTP_OKAY != ret)
+    {
+        sstp_standby_fail(conn, "could not configure HTTP handshake");
+        return;
+    }
+
+    /* Set the uuid of the connection if provided */
+    if (ctx->opts->uuid)
+    {
+        sstp_http_setuuid(conn->http, ctx->opts->uuid);
+    }
+
+    /* Perform the HTTP handshake with server */
+    ret = sstp_http_handshake(conn->http, conn->stream);
+    if (SSTP_FAIL == ret)
+    {
+        sstp_standby_fail(conn, "could not perform HTTP handshake");
+    }
+}
+
+
+/*!
+ * @brief Called when it's time to refresh, or retry the connection
+ */
+static void sstp_standby_timer(int fd, short event, sstp_standby_st *ctx)
+{
+    sstp_standby_start(ctx);
+}
+
+
+status_t sstp_standby_start(sstp_standby_st *ctx)
+{
+    sstp_standby_conn_st *conn = NULL;
+    status_t status = SSTP_FAIL;
+    int ret = 0;
+
+    /* Already in progress */
+    if (ctx->warm)
+    {
+        return SSTP_OKAY;
+    }
+
+    conn = calloc(1, sizeof(sstp_standby_conn_st));
+    if (!conn)
+    {
+        goto done;
+    }
+    conn->owner = ctx;
+
+    ret = sstp_buff_create(&conn->buf, sstp_tune()->state_buf);
+    if (SSTP_OKAY != ret)
+    {
+        goto done;
+    }
+
+    /* Create the I/O streams */
+    ret = sstp_stream_create(&conn->stream, ctx->ev_base, ctx->ssl_ctx);
+    if (SSTP_OKAY != ret)
+    {
+        log_err("Could not setup SSL streams");
+        goto done;
+    }
+
+    /* Abbreviate the handshake if we can */
+    sstp_stream_setsession(conn->stream, ctx->session);
+
+    /* Have the stream connect */
+    ret = sstp_stream_connect(conn->stream, (struct sockaddr*) &ctx->addr,
+            ctx->alen, (sstp_complete_fn) sstp_standby_connected, conn, 
+            sstp_tune()->connect_timeout);
+    if (SSTP_INPROG != ret &&
+        SSTP_OKAY   != ret)
+    {
+        log_warn("Could not connect standby to %s", ctx->server);
+        goto done;
+    }
+
+    log_debug("Warming up standby connection to %s", ctx->server);
+
+    /* Success! */
+    ctx->warm = conn;
+    status = SSTP_OKAY;
+
+done:
+
+    if (SSTP_OKAY != status)
+    {
+        if (conn)
+        {
+            sstp_standby_conn_free(conn);
+        }
+
+        sstp_standby_schedule(ctx, SSTP_STANDBY_RETRY);
+    }
+
+    return status;
+}
+
+
+int sstp_standby_ready(sstp_standby_st *ctx)
+{
+    return (ctx->ready != NULL);
+}
+
+
+sstp_stream_st *sstp_standby_promote(sstp_standby_st *ctx)
+{
+    sstp_standby_conn_st *conn = ctx->ready;
+    sstp_stream_st *stream = NULL;
+
+    if (!conn)
+    {
+        return NULL;
+    }
+
+    /* Take ownership of the stream */
+    stream = conn->stream;
+    conn->stream = NULL;
+    ctx->ready   = NULL;
+    sstp_standby_conn_free(conn);
+
+    log_info("Promoted standby connection to %s", ctx->server);
+
+    /* Start over with a new standby connection shortly */
+    sstp_standby_schedule(ctx, SSTP_STANDBY_RETRY);
+
+    return stream;
+}
+
+
+const char *sstp_standby_server(sstp_standby_st *ctx)
+{
+    return ctx->server;
+}
+
+
+void sstp_standby_free(sstp_standby_st *ctx)
+{
+    if (!ctx)
+    {
+        return;
+    }
+
+    if (ctx->ready)
+    {
+        sstp_standby_conn_free(ctx->ready);
+        ctx->ready = NULL;
+    }
+
+    if (ctx->warm)
+    {
+        sstp_standby_conn_free(ctx->warm);
+        ctx->warm = NULL;
+    }
+
+    if (ctx->session)
+    {
+        SSL_SESSION_free(ctx->session);
+        ctx->session = NULL;
+    }
+
+    if (ctx->ev_timer)
+    {
+        event_del(ctx->ev_timer);
+        event_free(ctx->ev_timer);
+        ctx->ev_timer = NULL;
+    }
+
+    free(ctx);
+}
+
+
+status_t sstp_standby_create(sstp_standby_st **ctx, event_base_st *base,
+        SSL_CTX *ssl, sstp_option_st *opts, const char *server,
+        struct sockaddr *addr, int alen)
+{
+    status_t status = SSTP_FAIL;
+
+    *ctx = calloc(1, sizeof(sstp_standby_st));
+    if (!*ctx)
+    {
+        goto done;
+    }
+
+    if (alen > sizeof((*ctx)->addr))
+    {
+        log_err("Invalid address length of standby server");
+        goto done;
+    }
+
+    (*ctx)->ev_base = base;
+    (*ctx)->ssl_ctx = ssl;
+    (*ctx)->opts    = opts;
+    (*ctx)->alen    = alen;
+    (*ctx)->refresh = (opts->standby_refresh > 0)
+            ? opts->standby_refresh
+            : SSTP_STANDBY_REFRESH;
+    memcpy(&(*ctx)->addr, addr, alen);
+    strncpy((*ctx)->server, server, sizeof((*ctx)->server) - 1);
+
+    (*ctx)->ev_timer = event_new(base, -1, 0, (event_fn)
+            sstp_standby_timer, *ctx);
+    if (!(*ctx)->ev_timer)
+    {
+        goto done;
+    }
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    if (SSTP_OKAY != status)
+    {
+        sstp_standby_free(*ctx);
+        *ctx = NULL;
+    }
+
+    return status;
+}
@@ -0,0 +1,97 @@
+/*!
+ * @brief Keep a pre-established connection ready for fail-over
+ *
+ * @file sstp-standby.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_STANDBY_H__
+#define __SSTP_STANDBY_H__
+
+
+/*< The default interval to refresh the standby connection (seconds) */
+#define SSTP_STANDBY_REFRESH        45
+
+/*< The delay before retrying a failed standby connection (seconds) */
+#define SSTP_STANDBY_RETRY          5
+
+
+struct sstp_standby;
+typedef struct sstp_standby sstp_standby_st;
+
+
+/*!
+ * @brief Create the standby context
+ *
+ * @param ctx       [OUT] The resulting standby context
+ * @param base      [IN] The event base
+ * @param ssl       [IN] The SSL context
+ * @param opts      [IN] The options (certificate checks, uuid, refresh)
+ * @param server    [IN] The server name (for HTTP and certificate checks)
+ * @param addr      [IN] The resolved address of the server
+ * @param alen      [IN] The length of @a addr
+ *
+ * @par Note:
+ *  The server is not resolved again, the standby connection is kept to
+ *  the address given here. The server SSTP negotiation timer requires a
+ *  Call Connect within 60 seconds after the HTTP handshake; the standby
+ *  connection is replaced before that happens, resuming the previous
+ *  SSL session to keep the refresh to a minimum.
+ */
+status_t sstp_standby_create(sstp_standby_st **ctx, event_base_st *base,
+        SSL_CTX *ssl, sstp_option_st *opts, const char *server,
+        struct sockaddr *addr, int alen);
+
+
+/*!
+ * @brief Start warming up the standby connection
+ */
+status_t sstp_standby_start(sstp_standby_st *ctx);
+
+
+/*!
+ * @brief Check if a connection is ready to be promoted
+ */
+int sstp_standby_ready(sstp_standby_st *ctx);
+
+
+/*!
+ * @brief Hand over the ready connection to the caller
+ *
+ * @return The stream ready for Call Connect, or NULL if none is ready. The
+ *  caller becomes the owner of the stream. A new standby connection is
+ *  started in the background.
+ */
+sstp_stream_st *sstp_standby_promote(sstp_standby_st *ctx);
+
+
+/*!
+ * @brief Get the server name of the standby connection
+ */
+const char *sstp_standby_server(sstp_standby_st *ctx);
+
+
+/*!
+ * @brief Release any resources associated with the standby context
+ */
+void sstp_standby_free(sstp_standby_st *ctx);
+
+
+#endif /* #ifndef __SSTP_STANDBY_H__ */
@@ -23,6 +23,10 @@
  */
 
 #include <config.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
 #include "sstp-private.h"
 
 /*!
@@ -64,6 +68,39 @@ struct sstp_state
     /*! The echo request counter */
     int echo;
 
+    /*! The time the Echo-Requests awaiting their reply were sent */
+    timeval_st echo_time[SSTP_ECHO_WINDOW];
+
+    /*! The current idle time before probing (seconds) */
+    int idle;
+
+    /*! The minimum idle time before probing (seconds) */
+    int idle_min;
+
+    /*! The maximum idle time before probing (seconds) */
+    int idle_max;
+
+    /*! The Echo-Reply timeout (seconds) */
+    int rto;
+
+    /*! The smoothed round-trip time (usec) */
+    int srtt;
+
+    /*! The round-trip time variation (usec) */
+    int rttvar;
+
+    /*! The last round-trip time samples (usec) */
+    int rtt[SSTP_RTT_SAMPLES];
+
+    /*! The number of samples taken */
+    int rtt_count;
+
+    /*! The number of Echo-Requests sent */
+    unsigned int echo_seq;
+
+    /*! The number of Echo-Replies received, answered in order */
+    unsigned int echo_ack;
+
     /*! The binding request value */
     uint8_t nounce[32];
 
@@ -183,12 +220,16 @@ static status_t sstp_state_echo_request(sstp_state_st *ctx)
     /* Dump the packet */
     sstp_pkt_trace(ctx->tx_buf, SSTP_DIR_SEND);
 
+    /* The server replies in order, the reply is to the oldest request */
+    gettimeofday(&ctx->echo_time[ctx->echo_seq % SSTP_ECHO_WINDOW], NULL);
+
     /* Send the Echo Response back to server */
     status = sstp_stream_send(ctx->stream, ctx->tx_buf, (sstp_complete_fn)
-            sstp_state_send_complete, ctx, 10);
+            sstp_state_send_complete, ctx, sstp_tune()->send_timeout);
 
     /* Increment the retry counter */
     ctx->echo++;
+    ctx->echo_seq++;
     
 done:
 
@@ -196,6 +237,89 @@ done:
 }
 
 
+/*!
+ * @brief Update the round-trip time estimate on an Echo-Reply
+ */
+static void sstp_state_echo_sample(sstp_state_st *ctx)
+{
+    timeval_st now;
+    unsigned int seq = 0;
+    int sample = 0;
+    int delta  = 0;
+
+    /* Not a reply to any of our requests */
+    if (ctx->echo_ack == ctx->echo_seq)
+    {
+        return;
+    }
+    seq = ctx->echo_ack++;
+
+    /* The time it was sent was taken by later requests */
+    if (ctx->echo_seq - seq > SSTP_ECHO_WINDOW)
+    {
+        return;
+    }
+
+    gettimeofday(&now, NULL);
+    timersub(&now, &ctx->echo_time[seq % SSTP_ECHO_WINDOW], &now);
+    sample = now.tv_sec * 1000000 + now.tv_usec;
+
+    /* Keep the series */
+    ctx->rtt[ctx->rtt_count++ % SSTP_RTT_SAMPLES] = sample;
+
+    /* Smoothed RTT and variation as of RFC 6298 */
+    if (ctx->rtt_count == 1)
+    {
+        ctx->srtt   = sample;
+        ctx->rttvar = sample / 2;
+    }
+    else
+    {
+        delta = ctx->srtt - sample;
+        ctx->rttvar = (3 * ctx->rttvar + abs(delta)) / 4;
+        ctx->srtt   = (7 * ctx->srtt + sample) / 8;
+    }
+
+    /* The timeout in whole seconds, at least one */
+    ctx->rto = (ctx->srtt + 4 * ctx->rttvar) / 1000000 + 1;
+    if (ctx->rto > ctx->idle_min)
+    {
+        ctx->rto = ctx->idle_min;
+    }
+
+    /* The tunnel is idle and the server alive, probe less often */
+    ctx->idle <<= 1;
+    if (ctx->idle > ctx->idle_max)
+    {
+        ctx->idle = ctx->idle_max;
+    }
+
+    log_debug("Echo-Reply after %d.%03d ms, next probe in %d seconds", 
+            sample / 1000, sample % 1000, ctx->idle);
+}
+
+
+/*!
+ * @brief Get the receive timeout, the idle time or the Echo-Reply timeout
+ */
+static int sstp_state_timeout(sstp_state_st *ctx)
+{
+    int timeout = ctx->idle;
+
+    /* Back off on each unanswered Echo-Request */
+    if (ctx->echo > 0)
+    {
+        timeout = ctx->rto << (ctx->echo - 1);
+        if (timeout > ctx->idle_max)
+        {
+            timeout = ctx->idle_max;
+        }
+    }
+
+    return timeout;
+}
+
+
 /*!
  * @brief Send a Echo Reply message in response to an Echo Request
  */
@@ -217,7 +341,7 @@ static status_t sstp_state_echo_reply(sstp_state_st *ctx)
 
     /* Send the Echo Response back to server */
     status = sstp_stream_send(ctx->stream, ctx->tx_buf, (sstp_complete_fn)
-            sstp_state_send_complete, ctx, 10);
+            sstp_state_send_complete, ctx, sstp_tune()->send_timeout);
     
 done:
 
@@ -246,7 +370,7 @@ static status_t sstp_state_disconnect(sstp_state_st *ctx)
 
     /* Send the Echo Response back to server */
     status = sstp_stream_send(ctx->stream, ctx->tx_buf, (sstp_complete_fn)
-            sstp_state_send_complete, ctx, 10);
+            sstp_state_send_complete, ctx, sstp_tune()->send_timeout);
     
 done:
 
@@ -275,7 +399,7 @@ static status_t sstp_state_disconnect_ack(sstp_state_st *ctx)
 
     /* Send the Echo Response back to server */
     status = sstp_stream_send(ctx->stream, ctx->tx_buf, (sstp_complete_fn)
-            sstp_state_send_complete, ctx, 10);
+            sstp_state_send_complete, ctx, sstp_tune()->send_timeout);
     
 done:
 
@@ -395,7 +519,7 @@ static void sstp_state_handle_ctrl(sstp_state_st *state, sstp_buff_st *buf,
         break;
 
     case SSTP_ECHO_REPLY:
-        state->echo = 0;
+        sstp_state_echo_sample(state);
         break;
 
     default:
@@ -413,6 +537,15 @@ static status_t sstp_state_handle_data(sstp_state_st *state,
 {
     status_t ret = SSTP_FAIL;
 
+    /* Data is flowing, no need to probe */
+    state->idle = state->idle_min;
+
+    /* Nothing to take the frames, e.g. while only pinging the server */
+    if (!state->forward_cb)
+    {
+        return SSTP_OKAY;
+    }
+
     /* Forward the data back to the pppd layer */
     ret = state->forward_cb(state->fwctx, sstp_pkt_data(buf), 
             sstp_pkt_data_len(buf));
@@ -464,8 +597,9 @@ static void sstp_state_recv(sstp_stream_st *stream, sstp_buff_st *buf,
     case SSTP_TIMEOUT:
         
         /* If we have seen no traffic, then disconnect */
-        if (ctx->echo > 4)
+        if (ctx->echo >= sstp_tune()->echo_retry)
         {
+            log_err("No reply to %d Echo-Requests", ctx->echo);
             ctx->state_cb(ctx->uarg, SSTP_CALL_ABORT);
             return;
         }
@@ -476,6 +610,9 @@ static void sstp_state_recv(sstp_stream_st *stream, sstp_buff_st *buf,
 
     case SSTP_OKAY:
         sstp_state_handle_packet(ctx, buf);
+
+        /* Any message shows the server is alive */
+        ctx->echo = 0;
         break;
 
     case SSTP_FAIL:
@@ -486,7 +623,7 @@ static void sstp_state_recv(sstp_stream_st *stream, sstp_buff_st *buf,
 
     /* Setup a receiver for SSTP messages */
     sstp_stream_setrecv(ctx->stream, sstp_stream_recv_sstp, ctx->rx_buf,
-            (sstp_complete_fn) sstp_state_recv, ctx, 60);
+            (sstp_complete_fn) sstp_state_recv, ctx, sstp_state_timeout(ctx));
 }
 
 
@@ -519,14 +656,16 @@ static status_t sstp_state_send_request(sstp_state_st *ctx)
     /* Dump the packet */
     sstp_pkt_trace(ctx->tx_buf, SSTP_DIR_SEND);
 
+    /* Setup a receiver for SSTP messages, even if the send is queued */
+    sstp_stream_setrecv(ctx->stream, sstp_stream_recv_sstp, ctx->rx_buf,
+            (sstp_complete_fn) sstp_state_recv, ctx, sstp_state_timeout(ctx));
+
     /* Send the Call Connect request to the server */
     status = sstp_stream_send(ctx->stream, ctx->tx_buf, (sstp_complete_fn)
-            sstp_state_send_complete, ctx, 10);
-    if (SSTP_OKAY == status)
+            sstp_state_send_complete, ctx, sstp_tune()->send_timeout);
+    if (SSTP_INPROG == status)
     {
-        /* Setup a receiver for SSTP messages */
-        sstp_stream_setrecv(ctx->stream, sstp_stream_recv_sstp, ctx->rx_buf,
-                (sstp_complete_fn) sstp_state_recv, ctx, 60);
+        status = SSTP_OKAY;
     }
  
 done:
@@ -608,7 +747,7 @@ static status_t sstp_state_send_connect(sstp_state_st *ctx)
 
     /* Success */
     status = sstp_stream_send(ctx->stream, ctx->tx_buf, (sstp_complete_fn)
-            sstp_state_send_complete, ctx, 10);
+            sstp_state_send_complete, ctx, sstp_tune()->send_timeout);
     if (SSTP_OKAY == status)
     {
         ctx->state_cb(ctx->uarg, SSTP_CALL_ESTABLISHED);
@@ -698,6 +837,70 @@ done:
 }
 
 
+void sstp_state_keepalive(sstp_state_st *ctx, int min, int max)
+{
+    ctx->idle_min = (min > 0) ? min : SSTP_KEEPALIVE_MIN;
+    ctx->idle_max = (max > 0) ? max : SSTP_KEEPALIVE_MAX;
+
+    if (ctx->idle_max < ctx->idle_min)
+    {
+        ctx->idle_max = ctx->idle_min;
+    }
+
+    if (ctx->rto > ctx->idle_min)
+    {
+        ctx->rto = ctx->idle_min;
+    }
+
+    ctx->idle = ctx->idle_min;
+}
+
+
+status_t sstp_state_echo(sstp_state_st *ctx)
+{
+    return sstp_state_echo_request(ctx);
+}
+
+
+/*!
+ * @brief Compare two RTT samples, for use with qsort()
+ */
+static int sstp_state_rtt_cmp(const void *a, const void *b)
+{
+    return (*(const int*) a - *(const int*) b);
+}
+
+
+void sstp_state_rtt(sstp_state_st *ctx, sstp_rtt_st *rtt)
+{
+    int series[SSTP_RTT_SAMPLES];
+    int count = MIN(ctx->rtt_count, SSTP_RTT_SAMPLES);
+
+    memset(rtt, 0, sizeof(*rtt));
+    rtt->count  = count;
+    rtt->srtt   = ctx->srtt;
+    rtt->rttvar = ctx->rttvar;
+    rtt->sent   = ctx->echo_seq;
+    rtt->recv   = ctx->echo_ack;
+    rtt->lost   = ctx->echo_seq - ctx->echo_ack;
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    /* Sort the series to get the percentiles */
+    memcpy(series, ctx->rtt, count * sizeof(int));
+    qsort(series, count, sizeof(int), sstp_state_rtt_cmp);
+
+    rtt->min = series[0];
+    rtt->p50 = series[(count - 1) * 50 / 100];
+    rtt->p90 = series[(count - 1) * 90 / 100];
+    rtt->p99 = series[(count - 1) * 99 / 100];
+    rtt->max = series[count - 1];
+}
+
+
 const char *sstp_state_reason(sstp_state_st *ctx)
 {
     return (ctx->state != 0)
@@ -750,16 +953,18 @@ status_t sstp_state_create(sstp_state_st **state, sstp_stream_st *stream,
     (*state)->state_cb = state_cb;
     (*state)->mode     = mode;
     (*state)->stream   = stream;
+    (*state)->rto      = SSTP_ECHO_TIMEOUT;
+    sstp_state_keepalive(*state, 0, 0);
 
     /* Allocate send buffer */
-    ret = sstp_buff_create(&(*state)->tx_buf, 16384);
+    ret = sstp_buff_create(&(*state)->tx_buf, sstp_tune()->state_buf);
     if (SSTP_OKAY != ret)
     {   
         goto done;
     }
 
     /* Allocate receive buffer */
-    ret = sstp_buff_create(&(*state)->rx_buf, 16384);
+    ret = sstp_buff_create(&(*state)->rx_buf, sstp_tune()->state_buf);
     if (SSTP_OKAY != ret)
     {   
         goto done;
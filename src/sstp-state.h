@@ -33,6 +33,24 @@
 #define SSTP_ST_DISCONNECT_ACK         0x0080
 #define SSTP_ST_ESTABLISHED            0x1000
 
+/*< The default idle time before probing the server (seconds) */
+#define SSTP_KEEPALIVE_MIN             20
+
+/*< The idle time is doubled up to this while the tunnel is idle */
+#define SSTP_KEEPALIVE_MAX             120
+
+/*< The default number of unanswered Echo-Requests before we give up */
+#define SSTP_ECHO_RETRY                3
+
+/*< The Echo-Reply timeout before any RTT is measured (seconds) */
+#define SSTP_ECHO_TIMEOUT              3
+
+/*< The number of RTT samples kept */
+#define SSTP_RTT_SAMPLES               64
+
+/*< The number of Echo-Requests timed while awaiting their reply */
+#define SSTP_ECHO_WINDOW               64
+
 typedef enum
 {
     SSTP_CALL_ABORT         = 1,
@@ -47,6 +65,36 @@ struct sstp_state;
 typedef struct sstp_state sstp_state_st;
 
 
+/*!
+ * @brief The round-trip time of the Echo-Request / Echo-Reply messages,
+ *  all times are in microseconds.
+ */
+typedef struct sstp_rtt
+{
+    /*< The number of samples in the series */
+    int count;
+
+    /*< The smoothed round-trip time */
+    int srtt;
+
+    /*< The round-trip time variation */
+    int rttvar;
+
+    /*< The minimum, median, 90th, 99th percentile and maximum */
+    int min, p50, p90, p99, max;
+
+    /*< The number of Echo-Requests sent */
+    int sent;
+
+    /*< The number of Echo-Replies received */
+    int recv;
+
+    /*< The number of Echo-Requests unanswered */
+    int lost;
+
+} sstp_rtt_st;
+
+
 /*!
  * @brief Signal to the upper layer any state transitions
  * @param state Can be any of the following states:
@@ -107,6 +155,32 @@ status_t sstp_state_accept(sstp_state_st *ctx);
 void sstp_state_chap_challenge(sstp_state_st *ctx, sstp_chap_st *chap);
 
 
+/*!
+ * @brief Set the bounds of the keep-alive interval
+ *
+ * @par Note:
+ *  The server is probed with an Echo-Request once nothing was received 
+ *  for @a min seconds. The interval is doubled up to @a max seconds for 
+ *  each probe answered while no data flows, and set back to @a min when 
+ *  data is received. Unanswered probes are retried after the timeout 
+ *  derived from the measured round-trip time, the call is aborted after 
+ *  the echo-retry tunable of probes. A value of 0 selects the default.
+ */
+void sstp_state_keepalive(sstp_state_st *ctx, int min, int max);
+
+
+/*!
+ * @brief Send an Echo-Request right away, measuring the round-trip time
+ */
+status_t sstp_state_echo(sstp_state_st *ctx);
+
+
+/*!
+ * @brief Get the round-trip time statistics
+ */
+void sstp_state_rtt(sstp_state_st *ctx, sstp_rtt_st *rtt);
+
+
 /*!
  * @brief Return reason for why call was aborted
  */
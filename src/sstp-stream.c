@@ -43,13 +43,25 @@
 #include <fcntl.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <openssl/ssl.h>
 
 #include "sstp-private.h"
 
 
+/*< The size of each of the rings of the BIO pair, a few of the largest
+ *  TLS records */
+#define SSTP_STREAM_RING        65536
+
+/*< Send the records held once this many bytes are waiting */
+#define SSTP_STREAM_BATCH       16384
+
+
 /*!
  * @brief A asynchronous send or recv channel object
  */
@@ -78,11 +90,8 @@ typedef struct sstp_operation
  */
 struct sstp_stream
 {
-    /*< The send socket */
-    int ssock;
-
-    /*< The recv socket */
-    int rsock;
+    /*< The socket */
+    int sock;
 
     /*< Last activity seen on socket */
     time_t last;
@@ -90,14 +99,35 @@ struct sstp_stream
     /*< The SSL connection context */
     SSL *ssl;
 
+    /*< Our end of the BIO pair of the SSL connection, see sstp_stream_setup() */
+    BIO *net;
+
+    /*< The start of the ring the records are sent from */
+    char *ring;
+
+    /*< Sends the records held in the BIO pair once back in the event loop */
+    event_st *ev_flush;
+
     /*< The SSL context structure */
     SSL_CTX *ssl_ctx;
 
+    /*< A previous session to resume, if any */
+    SSL_SESSION *session;
+
     /*< The length check function */
     sstp_recv_fn recv_cb;
 
     /*< The send function */
-    event_fn send_cb;
+    sstp_probe_st send_cb;
+
+    /*< The timing probe of the send event */
+    sstp_probe_st send_probe;
+
+    /*< The timing probe of the receive event */
+    sstp_probe_st recv_probe;
+
+    /*< The timing probe of the flush event */
+    sstp_probe_st flush_probe;
 
     /*< The event base */
     event_base_st *ev_base;
@@ -116,9 +146,325 @@ struct sstp_stream
 
     /*< The list of free operations */
     sstp_operation_st *cache;
+
+    /*< The scheduler, if any */
+    sstp_sched_st *sched;
+
+    /*< The bytes are exchanged in the clear, see sstp_stream_attach() */
+    int plain;
 };
 
 
+/*!
+ * @brief Send what the socket takes of the records held in the BIO pair
+ *
+ * @return 0 if all went, 1 if some are left for ev_flush, or -1 on error
+ */
+static int sstp_stream_flush(sstp_stream_st *ctx)
+{
+    struct iovec iov[2];
+    struct msghdr msg;
+    uint64_t start = 0;
+    char *data = NULL;
+    int pending = 0;
+    int len = 0;
+    int ret = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+
+    /* The records wrap around the ring at most once, send both runs */
+    while ((len = BIO_nread0(ctx->net, &data)) > 0)
+    {
+        iov[0].iov_base = data;
+        iov[0].iov_len  = len;
+        msg.msg_iovlen  = 1;
+
+        pending = BIO_ctrl_pending(ctx->net);
+        if (pending > len && data + len == ctx->ring + SSTP_STREAM_RING)
+        {
+            iov[1].iov_base = ctx->ring;
+            iov[1].iov_len  = pending - len;
+            msg.msg_iovlen  = 2;
+        }
+
+        start = sstp_cycle_start();
+        ret = sendmsg(ctx->sock, &msg, MSG_NOSIGNAL);
+        sstp_cycle_stop(SSTP_CYCLE_SOCK_SEND, start, ret);
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                if (!event_pending(ctx->ev_flush, EV_WRITE, NULL))
+                {
+                    event_add(ctx->ev_flush, NULL);
+                }
+                return 1;
+            }
+
+            log_err("Unrecoverable socket error, %d", errno);
+            return -1;
+        }
+
+        /* Release what was sent, the run up to the wrap first */
+        BIO_nread(ctx->net, &data, MIN(ret, len));
+        if (ret > len)
+        {
+            BIO_nread(ctx->net, &data, ret - len);
+        }
+    }
+
+    return 0;
+}
+
+
+/*!
+ * @brief The socket takes more of the records held in the BIO pair
+ */
+static void sstp_stream_flush_cont(int sock, short event, 
+        sstp_stream_st *ctx)
+{
+    /* Fail the receive, the peer won't see the rest of the stream */
+    if (0 > sstp_stream_flush(ctx))
+    {
+        shutdown(ctx->sock, SHUT_RDWR);
+    }
+}
+
+
+/*!
+ * @brief Receive what the BIO pair and the socket allow, each recv as
+ *  large as the room left up to where the ring wraps
+ *
+ * @return The number of bytes received, 0 if none were ready, or -1 on 
+ *  error or end of stream
+ */
+static int sstp_stream_fill(sstp_stream_st *ctx)
+{
+    uint64_t start = 0;
+    char *data = NULL;
+    int total = 0;
+    int len = 0;
+    int ret = 0;
+
+    while ((len = BIO_nwrite0(ctx->net, &data)) > 0)
+    {
+        start = sstp_cycle_start();
+        ret = recv(ctx->sock, data, len, 0);
+        sstp_cycle_stop(SSTP_CYCLE_SOCK_RECV, start, ret);
+        if (ret < 0)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+            {
+                break;
+            }
+
+            log_err("Unrecoverable socket error, %d", errno);
+            return -1;
+        }
+
+        if (ret == 0)
+        {
+            return (total > 0)
+                ? total
+                : -1;
+        }
+
+        BIO_nwrite(ctx->net, &data, ret);
+        total += ret;
+
+        /* The socket has no more for now */
+        if (ret < len)
+        {
+            break;
+        }
+    }
+
+    return total;
+}
+
+
+/*!
+ * @brief Check if there are bytes received, but not yet read
+ */
+static int sstp_stream_pending(sstp_stream_st *ctx)
+{
+    return (ctx->ssl && (SSL_pending(ctx->ssl) > 0 ||
+            BIO_ctrl_pending(SSL_get_rbio(ctx->ssl)) > 0));
+}
+
+
+/*!
+ * @brief Read the bytes decrypted by the SSL layer, or in the clear
+ *
+ * @param err   [OUT] The SSL_ERROR_* code of the read
+ */
+static int sstp_stream_read(sstp_stream_st *ctx, char *data, int len,
+        int *err)
+{
+    uint64_t start = 0;
+    int filled = 0;
+    int ret = 0;
+
+    if (ctx->plain)
+    {
+        start = sstp_cycle_start();
+        ret  = read(ctx->sock, data, len);
+        sstp_cycle_stop(SSTP_CYCLE_SOCK_RECV, start, ret);
+        *err = (ret > 0)
+            ? SSL_ERROR_NONE
+            : (ret < 0 && errno == EAGAIN)
+                ? SSL_ERROR_WANT_READ
+                : SSL_ERROR_SYSCALL;
+    }
+    else
+    {
+        /* Receive more when the SSL layer runs out */
+        do
+        {
+            start = sstp_cycle_start();
+            ret  = SSL_read(ctx->ssl, data, len);
+            *err = SSL_get_error(ctx->ssl, ret);
+            sstp_cycle_stop(SSTP_CYCLE_SSL_READ, start, ret);
+        }
+        while (*err == SSL_ERROR_WANT_READ && 
+               (filled = sstp_stream_fill(ctx)) > 0);
+
+        /* The peer closed the stream, or the socket failed */
+        if (filled < 0)
+        {
+            *err = SSL_ERROR_SYSCALL;
+        }
+
+        /* Send what the read may have queued, e.g. an alert */
+        if (0 > sstp_stream_flush(ctx))
+        {
+            *err = SSL_ERROR_SYSCALL;
+        }
+    }
+
+    if (ret > 0)
+    {
+        sstp_record(SSTP_RECORD_SSTP, SSTP_RECORD_IN, data, ret);
+    }
+
+    return ret;
+}
+
+
+/*!
+ * @brief Write the bytes to the SSL layer, or in the clear
+ *
+ * @par Note:
+ *  The records are held in the BIO pair until SSTP_STREAM_BATCH bytes 
+ *  are waiting, or we are back in the event loop. The records of all the
+ *  writes made in the meantime go with a single send.
+ *
+ * @param err   [OUT] The SSL_ERROR_* code of the write
+ */
+static int sstp_stream_write(sstp_stream_st *ctx, const char *data, int len,
+        int *err)
+{
+    uint64_t start = 0;
+    int filled = 0;
+    int ret = 0;
+
+    if (ctx->plain)
+    {
+        start = sstp_cycle_start();
+        ret  = write(ctx->sock, data, len);
+        sstp_cycle_stop(SSTP_CYCLE_SOCK_SEND, start, ret);
+        *err = (ret > 0)
+            ? SSL_ERROR_NONE
+            : (ret < 0 && errno == EAGAIN)
+                ? SSL_ERROR_WANT_WRITE
+                : SSL_ERROR_SYSCALL;
+    }
+    else
+    {
+        while (1)
+        {
+            start = sstp_cycle_start();
+            ret  = SSL_write(ctx->ssl, data, len);
+            *err = SSL_get_error(ctx->ssl, ret);
+            sstp_cycle_stop(SSTP_CYCLE_SSL_WRITE, start, ret);
+
+            /* The ring is full, try again once the socket took some */
+            if (*err == SSL_ERROR_WANT_WRITE)
+            {
+                ret = sstp_stream_flush(ctx);
+                if (ret == 0)
+                {
+                    continue;
+                }
+
+                *err = (ret < 0)
+                    ? SSL_ERROR_SYSCALL
+                    : SSL_ERROR_WANT_WRITE;
+                ret  = -1;
+                break;
+            }
+
+            /* The handshake, send ours and try again with the reply */
+            if (*err == SSL_ERROR_WANT_READ)
+            {
+                if (0 > sstp_stream_flush(ctx))
+                {
+                    *err = SSL_ERROR_SYSCALL;
+                    break;
+                }
+
+                ret = sstp_stream_fill(ctx);
+                if (ret > 0)
+                {
+                    filled = 1;
+                    continue;
+                }
+
+                if (ret < 0)
+                {
+                    *err = SSL_ERROR_SYSCALL;
+                }
+                ret = -1;
+                break;
+            }
+
+            break;
+        }
+
+        /* Send the batch when large enough, or back in the event loop */
+        if (*err == SSL_ERROR_NONE)
+        {
+            if (BIO_ctrl_pending(ctx->net) >= SSTP_STREAM_BATCH)
+            {
+                if (0 > sstp_stream_flush(ctx))
+                {
+                    *err = SSL_ERROR_SYSCALL;
+                }
+            }
+            else if (!event_pending(ctx->ev_flush, EV_WRITE, NULL))
+            {
+                event_add(ctx->ev_flush, NULL);
+            }
+        }
+
+        /* The receiver waits on the socket for what we took off it */
+        if (filled && sstp_stream_pending(ctx) && 
+            event_pending(ctx->ev_recv, EV_READ, NULL))
+        {
+            event_active(ctx->ev_recv, EV_READ, 1);
+        }
+    }
+
+    if (ret > 0)
+    {
+        sstp_record(SSTP_RECORD_SSTP, SSTP_RECORD_OUT, data, ret);
+    }
+
+    return ret;
+}
+
+
 static int sstp_operation_add_read(sstp_stream_st *ctx, sstp_buff_st *buf,
     int event, int timeout, sstp_complete_fn complete, void *arg);
 
@@ -181,6 +527,7 @@ static void sstp_operation_append(sstp_operation_st **head,
  */
 static void sstp_send_cont(int sock, short event, sstp_stream_st *ctx)
 {
+    sstp_operation_st **last;
     sstp_operation_st *op;
     int ret = 0;
 
@@ -193,7 +540,22 @@ static void sstp_send_cont(int sock, short event, sstp_stream_st *ctx)
         ret = sstp_stream_send(ctx, op->buf, op->complete, op->arg, 
                 op->tout.tv_sec);
         if (ret == SSTP_INPROG) 
+        {
+            /* SSL must be given this buffer again before any queued behind
+             * it, take back the retry appended to the queue */
+            for (last = &ctx->send; *last && (*last)->next; 
+                 last = &(*last)->next);
+            if (*last && (*last)->buf == op->buf)
+            {
+                (*last)->next = ctx->cache;
+                ctx->cache = *last;
+                *last = NULL;
+            }
+
+            op->next  = ctx->send;
+            ctx->send = op;
             return;
+        }
 
         /* Notify the caller of the status */
         op->complete(ctx, op->buf, op->arg, ret);
@@ -202,6 +564,46 @@ static void sstp_send_cont(int sock, short event, sstp_stream_st *ctx)
     }
 }
 
+/*!
+ * @brief Receive the packets already taken off the socket
+ *
+ * @par Note:
+ *  The socket is not readable again for the data kept by the SSL layer,
+ *  or held in the BIO pair; continue receiving until @a budget packets
+ *  are received and yield to the event loop with any left. Without a 
+ *  scheduler, continue until all are received.
+ */
+static void sstp_recv_drain(sstp_stream_st *ctx, int budget)
+{
+    sstp_operation_st *op = &ctx->recv;
+    int ret = 0;
+
+    while (sstp_stream_pending(ctx))
+    {
+        if (ctx->sched && budget-- <= 0)
+        {
+            sstp_sched_defer(ctx->sched, SSTP_SCHED_DOWNLINK, 
+                    (sstp_sched_fn) sstp_recv_drain, ctx);
+            return;
+        }
+
+        ret = (ctx->recv_cb)(ctx, op->buf, op->complete, op->arg, 
+                op->tout.tv_sec);
+        if (ret == SSTP_INPROG)
+        {
+            return;
+        }
+
+        /* Notify the caller of the status */
+        op->complete(ctx, op->buf, op->arg, ret);
+        if (ret != SSTP_OKAY)
+        {
+            return;
+        }
+    }
+}
+
+
 /*! 
  * @brief Resume the send operation by retrying last operation
  */
@@ -229,6 +631,12 @@ static void sstp_recv_cont(int sock, short event, sstp_stream_st *ctx)
     /* Re-add the event */
     sstp_operation_add_read(ctx, op->buf, EV_READ,  
             op->tout.tv_sec, op->complete, op->arg);
+
+    /* Continue with the packets left in the SSL layer */
+    if (SSTP_OKAY == ret && ctx->recv_cb == sstp_stream_recv_sstp)
+    {
+        sstp_recv_drain(ctx, sstp_sched_budget(ctx->sched) - 1);
+    }
 }
 
 
@@ -260,8 +668,8 @@ static int sstp_operation_add_read(sstp_stream_st *ctx,
         event_del(ctx->ev_recv);
     }
 
-    event_set(ctx->ev_recv, ctx->rsock, event,
-        (event_fn) sstp_recv_cont, ctx);
+    event_set(ctx->ev_recv, ctx->sock, event, (event_fn) sstp_probe_call, 
+        SSTP_PROBE(&ctx->recv_probe, sstp_recv_cont, ctx));
     
     /* Set the event base */
     event_base_set(ctx->ev_base, ctx->ev_recv);
@@ -318,9 +726,10 @@ static int sstp_operation_add_write(sstp_stream_st *ctx,
     if (timeout > 0)
         event |= EV_TIMEOUT;
 
-    /* Configure the event */
-    event_set(ctx->ev_send, ctx->ssock, event, 
-            (event_fn) ctx->send_cb, ctx);
+    /* Configure the event, the send function may change while pending */
+    ctx->send_probe = ctx->send_cb;
+    event_set(ctx->ev_send, ctx->sock, event, 
+            (event_fn) sstp_probe_call, &ctx->send_probe);
 
     /* Set the event base */
     event_base_set(ctx->ev_base, ctx->ev_send);
@@ -350,6 +759,12 @@ status_t sstp_get_cert_hash(sstp_stream_st *ctx, int proto,
     /* Reset the hash output */
     memset(hash, 0, hlen);
 
+    /* Nothing to bind the call to, in the clear */
+    if (ctx->plain)
+    {
+        return SSTP_OKAY;
+    }
+
     /* Get the peer certificate */
     peer = SSL_get_peer_certificate(ctx->ssl);
     if (!peer)
@@ -430,6 +845,90 @@ done:
     return status;
 }
 
+void *sstp_stream_getsession(sstp_stream_st *stream)
+{
+    return (stream->ssl)
+        ? SSL_get1_session(stream->ssl)
+        : NULL;
+}
+
+
+void sstp_stream_setsession(sstp_stream_st *stream, void *session)
+{
+    stream->session = (SSL_SESSION*) session;
+}
+
+
+int sstp_stream_resumed(sstp_stream_st *stream)
+{
+    return (stream->ssl)
+        ? SSL_session_reused(stream->ssl)
+        : 0;
+}
+
+
+int sstp_stream_mss(sstp_stream_st *stream)
+{
+    socklen_t len = sizeof(int);
+    int mss = 0;
+
+    if (getsockopt(stream->sock, IPPROTO_TCP, TCP_MAXSEG, &mss, &len))
+    {
+        return -1;
+    }
+
+    return mss;
+}
+
+
+int sstp_stream_overhead(sstp_stream_st *stream)
+{
+    const char *name = NULL;
+    int mac = 20;
+
+    if (!stream->ssl || !SSL_get_current_cipher(stream->ssl))
+    {
+        return -1;
+    }
+
+    name = SSL_CIPHER_get_name(SSL_get_current_cipher(stream->ssl));
+
+    /* TLS 1.3, the tag and the inner content type */
+    if (!strncmp(name, "TLS_", 4))
+    {
+        return SSTP_TLS_HEADER + 16 + 1;
+    }
+
+    /* The nonce is implicit with ChaCha20-Poly1305 */
+    if (strstr(name, "CHACHA20"))
+    {
+        return SSTP_TLS_HEADER + 16;
+    }
+
+    /* The explicit nonce and the tag of AES-GCM or AES-CCM */
+    if (strstr(name, "GCM") || strstr(name, "CCM"))
+    {
+        return SSTP_TLS_HEADER + 8 + 16;
+    }
+
+    /* CBC, the explicit IV, the MAC and up to a block of padding */
+    if (strstr(name, "SHA384"))
+    {
+        mac = 48;
+    }
+    else if (strstr(name, "SHA256"))
+    {
+        mac = 32;
+    }
+    else if (strstr(name, "MD5"))
+    {
+        mac = 16;
+    }
+
+    return SSTP_TLS_HEADER + 16 + mac + 16;
+}
+
+
 status_t sstp_last_activity(sstp_stream_st *stream, int seconds)
 {
     if (difftime(time(NULL), stream->last) > seconds)
@@ -461,7 +960,7 @@ status_t sstp_stream_recv_plain(sstp_stream_st *ctx, sstp_buff_st *buf,
     ctx->recv_cb = sstp_stream_recv_plain;
     
     /* Receive data */
-    ret = recv(ctx->rsock, buf->data + buf->off, 
+    ret = recv(ctx->sock, buf->data + buf->off, 
             buf->max - buf->off, 0);
     if (ret <= 0)
     {
@@ -484,6 +983,7 @@ status_t sstp_stream_recv(sstp_stream_st *ctx, sstp_buff_st *buf,
 {
     status_t status = SSTP_FAIL;
     short event = 0;
+    int err = 0;
     int ret = 0;
 
     /* Setup the timeout */
@@ -497,8 +997,9 @@ status_t sstp_stream_recv(sstp_stream_st *ctx, sstp_buff_st *buf,
     ctx->last = time(NULL);
 
     /* Try to read from the SSL socket until it blocks */
-    ret = SSL_read(ctx->ssl, buf->data + buf->off, buf->max - buf->off);
-    switch (SSL_get_error(ctx->ssl, ret))
+    ret = sstp_stream_read(ctx, buf->data + buf->off, buf->max - buf->off,
+            &err);
+    switch (err)
     {
     case SSL_ERROR_NONE:
         buf->off += ret;
@@ -533,6 +1034,7 @@ status_t sstp_stream_recv_sstp(sstp_stream_st *ctx, sstp_buff_st *buf,
         sstp_complete_fn complete, void *arg, int timeout)
 {
     status_t status = SSTP_FAIL;
+    int err = 0;
     int ret = 0;
 
     /* Activity Timer */
@@ -546,9 +1048,9 @@ status_t sstp_stream_recv_sstp(sstp_stream_st *ctx, sstp_buff_st *buf,
             : 4 ;
 
         /* Try to read from the SSL socket */
-        ret = SSL_read(ctx->ssl, buf->data + buf->off, 
-                buf->len - buf->off);
-        switch (SSL_get_error(ctx->ssl, ret))
+        ret = sstp_stream_read(ctx, buf->data + buf->off, 
+                buf->len - buf->off, &err);
+        switch (err)
         {
         case SSL_ERROR_NONE:
             buf->off += ret;
@@ -633,7 +1135,7 @@ status_t sstp_stream_send_plain(sstp_stream_st *stream, sstp_buff_st *buf,
     int ret = 0;
 
     /* Non-blocking send */
-    ret = send(stream->ssock, buf->data + buf->off,
+    ret = send(stream->sock, buf->data + buf->off,
             buf->len - buf->off, 0);
     if (ret <= 0)
     {
@@ -645,7 +1147,7 @@ status_t sstp_stream_send_plain(sstp_stream_st *stream, sstp_buff_st *buf,
     buf->off += ret;
     if (buf->off < buf->len)
     {
-        stream->send_cb = (event_fn) sstp_send_cont_plain;
+        SSTP_PROBE(&stream->send_cb, sstp_send_cont_plain, stream);
         sstp_operation_add_write(stream, buf, EV_WRITE, timeout,
                 complete, stream);
 
@@ -663,7 +1165,7 @@ status_t sstp_stream_send(sstp_stream_st *stream, sstp_buff_st *buf,
     int ret = 0;
 
     stream->last = time(NULL);
-    stream->send_cb = (event_fn) sstp_send_cont;
+    SSTP_PROBE(&stream->send_cb, sstp_send_cont, stream);
 
     /* 
      * If we try SSL_write before previous operation is complete, we
@@ -684,9 +1186,9 @@ status_t sstp_stream_send(sstp_stream_st *stream, sstp_buff_st *buf,
     {
         /* Try SSL write to the socket */
         int err = 0;
-        ret = SSL_write(stream->ssl, buf->data + buf->off, 
-                buf->len - buf->off);
-        switch ((err = SSL_get_error(stream->ssl, ret)))
+        ret = sstp_stream_write(stream, buf->data + buf->off, 
+                buf->len - buf->off, &err);
+        switch (err)
         {
         case SSL_ERROR_NONE:
             buf->off += ret;
@@ -715,6 +1217,8 @@ status_t sstp_stream_send(sstp_stream_st *stream, sstp_buff_st *buf,
 
 static status_t sstp_stream_setup(sstp_stream_st *stream)
 {
+    BIO *bio = NULL;
+
     /* Associate the streams */
     stream->ssl = SSL_new(stream->ssl_ctx);
     if (stream->ssl == NULL)
@@ -723,12 +1227,32 @@ static status_t sstp_stream_setup(sstp_stream_st *stream)
         goto done;
     }
 
-    /* Associate a socket with the connection */
-    if (SSL_set_fd(stream->ssl, stream->ssock) < 0)
-    {   
-        log_err("Could not set SSL socket");
+    /* The SSL layer works on the buffers of a BIO pair, we move the 
+     * records between our end of it and the socket */
+    if (!BIO_new_bio_pair(&bio, SSTP_STREAM_RING, &stream->net, 
+            SSTP_STREAM_RING))
+    {
+        log_err("Could not create the BIO pair");
         goto done;
-    }   
+    }
+    /* The records are written from the start of the empty ring */
+    BIO_nwrite0(bio, &stream->ring);
+    SSL_set_bio(stream->ssl, bio, bio);
+
+    stream->ev_flush = event_new(stream->ev_base, stream->sock, EV_WRITE,
+            (event_fn) sstp_probe_call, SSTP_PROBE(&stream->flush_probe, 
+                sstp_stream_flush_cont, stream));
+    if (!stream->ev_flush)
+    {
+        log_err("Could not create the flush event");
+        goto done;
+    }
+
+    /* Try to resume a previous session (abbreviated handshake) */
+    if (stream->session)
+    {
+        SSL_set_session(stream->ssl, stream->session);
+    }
 
     /* Set Client Mode (connect) */
     SSL_set_connect_state(stream->ssl);
@@ -744,6 +1268,12 @@ done:
         stream->ssl = NULL;
     }   
 
+    if (stream->net != NULL)
+    {
+        BIO_free(stream->net);
+        stream->net = NULL;
+    }
+
     return SSTP_FAIL;
 }
 
@@ -789,25 +1319,15 @@ status_t sstp_stream_connect(sstp_stream_st *stream, struct sockaddr *addr,
     int ret = (-1);
 
     /* Create the socket */
-    stream->ssock = socket(PF_INET, SOCK_STREAM, 0);
-    if (0 > stream->ssock)
+    stream->sock = socket(PF_INET, SOCK_STREAM, 0);
+    if (0 > stream->sock)
     {          
         log_err("Could not create socket");
         goto done;
     }
 
-    stream->rsock = dup(stream->ssock);
-
-    /* Set socket non-blocking mode */
-    ret = sstp_set_nonbl(stream->ssock, 1);
-    if (SSTP_OKAY != ret)
-    {
-        log_err("Unable to set non-blocking operation");
-        goto done;
-    }   
-    
     /* Set socket non-blocking mode */
-    ret = sstp_set_nonbl(stream->rsock, 1);
+    ret = sstp_set_nonbl(stream->sock, 1);
     if (SSTP_OKAY != ret)
     {
         log_err("Unable to set non-blocking operation");
@@ -815,14 +1335,14 @@ status_t sstp_stream_connect(sstp_stream_st *stream, struct sockaddr *addr,
     }   
     
     /* Set send buffer size */
-    ret = sstp_set_sndbuf(stream->ssock, 32768);
+    ret = sstp_set_sndbuf(stream->sock, sstp_tune()->send_buf);
     if (SSTP_OKAY != ret)      
     {                                              
         log_warn("Unable to set send buffer size", errno);
     }
 
     /* Connect to the server (non-blocking) */
-    ret = connect(stream->ssock, addr, alen);
+    ret = connect(stream->sock, addr, alen);
     if (ret == -1)
     {
         /* If we are not blocking b/c of connection in progress */
@@ -833,7 +1353,7 @@ status_t sstp_stream_connect(sstp_stream_st *stream, struct sockaddr *addr,
         }
 
         /* Add a send operation */
-        stream->send_cb = (event_fn) sstp_connect_complete;
+        SSTP_PROBE(&stream->send_cb, sstp_connect_complete, stream);
         ret = sstp_operation_add_write(stream, NULL, EV_WRITE, 
                 timeout, complete, arg);
         if (ret != SSTP_OKAY) {
@@ -850,47 +1370,114 @@ status_t sstp_stream_connect(sstp_stream_st *stream, struct sockaddr *addr,
 done:
 
     /* Cleanup */
-    if (stream->ssock >= 0)
+    if (stream->sock >= 0)
     {
-        close(stream->ssock);
+        close(stream->sock);
+        stream->sock = -1;
     }
     
     return SSTP_FAIL;
 }
 
+
+status_t sstp_stream_attach(sstp_stream_st *stream, int sock)
+{
+    stream->sock  = sock;
+    stream->plain = 1;
+
+    if (SSTP_OKAY != sstp_set_nonbl(stream->sock, 1))
+    {
+        log_err("Could not attach the stream to socket %d", sock);
+        return SSTP_FAIL;
+    }
+
+    return SSTP_OKAY;
+}
+
+
+int sstp_stream_sock(sstp_stream_st *stream)
+{
+    return (stream->sock);
+}
+
+
+int sstp_stream_queued(sstp_stream_st *stream)
+{
+    return (stream->net && BIO_ctrl_pending(stream->net) > 0) ||
+        sstp_stream_pending(stream);
+}
+
+
+void sstp_stream_setsched(sstp_stream_st *stream, sstp_sched_st *sched)
+{
+    stream->sched = sched;
+}
+
+
+void sstp_stream_abort(sstp_stream_st *stream)
+{
+    /* Don't let a dead peer hold up the SSL shutdown */
+    if (stream->sock > 0)
+    {
+        shutdown(stream->sock, SHUT_RDWR);
+    }
+}
+
+
 status_t sstp_stream_destroy(sstp_stream_st *stream)
 {
     sstp_operation_st *ptr = NULL;
     status_t retval = SSTP_FAIL;
     int ret = -1;
+
+    /* Drop any pending continuation */
+    if (stream->sched)
+    {
+        sstp_sched_cancel(stream->sched, stream);
+        stream->sched = NULL;
+    }
     
     /* Get the current socket */
-    if (stream->ssock <= 0)
+    if (stream->sock <= 0)
     {
         log_debug("No socket associated");
         goto done;
     }
 
     /* Set blocking mode */
-    ret = sstp_set_nonbl(stream->ssock, 0);
+    ret = sstp_set_nonbl(stream->sock, 0);
     if (SSTP_OKAY != ret)
     {
         log_warn("Unable to set blocking mode socket");
         goto done;
     }
 
-    /* Shutdown the server */
-    SSL_shutdown(stream->ssl);
+    /* Shutdown the server, unless we never got that far */
+    if (stream->ssl)
+    {
+        SSL_shutdown(stream->ssl);
 
-    /* Free resources */
-    SSL_free(stream->ssl);
-    stream->ssl = NULL;
+        /* Send the records held, the socket now blocks */
+        sstp_stream_flush(stream);
 
-    if (stream->ssock)
-        close(stream->ssock);
+        /* Free resources */
+        SSL_free(stream->ssl);
+        stream->ssl = NULL;
+    }
+
+    if (stream->net)
+    {
+        BIO_free(stream->net);
+        stream->net = NULL;
+    }
 
-    if (stream->rsock)
-        close(stream->rsock);
+    /* Remove the flush event */
+    if (stream->ev_flush)
+    {
+        event_del(stream->ev_flush);
+        event_free(stream->ev_flush);
+        stream->ev_flush = NULL;
+    }
 
     /* Remove the send event */
     if (stream->ev_send) 
@@ -908,6 +1495,10 @@ status_t sstp_stream_destroy(sstp_stream_st *stream)
         stream->ev_recv = NULL;
     }
 
+    /* Close the socket once none of the events watch it */
+    if (stream->sock)
+        close(stream->sock);
+
     /* Free the list of send events */
     ptr = stream->send;
     while (ptr) {
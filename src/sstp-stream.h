@@ -33,6 +33,9 @@
 #define SSTP_VERIFY_CERT        0x02    // Verify the Certificate with CA
 #define SSTP_VERIFY_CRL         0x04    // Verify against CRL service
 
+/*< The size of the TLS record header */
+#define SSTP_TLS_HEADER         5
+
 
 /*
  * NOTE:
@@ -57,6 +60,39 @@ status_t sstp_get_cert_hash(sstp_stream_st *ctx, int proto,
 status_t sstp_verify_cert(sstp_stream_st *ctx, const char *host, int opts);
 
 
+/*!
+ * @brief Get a reference to the SSL session, release with SSL_SESSION_free()
+ */
+void *sstp_stream_getsession(sstp_stream_st *stream);
+
+
+/*!
+ * @brief Resume @a session on the next connect, the caller keeps ownership
+ */
+void sstp_stream_setsession(sstp_stream_st *stream, void *session);
+
+
+/*!
+ * @brief Check if the previous SSL session was resumed
+ */
+int sstp_stream_resumed(sstp_stream_st *stream);
+
+
+/*!
+ * @brief Get the maximum segment size of the TCP connection
+ */
+int sstp_stream_mss(sstp_stream_st *stream);
+
+
+/*!
+ * @brief Get the bytes a TLS record adds to its payload with the cipher
+ *  negotiated, at most
+ *
+ * @retval The overhead, or -1 if the handshake is not complete
+ */
+int sstp_stream_overhead(sstp_stream_st *stream);
+
+
 /*!
  * @brief Check if the activity on the socket is longer than @a seconds
  */
@@ -144,6 +180,16 @@ status_t sstp_stream_connect(sstp_stream_st *client, struct sockaddr *addr,
         int addrlen, sstp_complete_fn complete, void *ctx, int timout);
 
 
+/*!
+ * @brief Exchange the bytes in the clear over @a sock instead of TLS
+ *
+ * @par Note:
+ *  Used to replay a recording with a socket pair standing in for the
+ *  connection; there is no certificate to verify or bind to the call.
+ */
+status_t sstp_stream_attach(sstp_stream_st *stream, int sock);
+
+
 /*!
  * @brief Create the client
  */
@@ -151,6 +197,33 @@ status_t sstp_stream_create(sstp_stream_st **client, event_base_st *base,
         SSL_CTX *ssl);
 
 
+/*!
+ * @brief Get the socket of the stream
+ */
+int sstp_stream_sock(sstp_stream_st *stream);
+
+
+/*!
+ * @brief Check if records are held by the stream, either batched to be 
+ *  sent on the socket or received but not yet read
+ */
+int sstp_stream_queued(sstp_stream_st *stream);
+
+
+/*!
+ * @brief Receive at most the budget of @a sched in packets at a time,
+ *  sharing the event loop with the other work of @a sched
+ */
+void sstp_stream_setsched(sstp_stream_st *stream, sstp_sched_st *sched);
+
+
+/*!
+ * @brief Abort the connection without waiting for the peer, call before
+ *  sstp_stream_destroy() when the connection is assumed dead.
+ */
+void sstp_stream_abort(sstp_stream_st *stream);
+
+
 /*!
  * @brief Destroy a SSL Client
  */
@@ -227,6 +227,12 @@ const char *sstp_task_ttydev(sstp_task_st* task)
 }
 
 
+int sstp_task_pid(sstp_task_st *task)
+{
+    return (task->pid);
+}
+
+
 int sstp_task_stdout(sstp_task_st *task)
 {
     return (task->out);
@@ -68,6 +68,12 @@ status_t sstp_task_new(sstp_task_st **task, sstp_task_t type);
 status_t sstp_task_start(sstp_task_st *task, const char *argv[]);
 
 
+/*!
+ * @brief Get the process id of the task
+ */
+int sstp_task_pid(sstp_task_st *task);
+
+
 /*!
  * @brief Get standard output
  */
@@ -0,0 +1,425 @@
+/*!
+ * @brief Tune the buffer sizes, timeouts and budgets at run-time
+ *
+ * @file sstp-tune.c
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <config.h>
+#include <ctype.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sstp-private.h"
+
+
+/*!
+ * @brief The name, default and bounds of a tunable
+ */
+typedef struct
+{
+    /*< The name used in the file */
+    const char *name;
+
+    /*< The offset into sstp_tune_st */
+    size_t offset;
+
+    /*< The default value */
+    int dflt;
+
+    /*< The smallest value accepted */
+    int min;
+
+    /*< The largest value accepted, or the size of a string setting */
+    int max;
+
+    /*< Is this a string setting */
+    int string;
+
+    /*< When a change takes effect */
+    sstp_tune_apply_t apply;
+
+} sstp_tune_def_st;
+
+
+#define SSTP_TUNE_INT(name, field, dflt, min, max, apply)   \
+    { name, offsetof(sstp_tune_st, field), dflt, min, max, 0, apply }
+
+#define SSTP_TUNE_STR(name, field, apply)                   \
+    { name, offsetof(sstp_tune_st, field), 0, 0,            \
+      sizeof(((sstp_tune_st*) 0)->field), 1, apply }
+
+
+static const sstp_tune_def_st sstp_tune_defs[] =
+{
+    SSTP_TUNE_INT("state-buffer",    state_buf,       16384, 4096, 1 << 20, SSTP_TUNE_RECONNECT),
+    SSTP_TUNE_INT("pppd-buffer",     pppd_buf,        16384, 4096, 1 << 20, SSTP_TUNE_RESTART),
+    SSTP_TUNE_INT("http-buffer",     http_buf,        8192,  1024, 1 << 20, SSTP_TUNE_RECONNECT),
+    SSTP_TUNE_INT("send-buffer",     send_buf,        32768, 4096, 1 << 24, SSTP_TUNE_LIVE),
+    SSTP_TUNE_INT("send-timeout",    send_timeout,    10,    1,    300,     SSTP_TUNE_LIVE),
+    SSTP_TUNE_INT("connect-timeout", connect_timeout, 10,    1,    300,     SSTP_TUNE_LIVE),
+    SSTP_TUNE_INT("recv-timeout",    recv_timeout,    60,    1,    600,     SSTP_TUNE_LIVE),
+    SSTP_TUNE_INT("echo-retry",      echo_retry,      SSTP_ECHO_RETRY,   1, 20,    SSTP_TUNE_LIVE),
+    SSTP_TUNE_INT("sched-budget",    sched_budget,    SSTP_SCHED_BUDGET, 1, 1024,  SSTP_TUNE_LIVE),
+    SSTP_TUNE_INT("log-level",       log_level,       -1,    -1,   SSTP_LOG_DUMP, SSTP_TUNE_LIVE),
+    SSTP_TUNE_STR("log-filter",      log_filter,                            SSTP_TUNE_LIVE),
+    SSTP_TUNE_INT("keepalive",       keepalive,       0,     0,    3600,    SSTP_TUNE_LIVE),
+    SSTP_TUNE_INT("keepalive-max",   keepalive_max,   0,     0,    86400,   SSTP_TUNE_LIVE),
+    SSTP_TUNE_INT("stall-budget",    stall_budget,    0,     0,    60000,   SSTP_TUNE_LIVE),
+};
+
+
+#define SSTP_TUNE_COUNT     (sizeof(sstp_tune_defs) / sizeof(sstp_tune_defs[0]))
+
+
+/*< The tunables in effect */
+static sstp_tune_st sstp_tune_cur;
+
+/*< Are the defaults set */
+static int sstp_tune_init;
+
+
+/*!
+ * @brief Access a tunable of @a tune
+ */
+static void *sstp_tune_field(const sstp_tune_st *tune, 
+        const sstp_tune_def_st *def)
+{
+    return (char*) tune + def->offset;
+}
+
+
+/*!
+ * @brief Format the value of a tunable
+ */
+static const char *sstp_tune_value(const sstp_tune_st *tune, 
+        const sstp_tune_def_st *def, char *buf, int len)
+{
+    if (def->string)
+    {
+        return (const char*) sstp_tune_field(tune, def);
+    }
+
+    snprintf(buf, len, "%d", *(int*) sstp_tune_field(tune, def));
+    return buf;
+}
+
+
+/*!
+ * @brief Set the defaults of all the tunables
+ */
+static void sstp_tune_reset(sstp_tune_st *tune)
+{
+    int i = 0;
+
+    memset(tune, 0, sizeof(sstp_tune_st));
+
+    for (i = 0; i < SSTP_TUNE_COUNT; i++)
+    {
+        if (!sstp_tune_defs[i].string)
+        {
+            *(int*) sstp_tune_field(tune, &sstp_tune_defs[i]) = 
+                    sstp_tune_defs[i].dflt;
+        }
+    }
+}
+
+
+/*!
+ * @brief Set a tunable of @a tune after validating its value
+ */
+static status_t sstp_tune_assign(sstp_tune_st *tune, const char *name, 
+        const char *value)
+{
+    const sstp_tune_def_st *def = NULL;
+    char *end = NULL;
+    long val  = 0;
+    int i = 0;
+
+    for (i = 0; i < SSTP_TUNE_COUNT; i++)
+    {
+        if (!strcmp(sstp_tune_defs[i].name, name))
+        {
+            def = &sstp_tune_defs[i];
+            break;
+        }
+    }
+
+    if (!def)
+    {
+        return SSTP_FAIL;
+    }
+
+    if (def->string)
+    {
+        if (strlen(value) >= def->max)
+        {
+            return SSTP_FAIL;
+        }
+
+        strcpy(sstp_tune_field(tune, def), value);
+        return SSTP_OKAY;
+    }
+
+    val = strtol(value, &end, 10);
+    if (end == value || *end != '\0' || 
+        val < def->min || val > def->max)
+    {
+        return SSTP_FAIL;
+    }
+
+    *(int*) sstp_tune_field(tune, def) = val;
+    return SSTP_OKAY;
+}
+
+
+const sstp_tune_st *sstp_tune(void)
+{
+    if (!sstp_tune_init)
+    {
+        sstp_tune_reset(&sstp_tune_cur);
+        sstp_tune_init = 1;
+    }
+
+    return &sstp_tune_cur;
+}
+
+
+status_t sstp_tune_set(const char *name, const char *value)
+{
+    sstp_tune();
+    return sstp_tune_assign(&sstp_tune_cur, name, value);
+}
+
+
+status_t sstp_tune_load(const char *file, int *line)
+{
+    status_t status = SSTP_FAIL;
+    sstp_tune_st tune;
+    FILE *fp  = NULL;
+    char buf[256];
+    char *name  = NULL;
+    char *value = NULL;
+    char *ptr   = NULL;
+
+    *line = 0;
+    sstp_tune_reset(&tune);
+
+    fp = fopen(file, "r");
+    if (!fp)
+    {
+        goto done;
+    }
+
+    while (fgets(buf, sizeof(buf), fp))
+    {
+        (*line)++;
+
+        /* Strip the comments */
+        ptr = strchr(buf, '#');
+        if (ptr)
+        {
+            *ptr = '\0';
+        }
+
+        /* Split "<name> = <value>", or "<name> <value>" */
+        name = strtok(buf, " \t\r\n=");
+        if (!name)
+        {
+            continue;
+        }
+
+        value = strtok(NULL, " \t\r\n=");
+        if (!value || strtok(NULL, " \t\r\n"))
+        {
+            goto done;
+        }
+
+        if (SSTP_OKAY != sstp_tune_assign(&tune, name, value))
+        {
+            goto done;
+        }
+    }
+
+    /* All or nothing */
+    memcpy(&sstp_tune_cur, &tune, sizeof(tune));
+    sstp_tune_init = 1;
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    if (fp)
+    {
+        fclose(fp);
+    }
+
+    return status;
+}
+
+
+void sstp_tune_diff(const sstp_tune_st *prev, sstp_tune_fn changed, 
+        void *arg)
+{
+    const sstp_tune_st *tune = sstp_tune();
+    const sstp_tune_def_st *def = NULL;
+    char buf[32];
+    int i = 0;
+
+    for (i = 0; i < SSTP_TUNE_COUNT; i++)
+    {
+        def = &sstp_tune_defs[i];
+
+        if (def->string 
+                ? strcmp(sstp_tune_field(prev, def), sstp_tune_field(tune, def))
+                : memcmp(sstp_tune_field(prev, def), sstp_tune_field(tune, def),
+                        sizeof(int)))
+        {
+            changed(arg, def->name, sstp_tune_value(tune, def, buf, 
+                    sizeof(buf)), def->apply);
+        }
+    }
+}
+
+
+const char *sstp_tune_print(char *buf, int len)
+{
+    const sstp_tune_st *tune = sstp_tune();
+    char value[32];
+    int pos = 0;
+    int i = 0;
+
+    buf[0] = '\0';
+
+    for (i = 0; i < SSTP_TUNE_COUNT && pos < len; i++)
+    {
+        pos += snprintf(buf + pos, len - pos, "%s%s=%s", (i) ? " " : "",
+                sstp_tune_defs[i].name, sstp_tune_value(tune, 
+                &sstp_tune_defs[i], value, sizeof(value)));
+    }
+
+    return buf;
+}
+
+
+#ifdef __SSTP_UNIT_TEST_TUNE
+
+#include <unistd.h>
+
+/*!
+ * @brief Record the changes reported
+ */
+static void sstp_test_changed(char *trace, const char *name, 
+        const char *value, sstp_tune_apply_t apply)
+{
+    sprintf(trace + strlen(trace), "%s=%s/%d ", name, value, apply);
+}
+
+
+int main(void)
+{
+    sstp_tune_st prev;
+    char trace[128] = {};
+    char file[] = "/tmp/sstp-tune.XXXXXX";
+    char buf[512];
+    FILE *fp = NULL;
+    int line = 0;
+    int fd = 0;
+
+    /* The defaults are in effect */
+    if (sstp_tune()->state_buf != 16384 || 
+        sstp_tune()->echo_retry != SSTP_ECHO_RETRY)
+    {
+        printf("Unexpected default values\n");
+        return EXIT_FAILURE;
+    }
+
+    fd = mkstemp(file);
+    if (fd < 0)
+    {
+        printf("Could not create %s\n", file);
+        return EXIT_FAILURE;
+    }
+
+    fp = fdopen(fd, "w");
+    fprintf(fp, "# Deployment over a long fat pipe\n");
+    fprintf(fp, "send-buffer = 262144\n");
+    fprintf(fp, "\n");
+    fprintf(fp, "recv-timeout 30   # seconds\n");
+    fclose(fp);
+
+    if (SSTP_OKAY != sstp_tune_load(file, &line))
+    {
+        printf("Could not load %s, line %d\n", file, line);
+        return EXIT_FAILURE;
+    }
+
+    if (sstp_tune()->send_buf != 262144 || 
+        sstp_tune()->recv_timeout != 30 ||
+        sstp_tune()->http_buf != 8192)
+    {
+        printf("Unexpected values: %s\n", sstp_tune_print(buf, sizeof(buf)));
+        return EXIT_FAILURE;
+    }
+
+    /* A value out of bounds rejects the whole file */
+    fp = fopen(file, "w");
+    fprintf(fp, "send-buffer = 65536\n");
+    fprintf(fp, "echo-retry = 0\n");
+    fclose(fp);
+
+    if (SSTP_OKAY == sstp_tune_load(file, &line) || line != 2 ||
+        sstp_tune()->send_buf != 262144)
+    {
+        printf("Accepted an invalid value, line %d\n", line);
+        return EXIT_FAILURE;
+    }
+
+    unlink(file);
+
+    /* Unknown names and trailing garbage are refused */
+    if (SSTP_OKAY == sstp_tune_set("send-bufer", "65536") ||
+        SSTP_OKAY == sstp_tune_set("send-buffer", "64k")  ||
+        SSTP_OKAY != sstp_tune_set("send-buffer", "65536"))
+    {
+        printf("Unexpected result of setting a tunable\n");
+        return EXIT_FAILURE;
+    }
+
+    /* Changes are reported with when they take effect */
+    memcpy(&prev, sstp_tune(), sizeof(prev));
+    sstp_tune_set("pppd-buffer", "8192");
+    sstp_tune_set("log-filter", "sstp-state.c");
+    sstp_tune_diff(&prev, (sstp_tune_fn) sstp_test_changed, trace);
+
+    if (strcmp(trace, "pppd-buffer=8192/2 log-filter=sstp-state.c/0 "))
+    {
+        printf("Unexpected changes: %s\n", trace);
+        return EXIT_FAILURE;
+    }
+
+    printf("Successfully tuned: %s\n", sstp_tune_print(buf, sizeof(buf)));
+    return EXIT_SUCCESS;
+}
+
+#endif /* #ifdef __SSTP_UNIT_TEST_TUNE */
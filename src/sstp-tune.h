@@ -0,0 +1,150 @@
+/*!
+ * @brief Tune the buffer sizes, timeouts and budgets at run-time
+ *
+ * @file sstp-tune.h
+ *
+ * @author Copyright (C) 2011 Eivind Naess,
+ *      All Rights Reserved
+ *
+ * @par License:
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef __SSTP_TUNE_H__
+#define __SSTP_TUNE_H__
+
+
+/*< The size of the log filter setting */
+#define SSTP_TUNE_FILTER        64
+
+
+/*!
+ * @brief When a change of a tunable takes effect
+ */
+typedef enum
+{
+    SSTP_TUNE_LIVE      = 0,
+    SSTP_TUNE_RECONNECT = 1,
+    SSTP_TUNE_RESTART   = 2,
+
+} sstp_tune_apply_t;
+
+
+/*!
+ * @brief The tunables in effect
+ */
+typedef struct
+{
+    /*< The size of the SSTP state machine buffers (bytes) */
+    int state_buf;
+
+    /*< The size of the buffers to and from pppd (bytes) */
+    int pppd_buf;
+
+    /*< The size of the HTTP handshake buffer (bytes) */
+    int http_buf;
+
+    /*< The send buffer of the socket to the server (bytes) */
+    int send_buf;
+
+    /*< The time to complete a send operation (seconds) */
+    int send_timeout;
+
+    /*< The time to connect to the server (seconds) */
+    int connect_timeout;
+
+    /*< The time to receive the HTTP response (seconds) */
+    int recv_timeout;
+
+    /*< The number of unanswered Echo-Requests before we give up */
+    int echo_retry;
+
+    /*< The number of packets a job may process before it must yield */
+    int sched_budget;
+
+    /*< The log level, or -1 for the level given on the command line */
+    int log_level;
+
+    /*< The trace log filter, or empty for the command line filter */
+    char log_filter[SSTP_TUNE_FILTER];
+
+    /*< The keep-alive interval, or 0 for the command line setting */
+    int keepalive;
+
+    /*< The maximum keep-alive interval, or 0 for the command line setting */
+    int keepalive_max;
+
+    /*< The stall budget (msec), or 0 for the command line setting */
+    int stall_budget;
+
+} sstp_tune_st;
+
+
+/*!
+ * @brief Get the tunables in effect
+ */
+const sstp_tune_st *sstp_tune(void);
+
+
+/*!
+ * @brief Set a tunable by name, e.g. "send-buffer", within its bounds
+ *
+ * @retval SSTP_OKAY, or SSTP_FAIL if the name or value is invalid
+ */
+status_t sstp_tune_set(const char *name, const char *value);
+
+
+/*!
+ * @brief Load the tunables from a file, one "<name> = <value>" per line;
+ *  '#' starts a comment
+ *
+ * @param line      [OUT] The line of the first invalid tunable
+ *
+ * @par Note:
+ *  Either all the tunables of the file take effect, or none do. Those
+ *  not in the file are set to their default.
+ *
+ * @retval SSTP_OKAY, or SSTP_FAIL if the file could not be read or an
+ *  invalid tunable was found
+ */
+status_t sstp_tune_load(const char *file, int *line);
+
+
+/*!
+ * @brief Called for a tunable that changed
+ *
+ * @param arg       The argument given to sstp_tune_diff()
+ * @param name      The name of the tunable
+ * @param value     The new value of the tunable
+ * @param apply     When the change takes effect
+ */
+typedef void (*sstp_tune_fn)(void *arg, const char *name, const char *value,
+        sstp_tune_apply_t apply);
+
+
+/*!
+ * @brief Report the tunables in effect that differ from @a prev
+ */
+void sstp_tune_diff(const sstp_tune_st *prev, sstp_tune_fn changed, 
+        void *arg);
+
+
+/*!
+ * @brief Format the tunables in effect as "<name>=<value> ..."
+ */
+const char *sstp_tune_print(char *buf, int len);
+
+
+#endif /* #ifndef __SSTP_TUNE_H__ */
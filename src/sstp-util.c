@@ -22,13 +22,18 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+/*< For the CPU affinity macros */
+#define _GNU_SOURCE
+
 #include <config.h>
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -36,6 +41,12 @@
 #include <grp.h>
 #include <unistd.h>
 
+#ifdef HAVE_NETLINK
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/capability.h>
+#endif
+
 #include "sstp-private.h"
 
 
@@ -97,6 +108,100 @@ status_t sstp_set_sndbuf(int sock, int size)
 }
 
 
+status_t sstp_set_busypoll(int sock, int usec)
+{
+#ifdef SO_BUSY_POLL
+    int ret = setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec));
+    if (ret != 0)
+    {
+        return SSTP_FAIL;
+    }
+
+    return SSTP_OKAY;
+#else
+    return SSTP_NOTIMPL;
+#endif
+}
+
+
+status_t sstp_set_affinity(int pid, const char *cpus)
+{
+    status_t status = SSTP_FAIL;
+    cpu_set_t set;
+    char *copy  = strdup(cpus);
+    char *save  = NULL;
+    char *range = NULL;
+    char *end   = NULL;
+    long first  = 0;
+    long last   = 0;
+
+    CPU_ZERO(&set);
+
+    /* Parse a list of cpus or ranges, e.g. 0,2-3 */
+    for (range = strtok_r(copy, ",", &save); range;
+         range = strtok_r(NULL, ",", &save))
+    {
+        first = last = strtol(range, &end, 10);
+        if (*end == '-')
+        {
+            last = strtol(end + 1, &end, 10);
+        }
+
+        if (end == range || *end != '\0' || first < 0 || 
+            last < first || last >= CPU_SETSIZE)
+        {
+            log_err("Invalid CPU list: %s", cpus);
+            goto done;
+        }
+
+        for (; first <= last; first++)
+        {
+            CPU_SET(first, &set);
+        }
+    }
+
+    if (sched_setaffinity(pid, sizeof(set), &set))
+    {
+        log_err("Could not set CPU affinity to %s, %s (%d)", cpus,
+                strerror(errno), errno);
+        goto done;
+    }
+
+    /* Success! */
+    status = SSTP_OKAY;
+
+done:
+
+    free(copy);
+    return status;
+}
+
+
+status_t sstp_set_realtime(int prio)
+{
+    struct sched_param param;
+
+    /* Avoid page faults on the data path */
+    if (mlockall(MCL_CURRENT | MCL_FUTURE))
+    {
+        log_warn("Could not lock memory, %s (%d)", strerror(errno), errno);
+    }
+
+    memset(&param, 0, sizeof(param));
+    param.sched_priority = prio;
+
+    /* Inherited by pppd as we fork it */
+    if (sched_setscheduler(0, SCHED_FIFO, &param))
+    {
+        log_err("Could not set real-time priority %d, %s (%d)", prio, 
+                strerror(errno), errno);
+        return SSTP_FAIL;
+    }
+
+    return SSTP_OKAY;
+}
+
+
 status_t sstp_url_parse(sstp_url_st **url, const char *path)
 {
     char *ptr = NULL;
@@ -342,7 +447,36 @@ int sstp_get_gid(const char *name)
 }
 
 
-int sstp_sandbox(const char *path, const char *user, const char *group)
+#ifdef HAVE_NETLINK
+/*!
+ * @brief Keep only CAP_NET_ADMIN, once the user id is changed
+ */
+static int sstp_sandbox_netadmin(void)
+{
+    struct __user_cap_header_struct head;
+    struct __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3];
+
+    memset(&head, 0, sizeof(head));
+    memset(&data, 0, sizeof(data));
+
+    head.version = _LINUX_CAPABILITY_VERSION_3;
+    data[CAP_TO_INDEX(CAP_NET_ADMIN)].permitted = CAP_TO_MASK(CAP_NET_ADMIN);
+    data[CAP_TO_INDEX(CAP_NET_ADMIN)].effective = CAP_TO_MASK(CAP_NET_ADMIN);
+
+    if (syscall(SYS_capset, &head, data) != 0)
+    {
+        log_warn("Could not keep the capability to manage routes, %s (%d)",
+            strerror(errno), errno);
+        return -1;
+    }
+
+    return 0;
+}
+#endif
+
+
+int sstp_sandbox(const char *path, const char *user, const char *group,
+        int netadmin)
 {
     int gid = -1;
     int uid = -1;
@@ -393,12 +527,29 @@ int sstp_sandbox(const char *path, const char *user, const char *group)
     /* Setting the user id */
     if (uid >= 0 && uid != getuid())
     {
+#ifdef HAVE_NETLINK
+        /* Hold on to the capabilities across setuid, to keep one below */
+        if (netadmin)
+        {
+            prctl(PR_SET_KEEPCAPS, 1, 0, 0, 0);
+        }
+#endif
+
         if (setuid(uid) != 0)
         {
             log_warn("Could not set process user id, %s (%d)", 
                 strerror(errno), errno);
             goto done;
         }
+
+#ifdef HAVE_NETLINK
+        /* The routes are still ours to install and remove */
+        if (netadmin)
+        {
+            prctl(PR_SET_KEEPCAPS, 0, 0, 0, 0);
+            sstp_sandbox_netadmin();
+        }
+#endif
     }
 
     retval = 0;
@@ -89,6 +89,28 @@ char *sstp_get_guid(char *buf, int len);
 status_t sstp_set_sndbuf(int sock, int size);
 
 
+/*!
+ * @brief Have the socket busy poll the device queue for @a usec 
+ *  microseconds on blocking receive (SO_BUSY_POLL)
+ */
+status_t sstp_set_busypoll(int sock, int usec);
+
+
+/*!
+ * @brief Pin a process to a list of CPUs, e.g. "0,2-3"
+ *
+ * @param pid       [IN] The process, or 0 for the calling process
+ * @param cpus      [IN] The comma separated list of CPUs or ranges
+ */
+status_t sstp_set_affinity(int pid, const char *cpus);
+
+
+/*!
+ * @brief Lock the memory and run with the SCHED_FIFO policy
+ */
+status_t sstp_set_realtime(int prio);
+
+
 /*!
  * @brief Split the URL up into components (non-rfc complient) 
  */
@@ -145,8 +167,13 @@ int sstp_create_dir(const char *path, const char *user, const char *group, mode_
 
 /*!
  * @brief Enter a sandbox given the new root @a newroot directory, user and group id.
+ *
+ * @par Note:
+ *  With @a netadmin, CAP_NET_ADMIN is kept across the change of user id,
+ *  and every other capability dropped, so the routes can still be managed.
  */
-int sstp_sandbox(const char *newroot, const char *user, const char *group);
+int sstp_sandbox(const char *newroot, const char *user, const char *group,
+        int netadmin);
 
 
 #endif
@@ -0,0 +1,106 @@
+#!/bin/sh
+#
+# Measure sstpc through the impairment relay, src/sstp-relay, under a set
+# of scenarios: the throughput of a load test session, and the time to
+# recover from stalls and resets.
+#
+# Usage: support/relay-bench.sh <server>[:port] [scenario ...]
+#
+# The server is a local SSTP server standing in for the real one, e.g. a
+# virtual machine on the host. The credentials are taken from SSTP_USER
+# and SSTP_PASS. Each scenario runs for SSTP_TIME seconds (default 30),
+# with the traffic of SSTP_TRAFFIC (default cbr:2000:1400). A session
+# that goes down reconnects after SSTP_RECONNECT seconds (default 1).
+#
+# The recovery is timed by the relay, from a reset until the server
+# answers on the next connection, and from the end of a stall until the
+# bytes are delivered on time again. The reconnect is timed by sstpc,
+# from the session going down until it is up again.
+#
+# Set SSTP_TUNNEL=1 to bring up the tunnel with pppd instead, as root, to
+# measure how sstpc itself recovers.
+#
+# Copyright (C) 2011 Eivind Naess, All Rights Reserved
+#
+
+SERVER=$1
+if [ -z "$SERVER" ] || [ -z "$SSTP_USER" ] || [ -z "$SSTP_PASS" ]; then
+    echo "Usage: SSTP_USER=<user> SSTP_PASS=<pass> $0 <server>[:port] [scenario ...]"
+    exit 1
+fi
+shift
+
+TOP=$(cd "$(dirname "$0")/.." && pwd)
+RELAY=${RELAY:-$TOP/src/sstp-relay}
+SSTPC=${SSTPC:-$TOP/src/sstpc}
+PORT=${SSTP_PORT:-8443}
+TIME=${SSTP_TIME:-30}
+TRAFFIC=${SSTP_TRAFFIC:-cbr:2000:1400}
+RECONNECT=${SSTP_RECONNECT:-1}
+LOGS=${SSTP_LOGS:-/tmp/relay-bench.$$}
+
+# name: the impairments of the relay
+scenario() {
+    case $1 in
+    baseline)   echo "" ;;
+    lan)        echo "--delay 1" ;;
+    broadband)  echo "--delay 15 --jitter 5 --rate 50000" ;;
+    mobile)     echo "--delay 60 --jitter 40 --rate 10000" ;;
+    satellite)  echo "--delay 300 --jitter 20 --rate 5000" ;;
+    lossy)      echo "--delay 40 --jitter 20 --stall-every 5 --stall-time 400" ;;
+    blackout)   echo "--delay 40 --stall-every 20 --stall-time 5000" ;;
+    reset)      echo "--delay 40 --reset-after 10" ;;
+    *)          return 1 ;;
+    esac
+}
+
+SCENARIOS=${*:-baseline lan broadband mobile satellite lossy blackout reset}
+
+mkdir -p "$LOGS"
+printf "%-10s %12s %12s %10s %10s %s\n" "scenario" "sent Mbit/s" "recv Mbit/s" \
+    "recovery" "reconnect" "drops"
+
+for name in $SCENARIOS; do
+    if ! args=$(scenario "$name"); then
+        echo "Unknown scenario: $name"
+        continue
+    fi
+
+    "$RELAY" $args --log-stderr --log-level 2 "127.0.0.1:$PORT" "$SERVER" \
+        2> "$LOGS/$name.relay" &
+    relay=$!
+    sleep 1
+
+    if [ "$SSTP_TUNNEL" = "1" ]; then
+        timeout -s INT "$TIME" "$SSTPC" --log-stderr --log-level 2 --cert-warn \
+            --user "$SSTP_USER" --password "$SSTP_PASS" "127.0.0.1:$PORT" \
+            noauth nodefaultroute 2> "$LOGS/$name.sstpc"
+    else
+        "$SSTPC" --log-stderr --log-level 2 --cert-warn --load 1 \
+            --load-time "$TIME" --load-traffic "$TRAFFIC" \
+            --load-reconnect "$RECONNECT" \
+            --user "$SSTP_USER" --password "$SSTP_PASS" "127.0.0.1:$PORT" \
+            2> "$LOGS/$name.sstpc"
+    fi
+
+    kill -INT $relay
+    wait $relay
+
+    # Load: sent X Mbit/s, received Y Mbit/s, N dropped
+    rates=$(grep "Load: sent" "$LOGS/$name.sstpc" | tail -1 | \
+        sed 's/.*sent \([0-9.]*\) Mbit\/s, received \([0-9.]*\) Mbit\/s, \([0-9]*\) dropped.*/\1 \2 \3/')
+    set -- ${rates:-- - -}
+
+    # Relay: recovered N times, min X ms, avg Y ms, max Z ms
+    recovery=$(grep "Relay: recovered" "$LOGS/$name.relay" | \
+        sed 's/.*avg \([0-9]*\) ms.*/\1 ms/')
+
+    # Load: recovered N times, min X ms, avg Y ms, max Z ms
+    reconnect=$(grep "Load: recovered" "$LOGS/$name.sstpc" | tail -1 | \
+        sed 's/.*avg \([0-9]*\) ms.*/\1 ms/')
+
+    printf "%-10s %12s %12s %10s %10s %s\n" "$name" "$1" "$2" \
+        "${recovery:--}" "${reconnect:--}" "$3"
+done
+
+echo "Logs in $LOGS"